@@ -1,5 +1,7 @@
 set(CONFIG_MAX_CPUS 24 CACHE STRING "Maximum number of cpus to support")
 option(CONFIG_TRACING "Enable verbose trace logging" OFF)
+option(CONFIG_TRACEPOINTS "Compile in tracepoints that can be enabled at run time" ON)
+set(CONFIG_LOG_LEVEL 3 CACHE STRING "Least important log level compiled in (0 = error, 1 = warn, 2 = info, 3 = debug)")
 
 option(BUILD_APPS "Build apps and libraries" ON)
 
@@ -9,7 +9,7 @@ Desktop::Desktop(ui::Context& ctx) : gui {ctx, ctx.width, ctx.height - TaskbarWi
 	taskbar = static_cast<TaskbarWindow*>(taskbar_unique.get());
 	gui.root_windows.push_back(std::move(taskbar_unique));
 
-	ctx.dirty_rects.push_back({
+	ctx.dirty.add({
 		.x = 0,
 		.y = ctx.height - TaskbarWindow::HEIGHT,
 		.width = ctx.width,
@@ -385,6 +385,10 @@ int main() {
 	ctx.height = info.height;
 	Desktop desktop {ctx};
 
+	auto cpu_count = sys_get_cpu_count();
+	ui::WorkerPool compositor_pool {cpu_count > 1 ? static_cast<uint32_t>(cpu_count - 1) : 0};
+	desktop.gui.pool = &compositor_pool;
+
 	CrescentHandle listener_thread_handle;
 	status = sys_thread_create(&listener_thread_handle, "listener", sizeof("listener") - 1, listener_thread, &desktop);
 	if (status != 0) {
@@ -587,7 +591,7 @@ int main() {
 		menu_window->add_child(std::move(reboot_button));
 		menu_window->add_child(std::move(sleep_button));
 
-		desktop->gui.ctx.dirty_rects.push_back({
+		desktop->gui.ctx.dirty.add({
 			.x = menu_window->rect.x,
 			.y = menu_window->rect.y,
 			.width = menu_window->rect.width + BORDER_WIDTH * 2,
@@ -629,6 +633,8 @@ int main() {
 	assert(status == 0);
 	//uint64_t last_fps = last_time_update_ns;
 
+	ui::Region last_frame_damage;
+
 	while (true) {
 		uint64_t start_time_ns;
 		sys_get_time(&start_time_ns);
@@ -690,7 +696,7 @@ int main() {
 
 					desktop.add_child(std::move(window));
 
-					desktop.gui.ctx.dirty_rects.push_back({
+					desktop.gui.ctx.dirty.add({
 						.x = req.create_window.x,
 						.y = req.create_window.y,
 						.width = req.create_window.width + BORDER_WIDTH * 2,
@@ -731,7 +737,7 @@ int main() {
 					auto window_rect = window->get_abs_rect();
 					window_rect.x += BORDER_WIDTH;
 					window_rect.y += TITLEBAR_HEIGHT;
-					ctx.dirty_rects.push_back(window_rect);
+					ctx.dirty.add(window_rect);
 
 					resp.ack.window_handle = window;
 					// todo check status
@@ -802,10 +808,21 @@ int main() {
 			last_time_update_ns = start_time_ns;
 		}
 
-		if (double_buffer) {
-			memcpy(back_mapping, front_mapping, info.height * info.pitch);
+		if (double_buffer && desktop.gui.needs_redraw()) {
+			// the back buffer is one frame behind the front one,
+			// only the parts that changed in the last frame need to be brought over
+			for (auto& rect : last_frame_damage) {
+				for (uint32_t y = rect.y; y < rect.y + rect.height; ++y) {
+					auto offset = y * info.pitch + rect.x * 4;
+					memcpy(
+						static_cast<uint8_t*>(back_mapping) + offset,
+						static_cast<uint8_t*>(front_mapping) + offset,
+						rect.width * 4);
+				}
+			}
 
 			desktop.draw();
+			last_frame_damage = desktop.gui.frame_damage;
 
 			fb_link.op = FbLinkOpFlip;
 			status = sys_devlink(&link);
@@ -819,7 +836,7 @@ int main() {
 			front_mapping = tmp;
 			ctx.fb = static_cast<uint32_t*>(back_mapping);
 		}
-		else {
+		else if (!double_buffer) {
 			desktop.draw();
 		}
 
@@ -92,6 +92,6 @@ void TaskbarWindow::update_time(ui::Context& ctx) {
 
 		date_text->text = std::string_view {ptr, static_cast<size_t>((buffer + 64) - ptr)};
 
-		ctx.dirty_rects.push_back(get_abs_rect());
+		ctx.dirty.add(get_abs_rect());
 	}
 }
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <string_view>
+#include <sys.h>
+
+namespace {
+	char BUFFER[4096];
+
+	/// Indexed by `CrescentLogLevel`.
+	constexpr const char* LEVEL_NAMES[] {"error", "warn", "info", "debug"};
+	constexpr int LEVEL_COUNT = sizeof(LEVEL_NAMES) / sizeof(*LEVEL_NAMES);
+}
+
+/// Prints the kernel log. `--level=<error|warn|info|debug>` also changes the level the kernel logs at
+/// from then on, debug needs a kernel built with it.
+int main(int argc, char** argv) {
+	constexpr std::string_view LEVEL_FLAG = "--level=";
+	for (int i = 0; i < argc; ++i) {
+		std::string_view arg {argv[i]};
+		if (!arg.starts_with(LEVEL_FLAG)) {
+			continue;
+		}
+
+		auto name = arg.substr(LEVEL_FLAG.size());
+		int level = -1;
+		for (int j = 0; j < LEVEL_COUNT; ++j) {
+			if (name == LEVEL_NAMES[j]) {
+				level = j;
+			}
+		}
+		if (level < 0) {
+			printf("[dmesg]: unknown log level %s\n", argv[i] + LEVEL_FLAG.size());
+			return 1;
+		}
+
+		auto new_level = static_cast<CrescentLogLevel>(level);
+		CrescentLogLevel old_level;
+		if (sys_syslog_set_level(new_level, &old_level) != 0) {
+			puts("[dmesg]: failed to set the kernel log level");
+			return 1;
+		}
+		printf("[dmesg]: kernel log level changed from %s to %s\n", LEVEL_NAMES[old_level], LEVEL_NAMES[level]);
+	}
+
+	uint64_t pos = 0;
+	while (true) {
+		size_t actual = 0;
+		if (sys_syslog_read(BUFFER, sizeof(BUFFER), &pos, &actual) != 0) {
+			puts("[dmesg]: failed to read the kernel log");
+			return 1;
+		}
+		if (!actual) {
+			break;
+		}
+		sys_write(STDOUT_HANDLE, BUFFER, actual, nullptr);
+	}
+	return 0;
+}
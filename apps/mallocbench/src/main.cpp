@@ -0,0 +1,303 @@
+#include <hz/slab.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys.h>
+#include <thread.h>
+
+// Runs a few allocation patterns on 1, 2 and 4 threads with the libc malloc and with the slab
+// allocator it replaced, and prints the operations per second and how much memory each had
+// mapped afterwards side by side.
+
+namespace {
+	constexpr uint32_t MAX_THREADS = 4;
+	constexpr uint32_t SLOTS = 256;
+
+	struct Backend {
+		const char* name;
+		void* (*alloc)(size_t size);
+		void (*free)(void* ptr);
+		void* (*realloc)(void* old, size_t new_size);
+		/// Bytes the allocator has mapped, all of them are resident since mappings are backed right away.
+		size_t (*mapped_size)();
+	};
+
+	/// The allocator libc used before, set up the same way it was there.
+	namespace slab {
+		size_t MAPPED_SIZE = 0;
+
+		struct ArenaAllocator {
+			static void* allocate(size_t size) {
+				size = (size + 0x1000 - 1) & ~(0x1000 - 1);
+				void* ret = nullptr;
+				if (sys_map(&ret, size, CRESCENT_PROT_READ | CRESCENT_PROT_WRITE)) {
+					return nullptr;
+				}
+				__atomic_fetch_add(&MAPPED_SIZE, size, __ATOMIC_RELAXED);
+				return ret;
+			}
+
+			static void deallocate(void* ptr, size_t size) {
+				size = (size + 0x1000 - 1) & ~(0x1000 - 1);
+				sys_unmap(ptr, size);
+				__atomic_fetch_sub(&MAPPED_SIZE, size, __ATOMIC_RELAXED);
+			}
+		};
+
+		constinit hz::slab_allocator<ArenaAllocator> ALLOCATOR {ArenaAllocator {}};
+		/// Serializes the threaded runs so they don't depend on locking inside the slab allocator.
+		bool LOCKED = false;
+
+		struct Guard {
+			Guard() {
+				while (__atomic_exchange_n(&LOCKED, true, __ATOMIC_ACQUIRE)) {
+					while (__atomic_load_n(&LOCKED, __ATOMIC_RELAXED)) {
+#ifdef __x86_64__
+						__builtin_ia32_pause();
+#elif defined(__aarch64__)
+						asm volatile("yield");
+#endif
+					}
+				}
+			}
+
+			~Guard() {
+				__atomic_store_n(&LOCKED, false, __ATOMIC_RELEASE);
+			}
+		};
+
+		void* alloc(size_t size) {
+			Guard guard {};
+			return ALLOCATOR.alloc(size);
+		}
+
+		void free(void* ptr) {
+			if (!ptr) {
+				return;
+			}
+			Guard guard {};
+			ALLOCATOR.free(ptr);
+		}
+
+		void* realloc(void* old, size_t new_size) {
+			if (!new_size) {
+				free(old);
+				return nullptr;
+			}
+
+			void* ptr = alloc(new_size);
+			if (!ptr) {
+				return nullptr;
+			}
+			if (old) {
+				size_t old_size;
+				{
+					Guard guard {};
+					old_size = ALLOCATOR.get_size_for_allocation(old);
+				}
+				memcpy(ptr, old, new_size < old_size ? new_size : old_size);
+				free(old);
+			}
+			return ptr;
+		}
+
+		size_t mapped_size() {
+			return __atomic_load_n(&MAPPED_SIZE, __ATOMIC_RELAXED);
+		}
+	}
+
+	constexpr Backend BACKENDS[] {
+		{"malloc", malloc, free, realloc, __malloc_mapped_size},
+		{"slab", slab::alloc, slab::free, slab::realloc, slab::mapped_size}
+	};
+	constexpr uint32_t BACKEND_COUNT = sizeof(BACKENDS) / sizeof(*BACKENDS);
+
+	/// Backend of the current run.
+	const Backend* BACKEND = nullptr;
+
+	struct Workload {
+		const char* name;
+		/// Returns the number of operations done by the thread at `index`.
+		uint64_t (*run)(uint32_t index);
+	};
+
+	uint32_t seed_for(uint32_t index) {
+		return 0x9E3779B9 ^ (index + 1) * 0x85EBCA6B;
+	}
+
+	uint32_t next_random(uint32_t& state) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	/// Replaces random objects in a small working set, the common case for most programs.
+	template<uint32_t MAX_SIZE, uint32_t SLOT_COUNT>
+	uint64_t churn(uint32_t index) {
+		constexpr uint64_t OPS = 1000000;
+
+		auto seed = seed_for(index);
+
+		void* slots[SLOT_COUNT] {};
+		for (uint64_t i = 0; i < OPS; ++i) {
+			auto& slot = slots[next_random(seed) % SLOT_COUNT];
+			BACKEND->free(slot);
+			size_t size = 16 + next_random(seed) % (MAX_SIZE - 16);
+			slot = BACKEND->alloc(size);
+			// touch it so the allocator can't win by handing out memory that's never used
+			static_cast<char*>(slot)[0] = 1;
+			static_cast<char*>(slot)[size - 1] = 1;
+		}
+		for (auto* slot : slots) {
+			BACKEND->free(slot);
+		}
+		return OPS;
+	}
+
+	/// Builds up a big set of objects and frees it in a different order than it was allocated in.
+	uint64_t bulk(uint32_t index) {
+		constexpr uint32_t COUNT = 20000;
+		constexpr uint32_t ROUNDS = 20;
+
+		static void* OBJECTS[MAX_THREADS][COUNT];
+		auto& objects = OBJECTS[index];
+		auto seed = seed_for(index);
+		for (uint32_t round = 0; round < ROUNDS; ++round) {
+			for (auto& obj : objects) {
+				obj = BACKEND->alloc(16 + next_random(seed) % 1024);
+			}
+			for (uint32_t i = 0; i < COUNT; ++i) {
+				// the stride is coprime with the count so every object is freed once
+				BACKEND->free(objects[(i * 7919) % COUNT]);
+			}
+		}
+		return uint64_t {COUNT} * ROUNDS * 2;
+	}
+
+	/// Grows buffers like a vector or a string builder would.
+	uint64_t grow(uint32_t) {
+		constexpr uint32_t ROUNDS = 2000;
+		constexpr size_t MAX_SIZE = 1024 * 1024;
+
+		uint64_t ops = 0;
+		for (uint32_t round = 0; round < ROUNDS; ++round) {
+			void* ptr = nullptr;
+			for (size_t size = 16; size <= MAX_SIZE; size += size / 2) {
+				ptr = BACKEND->realloc(ptr, size);
+				static_cast<char*>(ptr)[size - 1] = 1;
+				++ops;
+			}
+			BACKEND->free(ptr);
+			++ops;
+		}
+		return ops;
+	}
+
+	constexpr Workload WORKLOADS[] {
+		{"small churn", churn<256, 64>},
+		{"mixed churn", churn<64 * 1024, 256>},
+		{"bulk", bulk},
+		{"realloc grow", grow}
+	};
+
+	struct Run {
+		const Workload* workload;
+		uint64_t ops[MAX_THREADS];
+		int remaining;
+	};
+
+	Run RUN {};
+	uint32_t THREAD_INDEX[MAX_THREADS];
+
+	void worker(void* arg) {
+		auto index = *static_cast<uint32_t*>(arg);
+		RUN.ops[index] = RUN.workload->run(index);
+		if (__atomic_sub_fetch(&RUN.remaining, 1, __ATOMIC_RELEASE) == 0) {
+			sys_futex_wake(&RUN.remaining, 1);
+		}
+		thread_exit(0);
+	}
+
+	uint64_t get_time() {
+		uint64_t ns;
+		sys_get_time(&ns);
+		return ns;
+	}
+
+	struct Result {
+		uint64_t kops;
+		size_t mapped;
+	};
+
+	bool run(const Workload& workload, uint32_t thread_count, Result& res) {
+		RUN.workload = &workload;
+		RUN.remaining = static_cast<int>(thread_count);
+
+		CrescentHandle handles[MAX_THREADS];
+		auto start = get_time();
+		for (uint32_t i = 0; i < thread_count; ++i) {
+			THREAD_INDEX[i] = i;
+			if (thread_create(&handles[i], "mallocbench", sizeof("mallocbench") - 1, worker, &THREAD_INDEX[i]) != 0) {
+				puts("[mallocbench]: failed to create a thread");
+				return false;
+			}
+		}
+
+		while (true) {
+			auto remaining = __atomic_load_n(&RUN.remaining, __ATOMIC_ACQUIRE);
+			if (!remaining) {
+				break;
+			}
+			sys_futex_wait(&RUN.remaining, remaining, UINT64_MAX);
+		}
+		auto end = get_time();
+
+		for (uint32_t i = 0; i < thread_count; ++i) {
+			sys_close_handle(handles[i]);
+		}
+
+		uint64_t ops = 0;
+		for (uint32_t i = 0; i < thread_count; ++i) {
+			ops += RUN.ops[i];
+		}
+		uint64_t us = (end - start) / 1000;
+		if (!us) {
+			us = 1;
+		}
+
+		res.kops = ops * 1000 / us;
+		res.mapped = BACKEND->mapped_size();
+		return true;
+	}
+}
+
+int main() {
+	auto cpu_count = static_cast<uint32_t>(sys_get_cpu_count());
+
+	for (auto& workload : WORKLOADS) {
+		for (uint32_t threads = 1; threads <= MAX_THREADS; threads *= 2) {
+			if (threads > 1 && threads > cpu_count) {
+				break;
+			}
+
+			Result results[BACKEND_COUNT];
+			for (uint32_t i = 0; i < BACKEND_COUNT; ++i) {
+				BACKEND = &BACKENDS[i];
+				if (!run(workload, threads, results[i])) {
+					return 1;
+				}
+			}
+
+			printf("[mallocbench]: %s, %u threads:", workload.name, threads);
+			for (uint32_t i = 0; i < BACKEND_COUNT; ++i) {
+				printf(" %s %u kops/s %u KiB mapped%s",
+					BACKENDS[i].name,
+					static_cast<unsigned int>(results[i].kops),
+					static_cast<unsigned int>(results[i].mapped / 1024),
+					i + 1 < BACKEND_COUNT ? "," : "\n");
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys.h>
+
+// Measures memcpy, memset and strlen for sizes from a few bytes to well past the caches and
+// prints the throughput of each size in GB/s. The unaligned memcpy column offsets the source
+// and the destination differently so neither is aligned to anything.
+
+namespace {
+	constexpr size_t SIZES[] {
+		8, 16, 32, 64, 128, 256, 512,
+		1024, 4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024,
+		1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024
+	};
+	constexpr size_t MAX_SIZE = 16 * 1024 * 1024;
+	/// Bytes processed per measurement, small sizes are capped by `MAX_ITERATIONS` instead.
+	constexpr size_t TOTAL_BYTES = 512 * 1024 * 1024;
+	constexpr size_t MAX_ITERATIONS = 4 * 1024 * 1024;
+
+	unsigned char* SRC;
+	unsigned char* DEST;
+
+	uint64_t get_time() {
+		uint64_t ns;
+		sys_get_time(&ns);
+		return ns;
+	}
+
+	/// Keeps the compiler from dropping or merging the calls in the loops.
+	inline void clobber() {
+		asm volatile("" : : : "memory");
+	}
+
+	size_t iterations_for(size_t size) {
+		size_t iterations = TOTAL_BYTES / size;
+		return iterations > MAX_ITERATIONS ? MAX_ITERATIONS : iterations;
+	}
+
+	/// GB/s in hundredths.
+	uint64_t throughput(size_t size, size_t iterations, uint64_t ns) {
+		if (!ns) {
+			ns = 1;
+		}
+		return static_cast<uint64_t>(size) * iterations * 100 / ns;
+	}
+
+	uint64_t bench_memcpy(size_t size, size_t src_offset, size_t dest_offset) {
+		auto iterations = iterations_for(size);
+		auto start = get_time();
+		for (size_t i = 0; i < iterations; ++i) {
+			memcpy(DEST + dest_offset, SRC + src_offset, size);
+			clobber();
+		}
+		return throughput(size, iterations, get_time() - start);
+	}
+
+	uint64_t bench_memset(size_t size) {
+		auto iterations = iterations_for(size);
+		auto start = get_time();
+		for (size_t i = 0; i < iterations; ++i) {
+			memset(DEST, static_cast<int>(i), size);
+			clobber();
+		}
+		return throughput(size, iterations, get_time() - start);
+	}
+
+	uint64_t bench_strlen(size_t size) {
+		memset(DEST, 'a', size - 1);
+		DEST[size - 1] = 0;
+		auto* str = reinterpret_cast<const char*>(DEST);
+
+		auto iterations = iterations_for(size);
+		size_t total = 0;
+		auto start = get_time();
+		for (size_t i = 0; i < iterations; ++i) {
+			total += strlen(str);
+			clobber();
+		}
+		auto end = get_time();
+		if (total != (size - 1) * iterations) {
+			puts("[membench]: strlen returned the wrong length");
+		}
+		return throughput(size, iterations, end - start);
+	}
+
+	void print_column(uint64_t value) {
+		printf(" %u.%u%u", static_cast<unsigned int>(value / 100),
+			static_cast<unsigned int>(value / 10 % 10),
+			static_cast<unsigned int>(value % 10));
+	}
+}
+
+int main() {
+	// room for the unaligned offsets past the biggest size
+	SRC = static_cast<unsigned char*>(malloc(MAX_SIZE + 64));
+	DEST = static_cast<unsigned char*>(malloc(MAX_SIZE + 64));
+	if (!SRC || !DEST) {
+		puts("[membench]: failed to allocate the buffers");
+		return 1;
+	}
+	memset(SRC, 0xAA, MAX_SIZE + 64);
+	memset(DEST, 0, MAX_SIZE + 64);
+
+	printf("[membench]: size: memcpy memcpy-unaligned memset strlen (GB/s)\n");
+	for (auto size : SIZES) {
+		printf("[membench]: %u:", static_cast<unsigned int>(size));
+		print_column(bench_memcpy(size, 0, 0));
+		print_column(bench_memcpy(size, 3, 17));
+		print_column(bench_memset(size));
+		print_column(bench_strlen(size));
+		printf("\n");
+	}
+
+	free(SRC);
+	free(DEST);
+	return 0;
+}
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <sys.h>
+
+namespace {
+	// 10.0.2.2, the host as seen from qemu's user mode network
+	constexpr uint32_t SINK_IP = 10 | 0 << 8 | 2 << 16 | 2 << 24;
+	// any host-side sink works, e.g. `nc -l 5001 > /dev/null` or `iperf -s`
+	constexpr uint16_t SINK_PORT = 5001;
+	// 127.0.0.1, served by a thread of our own so the stack can be measured without any device
+	constexpr uint32_t LOOPBACK_IP = 127 | 0 << 8 | 0 << 16 | 1 << 24;
+	constexpr uint16_t LOOPBACK_PORT = 5002;
+	constexpr size_t PING_COUNT = 1000;
+	constexpr size_t CHUNK_SIZE = 1024 * 64;
+	constexpr size_t TOTAL_SIZE = 1024 * 1024 * 256;
+	// rx interrupt coalescing applied to every nic that supports it before the tests
+	constexpr uint32_t RX_COALESCE_FRAMES = 16;
+	constexpr uint32_t RX_COALESCE_USECS = 50;
+
+	uint64_t get_time() {
+		uint64_t ns;
+		sys_get_time(&ns);
+		return ns;
+	}
+
+	char CHUNK[CHUNK_SIZE];
+	char SERVER_BUFFER[CHUNK_SIZE];
+
+	bool connect_to(CrescentHandle& handle, uint32_t ip, uint16_t port) {
+		if (sys_socket_create(&handle, SOCKET_TYPE_TCP, 0) != 0) {
+			puts("[netbench]: failed to create socket");
+			return false;
+		}
+
+		Ipv4SocketAddress addr {
+			.generic {
+				.type = SOCKET_ADDRESS_TYPE_IPV4
+			},
+			.ipv4 = ip,
+			.port = port
+		};
+		if (sys_socket_connect(handle, &addr.generic) != 0) {
+			printf("[netbench]: failed to connect to port %u\n", port);
+			sys_close_handle(handle);
+			return false;
+		}
+		return true;
+	}
+
+	void print_throughput(const char* name, size_t bytes, uint64_t ns) {
+		uint64_t us = ns / 1000;
+		if (!us) {
+			us = 1;
+		}
+		printf("[netbench]: %s: sent %zu MiB in %llu ms, %llu MiB/s\n",
+			name,
+			bytes / 1024 / 1024,
+			static_cast<unsigned long long>(us / 1000),
+			static_cast<unsigned long long>(bytes * 1000000 / 1024 / 1024 / us));
+	}
+
+	void set_coalescing() {
+		for (uint32_t i = 0;; ++i) {
+			auto status = sys_nic_set_irq_coalescing(i, RX_COALESCE_FRAMES, RX_COALESCE_USECS);
+			if (status == ERR_INVALID_ARGUMENT) {
+				break;
+			}
+			else if (status == 0) {
+				printf("[netbench]: nic %u: rx irqs coalesced to %u frames or %u us\n", i, RX_COALESCE_FRAMES, RX_COALESCE_USECS);
+			}
+		}
+	}
+
+	void print_rx_stats() {
+		for (uint32_t i = 0;; ++i) {
+			NicRxStats stats {};
+			if (sys_nic_get_rx_stats(i, &stats) != 0) {
+				break;
+			}
+			printf("[netbench]: nic %u: %llu frames in %llu irqs (%llu per irq), %llu polls, %llu over budget\n",
+				i,
+				static_cast<unsigned long long>(stats.packets),
+				static_cast<unsigned long long>(stats.irqs),
+				static_cast<unsigned long long>(stats.irqs ? stats.packets / stats.irqs : 0),
+				static_cast<unsigned long long>(stats.polls),
+				static_cast<unsigned long long>(stats.budget_exhausted));
+		}
+	}
+
+	size_t send_all(CrescentHandle handle) {
+		size_t sent = 0;
+		while (sent < TOTAL_SIZE) {
+			size_t actual = 0;
+			if (sys_socket_send(handle, CHUNK, CHUNK_SIZE, &actual) != 0) {
+				puts("[netbench]: send failed");
+				break;
+			}
+			sent += actual;
+		}
+		return sent;
+	}
+
+	/// Accepts a connection to drain for the throughput test and then one to echo for the latency test.
+	void loopback_server(void*) {
+		CrescentHandle listener;
+		if (sys_socket_create(&listener, SOCKET_TYPE_TCP, 0) != 0) {
+			sys_thread_exit(1);
+		}
+
+		for (int i = 0; i < 2; ++i) {
+			CrescentHandle connection;
+			if (sys_socket_listen(listener, LOOPBACK_PORT) != 0 ||
+				sys_socket_accept(listener, &connection, 0) != 0) {
+				break;
+			}
+
+			while (true) {
+				size_t actual = 0;
+				if (sys_socket_receive(connection, SERVER_BUFFER, CHUNK_SIZE, &actual) != 0 || !actual) {
+					break;
+				}
+				if (i == 1) {
+					sys_socket_send(connection, SERVER_BUFFER, actual, &actual);
+				}
+			}
+
+			sys_close_handle(connection);
+		}
+
+		sys_close_handle(listener);
+		sys_thread_exit(0);
+	}
+
+	void run_loopback() {
+		CrescentHandle thread;
+		if (sys_thread_create(&thread, "netbench server", sizeof("netbench server") - 1, loopback_server, nullptr) != 0) {
+			puts("[netbench]: failed to create the loopback server");
+			return;
+		}
+		// a syn arriving before the server listens is only retransmitted after a second
+		sys_sleep(10 * 1000 * 1000);
+
+		CrescentHandle handle;
+		if (!connect_to(handle, LOOPBACK_IP, LOOPBACK_PORT)) {
+			sys_close_handle(thread);
+			return;
+		}
+		auto start = get_time();
+		auto sent = send_all(handle);
+		auto end = get_time();
+		sys_close_handle(handle);
+		print_throughput("loopback tcp", sent, end - start);
+
+		sys_sleep(10 * 1000 * 1000);
+		if (!connect_to(handle, LOOPBACK_IP, LOOPBACK_PORT)) {
+			sys_close_handle(thread);
+			return;
+		}
+
+		size_t completed = 0;
+		start = get_time();
+		for (; completed < PING_COUNT; ++completed) {
+			char byte = static_cast<char>(completed);
+			size_t actual = 0;
+			if (sys_socket_send(handle, &byte, 1, &actual) != 0 ||
+				sys_socket_receive(handle, &byte, 1, &actual) != 0 || !actual) {
+				puts("[netbench]: loopback ping failed");
+				break;
+			}
+		}
+		end = get_time();
+		sys_close_handle(handle);
+
+		if (completed) {
+			printf("[netbench]: loopback tcp: %zu round trips, %llu ns on average\n",
+				completed,
+				static_cast<unsigned long long>((end - start) / completed));
+		}
+
+		sys_close_handle(thread);
+	}
+}
+
+int main() {
+	for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+		CHUNK[i] = static_cast<char>(i);
+	}
+
+	set_coalescing();
+	run_loopback();
+
+	CrescentHandle handle;
+	if (!connect_to(handle, SINK_IP, SINK_PORT)) {
+		print_rx_stats();
+		return 1;
+	}
+
+	auto start = get_time();
+	auto sent = send_all(handle);
+	auto end = get_time();
+
+	sys_close_handle(handle);
+	print_throughput("sink tcp", sent, end - start);
+	print_rx_stats();
+	return 0;
+}
@@ -0,0 +1,313 @@
+#include <sys.h>
+#include <vector>
+
+// Samples every cpu for a while and writes the stacks to stdout in the folded format
+// (`frame;frame;frame count` per line) that flamegraph.pl, inferno and speedscope read.
+// Kernel frames are symbolized against the kernel elf, the names are left mangled for c++filt.
+// User frames are written as raw addresses, the binaries are position independent.
+
+namespace {
+	constexpr uint64_t INTERVAL_US = 1000;
+	constexpr uint64_t DURATION_NS = 2ULL * 1000 * 1000 * 1000;
+	// the per-cpu buffers hold 512 samples, so they are emptied well before they fill up
+	constexpr uint64_t READ_INTERVAL_NS = 20ULL * 1000 * 1000;
+	constexpr char KERNEL_PATH[] = "/crescent/crescent";
+
+	ProfileSample CHUNK[64];
+	std::vector<ProfileSample> SAMPLES;
+
+	// only the parts of the elf format needed to find the symbol table
+	struct ElfHeader {
+		uint8_t ident[16];
+		uint16_t type;
+		uint16_t machine;
+		uint32_t version;
+		uint64_t entry;
+		uint64_t phoff;
+		uint64_t shoff;
+		uint32_t flags;
+		uint16_t ehsize;
+		uint16_t phentsize;
+		uint16_t phnum;
+		uint16_t shentsize;
+		uint16_t shnum;
+		uint16_t shstrndx;
+	};
+
+	struct ElfSection {
+		uint32_t name;
+		uint32_t type;
+		uint64_t flags;
+		uint64_t addr;
+		uint64_t offset;
+		uint64_t size;
+		uint32_t link;
+		uint32_t info;
+		uint64_t addralign;
+		uint64_t entsize;
+	};
+
+	struct ElfSymbol {
+		uint32_t name;
+		uint8_t info;
+		uint8_t other;
+		uint16_t shndx;
+		uint64_t value;
+		uint64_t size;
+	};
+
+	constexpr uint32_t SHT_SYMTAB = 2;
+	constexpr uint8_t STT_FUNC = 2;
+
+	struct Symbol {
+		uint64_t start;
+		uint64_t end;
+		const char* name;
+	};
+
+	std::vector<Symbol> SYMBOLS;
+
+	void sift_down(size_t root, size_t end) {
+		while (2 * root + 1 < end) {
+			auto child = 2 * root + 1;
+			if (child + 1 < end && SYMBOLS[child].start < SYMBOLS[child + 1].start) {
+				++child;
+			}
+			if (SYMBOLS[child].start <= SYMBOLS[root].start) {
+				return;
+			}
+			auto tmp = SYMBOLS[root];
+			SYMBOLS[root] = SYMBOLS[child];
+			SYMBOLS[child] = tmp;
+			root = child;
+		}
+	}
+
+	void sort_symbols() {
+		auto count = SYMBOLS.size();
+		for (size_t i = count / 2; i > 0; --i) {
+			sift_down(i - 1, count);
+		}
+		for (size_t end = count; end > 1; --end) {
+			auto tmp = SYMBOLS[0];
+			SYMBOLS[0] = SYMBOLS[end - 1];
+			SYMBOLS[end - 1] = tmp;
+			sift_down(0, end - 1);
+		}
+	}
+
+	bool load_kernel_symbols() {
+		CrescentHandle handle;
+		if (sys_open(&handle, KERNEL_PATH, sizeof(KERNEL_PATH) - 1, 0) != 0) {
+			return false;
+		}
+
+		CrescentStat stat {};
+		const void* ptr = nullptr;
+		if (sys_stat(handle, &stat) != 0 ||
+			stat.size < sizeof(ElfHeader) ||
+			sys_map_file(handle, 0, stat.size, &ptr) != 0) {
+			sys_close_handle(handle);
+			return false;
+		}
+
+		// the file stays open and mapped, the symbol names point into it
+		auto* base = static_cast<const char*>(ptr);
+		auto* hdr = reinterpret_cast<const ElfHeader*>(base);
+		if (hdr->ident[0] != 0x7F || hdr->ident[1] != 'E' || hdr->ident[2] != 'L' || hdr->ident[3] != 'F' ||
+			hdr->shentsize != sizeof(ElfSection) ||
+			hdr->shoff > stat.size ||
+			hdr->shnum > (stat.size - hdr->shoff) / sizeof(ElfSection)) {
+			return false;
+		}
+
+		auto* sections = reinterpret_cast<const ElfSection*>(base + hdr->shoff);
+		for (uint16_t i = 0; i < hdr->shnum; ++i) {
+			auto& symtab = sections[i];
+			if (symtab.type != SHT_SYMTAB || symtab.link >= hdr->shnum) {
+				continue;
+			}
+			auto& strtab = sections[symtab.link];
+			if (symtab.offset > stat.size || symtab.size > stat.size - symtab.offset ||
+				strtab.offset > stat.size || strtab.size > stat.size - strtab.offset) {
+				return false;
+			}
+
+			auto* symbols = reinterpret_cast<const ElfSymbol*>(base + symtab.offset);
+			auto* strings = base + strtab.offset;
+			for (size_t j = 0; j < symtab.size / sizeof(ElfSymbol); ++j) {
+				auto& sym = symbols[j];
+				if ((sym.info & 0xF) != STT_FUNC || !sym.value || sym.name >= strtab.size) {
+					continue;
+				}
+				SYMBOLS.push_back({
+					.start = sym.value,
+					.end = sym.value + sym.size,
+					.name = strings + sym.name
+				});
+			}
+		}
+
+		sort_symbols();
+		return !SYMBOLS.empty();
+	}
+
+	const Symbol* find_symbol(uint64_t addr) {
+		size_t low = 0;
+		size_t high = SYMBOLS.size();
+		while (low < high) {
+			auto mid = low + (high - low) / 2;
+			if (SYMBOLS[mid].start <= addr) {
+				low = mid + 1;
+			}
+			else {
+				high = mid;
+			}
+		}
+		if (!low || addr >= SYMBOLS[low - 1].end) {
+			return nullptr;
+		}
+		return &SYMBOLS[low - 1];
+	}
+
+	struct Output {
+		void write(const char* str, size_t len) {
+			if (size + len > sizeof(buf)) {
+				flush();
+			}
+			if (len > sizeof(buf)) {
+				sys_write(STDOUT_HANDLE, str, len, nullptr);
+				return;
+			}
+			for (size_t i = 0; i < len; ++i) {
+				buf[size + i] = str[i];
+			}
+			size += len;
+		}
+
+		void operator+=(const char* str) {
+			size_t len = 0;
+			for (; str[len]; ++len);
+			write(str, len);
+		}
+
+		void hex(uint64_t value) {
+			char tmp[18];
+			char* ptr = tmp + sizeof(tmp);
+			do {
+				*--ptr = "0123456789abcdef"[value % 16];
+				value /= 16;
+			} while (value);
+			*--ptr = 'x';
+			*--ptr = '0';
+			write(ptr, tmp + sizeof(tmp) - ptr);
+		}
+
+		void flush() {
+			if (size) {
+				sys_write(STDOUT_HANDLE, buf, size, nullptr);
+				size = 0;
+			}
+		}
+
+		char buf[16 * 1024];
+		size_t size {};
+	};
+
+	Output OUT {};
+
+	void write_frame(const ProfileSample& sample, uint16_t index) {
+		// return addresses point past the call, which may already be the next function
+		auto addr = index ? sample.frames[index] - 1 : sample.frames[index];
+		const Symbol* sym = nullptr;
+		if (!(sample.flags & PROFILE_SAMPLE_USER)) {
+			sym = find_symbol(addr);
+		}
+
+		OUT += ";";
+		if (sym) {
+			OUT += sym->name;
+		}
+		else {
+			OUT.hex(sample.frames[index]);
+		}
+	}
+
+	void write_sample(const ProfileSample& sample) {
+		// spaces and semicolons separate the count and the frames
+		char name[sizeof(sample.process_name)];
+		size_t name_len = 0;
+		for (; name_len < sizeof(name) - 1 && sample.process_name[name_len]; ++name_len) {
+			char c = sample.process_name[name_len];
+			name[name_len] = c == ' ' || c == ';' ? '_' : c;
+		}
+		OUT.write(name, name_len);
+
+		// outermost frame first
+		for (uint16_t i = sample.depth; i > 0; --i) {
+			write_frame(sample, i - 1);
+		}
+		OUT += " 1\n";
+	}
+
+	bool drain(uint64_t& lost) {
+		while (true) {
+			size_t actual = 0;
+			uint64_t chunk_lost = 0;
+			if (sys_profile_read(CHUNK, sizeof(CHUNK) / sizeof(*CHUNK), &actual, &chunk_lost) != 0) {
+				return false;
+			}
+			lost += chunk_lost;
+			if (!actual) {
+				return true;
+			}
+			for (size_t i = 0; i < actual; ++i) {
+				SAMPLES.push_back(CHUNK[i]);
+			}
+		}
+	}
+
+	uint64_t get_time() {
+		uint64_t ns;
+		sys_get_time(&ns);
+		return ns;
+	}
+
+	void log(const char* str) {
+		size_t len = 0;
+		for (; str[len]; ++len);
+		sys_syslog(str, len);
+	}
+}
+
+int main() {
+	if (sys_profile_control(INTERVAL_US) != 0) {
+		log("[profile]: failed to start the profiler\n");
+		return 1;
+	}
+
+	// samples are only written out afterwards so symbolizing them doesn't show up in the profile
+	uint64_t lost = 0;
+	bool success = true;
+	auto end = get_time() + DURATION_NS;
+	while (success && get_time() < end) {
+		sys_sleep(READ_INTERVAL_NS);
+		success = drain(lost);
+	}
+
+	sys_profile_control(0);
+	success = success && drain(lost);
+
+	if (!load_kernel_symbols()) {
+		log("[profile]: no kernel symbols, kernel frames are left as addresses\n");
+	}
+	if (lost) {
+		log("[profile]: some samples were lost, the buffers filled up\n");
+	}
+
+	for (auto& sample : SAMPLES) {
+		write_sample(sample);
+	}
+	OUT.flush();
+	return success ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+#include <sys.h>
+#include <vector>
+
+// Prints the processes using the most cpu time every couple of seconds, with the threads of
+// multithreaded processes listed under them. Everything is the difference between two snapshots
+// of the scheduler statistics, so short lived threads only show up in the totals of their process.
+// A line about memory comes first, with the share of zeroed page allocations served by the pre-zeroed pool.
+
+namespace {
+	constexpr uint64_t INTERVAL_NS = 2ULL * 1000 * 1000 * 1000;
+	constexpr size_t MAX_PROCESSES = 20;
+
+	struct Row {
+		SchedStats delta;
+		const SchedStatsEntry* entry;
+	};
+
+	bool snapshot(std::vector<SchedStatsEntry>& entries) {
+		while (true) {
+			size_t actual = 0;
+			auto status = sys_get_sched_stats(entries.data(), entries.size(), &actual);
+			if (status == 0) {
+				entries.resize(actual);
+				return true;
+			}
+			else if (status != ERR_BUFFER_TOO_SMALL) {
+				return false;
+			}
+			// some room for whatever gets created before the next try
+			entries.resize(actual + 16);
+		}
+	}
+
+	const SchedStatsEntry* find(const std::vector<SchedStatsEntry>& entries, int pid, uint32_t tid) {
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (entries[i].pid == pid && entries[i].tid == tid) {
+				return &entries[i];
+			}
+		}
+		return nullptr;
+	}
+
+	SchedStats diff(const SchedStatsEntry& entry, const SchedStatsEntry* prev) {
+		auto delta = entry.stats;
+		if (!prev) {
+			return delta;
+		}
+		delta.user_ns -= prev->stats.user_ns;
+		delta.kernel_ns -= prev->stats.kernel_ns;
+		delta.voluntary_switches -= prev->stats.voluntary_switches;
+		delta.involuntary_switches -= prev->stats.involuntary_switches;
+		delta.migrations -= prev->stats.migrations;
+		for (int i = 0; i < SCHED_WAIT_BUCKETS; ++i) {
+			delta.wait_histogram[i] -= prev->stats.wait_histogram[i];
+		}
+		return delta;
+	}
+
+	/// Upper bound of the bucket holding the 99th percentile wait in us, zero if nothing waited.
+	uint64_t wait_p99_us(const SchedStats& stats) {
+		uint64_t total = 0;
+		for (auto count : stats.wait_histogram) {
+			total += count;
+		}
+		if (!total) {
+			return 0;
+		}
+
+		uint64_t seen = 0;
+		for (int i = 0; i < SCHED_WAIT_BUCKETS; ++i) {
+			seen += stats.wait_histogram[i];
+			if (seen * 100 >= total * 99) {
+				return uint64_t {1} << i;
+			}
+		}
+		return uint64_t {1} << (SCHED_WAIT_BUCKETS - 1);
+	}
+
+	struct Output {
+		void write(const char* str, size_t len) {
+			if (size + len > sizeof(buf)) {
+				flush();
+			}
+			for (size_t i = 0; i < len; ++i) {
+				buf[size + i] = str[i];
+			}
+			size += len;
+		}
+
+		void operator+=(const char* str) {
+			size_t len = 0;
+			for (; str[len]; ++len);
+			write(str, len);
+		}
+
+		/// Left aligned in `width` columns, longer strings are cut.
+		void text(const char* str, size_t width) {
+			size_t len = 0;
+			for (; len < width && str[len]; ++len);
+			write(str, len);
+			for (; len < width; ++len) {
+				write(" ", 1);
+			}
+		}
+
+		/// Right aligned in `width` columns, with `decimals` digits of `value / 10^decimals` after the point.
+		void num(uint64_t value, size_t width, int decimals = 0) {
+			char tmp[24];
+			char* ptr = tmp + sizeof(tmp);
+			int digits = 0;
+			do {
+				if (decimals && digits == decimals) {
+					*--ptr = '.';
+				}
+				*--ptr = static_cast<char>('0' + value % 10);
+				value /= 10;
+				++digits;
+			} while (value || digits <= decimals);
+
+			size_t len = tmp + sizeof(tmp) - ptr;
+			for (; len < width; ++len) {
+				write(" ", 1);
+			}
+			write(ptr, tmp + sizeof(tmp) - ptr);
+		}
+
+		void flush() {
+			if (size) {
+				sys_write(STDOUT_HANDLE, buf, size, nullptr);
+				size = 0;
+			}
+		}
+
+		char buf[16 * 1024];
+		size_t size {};
+	};
+
+	Output OUT {};
+
+	/// Time as a tenth of a percent of the interval, so 1000 is one cpu fully busy.
+	uint64_t permille(uint64_t ns, uint64_t interval) {
+		return interval ? ns * 1000 / interval : 0;
+	}
+
+	void write_row(const Row& row, uint64_t interval, bool thread) {
+		auto& stats = row.delta;
+		auto& entry = *row.entry;
+		OUT.num(static_cast<uint64_t>(entry.pid), 6);
+		OUT += " ";
+		if (thread) {
+			OUT.num(entry.tid, 6);
+			OUT += " ";
+		}
+		else {
+			OUT += "     - ";
+		}
+		OUT.num(permille(stats.user_ns + stats.kernel_ns, interval), 6, 1);
+		OUT.num(permille(stats.user_ns, interval), 6, 1);
+		OUT.num(permille(stats.kernel_ns, interval), 6, 1);
+		OUT.num(stats.voluntary_switches, 8);
+		OUT.num(stats.involuntary_switches, 8);
+		OUT.num(stats.migrations, 6);
+		OUT.num(wait_p99_us(stats), 9);
+		if (thread) {
+			OUT.num(entry.level, 4);
+			OUT.num(entry.cpu, 4);
+		}
+		else {
+			OUT += "   -   -";
+		}
+		OUT += thread ? "   " : " ";
+		OUT.text(entry.name, sizeof(entry.name));
+		OUT += "\n";
+	}
+
+	void write_mem(const MemStats& prev, const MemStats& now) {
+		auto hits = now.zero_pool_hits - prev.zero_pool_hits;
+		auto total = hits + now.zero_pool_misses - prev.zero_pool_misses;
+
+		OUT += "\nMEM: ";
+		OUT.num(now.used / 1024 / 1024, 0);
+		OUT += " of ";
+		OUT.num((now.total - now.reserved) / 1024 / 1024, 0);
+		OUT += " MiB used, zero pool ";
+		OUT.num(now.zero_pool_pages, 0);
+		OUT += " pages, ";
+		OUT.num(total ? hits * 1000 / total : 0, 0, 1);
+		OUT += "% of ";
+		OUT.num(total, 0);
+		OUT += " zeroed pages from the pool\n";
+	}
+
+	void print(const std::vector<SchedStatsEntry>& prev, const std::vector<SchedStatsEntry>& now, uint64_t interval) {
+		std::vector<Row> processes;
+		for (size_t i = 0; i < now.size(); ++i) {
+			if (!now[i].tid) {
+				processes.push_back({diff(now[i], find(prev, now[i].pid, 0)), &now[i]});
+			}
+		}
+
+		// busiest first, the list is short enough for a selection sort
+		for (size_t i = 0; i < processes.size(); ++i) {
+			auto busiest = i;
+			for (size_t j = i + 1; j < processes.size(); ++j) {
+				auto& a = processes[j].delta;
+				auto& b = processes[busiest].delta;
+				if (a.user_ns + a.kernel_ns > b.user_ns + b.kernel_ns) {
+					busiest = j;
+				}
+			}
+			auto tmp = processes[i];
+			processes[i] = processes[busiest];
+			processes[busiest] = tmp;
+		}
+
+		OUT += "   PID    TID  CPU%  USR%  SYS%     VCSW    IVCSW  MIGR  WAIT99us LVL CPU NAME\n";
+		for (size_t i = 0; i < processes.size() && i < MAX_PROCESSES; ++i) {
+			auto& process = processes[i];
+			write_row(process, interval, false);
+
+			// the entries of a process are directly followed by its threads
+			auto* end = now.data() + now.size();
+			auto* first = process.entry + 1;
+			auto* last = first;
+			for (; last != end && last->pid == process.entry->pid && last->tid; ++last);
+			if (last - first < 2) {
+				continue;
+			}
+
+			for (auto* thread = first; thread != last; ++thread) {
+				write_row({diff(*thread, find(prev, thread->pid, thread->tid)), thread}, interval, true);
+			}
+		}
+		OUT.flush();
+	}
+
+	uint64_t get_time() {
+		uint64_t ns;
+		sys_get_time(&ns);
+		return ns;
+	}
+}
+
+int main() {
+	std::vector<SchedStatsEntry> prev;
+	std::vector<SchedStatsEntry> now;
+	MemStats prev_mem {};
+	MemStats now_mem {};
+	if (!snapshot(prev) || sys_get_mem_stats(&prev_mem) != 0) {
+		OUT += "[top]: failed to get the scheduler or memory statistics\n";
+		OUT.flush();
+		return 1;
+	}
+	auto prev_time = get_time();
+
+	while (true) {
+		sys_sleep(INTERVAL_NS);
+
+		if (!snapshot(now) || sys_get_mem_stats(&now_mem) != 0) {
+			return 1;
+		}
+		auto now_time = get_time();
+
+		write_mem(prev_mem, now_mem);
+		print(prev, now, now_time - prev_time);
+
+		prev = now;
+		prev_mem = now_mem;
+		prev_time = now_time;
+	}
+}
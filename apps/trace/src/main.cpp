@@ -0,0 +1,204 @@
+#include <sys.h>
+
+// Records every tracepoint for a while and writes the events to stdout in the chrome trace event
+// format, which chrome://tracing and ui.perfetto.dev open directly.
+
+namespace {
+	constexpr uint64_t DURATION_NS = 1000ULL * 1000 * 1000;
+	// the per-cpu buffers are emptied this often so they don't overflow while recording
+	constexpr uint64_t READ_INTERVAL_NS = 10ULL * 1000 * 1000;
+
+	TraceRecord RECORDS[1024];
+
+	struct Output {
+		void write(const char* str, size_t len) {
+			if (size + len > sizeof(buf)) {
+				flush();
+			}
+			if (len > sizeof(buf)) {
+				sys_write(STDOUT_HANDLE, str, len, nullptr);
+				return;
+			}
+			for (size_t i = 0; i < len; ++i) {
+				buf[size + i] = str[i];
+			}
+			size += len;
+		}
+
+		void operator+=(const char* str) {
+			size_t len = 0;
+			for (; str[len]; ++len);
+			write(str, len);
+		}
+
+		void number(uint64_t value) {
+			char tmp[20];
+			char* ptr = tmp + sizeof(tmp);
+			do {
+				*--ptr = static_cast<char>('0' + value % 10);
+				value /= 10;
+			} while (value);
+			write(ptr, tmp + sizeof(tmp) - ptr);
+		}
+
+		void flush() {
+			if (size) {
+				sys_write(STDOUT_HANDLE, buf, size, nullptr);
+				size = 0;
+			}
+		}
+
+		char buf[16 * 1024];
+		size_t size {};
+	};
+
+	Output OUT {};
+	bool FIRST_EVENT = true;
+
+	struct EventInfo {
+		const char* name;
+		// chrome trace phase, B and E pair up into slices, i is an instant event
+		const char* phase;
+		const char* arg0;
+		const char* arg1;
+	};
+
+	const EventInfo* get_event_info(uint32_t event) {
+		static constexpr EventInfo SCHED_SWITCH {"sched switch", "i", "prev", "next"};
+		static constexpr EventInfo SYSCALL_ENTER {"syscall", "B", "num", nullptr};
+		static constexpr EventInfo SYSCALL_EXIT {"syscall", "E", "num", "ret"};
+		static constexpr EventInfo PAGE_FAULT_ENTER {"page fault", "B", "addr", nullptr};
+		static constexpr EventInfo PAGE_FAULT_EXIT {"page fault", "E", "addr", "handled"};
+		static constexpr EventInfo IRQ_ENTER {"irq", "B", "num", nullptr};
+		static constexpr EventInfo IRQ_EXIT {"irq", "E", "num", nullptr};
+		static constexpr EventInfo TCP_RX {"tcp rx", "i", "ports", "len"};
+		static constexpr EventInfo TCP_TX {"tcp tx", "i", "ports", "len"};
+		static constexpr EventInfo UDP_RX {"udp rx", "i", "ports", "len"};
+		static constexpr EventInfo UDP_TX {"udp tx", "i", "ports", "len"};
+		static constexpr EventInfo LOST {"lost events", "i", "count", nullptr};
+
+		switch (event) {
+			case TRACE_EVENT_SCHED_SWITCH:
+				return &SCHED_SWITCH;
+			case TRACE_EVENT_SYSCALL_ENTER:
+				return &SYSCALL_ENTER;
+			case TRACE_EVENT_SYSCALL_EXIT:
+				return &SYSCALL_EXIT;
+			case TRACE_EVENT_PAGE_FAULT_ENTER:
+				return &PAGE_FAULT_ENTER;
+			case TRACE_EVENT_PAGE_FAULT_EXIT:
+				return &PAGE_FAULT_EXIT;
+			case TRACE_EVENT_IRQ_ENTER:
+				return &IRQ_ENTER;
+			case TRACE_EVENT_IRQ_EXIT:
+				return &IRQ_EXIT;
+			case TRACE_EVENT_TCP_RX:
+				return &TCP_RX;
+			case TRACE_EVENT_TCP_TX:
+				return &TCP_TX;
+			case TRACE_EVENT_UDP_RX:
+				return &UDP_RX;
+			case TRACE_EVENT_UDP_TX:
+				return &UDP_TX;
+			case TRACE_EVENT_LOST:
+				return &LOST;
+			default:
+				return nullptr;
+		}
+	}
+
+	void write_arg(const char* name, uint64_t value, bool first) {
+		OUT += first ? "\"" : ",\"";
+		OUT += name;
+		OUT += "\":";
+		OUT.number(value);
+	}
+
+	void write_record(const TraceRecord& record) {
+		auto* info_ptr = get_event_info(record.event);
+		if (!info_ptr) {
+			return;
+		}
+		auto& info = *info_ptr;
+
+		OUT += FIRST_EVENT ? "\n{\"name\":\"" : ",\n{\"name\":\"";
+		FIRST_EVENT = false;
+		OUT += info.name;
+		OUT += "\",\"ph\":\"";
+		OUT += info.phase;
+		// timestamps are in microseconds
+		OUT += "\",\"ts\":";
+		OUT.number(record.timestamp / 1000);
+		OUT += ".";
+		char frac[3] {
+			static_cast<char>('0' + record.timestamp / 100 % 10),
+			static_cast<char>('0' + record.timestamp / 10 % 10),
+			static_cast<char>('0' + record.timestamp % 10)
+		};
+		OUT.write(frac, 3);
+		OUT += ",\"pid\":";
+		OUT.number(record.thread >> 32);
+		OUT += ",\"tid\":";
+		OUT.number(record.thread & 0xFFFFFFFF);
+		if (info.phase[0] == 'i') {
+			// lost events aren't tied to the thread that happened to read them
+			OUT += record.event == TRACE_EVENT_LOST ? ",\"s\":\"g\"" : ",\"s\":\"t\"";
+		}
+		OUT += ",\"args\":{";
+		write_arg("cpu", record.cpu, true);
+		if (info.arg0) {
+			write_arg(info.arg0, record.arg0, false);
+		}
+		if (info.arg1) {
+			write_arg(info.arg1, record.arg1, false);
+		}
+		OUT += "}}";
+	}
+
+	bool drain() {
+		constexpr size_t count = sizeof(RECORDS) / sizeof(*RECORDS);
+		while (true) {
+			size_t actual = 0;
+			if (sys_trace_read(RECORDS, count, &actual) != 0) {
+				return false;
+			}
+			for (size_t i = 0; i < actual; ++i) {
+				write_record(RECORDS[i]);
+			}
+			// every read records its own syscall events, so the buffers are never fully empty
+			// while tracing, a short read means everything older than it was drained
+			if (actual < count) {
+				return true;
+			}
+		}
+	}
+
+	uint64_t get_time() {
+		uint64_t ns;
+		sys_get_time(&ns);
+		return ns;
+	}
+}
+
+int main() {
+	if (sys_trace_control(TRACE_EVENT_MASK_ALL) != 0) {
+		sys_syslog("[trace]: failed to enable tracing\n", sizeof("[trace]: failed to enable tracing\n") - 1);
+		return 1;
+	}
+
+	OUT += "{\"traceEvents\":[";
+
+	bool success = true;
+	auto end = get_time() + DURATION_NS;
+	while (success && get_time() < end) {
+		sys_sleep(READ_INTERVAL_NS);
+		success = drain();
+	}
+
+	sys_trace_control(0);
+	success = success && drain();
+
+	OUT += "\n]}\n";
+	OUT.flush();
+	return success ? 0 : 1;
+}
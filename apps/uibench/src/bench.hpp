@@ -0,0 +1,36 @@
+#pragma once
+#include "sys.h"
+#include <cstdint>
+#include <vector>
+#include <ui/context.hpp>
+
+static constexpr uint64_t NS_IN_S = 1000 * 1000 * 1000;
+
+inline uint64_t get_time_ns() {
+	uint64_t ns;
+	sys_get_time(&ns);
+	return ns;
+}
+
+/// An offscreen framebuffer with a clip region covering all of it.
+struct OffscreenTarget {
+	OffscreenTarget(uint32_t width, uint32_t height) : pixels(width * height) {
+		ctx.fb = pixels.data();
+		ctx.pitch_32 = width;
+		ctx.width = width;
+		ctx.height = height;
+		ctx.clip = ui::Region {{
+			.x = 0,
+			.y = 0,
+			.width = width,
+			.height = height
+		}};
+	}
+
+	std::vector<uint32_t> pixels;
+	ui::Context ctx {};
+};
+
+void bench_text();
+void bench_region();
+void bench_compositor();
@@ -0,0 +1,95 @@
+#include "bench.hpp"
+#include <stdio.h>
+#include <ui/gui.hpp>
+#include <ui/text.hpp>
+
+namespace {
+	constexpr uint32_t SCREEN_WIDTH = 1920;
+	constexpr uint32_t SCREEN_HEIGHT = 1080;
+	constexpr uint32_t FRAMES = 20;
+
+	struct Random {
+		uint32_t state;
+
+		uint32_t next(uint32_t max) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state % max;
+		}
+	};
+
+	/// Fills the root window with `count` overlapping windows, each with a line of text.
+	void add_windows(ui::Gui& gui, uint32_t count) {
+		Random random {0x87654321};
+		auto& root = gui.root_windows[0];
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t width = 100 + random.next(600);
+			uint32_t height = 80 + random.next(400);
+
+			auto window = std::make_unique<ui::Window>(true);
+			window->set_pos(random.next(SCREEN_WIDTH - width), random.next(SCREEN_HEIGHT - height));
+			window->set_size(width, height);
+			window->bg_color = random.next(0xFFFFFF);
+
+			auto text = std::make_unique<ui::TextWindow>();
+			text->set_pos(0, 0);
+			text->set_size(width, 16);
+			text->bg_color = 0x202020;
+			text->text = "The quick brown fox jumps over the lazy dog";
+			window->add_child(std::move(text));
+
+			root->add_child(std::move(window));
+		}
+	}
+
+	void run(uint32_t window_count, ui::WorkerPool* pool) {
+		OffscreenTarget target {SCREEN_WIDTH, SCREEN_HEIGHT};
+		ui::Gui gui {target.ctx, SCREEN_WIDTH, SCREEN_HEIGHT};
+		gui.draw_cursor = false;
+		gui.pool = pool;
+		add_windows(gui, window_count);
+
+		ui::Rect screen_rect {
+			.x = 0,
+			.y = 0,
+			.width = SCREEN_WIDTH,
+			.height = SCREEN_HEIGHT
+		};
+
+		// the first frame bakes the glyphs
+		gui.draw();
+
+		uint64_t min_ns = UINT64_MAX;
+		uint64_t total_ns = 0;
+		for (uint32_t i = 0; i < FRAMES; ++i) {
+			target.ctx.dirty.add(screen_rect);
+
+			auto start = get_time_ns();
+			gui.draw();
+			auto elapsed = get_time_ns() - start;
+
+			min_ns = std::min(min_ns, elapsed);
+			total_ns += elapsed;
+		}
+
+		printf(
+			"[uibench]: %u windows, %u threads: %u us avg, %u us min per full frame\n",
+			window_count,
+			pool ? pool->get_thread_count() : 1,
+			static_cast<unsigned int>(total_ns / FRAMES / 1000),
+			static_cast<unsigned int>(min_ns / 1000));
+	}
+}
+
+void bench_compositor() {
+	auto cpu_count = sys_get_cpu_count();
+	ui::WorkerPool pool {cpu_count > 1 ? static_cast<uint32_t>(cpu_count - 1) : 0};
+
+	for (uint32_t count : {10U, 100U, 1000U}) {
+		run(count, nullptr);
+		if (pool.get_thread_count() > 1) {
+			run(count, &pool);
+		}
+	}
+}
@@ -0,0 +1,12 @@
+#include "bench.hpp"
+#include <stdio.h>
+
+int main() {
+	puts("[uibench]: text");
+	bench_text();
+	puts("[uibench]: region");
+	bench_region();
+	puts("[uibench]: compositor");
+	bench_compositor();
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include "bench.hpp"
+#include <stdio.h>
+#include <ui/region.hpp>
+
+namespace {
+	constexpr uint32_t SCREEN_WIDTH = 1920;
+	constexpr uint32_t SCREEN_HEIGHT = 1080;
+	constexpr uint32_t FRAMES = 50;
+
+	struct Random {
+		uint32_t state;
+
+		uint32_t next(uint32_t max) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state % max;
+		}
+	};
+
+	std::vector<ui::Rect> make_windows(uint32_t count) {
+		Random random {0x12345678};
+		std::vector<ui::Rect> windows;
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t width = 100 + random.next(600);
+			uint32_t height = 80 + random.next(400);
+			windows.push_back({
+				.x = random.next(SCREEN_WIDTH - width),
+				.y = random.next(SCREEN_HEIGHT - height),
+				.width = width,
+				.height = height
+			});
+		}
+		return windows;
+	}
+
+	/// The per-window rect list subtraction the compositor used before regions,
+	/// every window subtracts each window above it from a copy of the damage.
+	size_t clip_legacy(const std::vector<ui::Rect>& windows, const ui::Rect& damage) {
+		size_t total = 0;
+		for (size_t index = 0; index < windows.size(); ++index) {
+			std::vector<ui::Rect> clip_rects {damage};
+			for (size_t above = index + 1; above < windows.size(); ++above) {
+				auto& sibling_rect = windows[above];
+				for (size_t i = 0; i < clip_rects.size();) {
+					auto& old_rect = clip_rects[i];
+					if (old_rect.intersects(sibling_rect)) {
+						auto [splits, count] = old_rect.subtract(sibling_rect);
+						clip_rects.erase(
+							clip_rects.begin() +
+							static_cast<ptrdiff_t>(i));
+						for (int j = 0; j < count; ++j) {
+							clip_rects.push_back(splits[j]);
+						}
+						continue;
+					}
+
+					++i;
+				}
+			}
+			total += clip_rects.size();
+		}
+		return total;
+	}
+
+	/// Single top-down pass, each window gets what is left of the damage
+	/// after removing the windows above it.
+	size_t clip_region(const std::vector<ui::Rect>& windows, const ui::Rect& damage) {
+		size_t total = 0;
+		ui::Region remaining {damage};
+		for (size_t i = windows.size(); i > 0; --i) {
+			auto clip = remaining;
+			clip.intersect(windows[i - 1]);
+			total += clip.get_rects().size();
+			remaining.subtract(windows[i - 1]);
+		}
+		return total;
+	}
+
+	template<typename F>
+	void run(const char* name, uint32_t count, F fn) {
+		auto windows = make_windows(count);
+		ui::Rect damage {
+			.x = 0,
+			.y = 0,
+			.width = SCREEN_WIDTH,
+			.height = SCREEN_HEIGHT
+		};
+
+		size_t rects = 0;
+		auto start = get_time_ns();
+		for (uint32_t i = 0; i < FRAMES; ++i) {
+			rects = fn(windows, damage);
+		}
+		auto elapsed = get_time_ns() - start;
+
+		printf(
+			"[uibench]: %s: %u windows, %u us per frame, %u clip rects\n",
+			name,
+			count,
+			static_cast<unsigned int>(elapsed / FRAMES / 1000),
+			static_cast<unsigned int>(rects));
+	}
+}
+
+void bench_region() {
+	for (uint32_t count : {10U, 100U, 1000U}) {
+		run("rect list", count, clip_legacy);
+		run("region", count, clip_region);
+	}
+}
@@ -0,0 +1,109 @@
+#include "bench.hpp"
+#include <cassert>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <libtext/libtext.hpp>
+
+namespace {
+	constexpr uint32_t COLUMNS = 80;
+	constexpr uint32_t ROWS = 25;
+	constexpr uint32_t FRAMES = 200;
+
+	std::string make_line(uint32_t row) {
+		std::string line;
+		line.resize(COLUMNS);
+		for (uint32_t i = 0; i < COLUMNS; ++i) {
+			line[i] = static_cast<char>(0x20 + (row * 7 + i) % (0x7F - 0x20));
+		}
+		return line;
+	}
+
+	void report(const char* name, uint64_t elapsed_ns) {
+		uint64_t glyphs = uint64_t {COLUMNS} * ROWS * FRAMES;
+		uint64_t glyphs_per_s = elapsed_ns ? glyphs * NS_IN_S / elapsed_ns : 0;
+		printf(
+			"[uibench]: %s: %u redraws of %ux%u in %u us, %u glyphs/s\n",
+			name,
+			FRAMES,
+			COLUMNS,
+			ROWS,
+			static_cast<unsigned int>(elapsed_ns / 1000),
+			static_cast<unsigned int>(glyphs_per_s));
+	}
+}
+
+void bench_text() {
+	auto& atlas = libtext::GlyphAtlas::get();
+	auto glyph_width = atlas.glyph_width;
+	auto glyph_height = atlas.glyph_height;
+
+	OffscreenTarget target {COLUMNS * glyph_width, ROWS * glyph_height};
+
+	std::vector<std::string> lines;
+	for (uint32_t row = 0; row < ROWS; ++row) {
+		lines.push_back(make_line(row));
+	}
+
+	// per-glyph bitmaps baked with a fixed colour, one blit per glyph
+	auto text_ctx = libtext::Context::create().value();
+	std::unordered_map<uint32_t, libtext::Bitmap> glyph_cache;
+
+	ui::Rect screen_rect {
+		.x = 0,
+		.y = 0,
+		.width = target.ctx.width,
+		.height = target.ctx.height
+	};
+
+	// warm up both caches so only the drawing is measured
+	for (auto c : lines[0]) {
+		glyph_cache.insert({
+			static_cast<uint32_t>(c),
+			text_ctx.rasterize_glyph(c, glyph_width, glyph_height, 0xFFFFFF, 0).value()
+		});
+	}
+	target.ctx.draw_text(lines[0], 0, 0, 0xFFFFFF);
+
+	auto start = get_time_ns();
+	for (uint32_t frame = 0; frame < FRAMES; ++frame) {
+		for (uint32_t row = 0; row < ROWS; ++row) {
+			uint32_t x = 0;
+			for (auto c : lines[row]) {
+				auto bitmap = glyph_cache.find(c);
+				if (bitmap == glyph_cache.end()) {
+					auto new_bitmap = text_ctx.rasterize_glyph(c, glyph_width, glyph_height, 0xFFFFFF, 0).value();
+					bitmap = glyph_cache.insert({static_cast<uint32_t>(c), std::move(new_bitmap)}).first;
+				}
+
+				target.ctx.draw_bitmap(
+					bitmap->second.pixels.data(),
+					x,
+					row * glyph_height,
+					bitmap->second.width,
+					bitmap->second.height);
+				x += glyph_width;
+			}
+		}
+	}
+	report("bitmap per glyph", get_time_ns() - start);
+
+	// shared coverage atlas, one opaque run per line like a terminal redraw
+	start = get_time_ns();
+	for (uint32_t frame = 0; frame < FRAMES; ++frame) {
+		for (uint32_t row = 0; row < ROWS; ++row) {
+			target.ctx.draw_text(lines[row], 0, row * glyph_height, 0xFFFFFF, 0);
+		}
+	}
+	report("atlas opaque runs", get_time_ns() - start);
+
+	// shared coverage atlas, runs blended on top of a cleared background
+	start = get_time_ns();
+	for (uint32_t frame = 0; frame < FRAMES; ++frame) {
+		target.ctx.draw_filled_rect(screen_rect, 0);
+		for (uint32_t row = 0; row < ROWS; ++row) {
+			target.ctx.draw_text(lines[row], 0, row * glyph_height, 0xFFFFFF);
+		}
+	}
+	report("atlas blended runs", get_time_ns() - start);
+}
@@ -14,7 +14,8 @@ typedef enum CrescentDeviceType {
 typedef enum DevLinkRequestType {
 	DevLinkRequestGetDevices,
 	DevLinkRequestOpenDevice,
-	DevLinkRequestSpecific
+	DevLinkRequestSpecific,
+	DevLinkRequestBatch
 } DevLinkRequestType;
 
 typedef struct DevLinkRequest {
@@ -38,6 +39,11 @@ typedef struct DevLinkRequest {
 			const char* device;
 			size_t device_len;
 		} open_device;
+		// Submits up to DEVLINK_MAX_BATCH device specific requests in order, stopping at the first one that fails.
+		struct {
+			const struct DevLink* links;
+			size_t count;
+		} batch;
 	} data
 #ifdef __cplusplus
 	{.dummy {}};
@@ -60,6 +66,10 @@ typedef struct DevLinkResponse {
 		} open_device;
 
 		void* specific;
+
+		struct {
+			size_t completed;
+		} batch;
 	};
 } DevLinkResponse;
 
@@ -73,6 +83,7 @@ typedef struct DevLink {
 } DevLink;
 
 #define DEVLINK_BUFFER_SIZE 1024
+#define DEVLINK_MAX_BATCH 64
 
 typedef enum FbLinkOp {
 	FbLinkOpGetInfo,
@@ -121,7 +132,10 @@ typedef enum SoundLinkOp {
 	SoundLinkOpSetOutputParams,
 	SoundLinkOpQueueOutput,
 	SoundLinkOpPlay,
-	SoundLinkOpWaitUntilConsumed
+	SoundLinkOpWaitUntilConsumed,
+	SoundLinkOpSetPeriodSize,
+	SoundLinkOpMapRing,
+	SoundLinkOpGetPosition
 } SoundLinkOp;
 
 typedef enum SoundFormat {
@@ -154,6 +168,19 @@ typedef struct SoundOutputInfo {
 	SoundDeviceType type;
 } SoundOutputInfo;
 
+// Shared between the driver and the client of a mapped ring. Positions count bytes since the ring
+// was configured, the byte at position `pos` lives at `pos % ring_size` in the ring. The client fills
+// the ring up to `read_pos + ring_size` and then publishes the new `write_pos`, the driver updates
+// `read_pos` every period and counts an underrun whenever it passes `write_pos`.
+// The page holding this directly precedes the ring, unmapping it unmaps both.
+typedef struct SoundRingPosition {
+	uint64_t read_pos;
+	uint64_t write_pos;
+	uint32_t ring_size;
+	uint32_t period_size;
+	uint32_t underruns;
+} SoundRingPosition;
+
 typedef struct SoundLink {
 #ifdef __cplusplus
 	DevLinkRequest request {
@@ -196,6 +223,10 @@ typedef struct SoundLink {
 			size_t trip_size;
 		} wait_until_consumed;
 
+		struct {
+			size_t period_size;
+		} set_period_size;
+
 #ifdef __cplusplus
 		char dummy {};
 #else
@@ -219,6 +250,21 @@ typedef struct SoundLinkResponse {
 		struct {
 			size_t remaining;
 		} wait_until_consumed;
+
+		struct {
+			size_t period_size;
+			size_t ring_size;
+		} set_period_size;
+
+		struct {
+			void* ring;
+			size_t ring_size;
+			SoundRingPosition* position;
+		} map_ring;
+
+		struct {
+			uint64_t read_pos;
+		} get_position;
 	};
 } SoundLinkResponse;
 
@@ -0,0 +1,18 @@
+#ifndef CRESCENT_MEM_H
+#define CRESCENT_MEM_H
+
+#include <stdint.h>
+
+typedef struct MemStats {
+	// physical memory in bytes, reserved is used by the kernel to track the rest
+	uint64_t total;
+	uint64_t reserved;
+	uint64_t used;
+	// free pages that idle cpus already zeroed, they count as free
+	uint64_t zero_pool_pages;
+	// zeroed page allocations served from the pool and ones that had to zero the page themselves
+	uint64_t zero_pool_hits;
+	uint64_t zero_pool_misses;
+} MemStats;
+
+#endif
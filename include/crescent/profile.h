@@ -0,0 +1,27 @@
+#ifndef CRESCENT_PROFILE_H
+#define CRESCENT_PROFILE_H
+
+#include <stdint.h>
+
+#define PROFILE_MAX_FRAMES 29
+
+// The cpu was running user code, the frames are addresses in the process.
+#define PROFILE_SAMPLE_USER (1U << 0)
+
+typedef struct ProfileSample {
+	// ns since boot
+	uint64_t timestamp;
+	// pid << 32 | thread id of the thread that was running
+	uint64_t thread;
+	// name of the thread's process, truncated and null terminated
+	char process_name[16];
+	uint32_t cpu;
+	// PROFILE_SAMPLE_*
+	uint16_t flags;
+	// number of valid entries in frames
+	uint16_t depth;
+	// interrupted pc followed by the return addresses found by walking the frame pointers, innermost first
+	uint64_t frames[PROFILE_MAX_FRAMES];
+} ProfileSample;
+
+#endif
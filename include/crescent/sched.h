@@ -0,0 +1,36 @@
+#ifndef CRESCENT_SCHED_H
+#define CRESCENT_SCHED_H
+
+#include <stdint.h>
+
+#define SCHED_WAIT_BUCKETS 20
+
+typedef struct SchedStats {
+	// time spent running, system calls count as kernel time
+	uint64_t user_ns;
+	uint64_t kernel_ns;
+	// switches away because the thread blocked, slept or exited
+	uint64_t voluntary_switches;
+	// switches away because the thread was preempted or yielded
+	uint64_t involuntary_switches;
+	// moves to another cpu by the load balancer
+	uint64_t migrations;
+	// time between becoming runnable and running, bucket 0 counts waits under 1 us,
+	// bucket i waits in [2^(i - 1), 2^i) us and the last one everything longer
+	uint64_t wait_histogram[SCHED_WAIT_BUCKETS];
+} SchedStats;
+
+typedef struct SchedStatsEntry {
+	SchedStats stats;
+	int pid;
+	// zero for the entry of a whole process, which comes before its threads and also includes
+	// the threads that already exited. The kernel process (pid 0) doesn't include the idle threads.
+	uint32_t tid;
+	// for threads, the current scheduler level (0 has the shortest slices) and cpu
+	uint32_t level;
+	uint32_t cpu;
+	// process name for process entries, thread name otherwise, truncated and null terminated
+	char name[32];
+} SchedStatsEntry;
+
+#endif
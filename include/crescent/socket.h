@@ -37,6 +37,17 @@ typedef struct Ipv6SocketAddress {
 	uint16_t port;
 } Ipv6SocketAddress;
 
+// Receive counters of a nic summed over its rx rings.
+typedef struct NicRxStats {
+	// frames handed to the network stack
+	uint64_t packets;
+	// rx interrupts, packets / irqs is the average batch an interrupt was coalesced into
+	uint64_t irqs;
+	// poll batches and how many of them used the whole budget and had to yield
+	uint64_t polls;
+	uint64_t budget_exhausted;
+} NicRxStats;
+
 typedef enum SocketFlag {
 	SOCK_NONE = 0,
 	SOCK_NONBLOCK = 1 << 0
@@ -88,6 +88,20 @@ typedef enum CrescentSyscall {
 	SYS_EVM_VCPU_READ_STATE,
 	SYS_EVM_VCPU_TRIGGER_IRQ,
 
+	SYS_MAP_FILE,
+	SYS_GET_CPU_COUNT,
+	SYS_SOCKET_BIND_INTERFACE,
+	SYS_SYSLOG_READ,
+	SYS_TRACE_CONTROL,
+	SYS_TRACE_READ,
+	SYS_PROFILE_CONTROL,
+	SYS_PROFILE_READ,
+	SYS_GET_SCHED_STATS,
+	SYS_GET_MEM_STATS,
+	SYS_NIC_SET_IRQ_COALESCING,
+	SYS_NIC_GET_RX_STATS,
+	SYS_SYSLOG_SET_LEVEL,
+
 	SYS_POSIX_START = 0x1000
 } CrescentSyscall;
 
@@ -106,6 +120,13 @@ typedef enum CrescentError {
 	ERR_CONNECTION_CLOSED
 } CrescentError;
 
+typedef enum CrescentLogLevel {
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG
+} CrescentLogLevel;
+
 typedef enum ShutdownType {
 	SHUTDOWN_TYPE_POWER_OFF,
 	SHUTDOWN_TYPE_REBOOT,
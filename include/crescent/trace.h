@@ -0,0 +1,47 @@
+#ifndef CRESCENT_TRACE_H
+#define CRESCENT_TRACE_H
+
+#include <stdint.h>
+
+// Threads are identified as pid << 32 | thread id.
+typedef enum TraceEvent {
+	// arg0: previous thread, arg1: next thread
+	TRACE_EVENT_SCHED_SWITCH,
+	// arg0: syscall number
+	TRACE_EVENT_SYSCALL_ENTER,
+	// arg0: syscall number, arg1: return value
+	TRACE_EVENT_SYSCALL_EXIT,
+	// arg0: faulting address
+	TRACE_EVENT_PAGE_FAULT_ENTER,
+	// arg0: faulting address, arg1: whether it was handled
+	TRACE_EVENT_PAGE_FAULT_EXIT,
+	// arg0: irq number
+	TRACE_EVENT_IRQ_ENTER,
+	// arg0: irq number
+	TRACE_EVENT_IRQ_EXIT,
+	// arg0: local port << 16 | remote port, arg1: payload length
+	TRACE_EVENT_TCP_RX,
+	TRACE_EVENT_TCP_TX,
+	TRACE_EVENT_UDP_RX,
+	TRACE_EVENT_UDP_TX,
+	// Not enabled by the mask, reported by the kernel in place of records that didn't fit.
+	// arg0: number of records lost
+	TRACE_EVENT_LOST,
+	TRACE_EVENT_MAX
+} TraceEvent;
+
+#define TRACE_EVENT_MASK(event) (1ULL << (event))
+#define TRACE_EVENT_MASK_ALL (TRACE_EVENT_MASK(TRACE_EVENT_LOST) - 1)
+
+typedef struct TraceRecord {
+	// ns since boot
+	uint64_t timestamp;
+	// thread that was running when the event happened
+	uint64_t thread;
+	uint64_t arg0;
+	uint64_t arg1;
+	uint32_t event;
+	uint32_t cpu;
+} TraceRecord;
+
+#endif
@@ -3,6 +3,10 @@
 #include "crescent/event.h"
 #include "crescent/socket.h"
 #include "crescent/time.h"
+#include "crescent/mem.h"
+#include "crescent/profile.h"
+#include "crescent/sched.h"
+#include "crescent/trace.h"
 #include "crescent/evm.h"
 
 #ifdef __cplusplus
@@ -13,6 +17,7 @@ extern "C" {
 #define __noreturn __attribute__((noreturn))
 #endif
 
+// Threads that call into libc are created with thread_create from libc instead, which sets up its per-thread state.
 int sys_thread_create(CrescentHandle* handle, const char* name, size_t name_len, void (*fn)(void* arg), void* arg);
 __noreturn void sys_thread_exit(int status);
 int sys_process_create(CrescentHandle* handle, const char* path, size_t path_len, const ProcessCreateInfo* info);
@@ -21,10 +26,29 @@ int sys_kill(CrescentHandle handle);
 int sys_get_status(CrescentHandle handle);
 int sys_get_thread_id();
 int sys_get_process_id();
+int sys_get_cpu_count();
 int sys_sleep(uint64_t ns);
 int sys_get_time(uint64_t* ns);
 int sys_get_date_time(CrescentDateTime* time);
 int sys_syslog(const char* str, size_t size);
+// Reads the kernel log starting at byte `*pos`, which is advanced past what was read.
+// Only the newest part of the log is kept, older positions skip ahead to it.
+int sys_syslog_read(char* buffer, size_t size, uint64_t* pos, size_t* actual);
+// Sets the least important level the kernel logs and stores the previous one in `old` if it's not null.
+// Levels more verbose than the kernel was built with are unsupported.
+int sys_syslog_set_level(CrescentLogLevel level, CrescentLogLevel* old);
+// Records the events in `mask` (see TRACE_EVENT_MASK) into per-cpu buffers, zero stops recording.
+int sys_trace_control(uint64_t mask);
+// Moves up to `count` recorded events into `records`.
+int sys_trace_read(TraceRecord* records, size_t count, size_t* actual);
+// Samples every cpu every `interval_us` into per-cpu buffers, zero stops sampling.
+int sys_profile_control(uint64_t interval_us);
+// Moves up to `count` samples into `samples`, `lost` is set to the number dropped since the last read.
+int sys_profile_read(ProfileSample* samples, size_t count, size_t* actual, uint64_t* lost);
+// Gets the scheduler statistics of every process and thread. `actual` is set to the number of entries
+// even if `count` was too small for them, ERR_BUFFER_TOO_SMALL is returned in that case.
+int sys_get_sched_stats(SchedStatsEntry* entries, size_t count, size_t* actual);
+int sys_get_mem_stats(MemStats* stats);
 int sys_map(void** addr, size_t size, int protection);
 int sys_unmap(void* ptr, size_t size);
 int sys_devlink(const DevLink* dev_link);
@@ -41,6 +65,7 @@ int sys_write(CrescentHandle handle, const void* data, size_t size, size_t* actu
 int sys_seek(CrescentHandle handle, int64_t offset, int whence, uint64_t* value);
 int sys_stat(CrescentHandle handle, CrescentStat* stat);
 int sys_list_dir(CrescentHandle handle, CrescentDirEntry* entries, size_t* count, size_t* offset);
+int sys_map_file(CrescentHandle handle, size_t offset, size_t size, const void** ptr);
 
 int sys_pipe_create(
 	CrescentHandle* read_handle,
@@ -62,6 +87,11 @@ int sys_socket_send_to(CrescentHandle handle, const void* data, size_t size, con
 int sys_socket_receive(CrescentHandle handle, void* data, size_t size, size_t* actual);
 int sys_socket_receive_from(CrescentHandle handle, void* data, size_t size, size_t* actual, SocketAddress* address);
 int sys_socket_get_peer_name(CrescentHandle handle, SocketAddress* address);
+// Raises an rx interrupt of nic `index` only after `max_frames` frames or `max_usecs` us, whichever comes
+// first, zero disables that limit. Returns ERR_UNSUPPORTED if the nic can't coalesce interrupts.
+int sys_nic_set_irq_coalescing(uint32_t index, uint32_t max_frames, uint32_t max_usecs);
+int sys_nic_get_rx_stats(uint32_t index, NicRxStats* stats);
+int sys_socket_bind_interface(CrescentHandle handle, uint32_t index);
 
 int sys_shared_mem_alloc(CrescentHandle* handle, size_t size);
 int sys_shared_mem_map(CrescentHandle handle, void** ptr);
@@ -36,6 +36,10 @@ int sys_get_process_id() {
 	return static_cast<int>(syscall(SYS_GET_PROCESS_ID));
 }
 
+int sys_get_cpu_count() {
+	return static_cast<int>(syscall(SYS_GET_CPU_COUNT));
+}
+
 int sys_sleep(uint64_t ns) {
 	return static_cast<int>(syscall(SYS_SLEEP, ns));
 }
@@ -52,6 +56,38 @@ int sys_syslog(const char* str, size_t size) {
 	return static_cast<int>(syscall(SYS_SYSLOG, str, size));
 }
 
+int sys_syslog_read(char* buffer, size_t size, uint64_t* pos, size_t* actual) {
+	return static_cast<int>(syscall(SYS_SYSLOG_READ, buffer, size, pos, actual));
+}
+
+int sys_syslog_set_level(CrescentLogLevel level, CrescentLogLevel* old) {
+	return static_cast<int>(syscall(SYS_SYSLOG_SET_LEVEL, level, old));
+}
+
+int sys_trace_control(uint64_t mask) {
+	return static_cast<int>(syscall(SYS_TRACE_CONTROL, mask));
+}
+
+int sys_trace_read(TraceRecord* records, size_t count, size_t* actual) {
+	return static_cast<int>(syscall(SYS_TRACE_READ, records, count, actual));
+}
+
+int sys_profile_control(uint64_t interval_us) {
+	return static_cast<int>(syscall(SYS_PROFILE_CONTROL, interval_us));
+}
+
+int sys_profile_read(ProfileSample* samples, size_t count, size_t* actual, uint64_t* lost) {
+	return static_cast<int>(syscall(SYS_PROFILE_READ, samples, count, actual, lost));
+}
+
+int sys_get_sched_stats(SchedStatsEntry* entries, size_t count, size_t* actual) {
+	return static_cast<int>(syscall(SYS_GET_SCHED_STATS, entries, count, actual));
+}
+
+int sys_get_mem_stats(MemStats* stats) {
+	return static_cast<int>(syscall(SYS_GET_MEM_STATS, stats));
+}
+
 int sys_map(void** addr, size_t size, int protection) {
 	return static_cast<int>(syscall(SYS_MAP, addr, size, protection));
 }
@@ -104,6 +140,10 @@ int sys_list_dir(CrescentHandle handle, CrescentDirEntry* entries, size_t* count
 	return static_cast<int>(syscall(SYS_LIST_DIR, handle, entries, count, offset));
 }
 
+int sys_map_file(CrescentHandle handle, size_t offset, size_t size, const void** ptr) {
+	return static_cast<int>(syscall(SYS_MAP_FILE, handle, offset, size, ptr));
+}
+
 int sys_pipe_create(
 	CrescentHandle* read_handle,
 	CrescentHandle* write_handle,
@@ -161,6 +201,18 @@ int sys_socket_get_peer_name(CrescentHandle handle, SocketAddress* address) {
 	return static_cast<int>(syscall(SYS_SOCKET_GET_PEER_NAME, handle, address));
 }
 
+int sys_socket_bind_interface(CrescentHandle handle, uint32_t index) {
+	return static_cast<int>(syscall(SYS_SOCKET_BIND_INTERFACE, handle, index));
+}
+
+int sys_nic_set_irq_coalescing(uint32_t index, uint32_t max_frames, uint32_t max_usecs) {
+	return static_cast<int>(syscall(SYS_NIC_SET_IRQ_COALESCING, index, max_frames, max_usecs));
+}
+
+int sys_nic_get_rx_stats(uint32_t index, NicRxStats* stats) {
+	return static_cast<int>(syscall(SYS_NIC_GET_RX_STATS, index, stats));
+}
+
 int sys_shared_mem_alloc(CrescentHandle* handle, size_t size) {
 	return static_cast<int>(syscall(SYS_SHARED_MEM_ALLOC, handle, size));
 }
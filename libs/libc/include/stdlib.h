@@ -10,6 +10,9 @@ void* malloc(size_t __size);
 void* realloc(void* __old, size_t __new_size);
 void free(void* __ptr);
 
+// Bytes malloc currently has mapped, all of them are resident since mappings are backed right away.
+size_t __malloc_mapped_size();
+
 __attribute__((noreturn)) void exit(int status);
 __attribute__((noreturn)) void abort();
 
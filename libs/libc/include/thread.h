@@ -0,0 +1,17 @@
+#ifndef _THREAD_H
+#define _THREAD_H
+
+#include "bits/utils.h"
+#include <crescent/syscalls.h>
+
+__begin
+
+// Creates a thread running `fn(arg)` with libc's per-thread state set up,
+// threads that call into libc have to be created with it instead of sys_thread_create.
+int thread_create(CrescentHandle* __handle, const char* __name, size_t __name_len, void (*__fn)(void* __arg), void* __arg);
+// Gives libc's per-thread state, such as the malloc cache, back and exits the calling thread.
+__attribute__((noreturn)) void thread_exit(int __status);
+
+__end
+
+#endif
@@ -2,52 +2,797 @@
 #include "stdio.h"
 #include "sys.hpp"
 #include "string.h"
-#include <hz/slab.hpp>
+#include "thread.hpp"
+#include <stdint.h>
+
+// Small allocations are served from per-thread free lists of each size class, which are refilled
+// from and drained into central per-class lists in batches, so threads rarely touch shared state.
+// The central lists carve objects out of spans, runs of pages taken from the page heap. Freed spans
+// stay in the page heap and merge with their neighbours, mappings are only returned to the kernel
+// once more than `RETAIN_PAGES` are free. Larger allocations are spans of their own.
+//
+// The thread caches hang off the thread control block and go back to the central lists when
+// their thread exits through `thread_exit`, the cache structs themselves are reused by new threads.
 
 namespace {
-	struct ArenaAllocator {
-		static void* allocate(size_t size) {
-			size = (size + 0x1000 - 1) & ~(0x1000 - 1);
-			void* ret = nullptr;
-			if (sys_map(&ret, size, CRESCENT_PROT_READ | CRESCENT_PROT_WRITE)) {
+	constexpr size_t PAGE_SIZE = 0x1000;
+	constexpr size_t PAGE_SHIFT = 12;
+	constexpr size_t CLASS_COUNT = 40;
+	constexpr size_t MAX_SMALL_SIZE = 32 * 1024;
+	/// Pages mapped at once when the page heap runs out, larger requests get a mapping of their own.
+	constexpr size_t GROW_PAGES = 64;
+	/// Free pages kept mapped by the page heap (32 MiB), whole free mappings above it are unmapped.
+	constexpr size_t RETAIN_PAGES = 8192;
+	/// Spans up to this many pages have exact size lists in the page heap, the rest share one.
+	constexpr size_t MAX_LIST_PAGES = 128;
+	/// Bytes moved between a thread cache and a central list at once.
+	constexpr size_t BATCH_BYTES = 16 * 1024;
+	constexpr size_t MAX_BATCH = 32;
+	/// Bytes a thread cache holds before half of every list goes back to the central lists.
+	constexpr size_t MAX_CACHE_SIZE = 256 * 1024;
+
+	/// Futex backed lock, 0 is unlocked, 1 locked and 2 locked with waiters.
+	struct Lock {
+		void lock() {
+			int expected = 0;
+			if (__atomic_compare_exchange_n(&state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+				return;
+			}
+			if (expected != 2) {
+				expected = __atomic_exchange_n(&state, 2, __ATOMIC_ACQUIRE);
+			}
+			while (expected) {
+				sys_futex_wait(&state, 2, UINT64_MAX);
+				expected = __atomic_exchange_n(&state, 2, __ATOMIC_ACQUIRE);
+			}
+		}
+
+		void unlock() {
+			if (__atomic_exchange_n(&state, 0, __ATOMIC_RELEASE) == 2) {
+				sys_futex_wake(&state, 1);
+			}
+		}
+
+		int state;
+	};
+
+	struct LockGuard {
+		explicit LockGuard(Lock& lock) : lock {lock} {
+			lock.lock();
+		}
+
+		~LockGuard() {
+			lock.unlock();
+		}
+
+		LockGuard(const LockGuard&) = delete;
+		LockGuard& operator=(const LockGuard&) = delete;
+
+		Lock& lock;
+	};
+
+	/// 16 byte steps up to 128 and four classes per doubling after that.
+	constexpr size_t class_size(size_t index) {
+		if (index < 8) {
+			return (index + 1) * 16;
+		}
+		size_t doubling = (index - 8) / 4;
+		size_t step = (index - 8) % 4;
+		return (size_t {128} << doubling) + (step + 1) * (size_t {32} << doubling);
+	}
+
+	static_assert(class_size(CLASS_COUNT - 1) == MAX_SMALL_SIZE);
+
+	constexpr size_t size_to_class(size_t size) {
+		if (size <= 128) {
+			return size ? (size - 1) / 16 : 0;
+		}
+		size_t log = 63 - __builtin_clzl(size - 1);
+		return 8 + (log - 7) * 4 + (((size - 1) >> (log - 2)) & 3);
+	}
+
+	constexpr size_t class_span_pages(size_t index) {
+		size_t bytes = class_size(index) * 8;
+		if (bytes < 16 * 1024) {
+			bytes = 16 * 1024;
+		}
+		return (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+	}
+
+	constexpr size_t class_batch(size_t index) {
+		size_t count = BATCH_BYTES / class_size(index);
+		return count < 2 ? 2 : (count > MAX_BATCH ? MAX_BATCH : count);
+	}
+
+	size_t MAPPED_SIZE = 0;
+
+	void* os_map(size_t size) {
+		void* ptr = nullptr;
+		if (sys_map(&ptr, size, CRESCENT_PROT_READ | CRESCENT_PROT_WRITE)) {
+			return nullptr;
+		}
+		__atomic_fetch_add(&MAPPED_SIZE, size, __ATOMIC_RELAXED);
+		return ptr;
+	}
+
+	void os_unmap(void* ptr, size_t size) {
+		sys_unmap(ptr, size);
+		__atomic_fetch_sub(&MAPPED_SIZE, size, __ATOMIC_RELAXED);
+	}
+
+	enum class SpanState : uint8_t {
+		Free,
+		Small,
+		Large
+	};
+
+	struct Span {
+		uintptr_t start;
+		size_t pages;
+		/// Mapping the span was carved from, spans only merge within one and only whole ones are unmapped.
+		uintptr_t mapping;
+		size_t mapping_pages;
+		Span* prev;
+		Span* next;
+		void* free_list;
+		uint32_t used;
+		uint8_t size_class;
+		SpanState state;
+	};
+
+	struct SpanList {
+		void push(Span* span) {
+			span->prev = nullptr;
+			span->next = head;
+			if (head) {
+				head->prev = span;
+			}
+			head = span;
+		}
+
+		void remove(Span* span) {
+			if (span->prev) {
+				span->prev->next = span->next;
+			}
+			else {
+				head = span->next;
+			}
+			if (span->next) {
+				span->next->prev = span->prev;
+			}
+		}
+
+		Span* head;
+	};
+
+	/// Maps page numbers of 48 bit addresses to the spans containing them. Every page of a span
+	/// holding small objects is set, only the first and the last page of the other spans.
+	struct PageMap {
+		static constexpr size_t BITS = 12;
+		static constexpr size_t SIZE = size_t {1} << BITS;
+
+		struct Leaf {
+			Span* spans[SIZE];
+		};
+
+		struct Node {
+			Leaf* leaves[SIZE];
+		};
+
+		[[nodiscard]] Span* get(uintptr_t addr) const {
+			size_t page = addr >> PAGE_SHIFT;
+			auto* node = __atomic_load_n(&root[(page >> (2 * BITS)) % SIZE], __ATOMIC_ACQUIRE);
+			if (!node) {
+				return nullptr;
+			}
+			auto* leaf = __atomic_load_n(&node->leaves[(page >> BITS) % SIZE], __ATOMIC_ACQUIRE);
+			if (!leaf) {
 				return nullptr;
 			}
-			return ret;
+			return leaf->spans[page % SIZE];
 		}
 
-		static void deallocate(void* ptr, size_t size) {
-			size = (size + 0x1000 - 1) & ~(0x1000 - 1);
-			sys_unmap(ptr, size);
+		/// Only called with the page heap locked, the nodes are never freed so lookups don't need it.
+		bool set(uintptr_t addr, Span* span) {
+			size_t page = addr >> PAGE_SHIFT;
+			auto*& node = root[(page >> (2 * BITS)) % SIZE];
+			if (!node) {
+				auto* new_node = static_cast<Node*>(os_map(sizeof(Node)));
+				if (!new_node) {
+					return false;
+				}
+				memset(new_node, 0, sizeof(Node));
+				__atomic_store_n(&node, new_node, __ATOMIC_RELEASE);
+			}
+			auto*& leaf = node->leaves[(page >> BITS) % SIZE];
+			if (!leaf) {
+				auto* new_leaf = static_cast<Leaf*>(os_map(sizeof(Leaf)));
+				if (!new_leaf) {
+					return false;
+				}
+				memset(new_leaf, 0, sizeof(Leaf));
+				__atomic_store_n(&leaf, new_leaf, __ATOMIC_RELEASE);
+			}
+			leaf->spans[page % SIZE] = span;
+			return true;
 		}
+
+		Node* root[SIZE];
+	};
+
+	constinit PageMap PAGE_MAP {};
+
+	struct FreeList {
+		void* head;
+		uint32_t length;
+	};
+
+	struct ThreadCache {
+		void* alloc(size_t index);
+		void free(size_t index, void* ptr);
+		void release(size_t index, size_t keep);
+
+		FreeList lists[CLASS_COUNT];
+		size_t size;
+		/// Next cache in `UNUSED_CACHES`.
+		ThreadCache* next_unused;
 	};
 
-	constinit hz::slab_allocator<ArenaAllocator> ALLOCATOR {ArenaAllocator {}};
+	struct PageHeap {
+		/// `reserve` is the size of the mapping made if no free span is big enough, the pages
+		/// past `pages` stay free right after the span so it can be resized in place later.
+		Span* alloc(size_t pages, size_t reserve = 0);
+		void free(Span* span);
+		bool resize(Span* span, size_t pages);
+		void* alloc_meta(size_t size);
+		/// Makes interior pointers of a span find it as well.
+		bool set_all(Span* span);
+
+		Span* new_span();
+		void delete_span(Span* span);
+		void insert_free(Span* span);
+		void remove_free(Span* span);
+		bool set_edges(Span* span);
+		Span* grow(size_t pages);
+		void split(Span* span, size_t pages);
+
+		Lock lock;
+		SpanList free_lists[MAX_LIST_PAGES + 1];
+		size_t free_pages;
+		/// Span structs that can be reused.
+		Span* unused_spans;
+		char* meta;
+		size_t meta_left;
+	};
+
+	constinit PageHeap HEAP {};
+
+	struct CentralList {
+		size_t fetch(size_t index, size_t count, void*& head);
+		void release(void* head);
+
+		Lock lock;
+		/// Spans with free objects.
+		SpanList spans;
+	};
+
+	constinit CentralList CENTRAL[CLASS_COUNT] {};
+
+	/// Empty caches of exited threads, protected by the page heap lock.
+	constinit ThreadCache* UNUSED_CACHES {};
+}
+
+void* PageHeap::alloc_meta(size_t size) {
+	size = (size + 15) & ~size_t {15};
+	if (meta_left < size) {
+		constexpr size_t CHUNK_SIZE = 64 * 1024;
+		auto* chunk = static_cast<char*>(os_map(CHUNK_SIZE));
+		if (!chunk) {
+			return nullptr;
+		}
+		meta = chunk;
+		meta_left = CHUNK_SIZE;
+	}
+	void* ptr = meta;
+	meta += size;
+	meta_left -= size;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+Span* PageHeap::new_span() {
+	if (auto* span = unused_spans) {
+		unused_spans = span->next;
+		memset(span, 0, sizeof(Span));
+		return span;
+	}
+	return static_cast<Span*>(alloc_meta(sizeof(Span)));
+}
+
+void PageHeap::delete_span(Span* span) {
+	span->next = unused_spans;
+	unused_spans = span;
+}
+
+void PageHeap::insert_free(Span* span) {
+	span->state = SpanState::Free;
+	free_lists[span->pages <= MAX_LIST_PAGES ? span->pages : 0].push(span);
+	free_pages += span->pages;
+}
+
+void PageHeap::remove_free(Span* span) {
+	free_lists[span->pages <= MAX_LIST_PAGES ? span->pages : 0].remove(span);
+	free_pages -= span->pages;
+}
+
+bool PageHeap::set_edges(Span* span) {
+	return PAGE_MAP.set(span->start, span) &&
+		PAGE_MAP.set(span->start + (span->pages - 1) * PAGE_SIZE, span);
+}
+
+bool PageHeap::set_all(Span* span) {
+	for (size_t i = 0; i < span->pages; ++i) {
+		if (!PAGE_MAP.set(span->start + i * PAGE_SIZE, span)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Span* PageHeap::grow(size_t pages) {
+	if (pages < GROW_PAGES) {
+		pages = GROW_PAGES;
+	}
+
+	auto* span = new_span();
+	if (!span) {
+		return nullptr;
+	}
+	auto* ptr = os_map(pages * PAGE_SIZE);
+	if (!ptr) {
+		delete_span(span);
+		return nullptr;
+	}
+
+	span->start = reinterpret_cast<uintptr_t>(ptr);
+	span->pages = pages;
+	span->mapping = span->start;
+	span->mapping_pages = pages;
+	if (!set_edges(span)) {
+		os_unmap(ptr, pages * PAGE_SIZE);
+		delete_span(span);
+		return nullptr;
+	}
+	insert_free(span);
+	return span;
+}
+
+/// Splits the pages past `pages` off into a free span.
+void PageHeap::split(Span* span, size_t pages) {
+	if (span->pages == pages) {
+		return;
+	}
+
+	auto* rest = new_span();
+	if (!rest) {
+		// the span just stays bigger than needed
+		return;
+	}
+	rest->start = span->start + pages * PAGE_SIZE;
+	rest->pages = span->pages - pages;
+	rest->mapping = span->mapping;
+	rest->mapping_pages = span->mapping_pages;
+	if (!set_edges(rest)) {
+		delete_span(rest);
+		return;
+	}
+	span->pages = pages;
+	insert_free(rest);
+}
+
+Span* PageHeap::alloc(size_t pages, size_t reserve) {
+	LockGuard guard {lock};
+
+	Span* span = nullptr;
+	for (size_t i = pages; i <= MAX_LIST_PAGES && !span; ++i) {
+		span = free_lists[i].head;
+	}
+	if (!span) {
+		// best fit among the big ones
+		for (auto* candidate = free_lists[0].head; candidate; candidate = candidate->next) {
+			if (candidate->pages >= pages && (!span || candidate->pages < span->pages)) {
+				span = candidate;
+			}
+		}
+	}
+	if (!span) {
+		span = grow(reserve > pages ? reserve : pages);
+		if (!span) {
+			return nullptr;
+		}
+	}
+
+	remove_free(span);
+	split(span, pages);
+	span->state = SpanState::Large;
+	if (!set_edges(span)) {
+		insert_free(span);
+		return nullptr;
+	}
+	return span;
+}
+
+void PageHeap::free(Span* span) {
+	LockGuard guard {lock};
+
+	auto start = span->start;
+	auto end = start + span->pages * PAGE_SIZE;
+
+	if (start != span->mapping) {
+		auto* prev = PAGE_MAP.get(start - PAGE_SIZE);
+		if (prev && prev->state == SpanState::Free && prev->start + prev->pages * PAGE_SIZE == start) {
+			remove_free(prev);
+			span->start = prev->start;
+			span->pages += prev->pages;
+			delete_span(prev);
+		}
+	}
+
+	if (end != span->mapping + span->mapping_pages * PAGE_SIZE) {
+		auto* next = PAGE_MAP.get(end);
+		if (next && next->state == SpanState::Free && next->start == end) {
+			remove_free(next);
+			span->pages += next->pages;
+			delete_span(next);
+		}
+	}
+
+	if (span->pages == span->mapping_pages && free_pages + span->pages > RETAIN_PAGES) {
+		for (size_t i = 0; i < span->pages; ++i) {
+			PAGE_MAP.set(span->start + i * PAGE_SIZE, nullptr);
+		}
+		os_unmap(reinterpret_cast<void*>(span->start), span->pages * PAGE_SIZE);
+		delete_span(span);
+		return;
+	}
+
+	// can't fail, the map already has nodes for both of the edges
+	PAGE_MAP.set(span->start, span);
+	PAGE_MAP.set(span->start + (span->pages - 1) * PAGE_SIZE, span);
+	insert_free(span);
+}
+
+/// Resizes a large span in place, growing into the free span after it if there is one.
+bool PageHeap::resize(Span* span, size_t pages) {
+	LockGuard guard {lock};
+
+	if (pages <= span->pages) {
+		// shrinking by less than half isn't worth splitting for
+		if ((span->pages - pages) * 2 < span->pages) {
+			return true;
+		}
+		split(span, pages);
+		if (span->pages != pages) {
+			return true;
+		}
+		set_edges(span);
+
+		auto* rest = PAGE_MAP.get(span->start + pages * PAGE_SIZE);
+		auto rest_end = rest->start + rest->pages * PAGE_SIZE;
+		if (rest_end != span->mapping + span->mapping_pages * PAGE_SIZE) {
+			auto* next = PAGE_MAP.get(rest_end);
+			if (next && next->state == SpanState::Free && next->start == rest_end) {
+				remove_free(rest);
+				remove_free(next);
+				rest->pages += next->pages;
+				delete_span(next);
+				set_edges(rest);
+				insert_free(rest);
+			}
+		}
+		return true;
+	}
+
+	auto end = span->start + span->pages * PAGE_SIZE;
+	if (end == span->mapping + span->mapping_pages * PAGE_SIZE) {
+		return false;
+	}
+	auto* next = PAGE_MAP.get(end);
+	if (!next || next->state != SpanState::Free || next->start != end || span->pages + next->pages < pages) {
+		return false;
+	}
+
+	remove_free(next);
+	auto taken = pages - span->pages;
+	if (next->pages == taken) {
+		delete_span(next);
+	}
+	else {
+		next->start += taken * PAGE_SIZE;
+		next->pages -= taken;
+		set_edges(next);
+		insert_free(next);
+	}
+	span->pages = pages;
+	set_edges(span);
+	return true;
+}
+
+size_t CentralList::fetch(size_t index, size_t count, void*& head) {
+	LockGuard guard {lock};
+
+	size_t fetched = 0;
+	head = nullptr;
+	while (fetched < count) {
+		auto* span = spans.head;
+		if (!span) {
+			auto pages = class_span_pages(index);
+			span = HEAP.alloc(pages);
+			if (!span) {
+				break;
+			}
+
+			span->state = SpanState::Small;
+			span->size_class = index;
+			span->used = 0;
+			span->free_list = nullptr;
+
+			auto size = class_size(index);
+			auto object_count = span->pages * PAGE_SIZE / size;
+			for (size_t i = object_count; i > 0; --i) {
+				auto* obj = reinterpret_cast<void**>(span->start + (i - 1) * size);
+				*obj = span->free_list;
+				span->free_list = obj;
+			}
+
+			bool mapped;
+			{
+				LockGuard heap_guard {HEAP.lock};
+				mapped = HEAP.set_all(span);
+			}
+			if (!mapped) {
+				HEAP.free(span);
+				break;
+			}
+
+			spans.push(span);
+		}
+
+		while (fetched < count && span->free_list) {
+			auto* obj = static_cast<void**>(span->free_list);
+			span->free_list = *obj;
+			*obj = head;
+			head = obj;
+			++span->used;
+			++fetched;
+		}
+
+		if (!span->free_list) {
+			spans.remove(span);
+		}
+	}
+
+	return fetched;
+}
+
+void CentralList::release(void* head) {
+	LockGuard guard {lock};
+
+	while (head) {
+		auto* obj = static_cast<void**>(head);
+		head = *obj;
+
+		auto* span = PAGE_MAP.get(reinterpret_cast<uintptr_t>(obj));
+		if (!span->free_list) {
+			spans.push(span);
+		}
+		*obj = span->free_list;
+		span->free_list = obj;
+
+		// an empty span is kept if it's the only one left, so alternating
+		// allocations and frees don't map and unmap it every time
+		if (!--span->used && (span->prev || span->next)) {
+			spans.remove(span);
+			HEAP.free(span);
+		}
+	}
+}
+
+void* ThreadCache::alloc(size_t index) {
+	auto& list = lists[index];
+	if (!list.head) {
+		list.length = CENTRAL[index].fetch(index, class_batch(index), list.head);
+		if (!list.head) {
+			return nullptr;
+		}
+		size += list.length * class_size(index);
+	}
+
+	auto* obj = static_cast<void**>(list.head);
+	list.head = *obj;
+	--list.length;
+	size -= class_size(index);
+	return obj;
+}
+
+void ThreadCache::free(size_t index, void* ptr) {
+	auto& list = lists[index];
+	*static_cast<void**>(ptr) = list.head;
+	list.head = ptr;
+	++list.length;
+	size += class_size(index);
+
+	if (size > MAX_CACHE_SIZE) {
+		for (size_t i = 0; i < CLASS_COUNT; ++i) {
+			release(i, lists[i].length / 2);
+		}
+	}
+	else if (list.length > 2 * class_batch(index)) {
+		release(index, class_batch(index));
+	}
+}
+
+/// Returns all but the `keep` most recently freed objects of a list to the central list,
+/// those are the most likely to still be in the cpu caches.
+void ThreadCache::release(size_t index, size_t keep) {
+	auto& list = lists[index];
+	if (list.length <= keep) {
+		return;
+	}
+
+	void* released;
+	if (keep) {
+		auto* last = static_cast<void**>(list.head);
+		for (size_t i = 1; i < keep; ++i) {
+			last = static_cast<void**>(*last);
+		}
+		released = *last;
+		*last = nullptr;
+	}
+	else {
+		released = list.head;
+		list.head = nullptr;
+	}
+
+	size -= (list.length - keep) * class_size(index);
+	list.length = keep;
+	CENTRAL[index].release(released);
+}
+
+static ThreadCache* get_thread_cache() {
+	auto* tcb = get_tcb();
+	// threads not created with thread_create have no block on aarch64
+	if (!tcb) {
+		return nullptr;
+	}
+	else if (tcb->malloc_cache) {
+		return static_cast<ThreadCache*>(tcb->malloc_cache);
+	}
+
+	ThreadCache* cache;
+	{
+		LockGuard guard {HEAP.lock};
+		cache = UNUSED_CACHES;
+		if (cache) {
+			UNUSED_CACHES = cache->next_unused;
+			cache->next_unused = nullptr;
+		}
+		else {
+			cache = static_cast<ThreadCache*>(HEAP.alloc_meta(sizeof(ThreadCache)));
+		}
+	}
+	if (!cache) {
+		return nullptr;
+	}
+
+	tcb->malloc_cache = cache;
+	return cache;
+}
+
+void malloc_thread_exit() {
+	auto* tcb = get_tcb();
+	if (!tcb || !tcb->malloc_cache) {
+		return;
+	}
+
+	auto* cache = static_cast<ThreadCache*>(tcb->malloc_cache);
+	tcb->malloc_cache = nullptr;
+	for (size_t i = 0; i < CLASS_COUNT; ++i) {
+		cache->release(i, 0);
+	}
+
+	LockGuard guard {HEAP.lock};
+	cache->next_unused = UNUSED_CACHES;
+	UNUSED_CACHES = cache;
 }
 
 void* malloc(size_t size) {
-	return ALLOCATOR.alloc(size);
+	if (size <= MAX_SMALL_SIZE) {
+		auto index = size_to_class(size);
+		if (auto* cache = get_thread_cache()) {
+			return cache->alloc(index);
+		}
+
+		void* obj;
+		if (!CENTRAL[index].fetch(index, 1, obj)) {
+			return nullptr;
+		}
+		return obj;
+	}
+
+	auto pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	auto* span = HEAP.alloc(pages);
+	if (!span) {
+		return nullptr;
+	}
+	return reinterpret_cast<void*>(span->start);
 }
 
 void* realloc(void* old, size_t new_size) {
-	if (!new_size) {
-		ALLOCATOR.free(old);
+	if (!old) {
+		return malloc(new_size);
+	}
+	else if (!new_size) {
+		free(old);
 		return nullptr;
 	}
 
-	void* ptr = ALLOCATOR.alloc(new_size);
+	auto* span = PAGE_MAP.get(reinterpret_cast<uintptr_t>(old));
+	size_t old_size;
+	if (span->state == SpanState::Small) {
+		old_size = class_size(span->size_class);
+		if (new_size <= old_size && (new_size > old_size / 2 || span->size_class == 0)) {
+			return old;
+		}
+	}
+	else {
+		old_size = span->pages * PAGE_SIZE;
+		if (new_size > MAX_SMALL_SIZE && HEAP.resize(span, (new_size + PAGE_SIZE - 1) / PAGE_SIZE)) {
+			return old;
+		}
+	}
+
+	void* ptr;
+	if (new_size > MAX_SMALL_SIZE) {
+		// a buffer that's being grown is likely to be grown again, so it gets room for that
+		auto pages = (new_size + PAGE_SIZE - 1) / PAGE_SIZE;
+		auto* new_span = HEAP.alloc(pages, new_size > old_size ? pages * 2 : 0);
+		ptr = new_span ? reinterpret_cast<void*>(new_span->start) : nullptr;
+	}
+	else {
+		ptr = malloc(new_size);
+	}
 	if (!ptr) {
 		return nullptr;
 	}
-	if (old) {
-		auto old_size = ALLOCATOR.get_size_for_allocation(old);
-		memcpy(ptr, old, new_size < old_size ? new_size : old_size);
-		ALLOCATOR.free(old);
-	}
+	memcpy(ptr, old, new_size < old_size ? new_size : old_size);
+	free(old);
 	return ptr;
 }
 
 void free(void* ptr) {
-	ALLOCATOR.free(ptr);
+	if (!ptr) {
+		return;
+	}
+
+	auto* span = PAGE_MAP.get(reinterpret_cast<uintptr_t>(ptr));
+	if (span->state == SpanState::Large) {
+		HEAP.free(span);
+		return;
+	}
+
+	size_t index = span->size_class;
+	if (auto* cache = get_thread_cache()) {
+		cache->free(index, ptr);
+	}
+	else {
+		*static_cast<void**>(ptr) = nullptr;
+		CENTRAL[index].release(ptr);
+	}
+}
+
+size_t __malloc_mapped_size() {
+	return __atomic_load_n(&MAPPED_SIZE, __ATOMIC_RELAXED);
 }
 
 __attribute__((noreturn)) void exit(int status) {
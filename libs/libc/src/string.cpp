@@ -1,17 +1,398 @@
 #include "string.h"
 #include <stdint.h>
 
-size_t strlen(const char* str) {
-	size_t len = 0;
-	while (*str++) ++len;
-	return len;
+#ifdef __x86_64__
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Copies of up to 64 bytes are done with a few loads and stores that overlap in the middle instead
+// of loops. Bigger ones use the widest vectors the cpu has (or rep movsb/stosb where that is fast)
+// and only bypass the cache once the buffer wouldn't fit in it anyway.
+
+namespace {
+	template<typename T>
+	inline T load(const void* ptr) {
+		T value;
+		__builtin_memcpy(&value, ptr, sizeof(T));
+		return value;
+	}
+
+	template<typename T>
+	inline void store(void* ptr, T value) {
+		__builtin_memcpy(ptr, &value, sizeof(T));
+	}
+
+	/// Sizes of at most 16 bytes.
+	inline void copy_small(unsigned char* dest, const unsigned char* src, size_t size) {
+		if (size >= 8) {
+			auto first = load<uint64_t>(src);
+			auto last = load<uint64_t>(src + size - 8);
+			store(dest, first);
+			store(dest + size - 8, last);
+		}
+		else if (size >= 4) {
+			auto first = load<uint32_t>(src);
+			auto last = load<uint32_t>(src + size - 4);
+			store(dest, first);
+			store(dest + size - 4, last);
+		}
+		else if (size) {
+			auto first = src[0];
+			auto middle = src[size / 2];
+			auto last = src[size - 1];
+			dest[0] = first;
+			dest[size / 2] = middle;
+			dest[size - 1] = last;
+		}
+	}
+
+	/// Sizes of at most 16 bytes, `value` has the byte in every byte.
+	inline void set_small(unsigned char* dest, uint64_t value, size_t size) {
+		if (size >= 8) {
+			store(dest, value);
+			store(dest + size - 8, value);
+		}
+		else if (size >= 4) {
+			store(dest, static_cast<uint32_t>(value));
+			store(dest + size - 4, static_cast<uint32_t>(value));
+		}
+		else if (size) {
+			dest[0] = value;
+			dest[size / 2] = value;
+			dest[size - 1] = value;
+		}
+	}
 }
 
 #ifdef __x86_64__
 
+namespace {
+	constexpr uint32_t FEATURE_INITIALIZED = 1 << 0;
+	constexpr uint32_t FEATURE_AVX2 = 1 << 1;
+	/// Enhanced rep movsb/stosb, beats vector loops once the startup cost is amortized.
+	constexpr uint32_t FEATURE_ERMS = 1 << 2;
+
+	/// Copies below this use vector loops even if rep movsb is fast, even with fast short rep movsb
+	/// the loops are quicker for a few hundred bytes.
+	constexpr size_t REP_THRESHOLD = 2048;
+
+	uint32_t FEATURES = 0;
+	/// Copies at least this big use non-temporal stores, set to 3/4 of the last level cache.
+	size_t NON_TEMPORAL_THRESHOLD = 1024 * 1024;
+
+	struct CpuidResult {
+		uint32_t eax;
+		uint32_t ebx;
+		uint32_t ecx;
+		uint32_t edx;
+	};
+
+	CpuidResult cpuid(uint32_t leaf, uint32_t subleaf) {
+		CpuidResult res {};
+		asm volatile("cpuid" : "=a"(res.eax), "=b"(res.ebx), "=c"(res.ecx), "=d"(res.edx) : "a"(leaf), "c"(subleaf));
+		return res;
+	}
+
+	/// Largest cache described by a leaf in the format of leaf 4.
+	size_t largest_cache(uint32_t leaf) {
+		size_t largest = 0;
+		for (uint32_t i = 0; i < 16; ++i) {
+			auto info = cpuid(leaf, i);
+			if (!(info.eax & 0x1F)) {
+				break;
+			}
+			size_t ways = (info.ebx >> 22) + 1;
+			size_t partitions = ((info.ebx >> 12) & 0x3FF) + 1;
+			size_t line_size = (info.ebx & 0xFFF) + 1;
+			size_t sets = size_t {info.ecx} + 1;
+			size_t size = ways * partitions * line_size * sets;
+			if (size > largest) {
+				largest = size;
+			}
+		}
+		return largest;
+	}
+
+	[[gnu::noinline]] uint32_t init_features() {
+		uint32_t features = FEATURE_INITIALIZED;
+
+		auto max_leaf = cpuid(0, 0).eax;
+		auto basic = cpuid(1, 0);
+		if (max_leaf >= 7) {
+			auto extended = cpuid(7, 0);
+			// the kernel has to save the upper halves of the registers as well
+			bool ymm_enabled = false;
+			if (basic.ecx & 1U << 27) {
+				uint32_t xcr0_low;
+				uint32_t xcr0_high;
+				asm volatile("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+				ymm_enabled = (xcr0_low & 0b110) == 0b110;
+			}
+			if (ymm_enabled && (extended.ebx & 1U << 5)) {
+				features |= FEATURE_AVX2;
+			}
+			if (extended.ebx & 1U << 9) {
+				features |= FEATURE_ERMS;
+			}
+		}
+
+		// intel describes its caches in leaf 4, amd in 0x8000001D
+		size_t cache_size = max_leaf >= 4 ? largest_cache(4) : 0;
+		if (!cache_size && cpuid(0x80000000, 0).eax >= 0x8000001D) {
+			cache_size = largest_cache(0x8000001D);
+		}
+		if (cache_size) {
+			NON_TEMPORAL_THRESHOLD = cache_size / 4 * 3;
+		}
+
+		__atomic_store_n(&FEATURES, features, __ATOMIC_RELAXED);
+		return features;
+	}
+
+	inline uint32_t get_features() {
+		auto features = __atomic_load_n(&FEATURES, __ATOMIC_RELAXED);
+		if (!features) [[unlikely]] {
+			features = init_features();
+		}
+		return features;
+	}
+
+	inline void rep_movsb(unsigned char* dest, const unsigned char* src, size_t size) {
+		asm volatile("rep movsb" : "+D"(dest), "+S"(src), "+c"(size) : : "memory");
+	}
+
+	inline void rep_stosb(unsigned char* dest, int ch, size_t size) {
+		asm volatile("rep stosb" : "+D"(dest), "+c"(size) : "a"(ch) : "memory");
+	}
+
+	/// Sizes of more than 64 bytes.
+	void copy_sse2(unsigned char* dest, const unsigned char* src, size_t size) {
+		auto tail0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + size - 64));
+		auto tail1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + size - 48));
+		auto tail2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + size - 32));
+		auto tail3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + size - 16));
+		auto* end = dest + size;
+
+		for (; size > 64; size -= 64) {
+			auto value0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			auto value1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+			auto value2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+			auto value3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), value0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 16), value1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 32), value2);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 48), value3);
+			src += 64;
+			dest += 64;
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 64), tail0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 48), tail1);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 32), tail2);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 16), tail3);
+	}
+
+	/// Sizes of more than 64 bytes.
+	[[gnu::target("avx2")]] void copy_avx2(unsigned char* dest, const unsigned char* src, size_t size) {
+		auto tail0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + size - 64));
+		auto tail1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + size - 32));
+		auto* end = dest + size;
+
+		for (; size > 128; size -= 128) {
+			auto value0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+			auto value1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+			auto value2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+			auto value3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), value0);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 32), value1);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 64), value2);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 96), value3);
+			src += 128;
+			dest += 128;
+		}
+		if (size > 64) {
+			auto value0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+			auto value1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), value0);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 32), value1);
+		}
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(end - 64), tail0);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(end - 32), tail1);
+	}
+
+	/// Sizes of more than 64 bytes, the destination isn't brought into the cache.
+	void copy_non_temporal(unsigned char* dest, const unsigned char* src, size_t size) {
+		// streaming stores need an aligned destination
+		auto head = -reinterpret_cast<uintptr_t>(dest) & 15;
+		copy_small(dest, src, head);
+		dest += head;
+		src += head;
+		size -= head;
+
+		for (; size >= 64; size -= 64) {
+			auto value0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			auto value1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+			auto value2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+			auto value3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest), value0);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + 16), value1);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + 32), value2);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + 48), value3);
+			src += 64;
+			dest += 64;
+		}
+		_mm_sfence();
+
+		for (; size > 16; size -= 16) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+			src += 16;
+			dest += 16;
+		}
+		copy_small(dest, src, size);
+	}
+
+	/// Sizes of more than 64 bytes.
+	void set_sse2(unsigned char* dest, __m128i value, size_t size) {
+		auto* end = dest + size;
+		for (; size > 64; size -= 64) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), value);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 16), value);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 32), value);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 48), value);
+			dest += 64;
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 64), value);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 48), value);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 32), value);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 16), value);
+	}
+
+	/// Sizes of more than 64 bytes.
+	[[gnu::target("avx2")]] void set_avx2(unsigned char* dest, int ch, size_t size) {
+		auto value = _mm256_set1_epi8(static_cast<char>(ch));
+		auto* end = dest + size;
+		for (; size > 128; size -= 128) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), value);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 32), value);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 64), value);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 96), value);
+			dest += 128;
+		}
+		if (size > 64) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), value);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 32), value);
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(end - 64), value);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(end - 32), value);
+	}
+
+	/// Sizes of more than 64 bytes, the destination isn't brought into the cache.
+	void set_non_temporal(unsigned char* dest, __m128i value, size_t size) {
+		auto* end = dest + size;
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), value);
+		auto head = -reinterpret_cast<uintptr_t>(dest) & 15;
+		dest += head;
+		size -= head;
+
+		for (; size >= 64; size -= 64) {
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest), value);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + 16), value);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + 32), value);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + 48), value);
+			dest += 64;
+		}
+		_mm_sfence();
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 64), value);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 48), value);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 32), value);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(end - 16), value);
+	}
+
+	size_t strlen_sse2(const char* str) {
+		// aligned loads never cross into the next page, so reading before and past the string is fine
+		auto offset = reinterpret_cast<uintptr_t>(str) & 15;
+		auto* ptr = reinterpret_cast<const __m128i*>(str - offset);
+		auto zero = _mm_setzero_si128();
+
+		uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(ptr), zero)) >> offset;
+		if (mask) {
+			return __builtin_ctz(mask);
+		}
+		while (true) {
+			++ptr;
+			mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(ptr), zero));
+			if (mask) {
+				return reinterpret_cast<const char*>(ptr) + __builtin_ctz(mask) - str;
+			}
+		}
+	}
+
+	[[gnu::target("avx2")]] size_t strlen_avx2(const char* str) {
+		auto offset = reinterpret_cast<uintptr_t>(str) & 31;
+		auto* ptr = reinterpret_cast<const __m256i*>(str - offset);
+		auto zero = _mm256_setzero_si256();
+
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(ptr), zero))) >> offset;
+		if (mask) {
+			return __builtin_ctz(mask);
+		}
+		while (true) {
+			++ptr;
+			mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(ptr), zero));
+			if (mask) {
+				return reinterpret_cast<const char*>(ptr) + __builtin_ctz(mask) - str;
+			}
+		}
+	}
+}
+
+size_t strlen(const char* str) {
+	if (get_features() & FEATURE_AVX2) {
+		return strlen_avx2(str);
+	}
+	return strlen_sse2(str);
+}
+
 void* memset(void* __restrict dest, int ch, size_t size) {
-	void* dest_copy = dest;
-	asm volatile("rep stosb" : "+D"(dest_copy), "+c"(size) : "a"(ch) : "flags", "memory");
+	auto* ptr = static_cast<unsigned char*>(dest);
+	uint64_t value = static_cast<unsigned char>(ch) * 0x0101010101010101;
+
+	if (size <= 16) {
+		set_small(ptr, value, size);
+		return dest;
+	}
+
+	auto vec = _mm_set1_epi64x(static_cast<long long>(value));
+	if (size <= 32) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), vec);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr + size - 16), vec);
+		return dest;
+	}
+	else if (size <= 64) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), vec);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr + 16), vec);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr + size - 32), vec);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr + size - 16), vec);
+		return dest;
+	}
+
+	auto features = get_features();
+	if (size >= NON_TEMPORAL_THRESHOLD) {
+		set_non_temporal(ptr, vec, size);
+	}
+	else if (size >= REP_THRESHOLD && (features & FEATURE_ERMS)) {
+		rep_stosb(ptr, ch, size);
+	}
+	else if (features & FEATURE_AVX2) {
+		set_avx2(ptr, ch, size);
+	}
+	else {
+		set_sse2(ptr, vec, size);
+	}
 	return dest;
 }
 
@@ -19,103 +400,159 @@ void* memcpy(void* __restrict dest, const void* __restrict src, size_t size) {
 	auto* dest_ptr = static_cast<unsigned char*>(dest);
 	auto* src_ptr = static_cast<const unsigned char*>(src);
 
-	if (reinterpret_cast<uintptr_t>(dest_ptr) % 8 != reinterpret_cast<uintptr_t>(src_ptr) % 8) {
-		goto slow;
-	}
-	else if (size < 16) {
-		goto fast_8;
-	}
-
-	while (reinterpret_cast<uintptr_t>(dest_ptr) % 8 ||
-		   reinterpret_cast<uintptr_t>(src_ptr) % 8) {
-		*dest_ptr++ = *src_ptr++;
-		--size;
-	}
-
-	for (; size >= 64; size -= 64) {
-		auto value0 = *reinterpret_cast<const uint64_t*>(src_ptr);
-		auto value1 = *reinterpret_cast<const uint64_t*>(src_ptr + 8);
-		auto value2 = *reinterpret_cast<const uint64_t*>(src_ptr + 16);
-		auto value3 = *reinterpret_cast<const uint64_t*>(src_ptr + 24);
-		auto value4 = *reinterpret_cast<const uint64_t*>(src_ptr + 32);
-		auto value5 = *reinterpret_cast<const uint64_t*>(src_ptr + 40);
-		auto value6 = *reinterpret_cast<const uint64_t*>(src_ptr + 48);
-		auto value7 = *reinterpret_cast<const uint64_t*>(src_ptr + 56);
-		asm volatile(
-			"movnti %0, %1;"
-			"movnti %2, %3;"
-			"movnti %4, %5;"
-			"movnti %6, %7;"
-
-			"movnti %8, %9;"
-			"movnti %10, %11;"
-			"movnti %12, %13;"
-			"movnti %14, %15" : :
-			"r"(value0), "m"(*dest_ptr),
-			"r"(value1), "m"(*(dest_ptr + 8)),
-			"r"(value2), "m"(*(dest_ptr + 16)),
-			"r"(value3), "m"(*(dest_ptr + 24)),
-
-			"r"(value4), "m"(*(dest_ptr + 32)),
-			"r"(value5), "m"(*(dest_ptr + 40)),
-			"r"(value6), "m"(*(dest_ptr + 48)),
-			"r"(value7), "m"(*(dest_ptr + 56)));
-		src_ptr += 64;
-		dest_ptr += 64;
+	if (size <= 16) {
+		copy_small(dest_ptr, src_ptr, size);
+		return dest;
 	}
-
-	for (; size >= 32; size -= 32) {
-		auto value0 = *reinterpret_cast<const uint64_t*>(src_ptr);
-		auto value1 = *reinterpret_cast<const uint64_t*>(src_ptr + 8);
-		auto value2 = *reinterpret_cast<const uint64_t*>(src_ptr + 16);
-		auto value3 = *reinterpret_cast<const uint64_t*>(src_ptr + 24);
-		asm volatile(
-			"movnti %0, %1;"
-			"movnti %2, %3;"
-			"movnti %4, %5;"
-			"movnti %6, %7;" : :
-			"r"(value0), "m"(*dest_ptr),
-			"r"(value1), "m"(*(dest_ptr + 8)),
-			"r"(value2), "m"(*(dest_ptr + 16)),
-			"r"(value3), "m"(*(dest_ptr + 24)));
-		src_ptr += 32;
-		dest_ptr += 32;
+	else if (size <= 32) {
+		auto first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src_ptr));
+		auto last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src_ptr + size - 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest_ptr), first);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest_ptr + size - 16), last);
+		return dest;
 	}
-
-fast_8:
-	for (; size >= 8; size -= 8) {
-		auto value0 = *reinterpret_cast<const uint64_t*>(src_ptr);
-		asm volatile(
-			"movnti %0, %1;": :
-			"r"(value0), "m"(*dest_ptr));
-		src_ptr += 8;
-		dest_ptr += 8;
+	else if (size <= 64) {
+		auto value0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src_ptr));
+		auto value1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src_ptr + 16));
+		auto value2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src_ptr + size - 32));
+		auto value3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src_ptr + size - 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest_ptr), value0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest_ptr + 16), value1);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest_ptr + size - 32), value2);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest_ptr + size - 16), value3);
+		return dest;
 	}
 
-slow:
-	for (; size; --size) {
-		*dest_ptr++ = *src_ptr++;
+	auto features = get_features();
+	if (size >= NON_TEMPORAL_THRESHOLD) {
+		copy_non_temporal(dest_ptr, src_ptr, size);
+	}
+	else if (size >= REP_THRESHOLD && (features & FEATURE_ERMS)) {
+		rep_movsb(dest_ptr, src_ptr, size);
+	}
+	else if (features & FEATURE_AVX2) {
+		copy_avx2(dest_ptr, src_ptr, size);
+	}
+	else {
+		copy_sse2(dest_ptr, src_ptr, size);
 	}
-
 	return dest;
 }
 
-#else
+#elif defined(__aarch64__)
+
+size_t strlen(const char* str) {
+	// aligned loads never cross into the next page, so reading before and past the string is fine
+	auto offset = reinterpret_cast<uintptr_t>(str) & 15;
+	auto* ptr = reinterpret_cast<const uint8_t*>(str - offset);
+
+	// narrowing the comparison leaves four bits per byte in a 64 bit mask
+	auto zero_mask = [](const uint8_t* block) {
+		auto cmp = vceqzq_u8(vld1q_u8(block));
+		return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4)), 0);
+	};
+
+	uint64_t mask = zero_mask(ptr) >> (offset * 4);
+	if (mask) {
+		return __builtin_ctzll(mask) / 4;
+	}
+	while (true) {
+		ptr += 16;
+		mask = zero_mask(ptr);
+		if (mask) {
+			return reinterpret_cast<const char*>(ptr) + __builtin_ctzll(mask) / 4 - str;
+		}
+	}
+}
 
 void* memset(void* dest, int ch, size_t size) {
 	auto* ptr = static_cast<unsigned char*>(dest);
-	for (; size; --size) {
-		*ptr++ = static_cast<unsigned char>(ch);
+	uint64_t value = static_cast<unsigned char>(ch) * 0x0101010101010101;
+
+	if (size <= 16) {
+		set_small(ptr, value, size);
+		return dest;
+	}
+
+	auto vec = vdupq_n_u8(static_cast<uint8_t>(ch));
+	auto* end = ptr + size;
+	if (size <= 32) {
+		vst1q_u8(ptr, vec);
+		vst1q_u8(end - 16, vec);
+		return dest;
 	}
+	else if (size <= 64) {
+		vst1q_u8(ptr, vec);
+		vst1q_u8(ptr + 16, vec);
+		vst1q_u8(end - 32, vec);
+		vst1q_u8(end - 16, vec);
+		return dest;
+	}
+
+	for (; size > 64; size -= 64) {
+		vst1q_u8(ptr, vec);
+		vst1q_u8(ptr + 16, vec);
+		vst1q_u8(ptr + 32, vec);
+		vst1q_u8(ptr + 48, vec);
+		ptr += 64;
+	}
+	vst1q_u8(end - 64, vec);
+	vst1q_u8(end - 48, vec);
+	vst1q_u8(end - 32, vec);
+	vst1q_u8(end - 16, vec);
 	return dest;
 }
 
 void* memcpy(void* dest, const void* src, size_t size) {
 	auto* dest_ptr = static_cast<unsigned char*>(dest);
 	auto* src_ptr = static_cast<const unsigned char*>(src);
-	for (; size; --size) {
-		*dest_ptr++ = *src_ptr++;
+
+	if (size <= 16) {
+		copy_small(dest_ptr, src_ptr, size);
+		return dest;
+	}
+	else if (size <= 32) {
+		auto first = vld1q_u8(src_ptr);
+		auto last = vld1q_u8(src_ptr + size - 16);
+		vst1q_u8(dest_ptr, first);
+		vst1q_u8(dest_ptr + size - 16, last);
+		return dest;
+	}
+	else if (size <= 64) {
+		auto value0 = vld1q_u8(src_ptr);
+		auto value1 = vld1q_u8(src_ptr + 16);
+		auto value2 = vld1q_u8(src_ptr + size - 32);
+		auto value3 = vld1q_u8(src_ptr + size - 16);
+		vst1q_u8(dest_ptr, value0);
+		vst1q_u8(dest_ptr + 16, value1);
+		vst1q_u8(dest_ptr + size - 32, value2);
+		vst1q_u8(dest_ptr + size - 16, value3);
+		return dest;
 	}
+
+	auto tail0 = vld1q_u8(src_ptr + size - 64);
+	auto tail1 = vld1q_u8(src_ptr + size - 48);
+	auto tail2 = vld1q_u8(src_ptr + size - 32);
+	auto tail3 = vld1q_u8(src_ptr + size - 16);
+	auto* end = dest_ptr + size;
+
+	for (; size > 64; size -= 64) {
+		auto value0 = vld1q_u8(src_ptr);
+		auto value1 = vld1q_u8(src_ptr + 16);
+		auto value2 = vld1q_u8(src_ptr + 32);
+		auto value3 = vld1q_u8(src_ptr + 48);
+		vst1q_u8(dest_ptr, value0);
+		vst1q_u8(dest_ptr + 16, value1);
+		vst1q_u8(dest_ptr + 32, value2);
+		vst1q_u8(dest_ptr + 48, value3);
+		src_ptr += 64;
+		dest_ptr += 64;
+	}
+
+	vst1q_u8(end - 64, tail0);
+	vst1q_u8(end - 48, tail1);
+	vst1q_u8(end - 32, tail2);
+	vst1q_u8(end - 16, tail3);
 	return dest;
 }
 
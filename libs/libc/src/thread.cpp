@@ -0,0 +1,57 @@
+#include "thread.h"
+#include "thread.hpp"
+#include "stdlib.h"
+#include "sys.hpp"
+
+namespace {
+	constinit ThreadControlBlock MAIN_TCB {};
+
+	struct ThreadStart {
+		void (*fn)(void* arg);
+		void* arg;
+	};
+
+	void install_tcb(ThreadControlBlock* tcb) {
+		tcb->self = tcb;
+#ifdef __x86_64__
+		sys_set_fs_base(reinterpret_cast<uintptr_t>(tcb));
+#elif defined(__aarch64__)
+		asm volatile("msr tpidr_el0, %0" : : "r"(tcb));
+#endif
+	}
+
+	[[noreturn]] void thread_entry(void* arg) {
+		// this frame stays until the thread exits, so the block can live in it
+		ThreadControlBlock tcb {};
+		install_tcb(&tcb);
+
+		auto start = *static_cast<ThreadStart*>(arg);
+		free(arg);
+		start.fn(start.arg);
+		thread_exit(0);
+	}
+}
+
+__attribute__((constructor)) static void install_main_tcb() {
+	install_tcb(&MAIN_TCB);
+}
+
+int thread_create(CrescentHandle* handle, const char* name, size_t name_len, void (*fn)(void* arg), void* arg) {
+	auto* start = static_cast<ThreadStart*>(malloc(sizeof(ThreadStart)));
+	if (!start) {
+		return ERR_NO_MEM;
+	}
+	start->fn = fn;
+	start->arg = arg;
+
+	auto status = sys_thread_create(handle, name, name_len, thread_entry, start);
+	if (status != 0) {
+		free(start);
+	}
+	return status;
+}
+
+void thread_exit(int status) {
+	malloc_thread_exit();
+	sys_thread_exit(status);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+/// Per-thread state owned by libc, the thread pointer (fs base on x86, tpidr_el0 on aarch64)
+/// points to it. The layout leaves room for tls to be added later, x86 puts the tls blocks
+/// below the block and finds it through `self`, aarch64 puts them 16 bytes after it.
+struct ThreadControlBlock {
+	ThreadControlBlock* self;
+	/// Set by malloc the first time the thread allocates something.
+	void* malloc_cache;
+};
+
+static_assert(sizeof(ThreadControlBlock) == 16);
+
+inline ThreadControlBlock* get_tcb() {
+	ThreadControlBlock* tcb;
+#ifdef __x86_64__
+	asm("mov %%fs:0, %0" : "=r"(tcb));
+#elif defined(__aarch64__)
+	asm("mrs %0, tpidr_el0" : "=r"(tcb));
+#else
+	tcb = nullptr;
+#endif
+	return tcb;
+}
+
+/// Returns the malloc cache of the calling thread to the central lists.
+void malloc_thread_exit();
@@ -1,7 +1,10 @@
 #pragma once
 #include <string_view>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <unordered_map>
 #include <vector>
 
 namespace libtext {
@@ -15,16 +18,56 @@ namespace libtext {
 		}
 	};
 
+	struct Font;
+
 	struct Context {
+		/// Fonts are mapped read-only and shared between every context using the same path.
 		static std::optional<Context> create(std::string_view font_path = "");
 
 		std::optional<Bitmap> rasterize_glyph(uint32_t codepoint, uint32_t width, uint32_t height, uint32_t fg, uint32_t bg);
 
+		/// Writes glyph_width() * glyph_height() coverage values into `coverage`,
+		/// rows are `stride` bytes apart. Returns false if the codepoint is not in the font.
+		bool rasterize_coverage(uint32_t codepoint, uint8_t* coverage, uint32_t stride) const;
+
+		[[nodiscard]] uint32_t glyph_width() const;
+		[[nodiscard]] uint32_t glyph_height() const;
+
 	private:
-		constexpr explicit Context(std::vector<uint8_t> font, std::vector<uint16_t> glyph_mappings)
-			: font {std::move(font)}, glyph_mappings {std::move(glyph_mappings)} {}
+		explicit Context(std::shared_ptr<const Font> font) : font {std::move(font)} {}
+
+		[[nodiscard]] const uint8_t* get_glyph_data(uint32_t codepoint) const;
+
+		std::shared_ptr<const Font> font;
+	};
+
+	/// Process-wide cache of rasterized glyph coverage. Glyphs are stored once
+	/// regardless of colour, the colour is applied by the consumer when blitting.
+	class GlyphAtlas {
+	public:
+		static GlyphAtlas& get();
+
+		/// Returns glyph_width * glyph_height coverage values (either 0 or 255) for the codepoint,
+		/// the pointer stays valid for the lifetime of the atlas. `lock` must be held.
+		const uint8_t* lookup(uint32_t codepoint);
+
+		std::mutex lock;
+		const uint32_t glyph_width;
+		const uint32_t glyph_height;
+
+	private:
+		static constexpr uint32_t GLYPHS_PER_PAGE = 256;
+
+		explicit GlyphAtlas(Context ctx);
+
+		uint8_t* alloc_slot();
+		const uint8_t* bake(uint32_t codepoint);
 
-		std::vector<uint8_t> font;
-		std::vector<uint16_t> glyph_mappings;
+		Context ctx;
+		std::vector<std::unique_ptr<uint8_t[]>> pages;
+		std::unordered_map<uint32_t, const uint8_t*> glyphs;
+		const uint8_t* ascii[128] {};
+		const uint8_t* fallback {};
+		uint32_t page_used {GLYPHS_PER_PAGE};
 	};
 }
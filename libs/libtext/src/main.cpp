@@ -1,6 +1,8 @@
 #include "libtext/libtext.hpp"
 #include "sys.h"
+#include <algorithm>
 #include <cassert>
+#include <string>
 
 using namespace libtext;
 
@@ -15,108 +17,251 @@ struct Psf2Header {
 	uint32_t width;
 };
 
-std::optional<Context> Context::create(std::string_view font_path) {
-	if (font_path.empty()) {
-		font_path = "/usr/crescent/Tamsyn8x16r.psf";
+static constexpr uint32_t PSF2_MAGIC = 0x864AB572;
+static constexpr uint32_t PSF2_HAS_UNICODE_TABLE = 1;
+static constexpr uint16_t NO_GLYPH = UINT16_MAX;
+
+struct UnicodeMapping {
+	uint32_t codepoint;
+	uint16_t glyph;
+};
+
+namespace libtext {
+	struct Font {
+		~Font() {
+			if (mapped) {
+				auto status = sys_unmap(const_cast<uint8_t*>(data), size);
+				assert(status == 0);
+			}
+		}
+
+		[[nodiscard]] const Psf2Header* hdr() const {
+			return std::launder(reinterpret_cast<const Psf2Header*>(data));
+		}
+
+		[[nodiscard]] uint16_t get_glyph(uint32_t codepoint) const {
+			if (!has_unicode_table) {
+				return codepoint < hdr()->num_glyph ? codepoint : NO_GLYPH;
+			}
+			else if (codepoint < 128) {
+				return ascii[codepoint];
+			}
+
+			auto iter = std::lower_bound(
+				unicode.begin(),
+				unicode.end(),
+				codepoint,
+				[](const UnicodeMapping& mapping, uint32_t codepoint) {
+					return mapping.codepoint < codepoint;
+				});
+			if (iter == unicode.end() || iter->codepoint != codepoint) {
+				return NO_GLYPH;
+			}
+			return iter->glyph;
+		}
+
+		std::string path;
+		const uint8_t* data {};
+		size_t size {};
+		bool mapped {};
+		// only used if the file isn't resident in memory and can't be mapped
+		std::vector<uint8_t> storage;
+
+		bool has_unicode_table {};
+		uint16_t ascii[128] {};
+		// codepoints >= 128 sorted by codepoint
+		std::vector<UnicodeMapping> unicode;
+	};
+}
+
+static void parse_unicode_table(Font& font) {
+	auto* hdr = font.hdr();
+	auto* data = font.data;
+
+	for (auto& glyph : font.ascii) {
+		glyph = NO_GLYPH;
+	}
+
+	uint16_t glyph = 0;
+	for (size_t i = hdr->header_size + hdr->num_glyph * hdr->bytes_per_glyph; i < font.size; ++i) {
+		auto byte = data[i];
+
+		uint32_t cp;
+
+		if (byte == 0xFF) {
+			++glyph;
+			continue;
+		}
+		else if (byte == 0xFE) {
+			// multi-codepoint sequences aren't supported, skip to the next glyph
+			while (i + 1 < font.size && data[i + 1] != 0xFF) {
+				++i;
+			}
+			continue;
+		}
+		else if (byte & 1 << 7) {
+			if ((byte & 0b11100000) == 0b11000000) {
+				assert(i + 1 < font.size);
+				auto second = data[i + 1];
+				++i;
+				assert((second & 0b11000000) == 0b10000000);
+				cp = (second & 0x3F) | (byte & 0b11111) << 6;
+			}
+			else if ((byte & 0b11110000) == 0b11100000) {
+				assert(i + 2 < font.size);
+				auto second = data[i + 1];
+				auto third = data[i + 2];
+				i += 2;
+				assert((second & 0b11000000) == 0b10000000);
+				assert((third & 0b11000000) == 0b10000000);
+				cp = (third & 0x3F) | (second & 0x3F) << 6 | (byte & 0b1111) << 12;
+			}
+			else {
+				assert((byte & 0b11111000) == 0b11110000);
+				assert(i + 3 < font.size);
+				auto second = data[i + 1];
+				auto third = data[i + 2];
+				auto fourth = data[i + 3];
+				i += 3;
+				assert((second & 0b11000000) == 0b10000000);
+				assert((third & 0b11000000) == 0b10000000);
+				assert((fourth & 0b11000000) == 0b10000000);
+				cp =
+					(fourth & 0x3F) |
+					(third & 0x3F) << 6 |
+					(second & 0x3F) << 12 |
+					(byte & 0b111) << 18;
+			}
+		}
+		else {
+			cp = byte;
+		}
+
+		if (cp < 128) {
+			if (font.ascii[cp] == NO_GLYPH) {
+				font.ascii[cp] = glyph;
+			}
+		}
+		else {
+			font.unicode.push_back({.codepoint = cp, .glyph = glyph});
+		}
 	}
 
+	std::stable_sort(font.unicode.begin(), font.unicode.end(), [](const UnicodeMapping& a, const UnicodeMapping& b) {
+		return a.codepoint < b.codepoint;
+	});
+	auto last = std::unique(font.unicode.begin(), font.unicode.end(), [](const UnicodeMapping& a, const UnicodeMapping& b) {
+		return a.codepoint == b.codepoint;
+	});
+	font.unicode.erase(last, font.unicode.end());
+	font.unicode.shrink_to_fit();
+	font.has_unicode_table = true;
+}
+
+static std::shared_ptr<const Font> load_font(std::string_view font_path) {
 	CrescentHandle handle;
 	if (sys_open(&handle, font_path.data(), font_path.size(), 0) != 0) {
 		assert(!"failed to open /usr/crescent/Tamsyn8x16r.psf");
-		return std::nullopt;
+		return nullptr;
 	}
 
 	CrescentStat stat {};
-	if (sys_stat(handle, &stat) != 0) {
+	if (sys_stat(handle, &stat) != 0 || stat.size < sizeof(Psf2Header)) {
 		auto status = sys_close_handle(handle);
 		assert(status == 0);
-		return std::nullopt;
+		return nullptr;
 	}
 
-	std::vector<uint8_t> data;
-	data.resize(stat.size);
-	auto status = sys_read(handle, data.data(), data.size(), nullptr);
-	assert(status == 0);
-	status = sys_close_handle(handle);
+	auto font = std::make_shared<Font>();
+	font->path = font_path;
+	font->size = stat.size;
+
+	const void* mapping;
+	if (sys_map_file(handle, 0, stat.size, &mapping) == 0) {
+		font->data = static_cast<const uint8_t*>(mapping);
+		font->mapped = true;
+	}
+	else {
+		font->storage.resize(stat.size);
+		auto status = sys_read(handle, font->storage.data(), font->storage.size(), nullptr);
+		assert(status == 0);
+		font->data = font->storage.data();
+	}
+
+	auto status = sys_close_handle(handle);
 	assert(status == 0);
 
-	auto* hdr = std::launder(reinterpret_cast<Psf2Header*>(data.data()));
+	auto* hdr = font->hdr();
+	if (hdr->magic != PSF2_MAGIC ||
+		hdr->header_size + size_t {hdr->num_glyph} * hdr->bytes_per_glyph > font->size) {
+		return nullptr;
+	}
 
-	std::vector<uint16_t> glyph_mappings;
+	if (hdr->flags & PSF2_HAS_UNICODE_TABLE) {
+		parse_unicode_table(*font);
+	}
 
-	if (hdr->flags) {
-		glyph_mappings.resize(UINT16_MAX);
-		uint16_t glyph = 0;
-		for (size_t i = hdr->header_size + hdr->num_glyph * hdr->bytes_per_glyph; i < stat.size; ++i) {
-			auto byte = data[i];
+	return font;
+}
 
-			uint32_t cp;
+namespace {
+	std::mutex FONTS_LOCK;
+	std::vector<std::weak_ptr<const Font>> FONTS;
+}
 
-			if (byte == 0xFF) {
-				++glyph;
-				continue;
-			}
-			else if (byte & 1 << 7) {
-				if ((byte & 0b11100000) == 0b11000000) {
-					assert(i + 1 < stat.size);
-					auto second = data[i + 1];
-					++i;
-					assert((second & 0b11000000) == 0b10000000);
-					cp = (second & 0x3F) | (byte & 0b11111) << 6;
-				}
-				else if ((byte & 0b11110000) == 0b11100000) {
-					assert(i + 2 < stat.size);
-					auto second = data[i + 1];
-					auto third = data[i + 2];
-					i += 2;
-					assert((second & 0b11000000) == 0b10000000);
-					assert((third & 0b11000000) == 0b10000000);
-					cp = (third & 0x3F) | (second & 0x3F) << 6 | (byte & 0b1111) << 12;
-				}
-				else {
-					assert((byte & 0b11111000) == 0b11110000);
-					assert(i + 3 < stat.size);
-					auto second = data[i + 1];
-					auto third = data[i + 2];
-					auto fourth = data[i + 2];
-					i += 3;
-					assert((second & 0b11000000) == 0b10000000);
-					assert((third & 0b11000000) == 0b10000000);
-					assert((fourth & 0b11000000) == 0b10000000);
-					cp =
-						(fourth & 0x3F) |
-						(third & 0x3F) << 6 |
-						(second & 0x3F) << 12 |
-						(byte & 0b111) << 18;
-				}
-			}
-			else {
-				cp = byte;
-			}
+std::optional<Context> Context::create(std::string_view font_path) {
+	if (font_path.empty()) {
+		font_path = "/usr/crescent/Tamsyn8x16r.psf";
+	}
+
+	std::unique_lock guard {FONTS_LOCK};
+
+	for (size_t i = 0; i < FONTS.size();) {
+		auto font = FONTS[i].lock();
+		if (!font) {
+			FONTS.erase(FONTS.begin() + static_cast<ptrdiff_t>(i));
+			continue;
+		}
 
-			assert(cp < UINT16_MAX);
-			glyph_mappings[cp] = glyph;
+		if (font->path == font_path) {
+			return Context {std::move(font)};
 		}
+		++i;
 	}
 
-	return Context {std::move(data), std::move(glyph_mappings)};
+	auto font = load_font(font_path);
+	if (!font) {
+		return std::nullopt;
+	}
+	FONTS.push_back(font);
+	return Context {std::move(font)};
 }
 
-std::optional<Bitmap> Context::rasterize_glyph(uint32_t codepoint, uint32_t width, uint32_t height, uint32_t fg, uint32_t bg) {
-	assert(!font.empty());
+const uint8_t* Context::get_glyph_data(uint32_t codepoint) const {
+	assert(font);
 
-	auto* hdr = std::launder(reinterpret_cast<Psf2Header*>(font.data()));
-	assert(hdr);
+	auto* hdr = font->hdr();
 
-	uint16_t glyph = 0;
-	if (!glyph_mappings.empty()) {
-		assert(codepoint < glyph_mappings.size());
-		glyph = glyph_mappings[codepoint];
-	}
-	else {
-		assert(codepoint < UINT16_MAX);
-		glyph = codepoint;
+	auto glyph = font->get_glyph(codepoint);
+	if (glyph == NO_GLYPH || glyph >= hdr->num_glyph) {
+		return nullptr;
 	}
+	return font->data + hdr->header_size + glyph * hdr->bytes_per_glyph;
+}
+
+uint32_t Context::glyph_width() const {
+	return font->hdr()->width;
+}
+
+uint32_t Context::glyph_height() const {
+	return font->hdr()->height;
+}
+
+std::optional<Bitmap> Context::rasterize_glyph(uint32_t codepoint, uint32_t width, uint32_t height, uint32_t fg, uint32_t bg) {
+	auto* hdr = font->hdr();
+
+	auto* glyph_data = get_glyph_data(codepoint);
+	assert(glyph_data);
 
 	uint32_t bytes_per_line = (hdr->width + 7) / 8;
 
@@ -125,8 +270,6 @@ std::optional<Bitmap> Context::rasterize_glyph(uint32_t codepoint, uint32_t widt
 	bitmap.height = height;
 	bitmap.pixels.resize(width * height);
 
-	assert(glyph < hdr->num_glyph);
-	auto* glyph_data = font.data() + hdr->header_size + glyph * hdr->bytes_per_glyph;
 	for (uint32_t y = 0; y < hdr->height; ++y) {
 		for (uint32_t x = 0; x < hdr->width; ++x) {
 			uint32_t shift = hdr->width - 1 - x;
@@ -139,3 +282,90 @@ std::optional<Bitmap> Context::rasterize_glyph(uint32_t codepoint, uint32_t widt
 
 	return bitmap;
 }
+
+bool Context::rasterize_coverage(uint32_t codepoint, uint8_t* coverage, uint32_t stride) const {
+	auto* hdr = font->hdr();
+
+	auto* glyph_data = get_glyph_data(codepoint);
+	if (!glyph_data) {
+		return false;
+	}
+
+	uint32_t bytes_per_line = (hdr->width + 7) / 8;
+
+	for (uint32_t y = 0; y < hdr->height; ++y) {
+		for (uint32_t x = 0; x < hdr->width; ++x) {
+			uint32_t shift = hdr->width - 1 - x;
+			coverage[x] = (glyph_data[shift / 8] & (1 << (shift % 8))) ? 0xFF : 0;
+		}
+
+		glyph_data += bytes_per_line;
+		coverage += stride;
+	}
+
+	return true;
+}
+
+GlyphAtlas& GlyphAtlas::get() {
+	static GlyphAtlas ATLAS {Context::create().value()};
+	return ATLAS;
+}
+
+GlyphAtlas::GlyphAtlas(Context ctx)
+	: glyph_width {ctx.glyph_width()}, glyph_height {ctx.glyph_height()}, ctx {std::move(ctx)} {
+	// bake printable ascii up front, it covers nearly everything drawn
+	for (uint32_t c = 0x20; c < 0x7F; ++c) {
+		ascii[c] = bake(c);
+	}
+
+	// missing glyphs are drawn as '?', or left empty if the font doesn't have that either
+	fallback = ascii['?'];
+	if (!fallback) {
+		fallback = alloc_slot();
+	}
+}
+
+/// Returns a zeroed slot for one glyph.
+uint8_t* GlyphAtlas::alloc_slot() {
+	uint32_t glyph_size = glyph_width * glyph_height;
+
+	if (page_used == GLYPHS_PER_PAGE) {
+		pages.push_back(std::make_unique<uint8_t[]>(GLYPHS_PER_PAGE * glyph_size));
+		page_used = 0;
+	}
+
+	return pages.back().get() + page_used++ * glyph_size;
+}
+
+const uint8_t* GlyphAtlas::bake(uint32_t codepoint) {
+	auto* coverage = alloc_slot();
+	if (!ctx.rasterize_coverage(codepoint, coverage, glyph_width)) {
+		// nothing was written, the slot is still zeroed for the next glyph
+		--page_used;
+		return nullptr;
+	}
+	return coverage;
+}
+
+const uint8_t* GlyphAtlas::lookup(uint32_t codepoint) {
+	if (codepoint < 128 && ascii[codepoint]) {
+		return ascii[codepoint];
+	}
+
+	if (auto iter = glyphs.find(codepoint); iter != glyphs.end()) {
+		return iter->second;
+	}
+
+	auto* coverage = bake(codepoint);
+	if (!coverage) {
+		coverage = fallback;
+	}
+
+	if (codepoint < 128) {
+		ascii[codepoint] = coverage;
+	}
+	else {
+		glyphs.insert({codepoint, coverage});
+	}
+	return coverage;
+}
@@ -1,8 +1,10 @@
 #pragma once
 #include <cstdint>
+#include <string_view>
 #include <vector>
 #include <cassert>
 #include "primitive.hpp"
+#include "region.hpp"
 
 namespace ui {
 	struct Context {
@@ -12,10 +14,10 @@ namespace ui {
 		uint32_t height {};
 		uint32_t x_off {};
 		uint32_t y_off {};
-		std::vector<Rect> dirty_rects {};
-
-		void add_clip_rect(const Rect& rect);
-		void clear_clip_rects();
+		/// Screen area that has to be redrawn on the next frame.
+		Region dirty {};
+		/// Screen area the draw functions are allowed to touch.
+		Region clip {};
 
 		void draw_filled_rect(const Rect& rect, uint32_t color) const;
 		void draw_bitmap(
@@ -25,8 +27,10 @@ namespace ui {
 			uint32_t width,
 			uint32_t height) const;
 		void draw_rect_outline(const Rect& rect, uint32_t color, uint32_t thickness) const;
-
-		std::vector<Rect> clip_rects {};
-		std::vector<Rect> subtract_rects {};
+		/// Draws a single line of text using the shared glyph atlas,
+		/// the glyph coverage is blended with the existing contents using `color`.
+		void draw_text(std::string_view text, uint32_t x, uint32_t y, uint32_t color) const;
+		/// Same as above but every glyph cell is filled, uncovered pixels get `bg`.
+		void draw_text(std::string_view text, uint32_t x, uint32_t y, uint32_t fg, uint32_t bg) const;
 	};
 }
@@ -1,12 +1,16 @@
 #pragma once
 #include "window.hpp"
 #include "mouse.hpp"
+#include "worker_pool.hpp"
 
 namespace ui {
 	struct Gui {
 		explicit Gui(Context& ctx, uint32_t width, uint32_t height);
 
+		/// Composites the dirty region and moves the cursor overlay,
+		/// afterwards `frame_damage` holds every pixel that was written.
 		void draw();
+		[[nodiscard]] bool needs_redraw() const;
 		void handle_mouse(MouseState new_state);
 		void handle_keyboard(KeyState new_state);
 
@@ -21,5 +25,27 @@ namespace ui {
 		Window* last_mouse_over {};
 		bool key_states[SCANCODE_MAX] {};
 		bool draw_cursor {true};
+		Region frame_damage {};
+		/// If set, large redraws are split into tiles that are composited in parallel.
+		WorkerPool* pool {};
+
+	private:
+		static constexpr uint32_t CURSOR_SIZE = 10;
+		static constexpr uint32_t TILE_SIZE = 128;
+		/// Redraws smaller than this many pixels aren't worth waking up the workers for.
+		static constexpr uint64_t PARALLEL_MIN_PIXELS = 4 * TILE_SIZE * TILE_SIZE;
+
+		void composite(const Region& clip) const;
+		void composite_tiles();
+
+		[[nodiscard]] Rect get_cursor_rect() const;
+		void hide_cursor();
+		void show_cursor(const Rect& rect);
+
+		/// The framebuffer contents under the cursor, the cursor is drawn on top of the
+		/// composited frame and only these pixels are restored when it moves.
+		uint32_t cursor_save_under[CURSOR_SIZE * CURSOR_SIZE] {};
+		/// Where the cursor currently is in the framebuffer, empty if it isn't drawn.
+		Rect cursor_drawn_rect {};
 	};
 }
@@ -0,0 +1,83 @@
+#pragma once
+#include "primitive.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace ui {
+	/// A set of pixels stored as y-x banded rectangles. The rects are sorted by y and then by x,
+	/// rects with the same y form a band and share the same height, bands never overlap vertically
+	/// and rects within a band never overlap or touch. All set operations are a single linear merge
+	/// of the bands of both operands.
+	class Region {
+	public:
+		constexpr Region() = default;
+		explicit Region(const Rect& rect);
+
+		void add(const Rect& rect);
+		void add(const Region& other);
+		void subtract(const Rect& rect);
+		void subtract(const Region& other);
+		void intersect(const Rect& rect);
+		void intersect(const Region& other);
+
+		void clear() {
+			rects.clear();
+			extents = {};
+		}
+
+		[[nodiscard]] bool is_empty() const {
+			return rects.empty();
+		}
+
+		[[nodiscard]] bool intersects(const Rect& rect) const;
+
+		[[nodiscard]] const Rect& get_extents() const {
+			return extents;
+		}
+
+		[[nodiscard]] const std::vector<Rect>& get_rects() const {
+			return rects;
+		}
+
+		[[nodiscard]] auto begin() const {
+			return rects.begin();
+		}
+
+		[[nodiscard]] auto end() const {
+			return rects.end();
+		}
+
+		/// Calls `fn` with every rect of the region that intersects `rect`,
+		/// bands above `rect` are skipped with a binary search.
+		template<typename F>
+		void for_each_intersecting(const Rect& rect, F fn) const {
+			if (rects.empty() || !rect.width || !rect.height || !extents.intersects(rect)) {
+				return;
+			}
+
+			auto iter = std::partition_point(rects.begin(), rects.end(), [&](const Rect& band_rect) {
+				return band_rect.y + band_rect.height <= rect.y;
+			});
+
+			auto bottom = rect.y + rect.height;
+			for (; iter != rects.end() && iter->y < bottom; ++iter) {
+				if (iter->intersects(rect)) {
+					fn(*iter);
+				}
+			}
+		}
+
+	private:
+		enum class Op {
+			Union,
+			Intersect,
+			Subtract
+		};
+
+		void apply(const Region& other, Op op);
+		void update_extents();
+
+		std::vector<Rect> rects;
+		Rect extents {};
+	};
+}
@@ -1,8 +1,6 @@
 #pragma once
 #include "window.hpp"
-#include "libtext/libtext.hpp"
 #include <string>
-#include <unordered_map>
 
 namespace ui {
 	struct TextWindow : public Window {
@@ -24,9 +22,5 @@ namespace ui {
 
 		uint32_t text_color = 0xFFFFFF;
 		std::string text;
-
-	private:
-		libtext::Context text_ctx;
-		std::unordered_map<uint32_t, libtext::Bitmap> glyph_cache {};
 	};
 }
@@ -25,7 +25,9 @@ namespace ui {
 			return false;
 		}
 
-		void draw_generic(Context& ctx, std::vector<Rect> parent_clip_rects);
+		/// Draws the window and its children, `clip` is the part of the screen
+		/// that needs redrawing and isn't covered by anything above this window.
+		void draw_generic(Context& ctx, const Region& clip);
 
 		void add_child(std::unique_ptr<Window> child);
 
@@ -75,6 +77,16 @@ namespace ui {
 			};
 		}
 
+		/// Same as get_abs_rect but includes the titlebar and borders.
+		[[nodiscard]] constexpr Rect get_abs_outer_rect() const {
+			auto abs_rect = get_abs_rect();
+			if (!no_decorations) {
+				abs_rect.width += border.left + border.right;
+				abs_rect.height += titlebar->rect.height + border.bottom;
+			}
+			return abs_rect;
+		}
+
 		Window* parent {};
 		Window* active_child {};
 		std::vector<std::unique_ptr<Window>> children;
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+
+namespace ui {
+	/// A fixed set of threads splitting numbered jobs between them,
+	/// the thread calling run() takes part in the work as well.
+	class WorkerPool {
+	public:
+		using Job = void (*)(void* arg, uint32_t index);
+
+		/// Creates `thread_count` threads in addition to the caller,
+		/// they live until the process exits.
+		explicit WorkerPool(uint32_t thread_count);
+
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		/// Calls `job` once for every index in [0, count) and returns after all of them are done.
+		void run(Job job, void* arg, uint32_t count);
+
+		/// Number of threads working on a run including the caller.
+		[[nodiscard]] uint32_t get_thread_count() const {
+			return thread_count + 1;
+		}
+
+	private:
+		static void worker_thread(void* arg);
+		void work();
+
+		std::mutex lock;
+		Job job {};
+		void* job_arg {};
+		uint32_t job_count {};
+		uint32_t next_job {};
+		/// Bumped for every run, idle workers sleep on it.
+		int generation {};
+		/// Jobs that have not finished yet, run() sleeps on it.
+		int pending {};
+		uint32_t thread_count {};
+	};
+}
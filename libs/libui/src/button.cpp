@@ -15,7 +15,7 @@ bool ButtonWindow::handle_mouse(Context& ctx, const MouseState&, const MouseStat
 	if (!prev_mouse_state && new_state.left_pressed) {
 		bg_color = active_color;
 		prev_mouse_state = true;
-		ctx.dirty_rects.push_back(get_abs_rect());
+		ctx.dirty.add(get_abs_rect());
 	}
 	else if (prev_mouse_state && !new_state.left_pressed) {
 		bg_color = inactive_color;
@@ -23,7 +23,7 @@ bool ButtonWindow::handle_mouse(Context& ctx, const MouseState&, const MouseStat
 		if (callback) {
 			callback(arg);
 		}
-		ctx.dirty_rects.push_back(get_abs_rect());
+		ctx.dirty.add(get_abs_rect());
 	}
 
 	return true;
@@ -33,6 +33,6 @@ void ButtonWindow::on_mouse_leave(Context& ctx, const MouseState& new_state) {
 	if (prev_mouse_state) {
 		bg_color = inactive_color;
 		prev_mouse_state = false;
-		ctx.dirty_rects.push_back(get_abs_rect());
+		ctx.dirty.add(get_abs_rect());
 	}
 }
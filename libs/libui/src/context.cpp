@@ -1,42 +1,29 @@
 #include "ui/context.hpp"
+#include "libtext/libtext.hpp"
 #include <algorithm>
-#include <cassert>
 #include <cstring>
+#include <mutex>
 
 using namespace ui;
 
 void Context::draw_filled_rect(const Rect& rect, uint32_t color) const {
-	auto rect_x = rect.x + x_off;
-	auto rect_y = rect.y + y_off;
-
-#ifndef NDEBUG
-	for (auto& clip_rect : clip_rects) {
-		for (auto& other : clip_rects) {
-			if (&clip_rect == &other) {
-				continue;
-			}
-			assert(!clip_rect.intersects(other));
-		}
-	}
-#endif
-
-	for (auto& clip_rect : clip_rects) {
-		if (rect_x + rect.width <= clip_rect.x || rect_y >= clip_rect.y + clip_rect.height) {
-			continue;
-		}
+	Rect abs_rect {
+		.x = rect.x + x_off,
+		.y = rect.y + y_off,
+		.width = rect.width,
+		.height = rect.height
+	};
 
-		auto start_x = std::max(rect_x, clip_rect.x);
-		auto res_width = std::min(rect_x + rect.width, clip_rect.x + clip_rect.width) - start_x;
-		auto start_y = std::max(rect_y, clip_rect.y);
-		auto res_height = std::min(rect_y + rect.height, clip_rect.y + clip_rect.height) - start_y;
+	clip.for_each_intersecting(abs_rect, [&](const Rect& clip_rect) {
+		auto clipped = abs_rect.intersect(clip_rect);
 
-		for (uint32_t y = start_y; y < start_y + res_height; ++y) {
-			for (uint32_t x = start_x; x < start_x + res_width; ++x) {
-				//assert(fb[y * pitch_32 + x] == 0xCFCFCFCF);
-				fb[y * pitch_32 + x] = color;
+		for (uint32_t y = clipped.y; y < clipped.y + clipped.height; ++y) {
+			uint32_t* __restrict dest = &fb[y * pitch_32 + clipped.x];
+			for (uint32_t x = 0; x < clipped.width; ++x) {
+				dest[x] = color;
 			}
 		}
-	}
+	});
 }
 
 void Context::draw_bitmap(const uint32_t* pixels, uint32_t x, uint32_t y, uint32_t bitmap_width, uint32_t bitmap_height) const {
@@ -47,11 +34,7 @@ void Context::draw_bitmap(const uint32_t* pixels, uint32_t x, uint32_t y, uint32
 		.height = bitmap_height
 	};
 
-	for (auto& clip_rect : clip_rects) {
-		if (!clip_rect.intersects(content_rect)) {
-			continue;
-		}
-
+	clip.for_each_intersecting(content_rect, [&](const Rect& clip_rect) {
 		auto clipped = content_rect.intersect(clip_rect);
 
 		uint32_t rel_x = clipped.x - content_rect.x;
@@ -64,7 +47,7 @@ void Context::draw_bitmap(const uint32_t* pixels, uint32_t x, uint32_t y, uint32
 			auto src_ptr = &pixels[rel_y * bitmap_width + rel_x];
 			memcpy(dest_ptr, src_ptr, to_copy);
 		}
-	}
+	});
 }
 
 void Context::draw_rect_outline(const Rect& rect, uint32_t color, uint32_t thickness) const {
@@ -94,32 +77,81 @@ void Context::draw_rect_outline(const Rect& rect, uint32_t color, uint32_t thick
 	}, color);
 }
 
-void Context::add_clip_rect(const Rect& rect) {
-	std::vector<Rect> res;
-	res.push_back(rect);
-
-	for (auto& subtract : subtract_rects) {
-		for (size_t i = 0; i < res.size();) {
-			if (res[i].intersects(subtract)) {
-				auto [splits, count] = res[i].subtract(subtract);
-				res.erase(
-					res.begin() +
-					static_cast<ptrdiff_t>(i));
-				for (int j = 0; j < count; ++j) {
-					res.push_back(splits[j]);
-				}
-				continue;
+template<bool OPAQUE>
+static void draw_text_run(
+	const Context& ctx,
+	std::string_view text,
+	uint32_t x,
+	uint32_t y,
+	uint32_t fg,
+	uint32_t bg) {
+	auto& atlas = libtext::GlyphAtlas::get();
+	auto glyph_width = atlas.glyph_width;
+	auto glyph_height = atlas.glyph_height;
+
+	// resolve the glyphs in chunks so the atlas is locked once per chunk instead of once per glyph
+	constexpr size_t CHUNK_SIZE = 128;
+	const uint8_t* glyphs[CHUNK_SIZE];
+
+	for (size_t offset = 0; offset < text.size(); offset += CHUNK_SIZE) {
+		auto count = std::min(text.size() - offset, CHUNK_SIZE);
+
+		{
+			std::unique_lock guard {atlas.lock};
+			for (size_t i = 0; i < count; ++i) {
+				glyphs[i] = atlas.lookup(static_cast<unsigned char>(text[offset + i]));
 			}
-
-			++i;
 		}
-	}
 
-	for (auto& res_rect : res) {
-		clip_rects.push_back(res_rect);
+		Rect run_rect {
+			.x = ctx.x_off + x + static_cast<uint32_t>(offset) * glyph_width,
+			.y = ctx.y_off + y,
+			.width = static_cast<uint32_t>(count) * glyph_width,
+			.height = glyph_height
+		};
+
+		ctx.clip.for_each_intersecting(run_rect, [&](const Rect& clip_rect) {
+			auto clipped = run_rect.intersect(clip_rect);
+			uint32_t first_rel_x = clipped.x - run_rect.x;
+
+			for (uint32_t actual_y = clipped.y; actual_y < clipped.y + clipped.height; ++actual_y) {
+				uint32_t row_offset = (actual_y - run_rect.y) * glyph_width;
+				uint32_t* __restrict dest = &ctx.fb[actual_y * ctx.pitch_32 + clipped.x];
+
+				size_t index = first_rel_x / glyph_width;
+				uint32_t glyph_x = first_rel_x % glyph_width;
+				uint32_t remaining = clipped.width;
+				while (remaining) {
+					uint32_t span = std::min(glyph_width - glyph_x, remaining);
+					const uint8_t* __restrict src = glyphs[index] + row_offset + glyph_x;
+
+					// coverage is either 0 or 255 so it can be used as a selector without blending
+					if (span == 8) {
+						// the common 8px wide font, a fixed trip count lets this get vectorized
+						for (uint32_t i = 0; i < 8; ++i) {
+							dest[i] = src[i] ? fg : (OPAQUE ? bg : dest[i]);
+						}
+					}
+					else {
+						for (uint32_t i = 0; i < span; ++i) {
+							dest[i] = src[i] ? fg : (OPAQUE ? bg : dest[i]);
+						}
+					}
+
+					dest += span;
+					remaining -= span;
+					++index;
+					glyph_x = 0;
+				}
+			}
+		});
 	}
 }
 
-void Context::clear_clip_rects() {
-	clip_rects.clear();
+void Context::draw_text(std::string_view text, uint32_t x, uint32_t y, uint32_t color) const {
+	draw_text_run<false>(*this, text, x, y, color, 0);
+}
+
+void Context::draw_text(std::string_view text, uint32_t x, uint32_t y, uint32_t fg, uint32_t bg) const {
+	draw_text_run<true>(*this, text, x, y, fg, bg);
 }
@@ -1,4 +1,5 @@
 #include "ui/gui.hpp"
+#include <cstring>
 
 using namespace ui;
 
@@ -8,7 +9,7 @@ Gui::Gui(Context& ctx, uint32_t width, uint32_t height) : ctx {ctx} {
 	root_window->internal = true;
 	root_windows.push_back(std::move(root_window));
 
-	ctx.dirty_rects.push_back({
+	ctx.dirty.add({
 		.x = 0,
 		.y = 0,
 		.width = width,
@@ -16,50 +17,135 @@ Gui::Gui(Context& ctx, uint32_t width, uint32_t height) : ctx {ctx} {
 	});
 }
 
-void Gui::draw() {
-	if (ctx.dirty_rects.empty()) {
-		return;
+Rect Gui::get_cursor_rect() const {
+	if (!draw_cursor || mouse_state.pos.x >= ctx.width || mouse_state.pos.y >= ctx.height) {
+		return {};
 	}
 
-	if (draw_cursor) {
-		Rect mouse_rect {
-			.x = mouse_state.pos.x,
-			.y = mouse_state.pos.y,
-			.width = 10,
-			.height = 10
-		};
-		ctx.subtract_rects.push_back(mouse_rect);
+	return {
+		.x = mouse_state.pos.x,
+		.y = mouse_state.pos.y,
+		.width = std::min(CURSOR_SIZE, ctx.width - mouse_state.pos.x),
+		.height = std::min(CURSOR_SIZE, ctx.height - mouse_state.pos.y)
+	};
+}
+
+void Gui::hide_cursor() {
+	auto& rect = cursor_drawn_rect;
+	for (uint32_t y = 0; y < rect.height; ++y) {
+		auto* dest = &ctx.fb[(rect.y + y) * ctx.pitch_32 + rect.x];
+		memcpy(dest, &cursor_save_under[y * CURSOR_SIZE], rect.width * 4);
 	}
 
+	frame_damage.add(rect);
+	cursor_drawn_rect = {};
+}
+
+void Gui::show_cursor(const Rect& rect) {
+	for (uint32_t y = 0; y < rect.height; ++y) {
+		auto* dest = &ctx.fb[(rect.y + y) * ctx.pitch_32 + rect.x];
+		memcpy(&cursor_save_under[y * CURSOR_SIZE], dest, rect.width * 4);
+		for (uint32_t x = 0; x < rect.width; ++x) {
+			dest[x] = 0xFF0000;
+		}
+	}
+
+	frame_damage.add(rect);
+	cursor_drawn_rect = rect;
+}
+
+void Gui::composite(const Region& clip) const {
+	// drawing moves the offsets and clip around, every tile needs its own context
+	Context draw_ctx {
+		.fb = ctx.fb,
+		.pitch_32 = ctx.pitch_32,
+		.width = ctx.width,
+		.height = ctx.height
+	};
+
 	for (auto& window : root_windows) {
-		window->draw_generic(ctx, {});
+		window->draw_generic(draw_ctx, clip);
 	}
+}
 
-	ctx.x_off = 0;
-	ctx.y_off = 0;
-
-	if (draw_cursor) {
-		ctx.subtract_rects.clear();
-		ctx.clear_clip_rects();
-
-		ctx.clip_rects.push_back({
-			.x = 0,
-			.y = 0,
-			.width = ctx.width,
-			.height = ctx.height
-		});
-
-		Rect mouse_rect {
-			.x = mouse_state.pos.x,
-			.y = mouse_state.pos.y,
-			.width = 10,
-			.height = 10
-		};
+void Gui::composite_tiles() {
+	struct TileJobs {
+		const Gui* gui;
+		std::vector<Region> clips;
+	};
+
+	TileJobs jobs {
+		.gui = this,
+		.clips {}
+	};
+
+	auto& extents = ctx.dirty.get_extents();
+	auto end_x = extents.x + extents.width;
+	auto end_y = extents.y + extents.height;
+	for (uint32_t y = extents.y / TILE_SIZE * TILE_SIZE; y < end_y; y += TILE_SIZE) {
+		for (uint32_t x = extents.x / TILE_SIZE * TILE_SIZE; x < end_x; x += TILE_SIZE) {
+			Rect tile {
+				.x = x,
+				.y = y,
+				.width = TILE_SIZE,
+				.height = TILE_SIZE
+			};
+			if (!ctx.dirty.intersects(tile)) {
+				continue;
+			}
+
+			Region clip = ctx.dirty;
+			clip.intersect(tile);
+			jobs.clips.push_back(std::move(clip));
+		}
+	}
+
+	pool->run([](void* arg, uint32_t index) {
+		auto* tile_jobs = static_cast<TileJobs*>(arg);
+		tile_jobs->gui->composite(tile_jobs->clips[index]);
+	}, &jobs, static_cast<uint32_t>(jobs.clips.size()));
+}
+
+bool Gui::needs_redraw() const {
+	return !ctx.dirty.is_empty() || !(get_cursor_rect() == cursor_drawn_rect);
+}
+
+void Gui::draw() {
+	frame_damage.clear();
+
+	auto cursor_rect = get_cursor_rect();
+	bool cursor_moved = !(cursor_rect == cursor_drawn_rect);
+	if (ctx.dirty.is_empty() && !cursor_moved) {
+		return;
+	}
 
-		ctx.draw_filled_rect(mouse_rect, 0xFF0000);
+	// the cursor only has to be touched if it moved or something is drawn under it,
+	// pure mouse motion never composites any windows
+	bool cursor_damaged = cursor_moved || ctx.dirty.intersects(cursor_drawn_rect);
+	if (cursor_damaged && cursor_drawn_rect.width) {
+		hide_cursor();
 	}
 
-	ctx.dirty_rects.clear();
+	if (!ctx.dirty.is_empty()) {
+		uint64_t dirty_pixels = 0;
+		for (auto& rect : ctx.dirty) {
+			dirty_pixels += uint64_t {rect.width} * rect.height;
+		}
+
+		if (pool && pool->get_thread_count() > 1 && dirty_pixels >= PARALLEL_MIN_PIXELS) {
+			composite_tiles();
+		}
+		else {
+			composite(ctx.dirty);
+		}
+
+		frame_damage.add(ctx.dirty);
+		ctx.dirty.clear();
+	}
+
+	if (cursor_damaged && cursor_rect.width) {
+		show_cursor(cursor_rect);
+	}
 }
 
 static bool handle_mouse_recursive(Gui* desktop, std::unique_ptr<Window>& window, const MouseState& new_state) {
@@ -243,16 +329,8 @@ void Gui::handle_mouse(MouseState new_state) {
 			abs_new.height += dragging->titlebar->rect.height + dragging->border.bottom;
 		}
 
-		if (abs_old.intersects(abs_new)) {
-			auto [parts, count] = abs_old.subtract(abs_new);
-			for (int i = 0; i < count; ++i) {
-				ctx.dirty_rects.push_back(parts[i]);
-			}
-		}
-		else {
-			ctx.dirty_rects.push_back(abs_old);
-		}
-		ctx.dirty_rects.push_back(abs_new);
+		ctx.dirty.add(abs_old);
+		ctx.dirty.add(abs_new);
 	}
 	else {
 		for (size_t i = root_windows.size(); i > 0; --i) {
@@ -263,32 +341,6 @@ void Gui::handle_mouse(MouseState new_state) {
 		}
 	}
 
-	if (draw_cursor) {
-		Rect mouse_rect {
-			.x = mouse_state.pos.x,
-			.y = mouse_state.pos.y,
-			.width = std::min(10U, ctx.width - mouse_state.pos.x),
-			.height = std::min(10U, ctx.height - mouse_state.pos.y)
-		};
-
-		Rect new_mouse_rect {
-			.x = new_state.pos.x,
-			.y = new_state.pos.y,
-			.width = std::min(10U, ctx.width - new_state.pos.x),
-			.height = std::min(10U, ctx.height - new_state.pos.y)
-		};
-		if (mouse_rect.intersects(new_mouse_rect)) {
-			auto [parts, count] = mouse_rect.subtract(new_mouse_rect);
-			for (int i = 0; i < count; ++i) {
-				ctx.dirty_rects.push_back(parts[i]);
-			}
-		}
-		else {
-			ctx.dirty_rects.push_back(mouse_rect);
-		}
-		ctx.dirty_rects.push_back(new_mouse_rect);
-	}
-
 	mouse_state = new_state;
 }
 
@@ -341,12 +393,7 @@ void Gui::destroy_window(Window* window) {
 
 	for (size_t i = 0; i < window->parent->children.size(); ++i) {
 		if (window->parent->children[i].get() == window) {
-			auto dirty_rect = window->get_abs_rect();
-			if (!window->no_decorations) {
-				dirty_rect.width += window->border.left + window->border.right;
-				dirty_rect.height += window->titlebar->rect.height + window->border.bottom;
-			}
-			ctx.dirty_rects.push_back(dirty_rect);
+			ctx.dirty.add(window->get_abs_outer_rect());
 
 			window->parent->children.erase(
 				window->parent->children.begin() +
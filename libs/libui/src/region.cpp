@@ -0,0 +1,293 @@
+#include "ui/region.hpp"
+#include <cstdint>
+
+using namespace ui;
+
+Region::Region(const Rect& rect) {
+	if (rect.width && rect.height) {
+		rects.push_back(rect);
+		extents = rect;
+	}
+}
+
+void Region::add(const Rect& rect) {
+	if (!rect.width || !rect.height) {
+		return;
+	}
+	add(Region {rect});
+}
+
+void Region::add(const Region& other) {
+	if (other.rects.empty()) {
+		return;
+	}
+	else if (rects.empty()) {
+		*this = other;
+		return;
+	}
+	apply(other, Op::Union);
+}
+
+void Region::subtract(const Rect& rect) {
+	// an empty rect would turn into an empty region, which apply can't take
+	if (rects.empty() || !rect.width || !rect.height || !extents.intersects(rect)) {
+		return;
+	}
+	apply(Region {rect}, Op::Subtract);
+}
+
+void Region::subtract(const Region& other) {
+	if (rects.empty() || other.rects.empty() || !extents.intersects(other.extents)) {
+		return;
+	}
+	apply(other, Op::Subtract);
+}
+
+void Region::intersect(const Rect& rect) {
+	if (rects.empty()) {
+		return;
+	}
+	else if (!rect.width || !rect.height || !extents.intersects(rect)) {
+		clear();
+		return;
+	}
+
+	// clipping to a single rect keeps the bands sorted and disjoint, so it can be done in place
+	size_t out = 0;
+	for (auto& band_rect : rects) {
+		if (band_rect.intersects(rect)) {
+			rects[out++] = band_rect.intersect(rect);
+		}
+	}
+	rects.resize(out);
+	update_extents();
+}
+
+void Region::intersect(const Region& other) {
+	if (rects.empty()) {
+		return;
+	}
+	else if (other.rects.empty() || !extents.intersects(other.extents)) {
+		clear();
+		return;
+	}
+	apply(other, Op::Intersect);
+}
+
+bool Region::intersects(const Rect& rect) const {
+	bool found = false;
+	for_each_intersecting(rect, [&](const Rect&) {
+		found = true;
+	});
+	return found;
+}
+
+namespace {
+	struct BandIter {
+		const Rect* start;
+		const Rect* end;
+		const Rect* band_end;
+
+		[[nodiscard]] bool done() const {
+			return start == end;
+		}
+
+		[[nodiscard]] uint32_t top() const {
+			return start->y;
+		}
+
+		[[nodiscard]] uint32_t bottom() const {
+			return start->y + start->height;
+		}
+
+		void find_band_end() {
+			band_end = start;
+			while (band_end != end && band_end->y == start->y) {
+				++band_end;
+			}
+		}
+
+		void next_band() {
+			start = band_end;
+			if (start != end) {
+				find_band_end();
+			}
+		}
+	};
+
+	bool keep(bool op_union, bool op_intersect, bool in_a, bool in_b) {
+		if (op_union) {
+			return in_a || in_b;
+		}
+		else if (op_intersect) {
+			return in_a && in_b;
+		}
+		else {
+			return in_a && !in_b;
+		}
+	}
+}
+
+void Region::apply(const Region& other, Op op) {
+	bool op_union = op == Op::Union;
+	bool op_intersect = op == Op::Intersect;
+
+	std::vector<Rect> res;
+	res.reserve(rects.size() + other.rects.size());
+
+	BandIter a {rects.data(), rects.data() + rects.size(), nullptr};
+	BandIter b {other.rects.data(), other.rects.data() + other.rects.size(), nullptr};
+	a.find_band_end();
+	b.find_band_end();
+
+	// start of the previous output band, used to merge vertically adjacent identical bands
+	size_t prev_band = SIZE_MAX;
+
+	uint32_t y = std::min(a.top(), b.top());
+	while (!a.done() || !b.done()) {
+		// nothing past this point can be part of the result
+		if (a.done() && !op_union) {
+			break;
+		}
+		else if (b.done() && op_intersect) {
+			break;
+		}
+
+		if (!a.done() && a.bottom() <= y) {
+			a.next_band();
+			continue;
+		}
+		if (!b.done() && b.bottom() <= y) {
+			b.next_band();
+			continue;
+		}
+
+		bool in_a = !a.done() && a.top() <= y;
+		bool in_b = !b.done() && b.top() <= y;
+
+		uint32_t next_y = UINT32_MAX;
+		if (!a.done()) {
+			next_y = std::min(next_y, in_a ? a.bottom() : a.top());
+		}
+		if (!b.done()) {
+			next_y = std::min(next_y, in_b ? b.bottom() : b.top());
+		}
+
+		// a band only in b can still contribute to a union, subtracting needs a
+		bool band_kept = op_union ? (in_a || in_b) : (op_intersect ? (in_a && in_b) : in_a);
+		if (!band_kept) {
+			y = next_y;
+			continue;
+		}
+
+		// merge the spans of both bands over [y, next_y)
+		const Rect* span_a = in_a ? a.start : a.band_end;
+		const Rect* span_a_end = a.band_end;
+		const Rect* span_b = in_b ? b.start : b.band_end;
+		const Rect* span_b_end = b.band_end;
+		if (a.done()) {
+			span_a = span_a_end = nullptr;
+		}
+		if (b.done()) {
+			span_b = span_b_end = nullptr;
+		}
+
+		size_t band_start = res.size();
+		uint32_t height = next_y - y;
+
+		uint32_t x = UINT32_MAX;
+		if (span_a != span_a_end) {
+			x = std::min(x, span_a->x);
+		}
+		if (span_b != span_b_end) {
+			x = std::min(x, span_b->x);
+		}
+
+		while (span_a != span_a_end || span_b != span_b_end) {
+			bool x_in_a = span_a != span_a_end && span_a->x <= x;
+			bool x_in_b = span_b != span_b_end && span_b->x <= x;
+
+			uint32_t next_x = UINT32_MAX;
+			if (span_a != span_a_end) {
+				next_x = std::min(next_x, x_in_a ? span_a->x + span_a->width : span_a->x);
+			}
+			if (span_b != span_b_end) {
+				next_x = std::min(next_x, x_in_b ? span_b->x + span_b->width : span_b->x);
+			}
+
+			if (keep(op_union, op_intersect, x_in_a, x_in_b)) {
+				if (res.size() > band_start && res.back().x + res.back().width == x) {
+					res.back().width += next_x - x;
+				}
+				else {
+					res.push_back({
+						.x = x,
+						.y = y,
+						.width = next_x - x,
+						.height = height
+					});
+				}
+			}
+
+			x = next_x;
+			if (span_a != span_a_end && span_a->x + span_a->width == x) {
+				++span_a;
+			}
+			if (span_b != span_b_end && span_b->x + span_b->width == x) {
+				++span_b;
+			}
+		}
+
+		// coalesce with the band above if it has the same spans and touches this one
+		if (res.size() > band_start && prev_band != SIZE_MAX) {
+			size_t prev_count = band_start - prev_band;
+			size_t count = res.size() - band_start;
+			bool same = prev_count == count &&
+				res[prev_band].y + res[prev_band].height == y;
+			for (size_t i = 0; same && i < count; ++i) {
+				auto& prev = res[prev_band + i];
+				auto& cur = res[band_start + i];
+				same = prev.x == cur.x && prev.width == cur.width;
+			}
+
+			if (same) {
+				for (size_t i = prev_band; i < band_start; ++i) {
+					res[i].height += height;
+				}
+				res.resize(band_start);
+				band_start = prev_band;
+			}
+		}
+
+		if (res.size() > band_start) {
+			prev_band = band_start;
+		}
+
+		y = next_y;
+	}
+
+	rects = std::move(res);
+	update_extents();
+}
+
+void Region::update_extents() {
+	if (rects.empty()) {
+		extents = {};
+		return;
+	}
+
+	uint32_t min_x = UINT32_MAX;
+	uint32_t max_x = 0;
+	for (auto& rect : rects) {
+		min_x = std::min(min_x, rect.x);
+		max_x = std::max(max_x, rect.x + rect.width);
+	}
+
+	auto& last = rects.back();
+	extents = {
+		.x = min_x,
+		.y = rects.front().y,
+		.width = max_x - min_x,
+		.height = last.y + last.height - rects.front().y
+	};
+}
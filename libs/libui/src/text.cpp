@@ -1,41 +1,42 @@
 #include "ui/text.hpp"
+#include "libtext/libtext.hpp"
 
 using namespace ui;
 
-TextWindow::TextWindow()
-	: Window {true}, text_ctx {libtext::Context::create().value()} {
-}
+TextWindow::TextWindow() : Window {true} {}
 
 void TextWindow::draw(Context& ctx) {
-	ctx.draw_filled_rect(rect, bg_color);
+	auto& atlas = libtext::GlyphAtlas::get();
+	uint32_t chars_per_line = rect.width / atlas.glyph_width;
 
+	std::string_view remaining = text;
 	uint32_t y_offset = 0;
-	uint32_t x_offset = 0;
-
-	for (auto c : text) {
-		auto bitmap = glyph_cache.find(c);
-		if (bitmap == glyph_cache.end()) {
-			auto new_bitmap = text_ctx.rasterize_glyph(c, 8, 16, text_color, bg_color).value();
-			glyph_cache.insert(std::pair<uint32_t, libtext::Bitmap> {static_cast<uint32_t>(c), std::move(new_bitmap)});
-			bitmap = glyph_cache.find(c);
-			assert(bitmap != glyph_cache.end());
-		}
-
-		if (x_offset + bitmap->second.width > rect.width) {
-			x_offset = 0;
-			y_offset += bitmap->second.height;
-			if (y_offset >= rect.height) {
-				return;
+	if (chars_per_line) {
+		for (; !remaining.empty() && y_offset < rect.height; y_offset += atlas.glyph_height) {
+			auto line = remaining.substr(0, chars_per_line);
+			remaining.remove_prefix(line.size());
+
+			// the text cells are drawn opaque, only the rest of the line needs the background
+			ctx.draw_text(line, rect.x, rect.y + y_offset, text_color, bg_color);
+
+			auto line_width = static_cast<uint32_t>(line.size()) * atlas.glyph_width;
+			if (line_width < rect.width) {
+				ctx.draw_filled_rect({
+					.x = rect.x + line_width,
+					.y = rect.y + y_offset,
+					.width = rect.width - line_width,
+					.height = std::min(atlas.glyph_height, rect.height - y_offset)
+				}, bg_color);
 			}
 		}
+	}
 
-		ctx.draw_bitmap(
-			bitmap->second.pixels.data(),
-			rect.x + x_offset,
-			rect.y + y_offset,
-			bitmap->second.width,
-			bitmap->second.height);
-
-		x_offset += bitmap->second.width;
+	if (y_offset < rect.height) {
+		ctx.draw_filled_rect({
+			.x = rect.x,
+			.y = rect.y + y_offset,
+			.width = rect.width,
+			.height = rect.height - y_offset
+		}, bg_color);
 	}
-}
\ No newline at end of file
+}
@@ -44,102 +44,29 @@ void Window::draw_decorations(Context& ctx) {
 	ctx.draw_filled_rect(right_border_rect, border_color);
 }
 
-void Window::draw_generic(Context& ctx, std::vector<Rect> parent_clip_rects) {
-	// --------------------------- clipping ---------------------------
-	ctx.clear_clip_rects();
-
-	std::vector<Rect> clip_rects = std::move(parent_clip_rects);
-	if (parent) {
-		// subtract sibling rects above the current window
-		size_t index = 0;
-		for (; index < parent->children.size(); ++index) {
-			if (parent->children[index].get() == this) {
-				break;
-			}
-		}
-		++index;
-
-		for (; index < parent->children.size(); ++index) {
-			auto& sibling = parent->children[index];
-			auto sibling_rect = sibling->get_abs_rect();
-			if (!sibling->no_decorations) {
-				sibling_rect.width += sibling->border.left + sibling->border.right;
-				sibling_rect.height += sibling->titlebar->rect.height + sibling->border.bottom;
-			}
-
-			for (size_t i = 0; i < clip_rects.size();) {
-				auto& old_rect = clip_rects[i];
-				if (old_rect.intersects(sibling_rect)) {
-					auto [splits, count] = old_rect.subtract(sibling_rect);
-					clip_rects.erase(
-						clip_rects.begin() +
-						static_cast<ptrdiff_t>(i));
-					for (int j = 0; j < count; ++j) {
-						clip_rects.push_back(splits[j]);
-					}
-					continue;
-				}
-
-				++i;
-			}
-		}
-	}
-	else {
-		// root window, add viewport rect
-		//clip_rects.push_back(get_abs_rect());
-
-		// root window, add dirty rects
-		for (auto& dirty_rect : ctx.dirty_rects) {
-			for (size_t i = 0; i < clip_rects.size();) {
-				auto& old_rect = clip_rects[i];
-				if (old_rect.intersects(dirty_rect)) {
-					auto [splits, count] = old_rect.subtract(dirty_rect);
-					clip_rects.erase(
-						clip_rects.begin() +
-						static_cast<ptrdiff_t>(i));
-					for (int j = 0; j < count; ++j) {
-						clip_rects.push_back(splits[j]);
-					}
-					continue;
-				}
-
-				++i;
-			}
-
-			clip_rects.push_back(dirty_rect);
-		}
+void Window::draw_generic(Context& ctx, const Region& clip) {
+	if (clip.is_empty()) {
+		return;
 	}
 
-	auto new_parent_rects = clip_rects;
+	// --------------------------- clipping ---------------------------
 
-	// subtract child rects
-	for (auto& child : children) {
-		auto child_rect = child->get_abs_rect();
-		if (!child->no_decorations) {
-			child_rect.width += child->border.left + child->border.right;
-			child_rect.height += child->titlebar->rect.height + child->border.bottom;
+	// walk the children from the topmost one down, each one only gets the part of
+	// its own area that is left after removing the children above it
+	std::vector<Region> child_clips(children.size());
+	Region remaining = clip;
+	for (size_t i = children.size(); i > 0; --i) {
+		auto child_rect = children[i - 1]->get_abs_outer_rect();
+		if (!remaining.intersects(child_rect)) {
+			continue;
 		}
 
-		for (size_t i = 0; i < clip_rects.size();) {
-			auto& old_rect = clip_rects[i];
-			if (old_rect.intersects(child_rect)) {
-				auto [splits, count] = old_rect.subtract(child_rect);
-				clip_rects.erase(
-					clip_rects.begin() +
-					static_cast<ptrdiff_t>(i));
-				for (int j = 0; j < count; ++j) {
-					clip_rects.push_back(splits[j]);
-				}
-				continue;
-			}
-
-			++i;
-		}
+		child_clips[i - 1] = remaining;
+		child_clips[i - 1].intersect(child_rect);
+		remaining.subtract(child_rect);
 	}
 
-	for (auto& clip_rect : clip_rects) {
-		ctx.add_clip_rect(clip_rect);
-	}
+	ctx.clip = std::move(remaining);
 
 	// --------------------------- clipping end ---------------------------
 
@@ -167,11 +94,7 @@ void Window::draw_generic(Context& ctx, std::vector<Rect> parent_clip_rects) {
 			.height = rect.height
 		};
 
-		for (auto& clip_rect : ctx.clip_rects) {
-			if (!clip_rect.intersects(content_rect)) {
-				continue;
-			}
-
+		ctx.clip.for_each_intersecting(content_rect, [&](const Rect& clip_rect) {
 			auto clipped = content_rect.intersect(clip_rect);
 
 			uint32_t rel_x = clipped.x - content_rect.x;
@@ -182,19 +105,16 @@ void Window::draw_generic(Context& ctx, std::vector<Rect> parent_clip_rects) {
 
 				auto dest_ptr = &ctx.fb[y * ctx.pitch_32 + clipped.x];
 				auto src_ptr = &fb[rel_y * rect.width + rel_x];
-				for (size_t i = 0; i < clipped.width; ++i) {
-					//assert(dest_ptr[i] == 0xCFCFCFCF);
-				}
 				memcpy(dest_ptr, src_ptr, to_copy);
 			}
-		}
+		});
 	}
 	else {
 		draw(ctx);
 	}
 
-	for (auto& child : children) {
-		child->draw_generic(ctx, new_parent_rects);
+	for (size_t i = 0; i < children.size(); ++i) {
+		children[i]->draw_generic(ctx, child_clips[i]);
 	}
 }
 
@@ -0,0 +1,88 @@
+#include "ui/worker_pool.hpp"
+#include "sys.h"
+#include <climits>
+#include <cstdio>
+
+using namespace ui;
+
+WorkerPool::WorkerPool(uint32_t thread_count) {
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		CrescentHandle handle;
+		if (sys_thread_create(&handle, "ui worker", sizeof("ui worker") - 1, worker_thread, this) != 0) {
+			puts("[ui]: failed to create worker thread");
+			break;
+		}
+		sys_close_handle(handle);
+		++this->thread_count;
+	}
+}
+
+void WorkerPool::run(Job new_job, void* arg, uint32_t count) {
+	if (!count) {
+		return;
+	}
+
+	{
+		std::unique_lock guard {lock};
+		job = new_job;
+		job_arg = arg;
+		job_count = count;
+		next_job = 0;
+		__atomic_store_n(&pending, static_cast<int>(count), __ATOMIC_RELEASE);
+		__atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+	}
+
+	if (thread_count) {
+		sys_futex_wake(&generation, INT_MAX);
+	}
+
+	work();
+
+	while (true) {
+		auto remaining = __atomic_load_n(&pending, __ATOMIC_ACQUIRE);
+		if (!remaining) {
+			break;
+		}
+		sys_futex_wait(&pending, remaining, UINT64_MAX);
+	}
+}
+
+void WorkerPool::work() {
+	while (true) {
+		Job current_job;
+		void* arg;
+		uint32_t index;
+
+		{
+			std::unique_lock guard {lock};
+			if (next_job >= job_count) {
+				return;
+			}
+			index = next_job++;
+			current_job = job;
+			arg = job_arg;
+		}
+
+		current_job(arg, index);
+
+		if (__atomic_sub_fetch(&pending, 1, __ATOMIC_ACQ_REL) == 0) {
+			sys_futex_wake(&pending, 1);
+		}
+	}
+}
+
+void WorkerPool::worker_thread(void* arg) {
+	auto* pool = static_cast<WorkerPool*>(arg);
+
+	int seen_generation = 0;
+	while (true) {
+		auto current = __atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE);
+		if (current == seen_generation) {
+			sys_futex_wait(&pool->generation, seen_generation, UINT64_MAX);
+			continue;
+		}
+
+		seen_generation = current;
+		pool->work();
+	}
+}
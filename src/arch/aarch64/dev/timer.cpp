@@ -2,6 +2,7 @@
 #include "arch/cpu.hpp"
 #include "arch/irq.hpp"
 #include "utils/driver.hpp"
+#include "utils/profiler.hpp"
 
 static bool on_irq(IrqFrame*);
 
@@ -22,7 +23,8 @@ namespace {
 
 void ArmTickSource::oneshot(u64 us) {
 	auto current = get_virtual_system_counter();
-	auto compare = current + TICKS_PER_MS * (us / US_IN_MS);
+	// not rounded to whole ms, shorter periods like the profiler's would fire immediately
+	auto compare = current + TICKS_PER_SECOND * us / US_IN_S;
 	asm volatile("msr cntv_cval_el0, %0" : : "r"(compare));
 }
 
@@ -44,7 +46,12 @@ u64 ArmClockSource::get_ns() {
 	return get_virtual_system_counter() * (US_IN_MS * NS_IN_US) / TICKS_PER_MS;
 }
 
-static bool on_irq(IrqFrame*) {
+static bool on_irq(IrqFrame* frame) {
+	if (profile_enabled()) {
+		// spsr.M is zero when the exception was taken from el0
+		profile_sample((frame->spsr_el1 & 0b1111) == 0, frame->elr_el1, frame->x[29]);
+	}
+
 	auto cpu = get_current_thread()->cpu;
 	cpu->arm_tick_source.reset();
 	cpu->arm_tick_source.callback_producer.signal_all();
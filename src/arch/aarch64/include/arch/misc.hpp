@@ -5,6 +5,13 @@ static inline void arch_hlt() {
 	asm volatile("wfi");
 }
 
+/// Free running cycle counter, see `arch_get_cycle_frequency` for its rate.
+static inline u64 arch_get_cycles() {
+	u64 count;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(count));
+	return count;
+}
+
 static inline bool arch_enable_irqs(bool enable) {
 	u64 old;
 	asm volatile("mrs %0, daif" : "=r"(old));
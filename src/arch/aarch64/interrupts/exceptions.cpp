@@ -86,7 +86,7 @@ extern "C" [[gnu::used]] void arch_exception_handler(ExceptionFrame* frame) {
 			}
 
 			println("[kernel][aarch64]: ", Color::Red, "EXCEPTION: ", reason, ", FAR: 0x", Fmt::Hex, frame->far_el1);
-			println("\tat 0x", frame->elr_el1, "\nESR: ", frame->esr_el1, Fmt::Reset, Color::Reset);
+			println("\tat 0x", Fmt::Hex, frame->elr_el1, "\nESR: ", frame->esr_el1, Fmt::Reset, Color::Reset);
 			println("[kernel][x86]: sending SIGSEGV to ", current->process->name, " (thread ", current->name, ")");
 
 			auto guard = current->process->signal_ctx.lock();
@@ -145,7 +145,7 @@ extern "C" [[gnu::used]] void arch_exception_handler(ExceptionFrame* frame) {
 	}
 
 	println("[kernel][aarch64]: ", Color::Red, "EXCEPTION: ", reason, ", FAR: 0x", Fmt::Hex, frame->far_el1);
-	println("\tat 0x", frame->elr_el1, "\nESR: ", frame->esr_el1, Fmt::Reset, Color::Reset);
+	println("\tat 0x", Fmt::Hex, frame->elr_el1, "\nESR: ", frame->esr_el1, Fmt::Reset, Color::Reset);
 
 	if (current->process->user) {
 		println("[kernel][aarch64]: killing user process ", current->process->name);
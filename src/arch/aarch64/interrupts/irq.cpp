@@ -5,6 +5,7 @@
 #include "sched/sched.hpp"
 #include "vector.hpp"
 #include "stdio.hpp"
+#include "utils/trace.hpp"
 
 namespace {
 	ManuallyDestroy<kstd::vector<DoubleList<IrqHandler, &IrqHandler::hook>>> IRQ_HANDLERS;
@@ -44,6 +45,8 @@ extern "C" [[gnu::used]] void arch_irq_handler(ExceptionFrame* frame) {
 		return;
 	}
 
+	trace(TRACE_EVENT_IRQ_ENTER, num);
+
 	bool handler_found = false;
 	{
 		auto guard = IRQ_HANDLERS_LOCK.lock();
@@ -66,4 +69,6 @@ extern "C" [[gnu::used]] void arch_irq_handler(ExceptionFrame* frame) {
 		cpu->deferred_work.remove(&work);
 		work.fn();
 	}
+
+	trace(TRACE_EVENT_IRQ_EXIT, num);
 }
@@ -1,18 +1,211 @@
 #include "cstring.hpp"
 #include "types.hpp"
+#include "algorithm.hpp"
+#include "arch/misc.hpp"
+#include "arch/paging.hpp"
+#include "mem/mem.hpp"
+#include "mem/pmalloc.hpp"
+#include "stdio.hpp"
 
 #undef memcpy
 #undef memset
 
+namespace {
+	enum class PageCopyVariant : u8 {
+		/// `ldp/stp` pairs.
+		Pair,
+		/// `ldnp/stnp` pairs, hints that the data isn't reused soon.
+		NonTemporal
+	};
+
+	enum class PageZeroVariant : u8 {
+		/// `stp xzr, xzr` pairs.
+		Pair,
+		/// `dc zva`, only usable when dczid_el0 permits it.
+		Zva
+	};
+
+	constinit PageCopyVariant PAGE_COPY_VARIANT = PageCopyVariant::Pair;
+	constinit PageZeroVariant PAGE_ZERO_VARIANT = PageZeroVariant::Pair;
+	/// Bytes zeroed by one `dc zva`.
+	constinit usize ZVA_SIZE = 0;
+
+	inline u64 load64(const u8* ptr) {
+		u64 value;
+		__builtin_memcpy(&value, ptr, 8);
+		return value;
+	}
+
+	inline void store64(u8* ptr, u64 value) {
+		__builtin_memcpy(ptr, &value, 8);
+	}
+
+	/// Copies 16 bytes or less with loads from both ends that may overlap.
+	inline void copy_upto_16(u8* dest, const u8* src, usize size) {
+		if (size >= 8) {
+			u64 a = load64(src);
+			u64 b = load64(src + size - 8);
+			store64(dest, a);
+			store64(dest + size - 8, b);
+		}
+		else if (size >= 4) {
+			u32 a;
+			u32 b;
+			__builtin_memcpy(&a, src, 4);
+			__builtin_memcpy(&b, src + size - 4, 4);
+			__builtin_memcpy(dest, &a, 4);
+			__builtin_memcpy(dest + size - 4, &b, 4);
+		}
+		else if (size) {
+			u8 a = src[0];
+			u8 b = src[size / 2];
+			u8 c = src[size - 1];
+			dest[0] = a;
+			dest[size / 2] = b;
+			dest[size - 1] = c;
+		}
+	}
+
+	inline void copy_16(u8* dest, const u8* src) {
+		u64 a;
+		u64 b;
+		asm volatile("ldp %0, %1, [%2]" : "=&r"(a), "=r"(b) : "r"(src) : "memory");
+		asm volatile("stp %0, %1, [%2]" : : "r"(a), "r"(b), "r"(dest) : "memory");
+	}
+
+	inline void copy_64(u8* dest, const u8* src) {
+		copy_16(dest, src);
+		copy_16(dest + 16, src + 16);
+		copy_16(dest + 32, src + 32);
+		copy_16(dest + 48, src + 48);
+	}
+
+	/// Copies `blocks` 64 byte blocks, the loads of a block are all issued before its stores.
+	inline void copy_blocks(u8* dest, const u8* src, usize blocks) {
+		u64 a, b, c, d, e, f, g, h;
+		asm volatile(
+			"1:\n\t"
+			"ldp %[a], %[b], [%[src]]\n\t"
+			"ldp %[c], %[d], [%[src], #16]\n\t"
+			"ldp %[e], %[f], [%[src], #32]\n\t"
+			"ldp %[g], %[h], [%[src], #48]\n\t"
+			"add %[src], %[src], #64\n\t"
+			"stp %[a], %[b], [%[dest]]\n\t"
+			"stp %[c], %[d], [%[dest], #16]\n\t"
+			"stp %[e], %[f], [%[dest], #32]\n\t"
+			"stp %[g], %[h], [%[dest], #48]\n\t"
+			"add %[dest], %[dest], #64\n\t"
+			"subs %[blocks], %[blocks], #1\n\t"
+			"b.ne 1b"
+			: [dest] "+r"(dest), [src] "+r"(src), [blocks] "+r"(blocks),
+			  [a] "=&r"(a), [b] "=&r"(b), [c] "=&r"(c), [d] "=&r"(d),
+			  [e] "=&r"(e), [f] "=&r"(f), [g] "=&r"(g), [h] "=&r"(h)
+			:
+			: "cc", "memory");
+	}
+
+	inline void copy_blocks_nt(u8* dest, const u8* src, usize blocks) {
+		u64 a, b, c, d, e, f, g, h;
+		asm volatile(
+			"1:\n\t"
+			"ldnp %[a], %[b], [%[src]]\n\t"
+			"ldnp %[c], %[d], [%[src], #16]\n\t"
+			"ldnp %[e], %[f], [%[src], #32]\n\t"
+			"ldnp %[g], %[h], [%[src], #48]\n\t"
+			"add %[src], %[src], #64\n\t"
+			"stnp %[a], %[b], [%[dest]]\n\t"
+			"stnp %[c], %[d], [%[dest], #16]\n\t"
+			"stnp %[e], %[f], [%[dest], #32]\n\t"
+			"stnp %[g], %[h], [%[dest], #48]\n\t"
+			"add %[dest], %[dest], #64\n\t"
+			"subs %[blocks], %[blocks], #1\n\t"
+			"b.ne 1b"
+			: [dest] "+r"(dest), [src] "+r"(src), [blocks] "+r"(blocks),
+			  [a] "=&r"(a), [b] "=&r"(b), [c] "=&r"(c), [d] "=&r"(d),
+			  [e] "=&r"(e), [f] "=&r"(f), [g] "=&r"(g), [h] "=&r"(h)
+			:
+			: "cc", "memory");
+	}
+
+	/// Stores `pattern` to `blocks` 64 byte blocks, `dest` must be 16 byte aligned.
+	inline void set_blocks(u8* dest, u64 pattern, usize blocks) {
+		asm volatile(
+			"1:\n\t"
+			"stp %[pattern], %[pattern], [%[dest]]\n\t"
+			"stp %[pattern], %[pattern], [%[dest], #16]\n\t"
+			"stp %[pattern], %[pattern], [%[dest], #32]\n\t"
+			"stp %[pattern], %[pattern], [%[dest], #48]\n\t"
+			"add %[dest], %[dest], #64\n\t"
+			"subs %[blocks], %[blocks], #1\n\t"
+			"b.ne 1b"
+			: [dest] "+r"(dest), [blocks] "+r"(blocks)
+			: [pattern] "r"(pattern)
+			: "cc", "memory");
+	}
+
+	inline void page_copy_with(void* dest, const void* src, PageCopyVariant variant) {
+		if (variant == PageCopyVariant::NonTemporal) {
+			copy_blocks_nt(static_cast<u8*>(dest), static_cast<const u8*>(src), PAGE_SIZE / 64);
+		}
+		else {
+			copy_blocks(static_cast<u8*>(dest), static_cast<const u8*>(src), PAGE_SIZE / 64);
+		}
+	}
+
+	inline void page_zero_with(void* dest, PageZeroVariant variant) {
+		auto* ptr = static_cast<u8*>(dest);
+		if (variant == PageZeroVariant::Zva) {
+			for (usize i = 0; i < PAGE_SIZE; i += ZVA_SIZE) {
+				asm volatile("dc zva, %0" : : "r"(ptr + i) : "memory");
+			}
+		}
+		else {
+			set_blocks(ptr, 0, PAGE_SIZE / 64);
+		}
+	}
+}
+
+// only used once the mmu is on, unaligned accesses fault on device memory
 void* memcpy(void* __restrict dest, const void* __restrict src, size_t size) {
-	auto* dest_ptr = static_cast<unsigned char*>(dest);
-	auto* src_ptr = static_cast<const unsigned char*>(src);
-	for (; size; --size) {
-		*dest_ptr++ = *src_ptr++;
+	auto* dest_ptr = static_cast<u8*>(dest);
+	auto* src_ptr = static_cast<const u8*>(src);
+
+	if (size <= 16) {
+		copy_upto_16(dest_ptr, src_ptr, size);
+		return dest;
+	}
+	else if (size <= 32) {
+		copy_16(dest_ptr, src_ptr);
+		copy_16(dest_ptr + size - 16, src_ptr + size - 16);
+		return dest;
+	}
+	else if (size <= 64) {
+		copy_16(dest_ptr, src_ptr);
+		copy_16(dest_ptr + 16, src_ptr + 16);
+		copy_16(dest_ptr + size - 32, src_ptr + size - 32);
+		copy_16(dest_ptr + size - 16, src_ptr + size - 16);
+		return dest;
+	}
+
+	// the first 16 bytes are copied unaligned so the loop can start from an aligned destination
+	copy_16(dest_ptr, src_ptr);
+	usize skip = 16 - (reinterpret_cast<usize>(dest_ptr) & 15);
+	u8* end = dest_ptr + size;
+	const u8* src_end = src_ptr + size;
+	dest_ptr += skip;
+	src_ptr += skip;
+	size -= skip;
+
+	if (size > 64) {
+		usize blocks = (size - 1) / 64;
+		copy_blocks(dest_ptr, src_ptr, blocks);
 	}
+	// the last 64 bytes overlap whatever the loop already did
+	copy_64(end - 64, src_end - 64);
 	return dest;
 }
 
+// also used by the early paging code before the mmu is on, so every store is aligned
 void* memset(void* __restrict dest, int ch, size_t size) {
 	if (!size) {
 		return dest;
@@ -21,7 +214,7 @@ void* memset(void* __restrict dest, int ch, size_t size) {
 	u64 c = static_cast<unsigned char>(ch);
 	auto* ptr = static_cast<unsigned char*>(dest);
 
-	for (; reinterpret_cast<usize>(ptr) & 7;) {
+	for (; reinterpret_cast<usize>(ptr) & 15;) {
 		*ptr++ = c;
 		if (--size == 0) {
 			return dest;
@@ -32,6 +225,12 @@ void* memset(void* __restrict dest, int ch, size_t size) {
 	c |= c << 16;
 	c |= c << 32;
 
+	if (size >= 64) {
+		set_blocks(ptr, c, size / 64);
+		ptr += size & ~usize {63};
+		size &= 63;
+	}
+
 	for (; size >= 8; size -= 8) {
 		*reinterpret_cast<u64*>(ptr) = c;
 		ptr += 8;
@@ -43,3 +242,78 @@ void* memset(void* __restrict dest, int ch, size_t size) {
 
 	return dest;
 }
+
+void page_copy(void* dest, const void* src) {
+	page_copy_with(dest, src, PAGE_COPY_VARIANT);
+}
+
+void page_zero(void* dest) {
+	page_zero_with(dest, PAGE_ZERO_VARIANT);
+}
+
+namespace {
+	constexpr usize BENCH_RUNS = 8;
+
+	/// Best of `BENCH_RUNS` in cycles, the best run is the one least disturbed by irqs.
+	template<typename F>
+	u64 bench(F fn) {
+		fn();
+		u64 best = UINT64_MAX;
+		for (usize i = 0; i < BENCH_RUNS; ++i) {
+			auto start = arch_get_cycles();
+			fn();
+			best = kstd::min(best, arch_get_cycles() - start);
+		}
+		return best;
+	}
+}
+
+void aarch64_select_mem_variants() {
+	u64 dczid;
+	asm volatile("mrs %0, dczid_el0" : "=r"(dczid));
+	// bit 4 prohibits dc zva, bits 0-3 are the log2 of the block size in words
+	if (!(dczid & 1 << 4)) {
+		ZVA_SIZE = usize {4} << (dczid & 0xF);
+	}
+
+	auto phys = pmalloc(2);
+	if (!phys) {
+		println("[kernel][aarch64]: not enough memory to benchmark page_copy, using defaults");
+		return;
+	}
+
+	auto* src = to_virt<u8>(phys);
+	auto* dest = src + PAGE_SIZE;
+	for (usize i = 0; i < PAGE_SIZE; ++i) {
+		src[i] = static_cast<u8>(i);
+	}
+
+	auto pair = bench([&]() {
+		page_copy_with(dest, src, PageCopyVariant::Pair);
+	});
+	auto nt = bench([&]() {
+		page_copy_with(dest, src, PageCopyVariant::NonTemporal);
+	});
+	PAGE_COPY_VARIANT = nt < pair ? PageCopyVariant::NonTemporal : PageCopyVariant::Pair;
+	println(
+		"[kernel][aarch64]: page_copy uses ", nt < pair ? "ldnp/stnp" : "ldp/stp",
+		" (ldp/stp: ", pair, " cycles, ldnp/stnp: ", nt, " cycles)");
+
+	pair = bench([&]() {
+		page_zero_with(dest, PageZeroVariant::Pair);
+	});
+	if (ZVA_SIZE && ZVA_SIZE <= PAGE_SIZE) {
+		auto zva = bench([&]() {
+			page_zero_with(dest, PageZeroVariant::Zva);
+		});
+		PAGE_ZERO_VARIANT = zva < pair ? PageZeroVariant::Zva : PageZeroVariant::Pair;
+		println(
+			"[kernel][aarch64]: page_zero uses ", zva < pair ? "dc zva" : "stp",
+			" (stp: ", pair, " cycles, dc zva: ", zva, " cycles)");
+	}
+	else {
+		println("[kernel][aarch64]: page_zero uses stp, dc zva is unavailable");
+	}
+
+	pfree(phys, 2);
+}
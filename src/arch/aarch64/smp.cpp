@@ -322,3 +322,9 @@ usize arch_get_cpu_count() {
 Cpu* arch_get_cpu(usize index) {
 	return &*CPUS[index];
 }
+
+u64 arch_get_cycle_frequency() {
+	u64 freq;
+	asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+	return freq;
+}
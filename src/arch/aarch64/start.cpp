@@ -69,6 +69,7 @@ static void run_constructors() {
 constexpr usize KERNEL_SIZE_ALIGN = 1024 * 1024 * 128;
 
 extern void kernel_dtb_init(void* plain_dtb);
+extern void aarch64_select_mem_variants();
 
 extern EarlyPageMap* AARCH64_EARLY_KERNEL_MAP;
 
@@ -280,6 +281,8 @@ extern "C" [[noreturn, gnu::used]] void arch_start(usize dtb_phys, usize kernel_
 		ramfb_init();
 	}
 
+	// picked before the secondary cpus start, the variants aren't synchronized with their users
+	aarch64_select_mem_variants();
 	aarch64_smp_init(dtb);
 
 	println("arch start end");
@@ -24,3 +24,5 @@ struct Cpu : public ArchCpu {
 
 usize arch_get_cpu_count();
 Cpu* arch_get_cpu(usize index);
+/// Rate of `arch_get_cycles` on the current cpu in Hz.
+u64 arch_get_cycle_frequency();
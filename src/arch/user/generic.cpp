@@ -1,4 +1,7 @@
 #include "arch/aarch64/dtb.hpp"
+#include "arch/paging.hpp"
+#include "cstring.hpp"
+#include "mem/mem.hpp"
 #include "mem/pmalloc.hpp"
 #include "sched/process.hpp"
 #include "sched/sched.hpp"
@@ -17,6 +20,18 @@ void set_current_thread(Thread* thread) {
 	CURRENT_THREAD = thread;
 }
 
+u64 arch_get_cycle_frequency() {
+	return 1000000000;
+}
+
+void page_copy(void* dest, const void* src) {
+	memcpy(dest, src, PAGE_SIZE);
+}
+
+void page_zero(void* dest) {
+	memset(dest, 0, PAGE_SIZE);
+}
+
 extern "C" void sched_switch_thread(Thread* prev, Thread* current) {
 
 }
@@ -1,5 +1,7 @@
 #pragma once
+#include "types.hpp"
 #include <stdlib.h>
+#include <time.h>
 
 extern bool IRQS_ENABLED;
 
@@ -9,6 +11,12 @@ static inline bool arch_enable_irqs(bool enable) {
 	return old;
 }
 
+static inline u64 arch_get_cycles() {
+	timespec ts {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<u64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 static inline void arch_hlt() {
 	abort();
 }
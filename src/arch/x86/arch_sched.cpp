@@ -5,6 +5,7 @@
 #include "assert.hpp"
 #include "cpu.hpp"
 #include "mem/mem.hpp"
+#include "mem/pmalloc.hpp"
 #include "mem/vspace.hpp"
 #include "sched/sched.hpp"
 #include "simd_state.hpp"
@@ -58,6 +59,10 @@ sched_switch_thread:
 				}
 			}
 		}
+		// the run queues are checked again after every page
+		if (pmalloc_refill_zeroed()) {
+			continue;
+		}
 		asm volatile("hlt");
 	}
 }
@@ -256,7 +261,9 @@ ArchThread::ArchThread(const SysvInfo& sysv, Process* process) : self {this} {
 	auto* user_frame = reinterpret_cast<UserInitFrame*>(frame);
 	user_frame->rflags = 0x202;
 
-	usize data_size = 16 * 8;
+	// the argument strings go at the top of the stack, argv and the aux vector right below them
+	usize strings_size = sysv_strings_size(sysv);
+	usize data_size = strings_size + (17 + sysv.args.size()) * 8;
 	usize aligned_data_size = (data_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
 
 	auto kernel_mapping = KERNEL_VSPACE.alloc(aligned_data_size);
@@ -278,8 +285,22 @@ ArchThread::ArchThread(const SysvInfo& sysv, Process* process) : self {this} {
 		user_rsp -= 8;
 	};
 
+	user_rsp -= strings_size;
+	kernel_user_rsp -= strings_size / 8;
+	u64 user_strings = user_rsp;
+	auto* kernel_strings = reinterpret_cast<char*>(kernel_user_rsp);
+	usize strings_end = 0;
+	for (auto& arg : sysv.args) {
+		memcpy(kernel_strings + strings_end, arg.data(), arg.size());
+		kernel_strings[strings_end + arg.size()] = 0;
+		strings_end += arg.size() + 1;
+	}
+
 	// align to 16 bytes
 	push(0);
+	if (sysv.args.size() % 2) {
+		push(0);
+	}
 
 	// aux end
 	push(0);
@@ -305,9 +326,12 @@ ArchThread::ArchThread(const SysvInfo& sysv, Process* process) : self {this} {
 	// env (nothing)
 	// argv end
 	push(0);
-	// argv (nothing)
+	for (usize i = sysv.args.size(); i > 0; --i) {
+		strings_end -= sysv.args[i - 1].size() + 1;
+		push(user_strings + strings_end);
+	}
 	// argc
-	push(0);
+	push(sysv.args.size());
 
 	for (usize i = 0; i < aligned_data_size; i += PAGE_SIZE) {
 		KERNEL_PROCESS->page_map.unmap(reinterpret_cast<u64>(kernel_mapping) + i);
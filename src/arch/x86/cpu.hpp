@@ -97,6 +97,10 @@ struct CpuFeatures {
 	bool smap;
 	bool rdseed;
 	bool vmx;
+	/// Enhanced `rep movsb/stosb`.
+	bool erms;
+	/// Fast `rep movsb` for short copies.
+	bool fsrm;
 };
 static_assert(offsetof(CpuFeatures, smap) == 14);
 
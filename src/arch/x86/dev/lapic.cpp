@@ -5,6 +5,7 @@
 #include "arch/x86/cpu.hpp"
 #include "dev/clock.hpp"
 #include "mem/iospace.hpp"
+#include "utils/profiler.hpp"
 #include "x86/irq.hpp"
 
 namespace regs {
@@ -249,6 +250,10 @@ void LapicTickSource::reset() {
 }
 
 bool LapicTickSource::on_irq(IrqFrame* frame) {
+	if (profile_enabled()) {
+		profile_sample((frame->cs & 3) == 3, frame->rip, frame->rbp);
+	}
+
 	if ((frame->cs & 3) == 3) {
 		auto thread = get_current_thread();
 		thread->signal_ctx.check_signals(frame, thread);
@@ -5,6 +5,14 @@ static inline void arch_hlt() {
 	asm volatile("hlt");
 }
 
+/// Free running cycle counter, see `arch_get_cycle_frequency` for its rate.
+static inline u64 arch_get_cycles() {
+	u32 low;
+	u32 high;
+	asm volatile("rdtsc" : "=a"(low), "=d"(high));
+	return static_cast<u64>(high) << 32 | low;
+}
+
 static inline bool arch_enable_irqs(bool enable) {
 	u64 old;
 	asm volatile("pushfq; pop %0" : "=rm"(old));
@@ -131,7 +131,7 @@ static void print_page_fault(IrqFrame* frame, u64 cr2) {
 	}
 
 	println("[kernel][x86]: ", Color::Red, "pagefault caused by ", who, action, Fmt::Hex, cr2, " (", desc, ")");
-	println("\tat ", frame->rip, Fmt::Reset, Color::Reset);
+	println("\tat ", Fmt::Hex, frame->rip, Fmt::Reset, Color::Reset);
 
 	backtrace_display();
 }
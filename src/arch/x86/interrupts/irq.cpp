@@ -4,6 +4,7 @@
 #include "arch/x86/dev/lapic.hpp"
 #include "arch/cpu.hpp"
 #include "dev/random.hpp"
+#include "utils/trace.hpp"
 
 static u32 USED_IRQS[256 / 32] {};
 static u32 USED_SHAREABLE_IRQS[256 / 32] {};
@@ -88,6 +89,8 @@ extern "C" [[gnu::used]] void arch_irq_handler(IrqFrame* frame, u8 num) {
 		thread->signal_ctx.check_signals(frame, thread);
 	}
 
+	trace(TRACE_EVENT_IRQ_ENTER, num);
+
 	u64 entropy_rip = frame->cs == 0x2B ? frame->rip : (frame->rip & 0xFFFFFFFF);
 	u64 entropy = num | frame->cs << 8 | entropy_rip << 16 | (frame->rsp & 0xFFFFFFFF) << 32;
 	u32 tsc_low;
@@ -123,6 +126,8 @@ extern "C" [[gnu::used]] void arch_irq_handler(IrqFrame* frame, u8 num) {
 		work.fn();
 	}
 
+	trace(TRACE_EVENT_IRQ_EXIT, num);
+
 	if (frame->cs == 0x2B) {
 		asm volatile("swapgs");
 	}
@@ -38,7 +38,7 @@ bool PageMap::map_2mb(u64 virt, u64 phys, PageFlags flags, CacheMode cache_mode)
 		used_pages.push(Page::from_phys(page_phys));
 
 		level1 = to_virt<u64>(page_phys);
-		memset(level1, 0, PAGE_SIZE);
+		page_zero(level1);
 		level0[level0_index] = page_phys | all_flags;
 	}
 
@@ -54,7 +54,7 @@ bool PageMap::map_2mb(u64 virt, u64 phys, PageFlags flags, CacheMode cache_mode)
 		used_pages.push(Page::from_phys(page_phys));
 
 		level2 = to_virt<u64>(page_phys);
-		memset(level2, 0, PAGE_SIZE);
+		page_zero(level2);
 		level1[level1_index] = page_phys | all_flags;
 	}
 
@@ -115,7 +115,7 @@ bool PageMap::map(u64 virt, u64 phys, PageFlags flags, CacheMode cache_mode) {
 		used_pages.push(Page::from_phys(page_phys));
 
 		level1 = to_virt<u64>(page_phys);
-		memset(level1, 0, PAGE_SIZE);
+		page_zero(level1);
 		level0[level0_index] = page_phys | all_flags;
 	}
 
@@ -131,7 +131,7 @@ bool PageMap::map(u64 virt, u64 phys, PageFlags flags, CacheMode cache_mode) {
 		used_pages.push(Page::from_phys(page_phys));
 
 		level2 = to_virt<u64>(page_phys);
-		memset(level2, 0, PAGE_SIZE);
+		page_zero(level2);
 		level1[level1_index] = page_phys | all_flags;
 	}
 
@@ -147,7 +147,7 @@ bool PageMap::map(u64 virt, u64 phys, PageFlags flags, CacheMode cache_mode) {
 		used_pages.push(Page::from_phys(page_phys));
 
 		level3 = to_virt<u64>(page_phys);
-		memset(level3, 0, PAGE_SIZE);
+		page_zero(level3);
 		level2[level2_index] = page_phys | all_flags;
 	}
 
@@ -355,7 +355,7 @@ PageMap::PageMap(PageMap* kernel_map) {
 	auto phys = pmalloc(1);
 	assert(phys);
 	level0 = to_virt<u64>(phys);
-	memset(level0, 0, PAGE_SIZE);
+	page_zero(level0);
 	used_pages.push(Page::from_phys(phys));
 
 	if (kernel_map) {
@@ -374,7 +374,7 @@ void PageMap::fill_high_half() {
 	for (int i = 0; i < 512; ++i) {
 		auto phys = pmalloc(1);
 		assert(phys);
-		memset(to_virt<void>(phys), 0, PAGE_SIZE);
+		page_zero(to_virt<void>(phys));
 		level0[i] = phys | FLAG_PRESENT | FLAG_RW;
 		used_pages.push(Page::from_phys(phys));
 	}
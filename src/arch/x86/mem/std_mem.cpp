@@ -1,16 +1,256 @@
 #include "cstring.hpp"
+#include "algorithm.hpp"
+#include "arch/misc.hpp"
+#include "arch/paging.hpp"
+#include "arch/x86/cpu.hpp"
+#include "mem/mem.hpp"
+#include "mem/pmalloc.hpp"
+#include "stdio.hpp"
 
 #undef memcpy
 #undef memset
 
+namespace {
+	enum class StringVariant : u8 {
+		/// `rep movsq/stosq` for the bulk and one overlapping qword for the tail.
+		Qword,
+		/// A single `rep movsb/stosb`, as fast or faster with ERMS.
+		Byte
+	};
+
+	/// Large copies and sets, picked by `x86_select_mem_variants` before the aps start.
+	constinit StringVariant COPY_VARIANT = StringVariant::Byte;
+	constinit StringVariant SET_VARIANT = StringVariant::Byte;
+	/// Page sized copies and sets, picked separately as page copies are always aligned.
+	constinit StringVariant PAGE_COPY_VARIANT = StringVariant::Qword;
+	constinit StringVariant PAGE_SET_VARIANT = StringVariant::Qword;
+	/// Sizes up to this are done with plain moves, the string instructions have a startup cost
+	/// that is only hidden with FSRM.
+	constinit usize SMALL_LIMIT = 64;
+
+	inline u64 load64(const u8* ptr) {
+		u64 value;
+		__builtin_memcpy(&value, ptr, 8);
+		return value;
+	}
+
+	inline void store64(u8* ptr, u64 value) {
+		__builtin_memcpy(ptr, &value, 8);
+	}
+
+	/// Copies 32 bytes or less with loads from both ends that may overlap.
+	inline void copy_upto_32(u8* dest, const u8* src, usize size) {
+		if (size >= 16) {
+			u64 a = load64(src);
+			u64 b = load64(src + 8);
+			u64 c = load64(src + size - 16);
+			u64 d = load64(src + size - 8);
+			store64(dest, a);
+			store64(dest + 8, b);
+			store64(dest + size - 16, c);
+			store64(dest + size - 8, d);
+		}
+		else if (size >= 8) {
+			u64 a = load64(src);
+			u64 b = load64(src + size - 8);
+			store64(dest, a);
+			store64(dest + size - 8, b);
+		}
+		else if (size >= 4) {
+			u32 a;
+			u32 b;
+			__builtin_memcpy(&a, src, 4);
+			__builtin_memcpy(&b, src + size - 4, 4);
+			__builtin_memcpy(dest, &a, 4);
+			__builtin_memcpy(dest + size - 4, &b, 4);
+		}
+		else if (size) {
+			u8 a = src[0];
+			u8 b = src[size / 2];
+			u8 c = src[size - 1];
+			dest[0] = a;
+			dest[size / 2] = b;
+			dest[size - 1] = c;
+		}
+	}
+
+	inline void set_upto_32(u8* dest, u64 pattern, usize size) {
+		if (size >= 16) {
+			store64(dest, pattern);
+			store64(dest + 8, pattern);
+			store64(dest + size - 16, pattern);
+			store64(dest + size - 8, pattern);
+		}
+		else if (size >= 8) {
+			store64(dest, pattern);
+			store64(dest + size - 8, pattern);
+		}
+		else if (size >= 4) {
+			auto value = static_cast<u32>(pattern);
+			__builtin_memcpy(dest, &value, 4);
+			__builtin_memcpy(dest + size - 4, &value, 4);
+		}
+		else if (size) {
+			auto value = static_cast<u8>(pattern);
+			dest[0] = value;
+			dest[size / 2] = value;
+			dest[size - 1] = value;
+		}
+	}
+
+	inline void copy_large(u8* dest, const u8* src, usize size, StringVariant variant) {
+		if (variant == StringVariant::Qword) {
+			auto tail = load64(src + size - 8);
+			u8* dest_copy = dest;
+			usize count = size / 8;
+			asm volatile("rep movsq" : "+D"(dest_copy), "+S"(src), "+c"(count) : : "flags", "memory");
+			store64(dest + size - 8, tail);
+		}
+		else {
+			asm volatile("rep movsb" : "+D"(dest), "+S"(src), "+c"(size) : : "flags", "memory");
+		}
+	}
+
+	inline void set_large(u8* dest, u64 pattern, usize size, StringVariant variant) {
+		if (variant == StringVariant::Qword) {
+			u8* dest_copy = dest;
+			usize count = size / 8;
+			asm volatile("rep stosq" : "+D"(dest_copy), "+c"(count) : "a"(pattern) : "flags", "memory");
+			store64(dest + size - 8, pattern);
+		}
+		else {
+			asm volatile("rep stosb" : "+D"(dest), "+c"(size) : "a"(pattern) : "flags", "memory");
+		}
+	}
+}
+
 void* memcpy(void* __restrict dest, const void* __restrict src, size_t size) {
-	void* dest_copy = dest;
-	asm volatile("rep movsb" : "+D"(dest_copy), "+S"(src), "+c"(size) : : "flags", "memory");
+	auto* dest_ptr = static_cast<u8*>(dest);
+	auto* src_ptr = static_cast<const u8*>(src);
+
+	if (size <= 32) {
+		copy_upto_32(dest_ptr, src_ptr, size);
+	}
+	else if (size <= SMALL_LIMIT) {
+		copy_upto_32(dest_ptr, src_ptr, 32);
+		copy_upto_32(dest_ptr + size - 32, src_ptr + size - 32, 32);
+	}
+	else {
+		copy_large(dest_ptr, src_ptr, size, COPY_VARIANT);
+	}
 	return dest;
 }
 
 void* memset(void* __restrict dest, int ch, size_t size) {
-	void* dest_copy = dest;
-	asm volatile("rep stosb" : "+D"(dest_copy), "+c"(size) : "a"(ch) : "flags", "memory");
+	auto* dest_ptr = static_cast<u8*>(dest);
+	u64 pattern = static_cast<u8>(ch) * 0x0101010101010101;
+
+	if (size <= 32) {
+		set_upto_32(dest_ptr, pattern, size);
+	}
+	else if (size <= SMALL_LIMIT) {
+		set_upto_32(dest_ptr, pattern, 32);
+		set_upto_32(dest_ptr + size - 32, pattern, 32);
+	}
+	else {
+		set_large(dest_ptr, pattern, size, SET_VARIANT);
+	}
 	return dest;
 }
+
+void page_copy(void* dest, const void* src) {
+	copy_large(static_cast<u8*>(dest), static_cast<const u8*>(src), PAGE_SIZE, PAGE_COPY_VARIANT);
+}
+
+void page_zero(void* dest) {
+	set_large(static_cast<u8*>(dest), 0, PAGE_SIZE, PAGE_SET_VARIANT);
+}
+
+namespace {
+	constexpr usize BENCH_PAGES = 16;
+	constexpr usize BENCH_RUNS = 8;
+
+	/// Best of `BENCH_RUNS` in cycles, the best run is the one least disturbed by irqs.
+	template<typename F>
+	u64 bench(F fn) {
+		fn();
+		u64 best = UINT64_MAX;
+		for (usize i = 0; i < BENCH_RUNS; ++i) {
+			auto start = arch_get_cycles();
+			fn();
+			best = kstd::min(best, arch_get_cycles() - start);
+		}
+		return best;
+	}
+
+	const char* variant_name(StringVariant variant, bool copy) {
+		if (variant == StringVariant::Qword) {
+			return copy ? "rep movsq" : "rep stosq";
+		}
+		return copy ? "rep movsb" : "rep stosb";
+	}
+
+	/// Times both variants for `size` bytes and returns the faster one,
+	/// ties go to the byte variant when the cpu advertises it as fast.
+	StringVariant pick(u8* dest, const u8* src, usize size, bool copy, u64 (&cycles)[2]) {
+		for (int i = 0; i < 2; ++i) {
+			auto variant = static_cast<StringVariant>(i);
+			if (copy) {
+				cycles[i] = bench([&]() {
+					copy_large(dest, src, size, variant);
+				});
+			}
+			else {
+				cycles[i] = bench([&]() {
+					set_large(dest, 0, size, variant);
+				});
+			}
+		}
+
+		auto qword = cycles[static_cast<int>(StringVariant::Qword)];
+		auto byte = cycles[static_cast<int>(StringVariant::Byte)];
+		if (byte < qword || (byte == qword && CPU_FEATURES.erms)) {
+			return StringVariant::Byte;
+		}
+		return StringVariant::Qword;
+	}
+
+	void log_choice(const char* what, StringVariant variant, bool copy, const u64 (&cycles)[2]) {
+		println(
+			"[kernel][x86]: ", what, " uses ", variant_name(variant, copy), " (",
+			variant_name(StringVariant::Qword, copy), ": ", cycles[0], " cycles, ",
+			variant_name(StringVariant::Byte, copy), ": ", cycles[1], " cycles)");
+	}
+}
+
+void x86_select_mem_variants() {
+	COPY_VARIANT = CPU_FEATURES.erms ? StringVariant::Byte : StringVariant::Qword;
+	SET_VARIANT = COPY_VARIANT;
+	if (CPU_FEATURES.fsrm) {
+		SMALL_LIMIT = 32;
+	}
+
+	auto phys = pmalloc(BENCH_PAGES * 2);
+	if (!phys) {
+		println("[kernel][x86]: not enough memory to benchmark memcpy, using cpuid defaults");
+		return;
+	}
+
+	auto* src = to_virt<u8>(phys);
+	auto* dest = src + BENCH_PAGES * PAGE_SIZE;
+	for (usize i = 0; i < BENCH_PAGES * PAGE_SIZE; ++i) {
+		src[i] = static_cast<u8>(i);
+	}
+
+	u64 cycles[2];
+	COPY_VARIANT = pick(dest, src, BENCH_PAGES * PAGE_SIZE, true, cycles);
+	log_choice("memcpy", COPY_VARIANT, true, cycles);
+	SET_VARIANT = pick(dest, src, BENCH_PAGES * PAGE_SIZE, false, cycles);
+	log_choice("memset", SET_VARIANT, false, cycles);
+	PAGE_COPY_VARIANT = pick(dest, src, PAGE_SIZE, true, cycles);
+	log_choice("page_copy", PAGE_COPY_VARIANT, true, cycles);
+	PAGE_SET_VARIANT = pick(dest, src, PAGE_SIZE, false, cycles);
+	log_choice("page_zero", PAGE_SET_VARIANT, false, cycles);
+
+	pfree(phys, BENCH_PAGES * 2);
+}
@@ -88,6 +88,12 @@ static void x86_detect_cpu_features() {
 	if (info.ebx & 1U << 18) {
 		CPU_FEATURES.rdseed = true;
 	}
+	if (info.ebx & 1U << 9) {
+		CPU_FEATURES.erms = true;
+	}
+	if (info.edx & 1U << 4) {
+		CPU_FEATURES.fsrm = true;
+	}
 }
 
 static void x86_init_simd() {
@@ -209,6 +215,8 @@ static void x86_init_cpu_common(Cpu* self, u8 lapic_id, bool bsp) {
 extern char __CPU_LOCAL_START[];
 extern char __CPU_LOCAL_END[];
 
+extern void x86_select_mem_variants();
+
 void x86_smp_init() {
 	lapic_first_init();
 	x86_init_idt();
@@ -220,6 +228,10 @@ void x86_smp_init() {
 
 	x86_init_cpu_common(&*CPUS[0], SMP_REQUEST.response->bsp_lapic_id, true);
 
+	// the variants are plain globals read by every memcpy, so they are picked while no other cpu
+	// is running yet, which also keeps the aps from disturbing the timings
+	x86_select_mem_variants();
+
 	u32 prev = 0;
 
 	for (u64 i = 0; i < kstd::min(SMP_REQUEST.response->cpu_count, static_cast<u64>(CONFIG_MAX_CPUS)); ++i) {
@@ -267,6 +279,10 @@ Cpu* arch_get_cpu(usize index) {
 	return &*CPUS[index];
 }
 
+u64 arch_get_cycle_frequency() {
+	return get_current_thread()->cpu->tsc_freq;
+}
+
 CpuFeatures CPU_FEATURES {};
 
 struct [[gnu::packed]] BootInfo {
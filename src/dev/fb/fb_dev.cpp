@@ -1,4 +1,5 @@
 #include "dev/gpu/gpu_dev.hpp"
+#include "cstring.hpp"
 #include "dev/user_dev.hpp"
 #include "fb.hpp"
 #include "sched/process.hpp"
@@ -22,13 +23,14 @@ struct GpuFbDev : public UserDevice {
 		gpu->destroy_surface(back_surface);
 	}
 
-	int handle_request(const kstd::vector<u8>& data, kstd::vector<u8>& res, usize max_size) override {
-		if (data.size() < sizeof(FbLink) || max_size < sizeof(FbLinkResponse)) {
+	int handle_request(kstd::span<u8> data, void* res, usize& res_size) override {
+		if (data.size() < sizeof(FbLink) || res_size < sizeof(FbLinkResponse)) {
 			return ERR_INVALID_ARGUMENT;
 		}
 		auto* link = reinterpret_cast<const FbLink*>(data.data());
-		res.resize(sizeof(FbLinkResponse));
-		auto* resp = reinterpret_cast<FbLinkResponse*>(res.data());
+		res_size = sizeof(FbLinkResponse);
+		auto* resp = static_cast<FbLinkResponse*>(res);
+		memset(resp, 0, sizeof(FbLinkResponse));
 
 		switch (link->op) {
 			case FbLinkOpGetInfo:
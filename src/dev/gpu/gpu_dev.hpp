@@ -8,7 +8,7 @@ public:
 		this->name = name;
 	}
 
-	int handle_request(const kstd::vector<u8>& data, kstd::vector<u8>& res, usize max_size) override {
+	int handle_request(kstd::span<u8> data, void* res, usize& res_size) override {
 		return ERR_UNSUPPORTED;
 	}
 	Gpu* gpu;
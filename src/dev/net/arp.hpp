@@ -2,7 +2,6 @@
 #include "types.hpp"
 #include "bit.hpp"
 #include "mac.hpp"
-#include "optional.hpp"
 
 struct [[gnu::packed]] ArpHeader {
 	u16 htype;
@@ -32,4 +31,5 @@ struct Nic;
 struct ReceivedPacket;
 
 void arp_process_packet(Nic& nic, ReceivedPacket& packet);
-kstd::optional<Mac> arp_get_mac(u32 ip);
+/// Broadcasts a request for the mac of `ip`, the reply is recorded in the nic's neighbour table.
+void arp_send_query(Nic& nic, u32 ip);
@@ -1,28 +1,215 @@
 #pragma once
+#include "algorithm.hpp"
 #include "types.hpp"
 
+// Internet checksum (RFC 1071). Words are summed in native byte order, which gives the
+// byte swapped result on little endian machines, so the folded sum can be stored as is.
+
+/// Folds a partial sum to 16 bits without inverting it.
+constexpr u16 checksum_fold(u64 sum) {
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return sum;
+}
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+
+namespace checksum_detail {
+	using Vec = u32 __attribute__((vector_size(16)));
+
+	inline Vec load(const u8* ptr) {
+		Vec value;
+		__builtin_memcpy(&value, ptr, 16);
+		return value;
+	}
+
+	inline u64 reduce(Vec value) {
+		return u64 {value[0]} + value[1] + value[2] + value[3];
+	}
+}
+
+#endif
+
+/// Adds `size` bytes starting at an even offset of the checksummed data to `sum`.
+inline u64 checksum_partial(const void* data, usize size, u64 sum) {
+	auto* ptr = static_cast<const u8*>(data);
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+	using namespace checksum_detail;
+
+	// both halves of every 32 bit lane are accumulated separately so the lanes can't overflow
+	// for 16k iterations, they are drained into the 64 bit sum well before that
+	while (size >= 64) {
+		Vec lo {};
+		Vec hi {};
+		usize iterations = kstd::min(size / 64, usize {8192});
+		for (usize i = 0; i < iterations; ++i) {
+			Vec a = load(ptr);
+			Vec b = load(ptr + 16);
+			Vec c = load(ptr + 32);
+			Vec d = load(ptr + 48);
+			lo += (a & 0xFFFF) + (b & 0xFFFF) + (c & 0xFFFF) + (d & 0xFFFF);
+			hi += (a >> 16) + (b >> 16) + (c >> 16) + (d >> 16);
+			ptr += 64;
+		}
+		size -= iterations * 64;
+		sum += reduce(lo) + reduce(hi);
+	}
+#endif
+
+	// 32 bit words can be summed into a 64 bit accumulator without tracking carries
+	while (size >= 32) {
+		u32 words[8];
+		__builtin_memcpy(words, ptr, 32);
+		sum += u64 {words[0]} + words[1] + words[2] + words[3];
+		sum += u64 {words[4]} + words[5] + words[6] + words[7];
+		ptr += 32;
+		size -= 32;
+	}
+
+	while (size >= 4) {
+		u32 word;
+		__builtin_memcpy(&word, ptr, 4);
+		sum += word;
+		ptr += 4;
+		size -= 4;
+	}
+
+	if (size >= 2) {
+		u16 word;
+		__builtin_memcpy(&word, ptr, 2);
+		sum += word;
+		ptr += 2;
+		size -= 2;
+	}
+
+	if (size) {
+		// the missing byte is padded with zero
+		u16 word = 0;
+		__builtin_memcpy(&word, ptr, 1);
+		sum += word;
+	}
+
+	return sum;
+}
+
+/// Copies `size` bytes from `src` to `dest` while adding them to `sum` like `checksum_partial`,
+/// so the data is only read once.
+inline u64 checksum_copy_partial(void* dest, const void* src, usize size, u64 sum) {
+	auto* dest_ptr = static_cast<u8*>(dest);
+	auto* src_ptr = static_cast<const u8*>(src);
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+	using namespace checksum_detail;
+
+	while (size >= 64) {
+		Vec lo {};
+		Vec hi {};
+		usize iterations = kstd::min(size / 64, usize {8192});
+		for (usize i = 0; i < iterations; ++i) {
+			Vec a = load(src_ptr);
+			Vec b = load(src_ptr + 16);
+			Vec c = load(src_ptr + 32);
+			Vec d = load(src_ptr + 48);
+			__builtin_memcpy(dest_ptr, &a, 16);
+			__builtin_memcpy(dest_ptr + 16, &b, 16);
+			__builtin_memcpy(dest_ptr + 32, &c, 16);
+			__builtin_memcpy(dest_ptr + 48, &d, 16);
+			lo += (a & 0xFFFF) + (b & 0xFFFF) + (c & 0xFFFF) + (d & 0xFFFF);
+			hi += (a >> 16) + (b >> 16) + (c >> 16) + (d >> 16);
+			src_ptr += 64;
+			dest_ptr += 64;
+		}
+		size -= iterations * 64;
+		sum += reduce(lo) + reduce(hi);
+	}
+#endif
+
+	while (size >= 32) {
+		u32 words[8];
+		__builtin_memcpy(words, src_ptr, 32);
+		__builtin_memcpy(dest_ptr, words, 32);
+		sum += u64 {words[0]} + words[1] + words[2] + words[3];
+		sum += u64 {words[4]} + words[5] + words[6] + words[7];
+		src_ptr += 32;
+		dest_ptr += 32;
+		size -= 32;
+	}
+
+	while (size >= 4) {
+		u32 word;
+		__builtin_memcpy(&word, src_ptr, 4);
+		__builtin_memcpy(dest_ptr, &word, 4);
+		sum += word;
+		src_ptr += 4;
+		dest_ptr += 4;
+		size -= 4;
+	}
+
+	if (size >= 2) {
+		u16 word;
+		__builtin_memcpy(&word, src_ptr, 2);
+		__builtin_memcpy(dest_ptr, &word, 2);
+		sum += word;
+		src_ptr += 2;
+		dest_ptr += 2;
+		size -= 2;
+	}
+
+	if (size) {
+		u16 word = 0;
+		__builtin_memcpy(&word, src_ptr, 1);
+		*dest_ptr = *src_ptr;
+		sum += word;
+	}
+
+	return sum;
+}
+
+/// RFC 1624 update of a stored checksum after a 16 bit field covered by it
+/// changed from `old_value` to `new_value`, both as stored in the packet.
+constexpr u16 checksum_update(u16 checksum, u16 old_value, u16 new_value) {
+	// HC' = ~(~HC + ~m + m')
+	u32 sum = u32 {static_cast<u16>(~checksum)} + static_cast<u16>(~old_value) + new_value;
+	return ~checksum_fold(sum);
+}
+
+/// `checksum_update` for a 32 bit field such as an address.
+constexpr u16 checksum_update32(u16 checksum, u32 old_value, u32 new_value) {
+	checksum = checksum_update(checksum, old_value & 0xFFFF, new_value & 0xFFFF);
+	return checksum_update(checksum, old_value >> 16, new_value >> 16);
+}
+
 struct Checksum {
 	inline void add(u16 value) {
 		sum += value;
 	}
 
-	inline void add(const void* data, u32 size) {
-		if (size % 2) {
-			--size;
-			add(static_cast<const u8*>(data)[size]);
-		}
+	inline void add(const void* data, usize size) {
+		add_partial(checksum_partial(data, size, 0), size);
+	}
 
-		for (u32 i = 0; i < size / 2; ++i) {
-			sum += static_cast<const u16*>(data)[i];
-		}
+	/// Copies `size` bytes to `dest` and adds them to the checksum.
+	inline void add_copy(void* dest, const void* src, usize size) {
+		add_partial(checksum_copy_partial(dest, src, size, 0), size);
 	}
 
 	[[nodiscard]] inline u16 get() const {
-		u32 res = (sum & 0xFFFF) + (sum >> 16);
-		res = (res & 0xFFFF) + (res >> 16);
-		return ~res;
+		return ~checksum_fold(sum);
 	}
 
 private:
-	u32 sum = 0;
+	inline void add_partial(u64 partial, usize size) {
+		// data following an odd sized block starts in the high byte of a word
+		if (odd) {
+			partial = __builtin_bswap16(checksum_fold(partial));
+		}
+		sum += partial;
+		odd ^= size & 1;
+	}
+
+	u64 sum = 0;
+	bool odd = false;
 };
@@ -0,0 +1,88 @@
+#include "checksum.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+	/// The previous implementation, 16 bit words into a 32 bit accumulator.
+	u16 word_checksum(const void* data, u32 size) {
+		u32 sum = 0;
+		if (size % 2) {
+			--size;
+			sum += static_cast<const u8*>(data)[size];
+		}
+		for (u32 i = 0; i < size / 2; ++i) {
+			sum += static_cast<const u16*>(data)[i];
+		}
+		u32 res = (sum & 0xFFFF) + (sum >> 16);
+		res = (res & 0xFFFF) + (res >> 16);
+		return ~res;
+	}
+
+	volatile u16 SINK;
+
+	template<typename F>
+	void run(const char* name, usize size, F fn) {
+		// roughly the same amount of data for every size
+		usize iterations = 512 * 1024 * 1024 / size;
+		auto start = std::chrono::steady_clock::now();
+		for (usize i = 0; i < iterations; ++i) {
+			SINK = fn();
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		double gbps = static_cast<double>(iterations * size) / seconds / 1e9;
+		double ns = seconds * 1e9 / static_cast<double>(iterations);
+		printf("%-16s %8zu bytes %8.2f GB/s %10.2f ns\n", name, size, gbps, ns);
+	}
+}
+
+int main() {
+	std::vector<u8> src(64 * 1024 + 1);
+	std::vector<u8> dest(src.size());
+	for (auto& byte : src) {
+		byte = rand();
+	}
+
+	for (usize size : {64, 576, 1460, 9000, 65536}) {
+		run("word", size, [&]() {
+			return word_checksum(src.data(), size);
+		});
+		run("wide", size, [&]() {
+			Checksum sum;
+			sum.add(src.data(), size);
+			return sum.get();
+		});
+		run("memcpy + wide", size, [&]() {
+			memcpy(dest.data(), src.data(), size);
+			Checksum sum;
+			sum.add(dest.data(), size);
+			return sum.get();
+		});
+		run("copy + checksum", size, [&]() {
+			Checksum sum;
+			sum.add_copy(dest.data(), src.data(), size);
+			return sum.get();
+		});
+		printf("\n");
+	}
+
+	// rewriting an address in an ipv4 header
+	u32 addr = 0;
+	run("header full", 20, [&]() {
+		memcpy(src.data() + 12, &++addr, 4);
+		Checksum sum;
+		sum.add(src.data(), 20);
+		return sum.get();
+	});
+	u16 checksum = 0;
+	run("header update", 20, [&]() {
+		u32 old_addr = addr++;
+		memcpy(src.data() + 12, &addr, 4);
+		checksum = checksum_update32(checksum, old_addr, addr);
+		return checksum;
+	});
+}
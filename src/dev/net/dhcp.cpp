@@ -1,6 +1,7 @@
 #include "dhcp.hpp"
 #include "nic/nic.hpp"
 #include "packet.hpp"
+#include "route.hpp"
 #include "udp.hpp"
 
 enum class Option : u8 {
@@ -107,7 +108,7 @@ void dhcp_process_packet(Nic& nic, ReceivedPacket& packet) {
 
 			Packet request_packet {static_cast<u32>(sizeof(EthernetHeader) + sizeof(Ipv4Header) + request_payload_size)};
 			request_packet.add_ethernet(nic.mac, BROADCAST_MAC, EtherType::Ipv4);
-			request_packet.add_ipv4(IpProtocol::Udp, request_payload_size, 0, 0xFFFFFFFF);
+			request_packet.add_ipv4(IpProtocol::Udp, request_payload_size, 0, 0xFFFFFFFF, false);
 			request_packet.add_udp(68, 67, request_payload_size - sizeof(UdpHeader));
 
 			auto* ptr = request_packet.add_header(request_payload_size - sizeof(UdpHeader));
@@ -156,14 +157,18 @@ void dhcp_process_packet(Nic& nic, ReceivedPacket& packet) {
 				"ip ", first, ".", second, ".", third, ".", fourth,
 				" leased for ", lease_seconds, " seconds");
 
-			IrqGuard irq_guard {};
-			auto guard = nic.lock.lock();
-			nic.ip = ip;
-			nic.subnet_mask = subnet_mask;
-			nic.gateway_ip = dhcp_hdr->giaddr;
-			if (!nic.gateway_ip) {
-				nic.gateway_ip = dhcp_hdr->siaddr;
+			{
+				IrqGuard irq_guard {};
+				auto guard = nic.lock.lock();
+				nic.ip = ip;
+				nic.subnet_mask = subnet_mask;
+				nic.gateway_ip = dhcp_hdr->giaddr;
+				if (!nic.gateway_ip) {
+					nic.gateway_ip = dhcp_hdr->siaddr;
+				}
 			}
+
+			route_configure_nic(nic);
 			nic.ip_available_event.signal_count(256);
 		}
 	}
@@ -175,7 +180,7 @@ void dhcp_discover(Nic* nic) {
 
 	Packet discover_packet {static_cast<u32>(sizeof(EthernetHeader) + sizeof(Ipv4Header) + discover_payload_size)};
 	discover_packet.add_ethernet(nic->mac, BROADCAST_MAC, EtherType::Ipv4);
-	discover_packet.add_ipv4(IpProtocol::Udp, discover_payload_size, 0, 0xFFFFFFFF);
+	discover_packet.add_ipv4(IpProtocol::Udp, discover_payload_size, 0, 0xFFFFFFFF, false);
 	discover_packet.add_udp(68, 67, discover_payload_size - sizeof(UdpHeader));
 
 	auto* ptr = discover_packet.add_header(discover_payload_size - sizeof(UdpHeader));
@@ -3,13 +3,18 @@
 #include "arp.hpp"
 #include "packet.hpp"
 
-void ethernet_process_packet(Nic& nic, void* data, usize) {
+void ethernet_process_packet(Nic& nic, void* data, usize size) {
+	if (size < sizeof(EthernetHeader)) {
+		return;
+	}
+
 	auto* hdr = static_cast<EthernetHeader*>(data);
 	hdr->deserialize();
 
 	ReceivedPacket packet {};
 	packet.layer0.ethernet = *hdr;
 	packet.layer1.raw = &hdr[1];
+	packet.layer1_len = static_cast<u32>(size - sizeof(EthernetHeader));
 
 	if (hdr->ether_type == EtherType::Ipv4) {
 		ipv4_process_packet(nic, packet);
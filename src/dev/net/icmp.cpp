@@ -0,0 +1,88 @@
+#include "icmp.hpp"
+#include "checksum.hpp"
+#include "cstring.hpp"
+#include "packet.hpp"
+#include "route.hpp"
+#include "tcp.hpp"
+
+namespace icmp_type {
+	static constexpr u8 DEST_UNREACHABLE = 3;
+}
+
+namespace unreachable_code {
+	static constexpr u8 FRAGMENTATION_NEEDED = 4;
+}
+
+/// RFC 1191 plateau table, used to guess the mtu if an old router didn't report it.
+static constexpr u16 MTU_PLATEAUS[] {32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, 68};
+
+static void process_fragmentation_needed(const IcmpHeader& hdr, const u8* quoted, u32 quoted_len, u32 own_ip) {
+	// the header of the dropped datagram and at least 8 bytes of its payload are quoted
+	if (quoted_len < sizeof(Ipv4Header)) {
+		return;
+	}
+
+	Ipv4Header orig {};
+	memcpy(&orig, quoted, sizeof(Ipv4Header));
+	orig.deserialize();
+
+	u32 orig_hdr_len = (orig.ihl_version & 0xF) * 4;
+	if (orig_hdr_len < sizeof(Ipv4Header) || quoted_len < orig_hdr_len + 8 || orig.src_addr != own_ip) {
+		return;
+	}
+
+	u32 mtu = kstd::to_ne_from_be(hdr.next_hop_mtu);
+	if (!mtu || mtu >= orig.total_len) {
+		mtu = 0;
+		for (auto plateau : MTU_PLATEAUS) {
+			if (plateau < orig.total_len) {
+				mtu = plateau;
+				break;
+			}
+		}
+	}
+	if (!mtu) {
+		return;
+	}
+
+	mtu = route_update_pmtu(orig.dest_addr, mtu);
+	if (!mtu) {
+		return;
+	}
+
+	if (orig.protocol == IpProtocol::Tcp) {
+		u16 ports[2];
+		u32 seq;
+		memcpy(ports, quoted + orig_hdr_len, 4);
+		memcpy(&seq, quoted + orig_hdr_len + 4, 4);
+		tcp_process_path_mtu(
+			orig.src_addr,
+			kstd::to_ne_from_be(ports[0]),
+			orig.dest_addr,
+			kstd::to_ne_from_be(ports[1]),
+			kstd::to_ne_from_be(seq),
+			mtu);
+	}
+}
+
+void icmp_process_packet(Nic&, ReceivedPacket& packet) {
+	if (packet.layer2_len < sizeof(IcmpHeader)) {
+		return;
+	}
+
+	Checksum sum;
+	sum.add(packet.layer2.raw, packet.layer2_len);
+	if (sum.get()) {
+		return;
+	}
+
+	IcmpHeader hdr {};
+	memcpy(&hdr, packet.layer2.raw, sizeof(IcmpHeader));
+
+	auto* quoted = offset(packet.layer2.raw, const u8*, sizeof(IcmpHeader));
+	u32 quoted_len = packet.layer2_len - sizeof(IcmpHeader);
+
+	if (hdr.type == icmp_type::DEST_UNREACHABLE && hdr.code == unreachable_code::FRAGMENTATION_NEEDED) {
+		process_fragmentation_needed(hdr, quoted, quoted_len, packet.layer1.ipv4.dest_addr);
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "types.hpp"
+
+struct IcmpHeader {
+	u8 type;
+	u8 code;
+	u16 checksum;
+	// layout of destination unreachable messages, other types use these bytes differently
+	u16 unused;
+	/// Mtu of the link the datagram couldn't be forwarded to if fragmentation was needed, zero if unknown.
+	u16 next_hop_mtu;
+};
+
+struct Nic;
+struct ReceivedPacket;
+
+void icmp_process_packet(Nic& nic, ReceivedPacket& packet);
@@ -2,6 +2,7 @@
 #include "types.hpp"
 
 enum class IpProtocol : u8 {
+	Icmp = 1,
 	Tcp = 6,
 	Udp = 17
 };
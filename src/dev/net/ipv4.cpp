@@ -1,34 +1,120 @@
 #include "ipv4.hpp"
+#include "arch/cpu.hpp"
 #include "checksum.hpp"
 #include "cstring.hpp"
+#include "dev/clock.hpp"
 #include "dhcp.hpp"
+#include "double_list.hpp"
+#include "icmp.hpp"
+#include "manually_destroy.hpp"
+#include "neighbour.hpp"
+#include "net_worker.hpp"
 #include "packet.hpp"
 #include "stdio.hpp"
 #include "tcp.hpp"
 #include "udp.hpp"
+#include "utils/irq_guard.hpp"
+#include "utils/spinlock.hpp"
+#include "vector.hpp"
 
-void ipv4_process_packet(Nic& nic, ReceivedPacket& packet) {
-	auto orig_layer1 = packet.layer1.raw;
+namespace {
+	/// Payload bytes [start, end) of a datagram that have been received.
+	struct FragmentRange {
+		u32 start;
+		u32 end;
+	};
 
-	Ipv4Header hdr {};
-	memcpy(&hdr, orig_layer1, sizeof(Ipv4Header));
-	hdr.deserialize();
+	struct ReassemblyQueue {
+		DoubleListHook hook {};
+		u32 src_addr;
+		u32 dest_addr;
+		u16 ident;
+		IpProtocol protocol;
+		u64 expires;
+		/// Payload size, only known once the last fragment arrived.
+		u32 total_len {UINT32_MAX};
+		u32 received {};
+		/// Header of the first fragment in host order, passed up with the datagram.
+		Ipv4Header hdr {};
+		bool has_first {};
+		kstd::vector<FragmentRange> ranges {};
+		kstd::vector<u8> data {};
+	};
 
-	packet.layer1.ipv4 = hdr;
+	/// Datagrams being reassembled, oldest first so expiring and evicting only look at the front.
+	struct Reassembly {
+		static constexpr usize MAX_QUEUES = 64;
+		/// Upper bound of the buffered payload of all queues, the oldest queues are dropped to stay below it.
+		static constexpr usize MAX_MEMORY = 1024 * 1024;
+		static constexpr u64 TIMEOUT = 30ULL * 1000 * 1000;
 
-	if ((hdr.frag_flags & 0x1FF) || (hdr.frag_flags >> 13 & 1U << 2)) {
-		println("[kernel][ipv4]: fragmentation is not supported");
+		void drop(ReassemblyQueue* queue) {
+			queues.remove(queue);
+			--count;
+			memory -= queue->data.size();
+			delete queue;
+		}
+
+		void arm_timer();
+
+		DoubleList<ReassemblyQueue, &ReassemblyQueue::hook> queues {};
+		usize count {};
+		usize memory {};
+		NetWorker* worker {};
+		NetTimer timer {};
+		bool timer_armed {};
+	};
+
+	ManuallyDestroy<Spinlock<Reassembly>> REASSEMBLY;
+}
+
+static u64 ipv4_now() {
+	return get_current_ns() / NS_IN_US;
+}
+
+static void reassembly_on_timer();
+
+void Reassembly::arm_timer() {
+	if (timer_armed || !queues.front()) {
 		return;
 	}
 
-	auto hdr_len = (hdr.ihl_version & 0xF) * 4;
-	packet.layer2.raw = offset(orig_layer1, void*, hdr_len);
-	packet.layer2_len = hdr.total_len - hdr_len;
+	if (!worker) {
+		worker = net_worker_get(get_current_thread()->cpu);
+		timer.fn = []() {
+			reassembly_on_timer();
+		};
+	}
+	timer_armed = true;
+	worker->arm(&timer, queues.front()->expires);
+}
+
+static void reassembly_on_timer() {
+	IrqGuard irq_guard {};
+	auto guard = REASSEMBLY->lock();
+	guard->timer_armed = false;
+
+	auto now = ipv4_now();
+	while (auto* queue = guard->queues.front()) {
+		if (queue->expires > now) {
+			break;
+		}
+		guard->drop(queue);
+	}
+	guard->arm_timer();
+}
+
+static void ipv4_deliver(Nic& nic, ReceivedPacket& packet) {
+	auto& hdr = packet.layer1.ipv4;
 
 	if (hdr.protocol == IpProtocol::Tcp) {
 		tcp_process_packet(nic, packet);
 	}
 	else if (hdr.protocol == IpProtocol::Udp) {
+		if (packet.layer2_len < sizeof(UdpHeader)) {
+			return;
+		}
+
 		UdpHeader udp_hdr {};
 		memcpy(&udp_hdr, packet.layer2.raw, sizeof(UdpHeader));
 		udp_hdr.deserialize();
@@ -39,6 +125,208 @@ void ipv4_process_packet(Nic& nic, ReceivedPacket& packet) {
 			udp_process_packet(nic, packet);
 		}
 	}
+	else if (hdr.protocol == IpProtocol::Icmp) {
+		icmp_process_packet(nic, packet);
+	}
+}
+
+/// Adds a fragment to its queue, returns the queue once the datagram is complete. The returned
+/// queue has already been removed from the table and has to be freed by the caller.
+static ReassemblyQueue* reassembly_add(const Ipv4Header& hdr, const void* payload, u32 payload_len) {
+	u32 start = (hdr.frag_flags & ipv4_flags::FRAGMENT_OFFSET) * 8;
+	u32 end = start + payload_len;
+	bool last = !(hdr.frag_flags & ipv4_flags::MORE_FRAGMENTS);
+
+	// every fragment but the last one carries a multiple of 8 bytes
+	if (!payload_len || (!last && payload_len % 8) || end > 0xFFFF - sizeof(Ipv4Header)) {
+		return nullptr;
+	}
+
+	IrqGuard irq_guard {};
+	auto guard = REASSEMBLY->lock();
+
+	ReassemblyQueue* queue = nullptr;
+	for (auto& existing : guard->queues) {
+		if (existing.ident == hdr.ident &&
+			existing.src_addr == hdr.src_addr &&
+			existing.dest_addr == hdr.dest_addr &&
+			existing.protocol == hdr.protocol) {
+			queue = &existing;
+			break;
+		}
+	}
+
+	if (!queue) {
+		if (guard->count == Reassembly::MAX_QUEUES) {
+			guard->drop(guard->queues.front());
+		}
+
+		queue = new ReassemblyQueue {
+			.src_addr = hdr.src_addr,
+			.dest_addr = hdr.dest_addr,
+			.ident = hdr.ident,
+			.protocol = hdr.protocol,
+			.expires = ipv4_now() + Reassembly::TIMEOUT
+		};
+		guard->queues.push(queue);
+		++guard->count;
+		guard->arm_timer();
+	}
+
+	if (last) {
+		if ((queue->total_len != UINT32_MAX && queue->total_len != end) ||
+			(!queue->ranges.is_empty() && queue->ranges[queue->ranges.size() - 1].end > end)) {
+			guard->drop(queue);
+			return nullptr;
+		}
+		queue->total_len = end;
+	}
+	else if (end > queue->total_len) {
+		guard->drop(queue);
+		return nullptr;
+	}
+
+	// overlapping fragments are only ever sent to confuse whoever reassembles them,
+	// so the whole datagram is dropped unless it's an exact duplicate
+	usize index = 0;
+	for (; index < queue->ranges.size(); ++index) {
+		auto& range = queue->ranges[index];
+		if (range.start == start && range.end == end) {
+			return nullptr;
+		}
+		else if (start < range.end && range.start < end) {
+			guard->drop(queue);
+			return nullptr;
+		}
+		else if (end <= range.start) {
+			break;
+		}
+	}
+
+	if (queue->data.size() < end) {
+		usize growth = end - queue->data.size();
+		while (guard->memory + growth > Reassembly::MAX_MEMORY) {
+			auto* oldest = guard->queues.front();
+			if (oldest == queue) {
+				guard->drop(queue);
+				return nullptr;
+			}
+			guard->drop(oldest);
+		}
+
+		queue->data.resize(end);
+		guard->memory += growth;
+	}
+
+	memcpy(queue->data.data() + start, payload, payload_len);
+	queue->ranges.push({});
+	for (usize i = queue->ranges.size() - 1; i > index; --i) {
+		queue->ranges[i] = queue->ranges[i - 1];
+	}
+	queue->ranges[index] = {.start = start, .end = end};
+	queue->received += payload_len;
+
+	if (!start) {
+		queue->hdr = hdr;
+		queue->has_first = true;
+	}
+
+	if (queue->has_first && queue->received == queue->total_len) {
+		guard->queues.remove(queue);
+		--guard->count;
+		guard->memory -= queue->data.size();
+		return queue;
+	}
+
+	return nullptr;
+}
+
+void ipv4_process_packet(Nic& nic, ReceivedPacket& packet) {
+	auto orig_layer1 = packet.layer1.raw;
+	if (packet.layer1_len < sizeof(Ipv4Header)) {
+		return;
+	}
+
+	Ipv4Header hdr {};
+	memcpy(&hdr, orig_layer1, sizeof(Ipv4Header));
+	hdr.deserialize();
+
+	packet.layer1.ipv4 = hdr;
+
+	u32 hdr_len = (hdr.ihl_version & 0xF) * 4;
+	// the frame may be longer because of link padding but never shorter
+	if (hdr_len < sizeof(Ipv4Header) || hdr.total_len < hdr_len || hdr.total_len > packet.layer1_len) {
+		return;
+	}
+
+	packet.layer2.raw = offset(orig_layer1, void*, hdr_len);
+	packet.layer2_len = hdr.total_len - hdr_len;
+
+	if (!(hdr.frag_flags & (ipv4_flags::MORE_FRAGMENTS | ipv4_flags::FRAGMENT_OFFSET))) {
+		ipv4_deliver(nic, packet);
+		return;
+	}
+
+	auto* queue = reassembly_add(hdr, packet.layer2.raw, packet.layer2_len);
+	if (!queue) {
+		return;
+	}
+
+	// the datagram is passed up as if it had arrived unfragmented
+	u32 first_hdr_len = (queue->hdr.ihl_version & 0xF) * 4;
+	packet.layer1.ipv4 = queue->hdr;
+	packet.layer1.ipv4.total_len = first_hdr_len + queue->total_len;
+	packet.layer1.ipv4.frag_flags = 0;
+	packet.layer2.raw = queue->data.data();
+	packet.layer2_len = queue->total_len;
+	ipv4_deliver(nic, packet);
+
+	delete queue;
+}
+
+bool ipv4_output(Nic& nic, u32 next_hop, u32 mtu, Packet& packet) {
+	u32 size = packet.size - sizeof(EthernetHeader);
+	if (size <= mtu) {
+		return neighbour_output(nic, next_hop, packet);
+	}
+
+	Ipv4Header hdr;
+	auto* ip_ptr = offset(packet.data, const u8*, sizeof(EthernetHeader));
+	memcpy(&hdr, ip_ptr, sizeof(Ipv4Header));
+	if (hdr.frag_flags & kstd::to_be(ipv4_flags::DONT_FRAGMENT)) {
+		return false;
+	}
+
+	u32 hdr_len = (hdr.ihl_version & 0xF) * 4;
+	u32 payload_len = size - hdr_len;
+	u32 max_fragment = (mtu - hdr_len) & ~7U;
+
+	for (u32 start = 0; start < payload_len; start += max_fragment) {
+		u32 len = kstd::min(max_fragment, payload_len - start);
+		bool last = start + len == payload_len;
+
+		Packet fragment {static_cast<u32>(sizeof(EthernetHeader) + hdr_len + len)};
+		memcpy(fragment.add_header(sizeof(EthernetHeader)), packet.data, sizeof(EthernetHeader));
+
+		// only the length and the offset change, so the checksum is updated instead of recalculated
+		Ipv4Header frag_hdr = hdr;
+		frag_hdr.total_len = kstd::to_be(static_cast<u16>(hdr_len + len));
+		frag_hdr.frag_flags = kstd::to_be(static_cast<u16>(start / 8 | (last ? 0 : ipv4_flags::MORE_FRAGMENTS)));
+		frag_hdr.hdr_checksum = checksum_update(hdr.hdr_checksum, hdr.total_len, frag_hdr.total_len);
+		frag_hdr.hdr_checksum = checksum_update(frag_hdr.hdr_checksum, hdr.frag_flags, frag_hdr.frag_flags);
+
+		auto* frag_ip_ptr = fragment.add_header(hdr_len);
+		memcpy(frag_ip_ptr, &frag_hdr, sizeof(Ipv4Header));
+		// options are copied into every fragment, nothing in the stack sends ones that shouldn't be
+		memcpy(offset(frag_ip_ptr, void*, sizeof(Ipv4Header)), ip_ptr + sizeof(Ipv4Header), hdr_len - sizeof(Ipv4Header));
+		memcpy(fragment.add_header(len), ip_ptr + hdr_len + start, len);
+
+		if (!neighbour_output(nic, next_hop, fragment)) {
+			return false;
+		}
+	}
+
+	return true;
 }
 
 void Ipv4Header::update_checksum() {
@@ -3,6 +3,12 @@
 #include "ip.hpp"
 #include "bit.hpp"
 
+namespace ipv4_flags {
+	static constexpr u16 FRAGMENT_OFFSET = 0x1FFF;
+	static constexpr u16 MORE_FRAGMENTS = 1 << 13;
+	static constexpr u16 DONT_FRAGMENT = 1 << 14;
+}
+
 struct Ipv4Header {
 	u8 ihl_version;
 	u8 ecn_dscp;
@@ -31,6 +37,11 @@ struct Ipv4Header {
 };
 
 struct Nic;
+struct Packet;
 struct ReceivedPacket;
 
 void ipv4_process_packet(Nic& nic, ReceivedPacket& packet);
+
+/// Sends a frame built with `Packet::add_ipv4` to `next_hop`, splitting it into fragments if it's larger
+/// than `mtu`. Returns false if it was dropped, which includes frames that are too large but may not be fragmented.
+bool ipv4_output(Nic& nic, u32 next_hop, u32 mtu, Packet& packet);
@@ -0,0 +1,400 @@
+#include "neighbour.hpp"
+#include "algorithm.hpp"
+#include "arch/cpu.hpp"
+#include "arp.hpp"
+#include "cstring.hpp"
+#include "dev/clock.hpp"
+#include "nic/nic.hpp"
+#include "packet.hpp"
+#include "vector.hpp"
+
+struct PendingFrame {
+	PendingFrame* next;
+	kstd::vector<u8> data;
+	TxOffload offload;
+};
+
+static u64 neighbour_now() {
+	return get_current_ns() / NS_IN_US;
+}
+
+static constexpr usize neighbour_hash(u32 ip) {
+	return (ip * u32 {0x9E3779B1}) >> 24;
+}
+
+static_assert(NeighbourTable::CAPACITY == 256, "neighbour_hash produces 8 bits");
+
+static u64 pack_mac(const Mac& mac) {
+	u64 value = 0;
+	memcpy(&value, mac.data.data, 6);
+	return value;
+}
+
+static Mac unpack_mac(u64 value) {
+	Mac mac {};
+	memcpy(mac.data.data, &value, 6);
+	return mac;
+}
+
+static void write_begin(Neighbour& entry) {
+	entry.seq.store(entry.seq.load(kstd::memory_order::relaxed) + 1, kstd::memory_order::relaxed);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void write_end(Neighbour& entry) {
+	entry.seq.store(entry.seq.load(kstd::memory_order::relaxed) + 1, kstd::memory_order::release);
+}
+
+static void free_pending(PendingFrame* frame) {
+	while (frame) {
+		auto* next = frame->next;
+		delete frame;
+		frame = next;
+	}
+}
+
+NeighbourTable::~NeighbourTable() {
+	if (worker) {
+		worker->disarm_sync(&timer);
+	}
+	for (auto& entry : entries) {
+		free_pending(entry.pending);
+	}
+}
+
+NeighbourTable::Snapshot NeighbourTable::find(u32 ip) {
+	auto start = neighbour_hash(ip);
+	for (usize i = 0; i < CAPACITY; ++i) {
+		auto& entry = entries[(start + i) % CAPACITY];
+
+		while (true) {
+			auto seq = entry.seq.load(kstd::memory_order::acquire);
+			if (seq & 1) {
+				continue;
+			}
+
+			auto entry_ip = entry.ip.load(kstd::memory_order::relaxed);
+			auto state = entry.state.load(kstd::memory_order::relaxed);
+			auto mac = entry.mac.load(kstd::memory_order::relaxed);
+			auto confirmed = entry.confirmed.load(kstd::memory_order::relaxed);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (entry.seq.load(kstd::memory_order::relaxed) != seq) {
+				continue;
+			}
+
+			// slots never go back to being free so a free one ends the probe sequence
+			if (state == NeighbourState::Free) {
+				return {};
+			}
+			else if (entry_ip == ip) {
+				return {
+					.entry = &entry,
+					.state = state,
+					.mac = unpack_mac(mac),
+					.confirmed = confirmed
+				};
+			}
+			break;
+		}
+	}
+
+	return {};
+}
+
+Neighbour* NeighbourTable::find_locked(u32 ip) {
+	auto start = neighbour_hash(ip);
+	for (usize i = 0; i < CAPACITY; ++i) {
+		auto& entry = entries[(start + i) % CAPACITY];
+		auto state = entry.state.load(kstd::memory_order::relaxed);
+		if (state == NeighbourState::Free) {
+			return nullptr;
+		}
+		else if (entry.ip.load(kstd::memory_order::relaxed) == ip) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+Neighbour* NeighbourTable::allocate_locked(u32 ip, u64 now) {
+	// the new entry has to be reachable from the start of its own probe sequence,
+	// so the first free or unused slot in it is taken
+	auto start = neighbour_hash(ip);
+	for (usize i = 0; i < CAPACITY; ++i) {
+		auto& entry = entries[(start + i) % CAPACITY];
+		auto state = entry.state.load(kstd::memory_order::relaxed);
+
+		bool reusable;
+		switch (state) {
+			case NeighbourState::Free:
+			case NeighbourState::Failed:
+				reusable = !entry.pending;
+				break;
+			case NeighbourState::Reachable:
+			case NeighbourState::Stale:
+				reusable = now - entry.confirmed.load(kstd::memory_order::relaxed) >= GC_TIME;
+				break;
+			case NeighbourState::Incomplete:
+			case NeighbourState::Probe:
+				reusable = false;
+				break;
+		}
+
+		if (!reusable) {
+			continue;
+		}
+
+		write_begin(entry);
+		entry.ip.store(ip, kstd::memory_order::relaxed);
+		entry.mac.store(0, kstd::memory_order::relaxed);
+		entry.confirmed.store(0, kstd::memory_order::relaxed);
+		entry.state.store(NeighbourState::Incomplete, kstd::memory_order::relaxed);
+		write_end(entry);
+		entry.last_query = 0;
+		entry.queries = 0;
+		return &entry;
+	}
+
+	return nullptr;
+}
+
+void NeighbourTable::query(Neighbour& entry, u32 ip, u64 now) {
+	entry.last_query = now;
+	++entry.queries;
+	arp_send_query(nic, ip);
+}
+
+void NeighbourTable::set_state(Neighbour& entry, NeighbourState state) {
+	write_begin(entry);
+	entry.state.store(state, kstd::memory_order::relaxed);
+	write_end(entry);
+}
+
+void NeighbourTable::start_probe(u32 ip, u64 now) {
+	IrqGuard irq_guard {};
+	auto guard = lock.lock();
+
+	// another sender may have started it between the lockless lookup and taking the lock
+	auto* entry = find_locked(ip);
+	if (!entry || entry->state.load(kstd::memory_order::relaxed) != NeighbourState::Stale) {
+		return;
+	}
+
+	set_state(*entry, NeighbourState::Probe);
+	entry->queries = 0;
+	query(*entry, ip, now);
+	arm_timer(now + RETRANS_TIME);
+}
+
+void NeighbourTable::arm_timer(u64 deadline) {
+	if (timer_deadline <= deadline) {
+		return;
+	}
+
+	if (!worker) {
+		worker = net_worker_get(get_current_thread()->cpu);
+		timer.fn = [this]() {
+			on_timer();
+		};
+	}
+	timer_deadline = deadline;
+	worker->arm(&timer, deadline);
+}
+
+void NeighbourTable::on_timer() {
+	IrqGuard irq_guard {};
+	auto guard = lock.lock();
+	timer_deadline = UINT64_MAX;
+
+	auto now = neighbour_now();
+	u64 next = UINT64_MAX;
+	for (auto& entry : entries) {
+		switch (entry.state.load(kstd::memory_order::relaxed)) {
+			case NeighbourState::Reachable:
+			{
+				auto expiry = entry.confirmed.load(kstd::memory_order::relaxed) + REACHABLE_TIME;
+				if (now >= expiry) {
+					set_state(entry, NeighbourState::Stale);
+				}
+				else {
+					next = kstd::min(next, expiry);
+				}
+				break;
+			}
+			case NeighbourState::Incomplete:
+			case NeighbourState::Probe:
+				if (now - entry.last_query < RETRANS_TIME) {
+					next = kstd::min(next, entry.last_query + RETRANS_TIME);
+				}
+				else if (entry.queries < MAX_QUERIES) {
+					query(entry, entry.ip.load(kstd::memory_order::relaxed), now);
+					next = kstd::min(next, now + RETRANS_TIME);
+				}
+				else {
+					// the old mapping of a probed entry is dropped with it so nothing is sent to a dead host
+					write_begin(entry);
+					entry.mac.store(0, kstd::memory_order::relaxed);
+					entry.state.store(NeighbourState::Failed, kstd::memory_order::relaxed);
+					write_end(entry);
+					free_pending(entry.pending);
+					entry.pending = nullptr;
+					entry.pending_count = 0;
+				}
+				break;
+			case NeighbourState::Free:
+			case NeighbourState::Stale:
+			case NeighbourState::Failed:
+				break;
+		}
+	}
+
+	if (next != UINT64_MAX) {
+		arm_timer(next);
+	}
+}
+
+static bool neighbour_usable(NeighbourState state) {
+	return state == NeighbourState::Reachable || state == NeighbourState::Stale || state == NeighbourState::Probe;
+}
+
+kstd::optional<Mac> NeighbourTable::lookup(u32 ip) {
+	auto snapshot = find(ip);
+	if (neighbour_usable(snapshot.state)) {
+		return snapshot.mac;
+	}
+	return {};
+}
+
+bool NeighbourTable::output(u32 ip, void* frame, u32 size, const TxOffload& offload) {
+	auto now = neighbour_now();
+
+	auto snapshot = find(ip);
+	if (neighbour_usable(snapshot.state)) {
+		if (snapshot.state == NeighbourState::Stale) {
+			// the old mapping keeps being used while it's probed
+			start_probe(ip, now);
+		}
+
+		memcpy(frame, snapshot.mac.data.data, 6);
+		nic.send_offload(frame, size, offload);
+		return true;
+	}
+
+	Mac mac;
+	{
+		IrqGuard irq_guard {};
+		auto guard = lock.lock();
+
+		auto* entry = find_locked(ip);
+		if (!entry) {
+			entry = allocate_locked(ip, now);
+			if (!entry) {
+				return false;
+			}
+		}
+
+		auto state = entry->state.load(kstd::memory_order::relaxed);
+		if (state == NeighbourState::Failed) {
+			if (now - entry->last_query < RETRANS_TIME) {
+				return false;
+			}
+
+			set_state(*entry, NeighbourState::Incomplete);
+			entry->queries = 0;
+			state = NeighbourState::Incomplete;
+		}
+
+		if (state == NeighbourState::Incomplete) {
+			if (!entry->queries) {
+				query(*entry, ip, now);
+				arm_timer(now + RETRANS_TIME);
+			}
+
+			if (entry->pending_count == MAX_PENDING) {
+				return false;
+			}
+
+			auto* pending = new PendingFrame {
+				.next = nullptr,
+				.data {},
+				.offload = offload
+			};
+			pending->data.resize(size);
+			memcpy(pending->data.data(), frame, size);
+
+			auto** tail = &entry->pending;
+			while (*tail) {
+				tail = &(*tail)->next;
+			}
+			*tail = pending;
+			++entry->pending_count;
+			return true;
+		}
+
+		// resolved between the lockless lookup and taking the lock
+		mac = unpack_mac(entry->mac.load(kstd::memory_order::relaxed));
+	}
+
+	memcpy(frame, mac.data.data, 6);
+	nic.send_offload(frame, size, offload);
+	return true;
+}
+
+void NeighbourTable::update(u32 ip, const Mac& mac, bool create) {
+	auto now = neighbour_now();
+
+	PendingFrame* pending;
+	{
+		IrqGuard irq_guard {};
+		auto guard = lock.lock();
+
+		auto* entry = find_locked(ip);
+		if (!entry) {
+			if (!create) {
+				return;
+			}
+			entry = allocate_locked(ip, now);
+			if (!entry) {
+				return;
+			}
+		}
+
+		write_begin(*entry);
+		entry->mac.store(pack_mac(mac), kstd::memory_order::relaxed);
+		entry->confirmed.store(now, kstd::memory_order::relaxed);
+		entry->state.store(NeighbourState::Reachable, kstd::memory_order::relaxed);
+		write_end(*entry);
+		entry->queries = 0;
+		arm_timer(now + REACHABLE_TIME);
+
+		pending = entry->pending;
+		entry->pending = nullptr;
+		entry->pending_count = 0;
+	}
+
+	for (auto* frame = pending; frame; frame = frame->next) {
+		memcpy(frame->data.data(), mac.data.data, 6);
+		nic.send_offload(frame->data.data(), frame->data.size(), frame->offload);
+	}
+	free_pending(pending);
+}
+
+bool neighbour_output(Nic& nic, u32 next_hop, Packet& packet) {
+	return neighbour_output(nic, next_hop, packet, {});
+}
+
+bool neighbour_output(Nic& nic, u32 next_hop, Packet& packet, const TxOffload& offload) {
+	if (nic.no_arp) {
+		nic.send_offload(packet.data, packet.size, offload);
+		return true;
+	}
+	else if (next_hop == 0xFFFFFFFF) {
+		memcpy(packet.data, BROADCAST_MAC.data.data, 6);
+		nic.send_offload(packet.data, packet.size, offload);
+		return true;
+	}
+	else if (!next_hop) {
+		return false;
+	}
+	return nic.neighbours.output(next_hop, packet.data, packet.size, offload);
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "atomic.hpp"
+#include "mac.hpp"
+#include "net_worker.hpp"
+#include "optional.hpp"
+#include "types.hpp"
+#include "utils/spinlock.hpp"
+
+struct Nic;
+struct Packet;
+struct PendingFrame;
+struct TxOffload;
+
+enum class NeighbourState : u8 {
+	Free,
+	/// A query was sent, frames for the address are queued until it's answered.
+	Incomplete,
+	/// The mapping was confirmed within `NeighbourTable::REACHABLE_TIME`.
+	Reachable,
+	/// The mapping wasn't confirmed in time, the next use starts probing it.
+	Stale,
+	/// The mapping is still used while queries confirm it, it fails after `MAX_QUERIES` without a reply.
+	Probe,
+	/// No reply was received, frames are dropped until the next attempt and the slot may be reused.
+	Failed
+};
+
+struct Neighbour {
+	// read without the table lock, `seq` is odd while a writer is changing them
+	kstd::atomic<u32> seq {};
+	kstd::atomic<u32> ip {};
+	kstd::atomic<u64> mac {};
+	kstd::atomic<u64> confirmed {};
+	kstd::atomic<NeighbourState> state {};
+
+	// protected by the table lock
+	/// Time the last query was sent.
+	u64 last_query {};
+	PendingFrame* pending {};
+	u32 pending_count {};
+	u32 queries {};
+};
+
+/// Ipv4 to mac mappings of a nic. Entries live in a fixed open addressed array that is never
+/// shrunk, slots are only reused in place, so the tx path can look them up without taking a lock.
+struct NeighbourTable {
+	static constexpr usize CAPACITY = 256;
+	static constexpr u64 REACHABLE_TIME = 30ULL * 1000 * 1000;
+	static constexpr u64 RETRANS_TIME = 1000 * 1000;
+	/// Time after which an idle stale entry may be replaced by a new one.
+	static constexpr u64 GC_TIME = 60ULL * 1000 * 1000;
+	static constexpr u32 MAX_QUERIES = 3;
+	/// Enough for every fragment of a maximum sized datagram on an ethernet link.
+	static constexpr u32 MAX_PENDING = 48;
+
+	explicit NeighbourTable(Nic& nic) : nic {nic} {}
+	~NeighbourTable();
+
+	NeighbourTable(const NeighbourTable&) = delete;
+	NeighbourTable& operator=(const NeighbourTable&) = delete;
+
+	/// Returns the mac of `ip` if it's resolved, never blocks or sends anything.
+	kstd::optional<Mac> lookup(u32 ip);
+
+	/// Fills in the destination mac of an ethernet frame and sends it to `ip`. If the address
+	/// isn't resolved yet a copy of the frame is queued and sent once a reply arrives.
+	/// Returns false if the frame was dropped.
+	bool output(u32 ip, void* frame, u32 size, const TxOffload& offload);
+
+	/// Records the sender of a received arp packet, a new entry is only created if `create` is set.
+	void update(u32 ip, const Mac& mac, bool create);
+
+private:
+	struct Snapshot {
+		Neighbour* entry;
+		NeighbourState state;
+		Mac mac;
+		u64 confirmed;
+	};
+
+	[[nodiscard]] Snapshot find(u32 ip);
+	Neighbour* find_locked(u32 ip);
+	Neighbour* allocate_locked(u32 ip, u64 now);
+	void query(Neighbour& entry, u32 ip, u64 now);
+	void start_probe(u32 ip, u64 now);
+	void set_state(Neighbour& entry, NeighbourState state);
+	void arm_timer(u64 deadline);
+	void on_timer();
+
+	Nic& nic;
+	Neighbour entries[CAPACITY] {};
+	Spinlock<void> lock {};
+	NetWorker* worker {};
+	NetTimer timer {};
+	/// Deadline the timer is armed for, UINT64_MAX if it isn't.
+	u64 timer_deadline {UINT64_MAX};
+};
+
+/// Sends an ipv4 frame built with `Packet::add_ethernet` through `nic` to the next hop picked by the routing table.
+bool neighbour_output(Nic& nic, u32 next_hop, Packet& packet);
+bool neighbour_output(Nic& nic, u32 next_hop, Packet& packet, const TxOffload& offload);
@@ -0,0 +1,198 @@
+#include "net_worker.hpp"
+#include "algorithm.hpp"
+#include "arch/cpu.hpp"
+#include "config.hpp"
+#include "dev/clock.hpp"
+
+static u64 worker_now() {
+	return get_current_ns() / NS_IN_US;
+}
+
+NetWorker::NetWorker(Cpu* cpu) : cpu {cpu} {
+	IrqGuard irq_guard {};
+	thread = new Thread {"net worker", cpu, &*KERNEL_PROCESS, worker_fn, this};
+	thread->pin_cpu = true;
+	thread->pin_level = true;
+	cpu->scheduler.queue(thread);
+	cpu->thread_count.fetch_add(1, kstd::memory_order::seq_cst);
+}
+
+void NetWorker::arm(NetTimer* timer, u64 deadline) {
+	assert(deadline != UINT64_MAX);
+
+	IrqGuard irq_guard {};
+	auto guard = state.lock();
+	if (timer->deadline != UINT64_MAX) {
+		guard->wheel[timer->slot].remove(timer);
+		--guard->armed;
+	}
+
+	// a deadline in a tick that was already passed goes into the current one so it isn't missed
+	auto tick = kstd::max(deadline / TICK_US, guard->next_tick);
+	timer->deadline = deadline;
+	timer->slot = tick % WHEEL_SLOTS;
+	guard->wheel[timer->slot].push(timer);
+	++guard->armed;
+
+	if (deadline < guard->wake_at) {
+		guard->wake_at = 0;
+		event.signal_one_if_not_pending();
+	}
+}
+
+void NetWorker::disarm(NetTimer* timer) {
+	IrqGuard irq_guard {};
+	auto guard = state.lock();
+	if (timer->deadline != UINT64_MAX) {
+		guard->wheel[timer->slot].remove(timer);
+		timer->deadline = UINT64_MAX;
+		--guard->armed;
+	}
+}
+
+void NetWorker::disarm_sync(NetTimer* timer) {
+	bool running;
+	{
+		IrqGuard irq_guard {};
+		auto guard = state.lock();
+		if (timer->deadline != UINT64_MAX) {
+			guard->wheel[timer->slot].remove(timer);
+			timer->deadline = UINT64_MAX;
+			--guard->armed;
+		}
+		running = guard->running == timer;
+	}
+
+	if (running) {
+		assert(get_current_thread() != thread);
+
+		// work is run in order after the current callback returns
+		Event done {};
+		DeferredIrqWork barrier {
+			.fn {[&done]() {
+				done.signal_one();
+			}}
+		};
+		defer(&barrier);
+		done.wait();
+	}
+}
+
+void NetWorker::defer(DeferredIrqWork* work) {
+	IrqGuard irq_guard {};
+	state.lock()->work.push(work);
+	event.signal_one_if_not_pending();
+}
+
+NetTimer* NetWorker::State::pop_expired(u64 now) {
+	u64 now_tick = now / TICK_US;
+	if (!armed) {
+		next_tick = kstd::max(next_tick, now_tick);
+		return nullptr;
+	}
+
+	// a full revolution visits every slot, there is no need to walk ticks one by one after an idle period
+	if (now_tick > next_tick + WHEEL_SLOTS) {
+		next_tick = now_tick - WHEEL_SLOTS;
+	}
+
+	while (true) {
+		auto& slot = wheel[next_tick % WHEEL_SLOTS];
+		for (auto& timer : slot) {
+			if (timer.deadline <= now) {
+				slot.remove(&timer);
+				timer.deadline = UINT64_MAX;
+				--armed;
+				return &timer;
+			}
+		}
+
+		if (next_tick >= now_tick) {
+			return nullptr;
+		}
+		++next_tick;
+	}
+}
+
+u64 NetWorker::State::next_expiry() const {
+	if (!armed) {
+		return UINT64_MAX;
+	}
+
+	// timers further out than one revolution share slots with closer ones,
+	// waking up for them early only costs an empty pass over the slot
+	for (usize i = 0; i < WHEEL_SLOTS; ++i) {
+		if (!wheel[(next_tick + i) % WHEEL_SLOTS].is_empty()) {
+			return (next_tick + i + 1) * TICK_US;
+		}
+	}
+	return UINT64_MAX;
+}
+
+bool NetWorker::run_one(u64 now) {
+	DeferredIrqWork* work = nullptr;
+	NetTimer* timer = nullptr;
+
+	{
+		IrqGuard irq_guard {};
+		auto guard = state.lock();
+		work = guard->work.pop_front();
+		if (!work) {
+			timer = guard->pop_expired(now);
+			guard->running = timer;
+		}
+	}
+
+	if (work) {
+		work->fn();
+		return true;
+	}
+	else if (timer) {
+		timer->fn();
+
+		IrqGuard irq_guard {};
+		state.lock()->running = nullptr;
+		return true;
+	}
+
+	return false;
+}
+
+void NetWorker::worker_fn(void* arg) {
+	auto* self = static_cast<NetWorker*>(arg);
+
+	while (true) {
+		while (self->run_one(worker_now()));
+
+		u64 wake_at;
+		{
+			IrqGuard irq_guard {};
+			auto guard = self->state.lock();
+			wake_at = guard->next_expiry();
+			guard->wake_at = wake_at;
+		}
+
+		if (wake_at == UINT64_MAX) {
+			self->event.wait();
+			continue;
+		}
+
+		auto now = worker_now();
+		if (wake_at > now) {
+			self->event.wait_with_timeout((wake_at - now) * NS_IN_US);
+		}
+	}
+}
+
+namespace {
+	Spinlock<NetWorker*> WORKERS[CONFIG_MAX_CPUS] {};
+}
+
+NetWorker* net_worker_get(Cpu* cpu) {
+	IrqGuard irq_guard {};
+	auto guard = WORKERS[cpu->number].lock();
+	if (!*guard) {
+		*guard = new NetWorker {cpu};
+	}
+	return *guard;
+}
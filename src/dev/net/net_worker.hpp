@@ -0,0 +1,67 @@
+#pragma once
+#include "dev/event.hpp"
+#include "double_list.hpp"
+#include "functional.hpp"
+#include "sched/deferred_work.hpp"
+#include "types.hpp"
+#include "utils/spinlock.hpp"
+
+struct Cpu;
+struct NetWorker;
+
+/// One shot timer run on a network worker, `fn` is called from the worker thread with irqs enabled.
+struct NetTimer {
+	DoubleListHook hook {};
+	kstd::small_function<void()> fn;
+	/// Expiry in microseconds, UINT64_MAX if the timer isn't armed.
+	u64 deadline {UINT64_MAX};
+	u16 slot {};
+};
+
+/// Per cpu context that drives protocol timers and deferred work so connections don't need
+/// a thread of their own. Timers are kept in a hashed wheel with millisecond ticks,
+/// arming and disarming them is constant time regardless of how many are pending.
+struct NetWorker {
+	explicit NetWorker(Cpu* cpu);
+
+	/// Arms or rearms `timer` to expire at `deadline` (in microseconds).
+	void arm(NetTimer* timer, u64 deadline);
+	/// Disarms `timer`, its callback may still be running on the worker.
+	void disarm(NetTimer* timer);
+	/// Disarms `timer` and waits for its callback to return if it's currently running.
+	void disarm_sync(NetTimer* timer);
+	/// Queues `work` to be run on the worker thread, can be called from irq context.
+	void defer(DeferredIrqWork* work);
+
+	[[noreturn]] static void worker_fn(void* arg);
+
+	Cpu* const cpu;
+
+private:
+	static constexpr usize WHEEL_SLOTS = 512;
+	static constexpr u64 TICK_US = 1000;
+
+	struct State {
+		/// Removes an expired timer from the wheel, advancing the wheel up to `now`.
+		NetTimer* pop_expired(u64 now);
+		/// End of the first tick with a timer in it, UINT64_MAX if there are none.
+		[[nodiscard]] u64 next_expiry() const;
+
+		DoubleList<NetTimer, &NetTimer::hook> wheel[WHEEL_SLOTS] {};
+		DoubleList<DeferredIrqWork, &DeferredIrqWork::hook> work {};
+		NetTimer* running {};
+		u64 next_tick {};
+		u64 wake_at {};
+		usize armed {};
+	};
+
+	/// Runs a single work item or expired timer, returns false if there was nothing to do.
+	bool run_one(u64 now);
+
+	Spinlock<State> state {};
+	Event event {};
+	Thread* thread {};
+};
+
+/// Returns the worker of `cpu`, starting it on first use.
+NetWorker* net_worker_get(Cpu* cpu);
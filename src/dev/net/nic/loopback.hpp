@@ -0,0 +1,4 @@
+#pragma once
+
+/// Registers the `lo` interface with 127.0.0.1/8, called before any other nic so it gets index 0.
+void loopback_init();
@@ -1,8 +1,71 @@
 #include "nic.hpp"
+#include "arch/cpu.hpp"
 #include "dev/clock.hpp"
+#include "dev/net/checksum.hpp"
 
 ManuallyDestroy<Spinlock<kstd::vector<kstd::shared_ptr<Nic>>>> NICS;
 
+void RxPoller::start(kstd::string_view name, Cpu* cpu) {
+	IrqGuard irq_guard {};
+	auto* thread = new Thread {name, cpu, &*KERNEL_PROCESS, poll_fn, this};
+	thread->pin_cpu = true;
+	thread->pin_level = true;
+	cpu->scheduler.queue(thread);
+	cpu->thread_count.fetch_add(1, kstd::memory_order::seq_cst);
+}
+
+void RxPoller::schedule() {
+	stats.irqs.fetch_add(1, kstd::memory_order::relaxed);
+	event.signal_one_if_not_pending();
+}
+
+void RxPoller::poll_fn(void* arg) {
+	auto* self = static_cast<RxPoller*>(arg);
+
+	while (true) {
+		self->event.wait();
+
+		while (true) {
+			u32 done;
+			{
+				// the protocol handlers still expect to run with irqs disabled
+				IrqGuard irq_guard {};
+				done = self->poll(self->budget);
+			}
+
+			self->stats.packets.fetch_add(done, kstd::memory_order::relaxed);
+			self->stats.polls.fetch_add(1, kstd::memory_order::relaxed);
+
+			if (done < self->budget) {
+				IrqGuard irq_guard {};
+				if (self->enable_irq()) {
+					break;
+				}
+				continue;
+			}
+
+			// let other threads run before the next batch so a flood can't starve them
+			self->stats.budget_exhausted.fetch_add(1, kstd::memory_order::relaxed);
+			get_current_thread()->cpu->scheduler.yield();
+		}
+	}
+}
+
+void Nic::send_offload(void* data, u32 size, const TxOffload& offload) {
+	assert(!offload.tcp_mss);
+
+	if (offload.csum_start) {
+		assert(offload.csum_start + offload.csum_offset + 2u <= size);
+
+		Checksum sum;
+		sum.add(offset(data, void*, offload.csum_start), size - offload.csum_start);
+		u16 value = sum.get();
+		memcpy(offset(data, void*, offload.csum_start + offload.csum_offset), &value, 2);
+	}
+
+	send(data, size);
+}
+
 void Nic::wait_for_ip() {
 	bool wait = false;
 	{
@@ -49,3 +112,12 @@ void nics_wait_ready() {
 		nic->wait_for_ip_with_timeout(1);
 	}
 }
+
+kstd::shared_ptr<Nic> nics_get(usize index) {
+	IrqGuard irq_guard {};
+	auto guard = NICS->lock();
+	if (index >= guard->size()) {
+		return nullptr;
+	}
+	return (*guard)[index];
+}
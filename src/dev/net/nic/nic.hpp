@@ -1,14 +1,79 @@
 #pragma once
+#include "atomic.hpp"
+#include "crescent/socket.h"
 #include "dev/event.hpp"
 #include "dev/net/mac.hpp"
+#include "dev/net/neighbour.hpp"
+#include "functional.hpp"
 #include "manually_destroy.hpp"
 #include "shared_ptr.hpp"
 #include "vector.hpp"
 
+/// Work that can be left for the nic to do on a frame being sent.
+struct TxOffload {
+	/// Offset of the first byte covered by the l4 checksum, zero if there is no checksum to fill in.
+	/// The checksum field itself holds the folded (not inverted) pseudo header sum.
+	u16 csum_start {};
+	/// Offset of the checksum field from csum_start.
+	u16 csum_offset {};
+	/// If not zero the frame is a tcpv4 segment larger than the mtu that has to be
+	/// split into segments carrying at most this many bytes of payload.
+	u16 tcp_mss {};
+};
+
+struct Cpu;
+
+struct RxStats {
+	kstd::atomic<u64> packets {};
+	kstd::atomic<u64> irqs {};
+	kstd::atomic<u64> polls {};
+	/// Polls that used up the whole budget and had to yield before continuing.
+	kstd::atomic<u64> budget_exhausted {};
+
+	void add_to(NicRxStats& out) const {
+		out.packets += packets.load(kstd::memory_order::relaxed);
+		out.irqs += irqs.load(kstd::memory_order::relaxed);
+		out.polls += polls.load(kstd::memory_order::relaxed);
+		out.budget_exhausted += budget_exhausted.load(kstd::memory_order::relaxed);
+	}
+};
+
+/// Deferred receive processing for one rx ring. The driver's irq handler masks the ring's
+/// interrupt and calls `schedule`, the poll thread then processes frames in batches of at most
+/// `budget` and only unmasks the interrupt once the ring has been drained.
+struct RxPoller {
+	/// Processes at most `budget` received frames and returns how many were processed.
+	kstd::small_function<u32(u32 budget)> poll;
+	/// Unmasks the ring's interrupt, returns false if frames arrived in the meantime.
+	kstd::small_function<bool()> enable_irq;
+
+	void start(kstd::string_view name, Cpu* cpu);
+	void schedule();
+
+	static void poll_fn(void* arg);
+
+	u32 budget {64};
+	RxStats stats {};
+	Event event {};
+};
+
 struct Nic {
 	virtual ~Nic() = default;
 
 	virtual void send(const void* data, u32 size) = 0;
+	/// Sends a frame with a partial checksum, the default implementation completes it in software.
+	/// Segmentation may only be requested if `tso` is set.
+	virtual void send_offload(void* data, u32 size, const TxOffload& offload);
+
+	/// Configures hardware rx interrupt coalescing, an interrupt is raised after `max_frames`
+	/// frames or `max_usecs` microseconds, whichever comes first. Zero disables the limit.
+	/// Returns false if the nic doesn't support it.
+	virtual bool set_irq_coalescing(u32 max_frames, u32 max_usecs) {
+		return false;
+	}
+
+	/// Adds the counters of every rx ring to `stats`.
+	virtual void get_rx_stats(NicRxStats& stats) const {}
 
 	void wait_for_ip();
 	bool wait_for_ip_with_timeout(usize seconds);
@@ -17,10 +82,18 @@ struct Nic {
 	u32 ip {};
 	u32 subnet_mask {};
 	u32 gateway_ip {};
+	u32 mtu {1500};
+	bool tx_csum_offload {};
+	bool tso {};
+	/// The link has no addresses to resolve, frames are sent without a destination mac.
+	bool no_arp {};
 	Spinlock<void> lock {};
 	Event ip_available_event {};
+	NeighbourTable neighbours {*this};
 };
 
 void nics_wait_ready();
+/// Returns the nic with the given index in registration order or null.
+kstd::shared_ptr<Nic> nics_get(usize index);
 
 extern ManuallyDestroy<Spinlock<kstd::vector<kstd::shared_ptr<Nic>>>> NICS;
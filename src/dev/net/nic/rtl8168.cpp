@@ -28,6 +28,7 @@ namespace regs {
 	static constexpr BitRegister<u8> PHY_STS {0x6C};
 	static constexpr BitRegister<u16> RMS {0xDA};
 	static constexpr BitRegister<u16> CPCR {0xE0};
+	static constexpr BitRegister<u16> INTR_MITIGATE {0xE2};
 	static constexpr BasicRegister<u32> RDSAR_LOW {0xE4};
 	static constexpr BasicRegister<u32> RDSAR_HIGH {0xE8};
 	static constexpr BitRegister<u8> MTPS {0xEC};
@@ -107,6 +108,13 @@ namespace cpcr {
 	static constexpr BitField<u16, bool> RX_VLAN {6, 1};
 }
 
+namespace intr_mitigate {
+	static constexpr BitField<u16, u8> RX_FRAMES {0, 4};
+	static constexpr BitField<u16, u8> RX_TIMER {4, 4};
+	static constexpr BitField<u16, u8> TX_FRAMES {8, 4};
+	static constexpr BitField<u16, u8> TX_TIMER {12, 4};
+}
+
 namespace mtps {
 	static constexpr BitField<u8, u8> MTPS {0, 6};
 }
@@ -295,6 +303,7 @@ struct Rtl : public Nic {
 		imr |= imr_isr::RER(true);
 		imr |= imr_isr::ROK(true);
 		space.store(regs::IMR, imr);
+		imr_value = imr;
 
 		auto rx_config = space.load(regs::RX_CFG);
 		rx_config &= ~rx_config::RX_FTH;
@@ -385,9 +394,75 @@ struct Rtl : public Nic {
 		cmd |= cmd::RE(true);
 		space.store(regs::CMD, cmd);
 
+		rx_poller.start("rtl rx poll", get_current_thread()->cpu);
+
 		device.enable_irqs(true);
 	}
 
+	void mask_rx_irq(bool mask) {
+		auto guard = imr_lock.lock();
+		if (mask) {
+			imr_value &= ~imr_isr::ROK;
+			imr_value &= ~imr_isr::RER;
+		}
+		else {
+			imr_value |= imr_isr::ROK(true);
+			imr_value |= imr_isr::RER(true);
+		}
+		space.store(regs::IMR, imr_value);
+	}
+
+	u32 poll_rx(u32 budget) {
+		u32 done = 0;
+		for (; done < budget; ++done) {
+			auto& desc = rx_desc[rx_desc_ptr];
+			if (desc.flags & rx_full_flags::OWN) {
+				break;
+			}
+
+			auto size = desc.flags & rx_full_flags::FRAME_LEN;
+			ethernet_process_packet(*this, to_virt<void>(desc.buffer), size);
+
+			desc.flags = {rx_empty_flags::OWN(true) | rx_empty_flags::BUFFER_SIZE(PAGE_SIZE)};
+			if (rx_desc_ptr == desc_count - 1) {
+				desc.flags |= rx_empty_flags::EOR(true);
+			}
+
+			rx_desc_ptr = (rx_desc_ptr + 1) % desc_count;
+		}
+
+		return done;
+	}
+
+	bool enable_rx_irq() {
+		// frames arriving after the ring was checked set the status bits again,
+		// so they raise an interrupt as soon as it is unmasked
+		space.store(regs::ISR, imr_isr::ROK(true) | imr_isr::RER(true));
+		if (!(rx_desc[rx_desc_ptr].flags & rx_full_flags::OWN)) {
+			return false;
+		}
+
+		mask_rx_irq(false);
+		return true;
+	}
+
+	bool set_irq_coalescing(u32 max_frames, u32 max_usecs) override {
+		if (is_8139) {
+			return false;
+		}
+
+		// frames are counted in units of four and the timer ticks roughly every 5us at gigabit speeds
+		BitValue<u16> value {};
+		value |= intr_mitigate::RX_FRAMES(kstd::min(max_frames / 4, u32 {15}));
+		value |= intr_mitigate::RX_TIMER(kstd::min(max_usecs / 5, u32 {15}));
+		space.store(regs::INTR_MITIGATE, value);
+		return true;
+	}
+
+	void get_rx_stats(NicRxStats& stats) const override {
+		rx_poller.stats.add_to(stats);
+	}
+
 	void send(const void* data, u32 size) override {
 		assert(size <= PAGE_SIZE);
 
@@ -420,22 +495,8 @@ struct Rtl : public Nic {
 		space.store(regs::ISR, isr);
 
 		if ((isr & imr_isr::ROK) || (isr & imr_isr::RER)) {
-			while (true) {
-				auto& desc = rx_desc[rx_desc_ptr];
-				if (desc.flags & rx_full_flags::OWN) {
-					break;
-				}
-
-				auto size = desc.flags & rx_full_flags::FRAME_LEN;
-				ethernet_process_packet(*this, to_virt<void>(desc.buffer), size);
-
-				desc.flags = {rx_empty_flags::OWN(true) | rx_empty_flags::BUFFER_SIZE(PAGE_SIZE)};
-				if (rx_desc_ptr == desc_count - 1) {
-					desc.flags |= rx_empty_flags::EOR(true);
-				}
-
-				rx_desc_ptr = (rx_desc_ptr + 1) % desc_count;
-			}
+			mask_rx_irq(true);
+			rx_poller.schedule();
 		}
 		else if (isr & imr_isr::TER) {
 			println("[kernel][nic]: rtl packet send error");
@@ -472,6 +533,16 @@ struct Rtl : public Nic {
 		},
 		.can_be_shared = false
 	};
+	RxPoller rx_poller {
+		.poll = [this](u32 budget) {
+			return poll_rx(budget);
+		},
+		.enable_irq = [this]() {
+			return enable_rx_irq();
+		}
+	};
+	IrqSpinlock<void> imr_lock {};
+	BitValue<u16> imr_value {};
 	TxDescriptor* tx_desc {};
 	RxDescriptor* rx_desc {};
 	u32 tx_desc_ptr {};
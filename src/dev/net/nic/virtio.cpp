@@ -1,3 +1,16 @@
+#include "arch/cpu.hpp"
+#include "arch/irq.hpp"
+#include "dev/clock.hpp"
+#include "dev/net/checksum.hpp"
+#include "dev/net/dhcp.hpp"
+#include "dev/net/ethernet.hpp"
+#include "mem/iospace.hpp"
+#include "mem/mem.hpp"
+#include "mem/pmalloc.hpp"
+#include "nic.hpp"
+#include "sched/mutex.hpp"
+#include "sched/process.hpp"
+#include "unique_ptr.hpp"
 #include "utils/driver.hpp"
 
 namespace virtio {
@@ -21,38 +34,939 @@ namespace virtio {
 	static constexpr u8 TYPE_SHARED_MEM_CFG = 8;
 	static constexpr u8 TYPE_VENDOR_CFG = 9;
 
-	struct CommonCfg {
-		u32 device_feature_select;
-		u32 device_feature;
-		u32 driver_feature_select;
-		u32 driver_feature;
-		u16 config_msix_vector;
-		u16 num_queues;
-		u8 device_status;
-		u8 config_generation;
-		u16 queue_select;
-		u16 queue_size;
-		u16 queue_msix_vector;
-		u16 queue_enable;
-		u16 queue_notify_off;
-		u64 queue_desc;
-		u64 queue_driver;
-		u64 queue_device;
-		u16 queue_notify_data;
-		u16 queue_reset;
-	};
+	namespace common_cfg {
+		static constexpr BasicRegister<u32> DEVICE_FEATURE_SELECT {0x0};
+		static constexpr BasicRegister<u32> DEVICE_FEATURE {0x4};
+		static constexpr BasicRegister<u32> DRIVER_FEATURE_SELECT {0x8};
+		static constexpr BasicRegister<u32> DRIVER_FEATURE {0xC};
+		static constexpr BasicRegister<u16> CONFIG_MSIX_VECTOR {0x10};
+		static constexpr BasicRegister<u16> NUM_QUEUES {0x12};
+		static constexpr BasicRegister<u8> DEVICE_STATUS {0x14};
+		static constexpr BasicRegister<u8> CONFIG_GENERATION {0x15};
+		static constexpr BasicRegister<u16> QUEUE_SELECT {0x16};
+		static constexpr BasicRegister<u16> QUEUE_SIZE {0x18};
+		static constexpr BasicRegister<u16> QUEUE_MSIX_VECTOR {0x1A};
+		static constexpr BasicRegister<u16> QUEUE_ENABLE {0x1C};
+		static constexpr BasicRegister<u16> QUEUE_NOTIFY_OFF {0x1E};
+		static constexpr BasicRegister<u32> QUEUE_DESC_LOW {0x20};
+		static constexpr BasicRegister<u32> QUEUE_DESC_HIGH {0x24};
+		static constexpr BasicRegister<u32> QUEUE_DRIVER_LOW {0x28};
+		static constexpr BasicRegister<u32> QUEUE_DRIVER_HIGH {0x2C};
+		static constexpr BasicRegister<u32> QUEUE_DEVICE_LOW {0x30};
+		static constexpr BasicRegister<u32> QUEUE_DEVICE_HIGH {0x34};
+	}
 
 	struct NotifyCap {
 		PciCap cap;
 		u32 notify_off_multiplier;
 	};
 
-	static constexpr u32 NO_VECTOR = 0xFFFF;
+	static constexpr u16 NO_VECTOR = 0xFFFF;
+
+	namespace status {
+		static constexpr u8 ACKNOWLEDGE = 1 << 0;
+		static constexpr u8 DRIVER = 1 << 1;
+		static constexpr u8 DRIVER_OK = 1 << 2;
+		static constexpr u8 FEATURES_OK = 1 << 3;
+		static constexpr u8 DEVICE_NEEDS_RESET = 1 << 6;
+		static constexpr u8 FAILED = 1 << 7;
+	}
+
+	namespace features {
+		static constexpr u64 RING_EVENT_IDX = u64 {1} << 29;
+		static constexpr u64 VERSION_1 = u64 {1} << 32;
+	}
+
+	static constexpr u8 ISR_QUEUE = 1 << 0;
+	static constexpr u8 ISR_CONFIG = 1 << 1;
+
+	static constexpr u16 DESC_F_NEXT = 1;
+	static constexpr u16 DESC_F_WRITE = 2;
+	static constexpr u16 AVAIL_F_NO_INTERRUPT = 1;
+	static constexpr u16 USED_F_NO_NOTIFY = 1;
+
+	struct Descriptor {
+		u64 addr;
+		u32 len;
+		u16 flags;
+		u16 next;
+	};
+
+	struct AvailRing {
+		u16 flags;
+		u16 idx;
+		u16 ring[];
+	};
+
+	struct UsedElem {
+		u32 id;
+		u32 len;
+	};
+
+	struct UsedRing {
+		u16 flags;
+		u16 idx;
+		UsedElem ring[];
+	};
+
+	/// Split virtqueue, descriptors are handed out from a free list linked through `next`.
+	struct Virtqueue {
+		static constexpr u16 MAX_SIZE = 256;
+
+		bool init(IoSpace common, u16 index, u16 vector, bool use_event_idx) {
+			common.store(common_cfg::QUEUE_SELECT, index);
+			u16 max_size = common.load(common_cfg::QUEUE_SIZE);
+			if (!max_size) {
+				return false;
+			}
+
+			// sizes of split queues are always powers of two
+			size = kstd::min(max_size, MAX_SIZE);
+			common.store(common_cfg::QUEUE_SIZE, size);
+
+			usize desc_size = sizeof(Descriptor) * size;
+			usize avail_size = sizeof(AvailRing) + 2 * (size + 1);
+			usize used_offset = ALIGNUP(desc_size + avail_size, 4);
+			usize used_size = sizeof(UsedRing) + sizeof(UsedElem) * size + 2;
+			page_count = ALIGNUP(used_offset + used_size, PAGE_SIZE) / PAGE_SIZE;
+
+			phys = pmalloc(page_count);
+			if (!phys) {
+				return false;
+			}
+			memset(to_virt<void>(phys), 0, page_count * PAGE_SIZE);
+
+			desc = to_virt<Descriptor>(phys);
+			avail = to_virt<AvailRing>(phys + desc_size);
+			used = to_virt<UsedRing>(phys + used_offset);
+
+			for (u16 i = 0; i < size; ++i) {
+				desc[i].next = i + 1;
+			}
+			free_head = 0;
+			num_free = size;
+			event_idx = use_event_idx;
+			queue_index = index;
+
+			common.store(common_cfg::QUEUE_MSIX_VECTOR, vector);
+			if (common.load(common_cfg::QUEUE_MSIX_VECTOR) != vector) {
+				return false;
+			}
+
+			usize avail_phys = phys + desc_size;
+			usize used_phys = phys + used_offset;
+			common.store(common_cfg::QUEUE_DESC_LOW, phys);
+			common.store(common_cfg::QUEUE_DESC_HIGH, phys >> 32);
+			common.store(common_cfg::QUEUE_DRIVER_LOW, avail_phys);
+			common.store(common_cfg::QUEUE_DRIVER_HIGH, avail_phys >> 32);
+			common.store(common_cfg::QUEUE_DEVICE_LOW, used_phys);
+			common.store(common_cfg::QUEUE_DEVICE_HIGH, used_phys >> 32);
+			notify_off = common.load(common_cfg::QUEUE_NOTIFY_OFF);
+			return true;
+		}
+
+		u16 alloc_desc() {
+			assert(num_free);
+			u16 id = free_head;
+			free_head = desc[id].next;
+			--num_free;
+			return id;
+		}
+
+		void free_chain(u16 head) {
+			u16 id = head;
+			while (true) {
+				++num_free;
+				if (!(desc[id].flags & DESC_F_NEXT)) {
+					break;
+				}
+				id = desc[id].next;
+			}
+
+			// the chain is still linked through next so it can be spliced in as a whole
+			desc[id].next = free_head;
+			free_head = head;
+		}
+
+		/// Queues a chain for the device, it isn't visible before the next `publish`.
+		void submit(u16 head) {
+			avail->ring[shadow_avail_idx & (size - 1)] = head;
+			++shadow_avail_idx;
+		}
+
+		/// Makes all submitted chains visible, returns true if the device wants to be notified.
+		bool publish() {
+			u16 old_idx = published_avail_idx;
+			u16 new_idx = shadow_avail_idx;
+			published_avail_idx = new_idx;
+
+			__atomic_store_n(&avail->idx, new_idx, __ATOMIC_RELEASE);
+			if (old_idx == new_idx) {
+				return false;
+			}
+
+			// the index store has to be visible before the device's suppression state is read
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+			if (event_idx) {
+				auto* avail_event = reinterpret_cast<u16*>(&used->ring[size]);
+				u16 event = __atomic_load_n(avail_event, __ATOMIC_RELAXED);
+				return static_cast<u16>(new_idx - event - 1) < static_cast<u16>(new_idx - old_idx);
+			}
+			else {
+				return !(__atomic_load_n(&used->flags, __ATOMIC_RELAXED) & USED_F_NO_NOTIFY);
+			}
+		}
+
+		void notify() {
+			*notify_ptr = queue_index;
+		}
+
+		bool pop_used(u16& id, u32& len) {
+			if (last_used_idx == __atomic_load_n(&used->idx, __ATOMIC_ACQUIRE)) {
+				return false;
+			}
+
+			auto& elem = used->ring[last_used_idx & (size - 1)];
+			id = elem.id;
+			len = elem.len;
+			++last_used_idx;
+			return true;
+		}
+
+		/// Suppresses interrupts for used buffers, the queue has to be polled instead.
+		void disable_notifications() {
+			auto* used_event = &avail->ring[size];
+			__atomic_store_n(used_event, static_cast<u16>(last_used_idx - 1), __ATOMIC_RELAXED);
+			__atomic_store_n(&avail->flags, AVAIL_F_NO_INTERRUPT, __ATOMIC_RELAXED);
+		}
+
+		/// Asks for an interrupt on the next used buffer, returns false if buffers were used
+		/// before the request became visible and the caller has to poll again.
+		bool enable_notifications() {
+			if (event_idx) {
+				auto* used_event = &avail->ring[size];
+				__atomic_store_n(used_event, last_used_idx, __ATOMIC_RELAXED);
+			}
+			else {
+				__atomic_store_n(&avail->flags, 0, __ATOMIC_RELAXED);
+			}
+
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			return __atomic_load_n(&used->idx, __ATOMIC_RELAXED) == last_used_idx;
+		}
+
+		Descriptor* desc {};
+		AvailRing* avail {};
+		UsedRing* used {};
+		volatile u16* notify_ptr {};
+		usize phys {};
+		usize page_count {};
+		u16 size {};
+		u16 queue_index {};
+		u16 notify_off {};
+		u16 free_head {};
+		u16 num_free {};
+		u16 shadow_avail_idx {};
+		u16 published_avail_idx {};
+		u16 last_used_idx {};
+		bool event_idx {};
+	};
+}
+
+namespace virtio_net {
+	namespace features {
+		static constexpr u64 CSUM = u64 {1} << 0;
+		static constexpr u64 GUEST_CSUM = u64 {1} << 1;
+		static constexpr u64 MTU = u64 {1} << 3;
+		static constexpr u64 MAC = u64 {1} << 5;
+		static constexpr u64 GUEST_TSO4 = u64 {1} << 7;
+		static constexpr u64 HOST_TSO4 = u64 {1} << 11;
+		static constexpr u64 MRG_RXBUF = u64 {1} << 15;
+		static constexpr u64 STATUS = u64 {1} << 16;
+		static constexpr u64 CTRL_VQ = u64 {1} << 17;
+		static constexpr u64 MQ = u64 {1} << 22;
+		static constexpr u64 NOTF_COAL = u64 {1} << 53;
+	}
+
+	namespace cfg {
+		static constexpr usize MAC = 0;
+		static constexpr BasicRegister<u16> STATUS {6};
+		static constexpr BasicRegister<u16> MAX_VIRTQUEUE_PAIRS {8};
+		static constexpr BasicRegister<u16> MTU {10};
+	}
+
+	static constexpr u16 STATUS_LINK_UP = 1;
+
+	struct Header {
+		u8 flags;
+		u8 gso_type;
+		u16 hdr_len;
+		u16 gso_size;
+		u16 csum_start;
+		u16 csum_offset;
+		u16 num_buffers;
+	};
+
+	static constexpr u8 HDR_F_NEEDS_CSUM = 1;
+	static constexpr u8 HDR_F_DATA_VALID = 2;
+	static constexpr u8 GSO_NONE = 0;
+	static constexpr u8 GSO_TCPV4 = 1;
+
+	static constexpr u8 CTRL_MQ = 4;
+	static constexpr u8 CTRL_MQ_VQ_PAIRS_SET = 0;
+	static constexpr u8 CTRL_NOTF_COAL = 6;
+	static constexpr u8 CTRL_NOTF_COAL_RX_SET = 1;
+	static constexpr u8 CTRL_OK = 0;
+
+	struct CtrlCoalRx {
+		u32 rx_max_packets;
+		u32 rx_usecs;
+	};
+
+	static constexpr usize MAX_FRAME_SIZE = 1024 * 64 + sizeof(EthernetHeader);
 }
 
+struct VirtioNic : public Nic {
+	struct RxQueue {
+		VirtioNic* owner {};
+		virtio::Virtqueue vq {};
+		kstd::vector<usize> buffers {};
+		kstd::vector<u8> scratch {};
+		IrqHandler irq_handler {
+			.fn = [this](IrqFrame*) {
+				return owner->on_rx_irq(*this);
+			},
+			.can_be_shared = false
+		};
+		RxPoller poller {
+			.poll = [this](u32 budget) {
+				return owner->poll_rx(*this, budget);
+			},
+			.enable_irq = [this]() {
+				if (vq.enable_notifications()) {
+					return true;
+				}
+				vq.disable_notifications();
+				return false;
+			}
+		};
+	};
+
+	struct TxQueue {
+		virtio::Virtqueue vq {};
+		kstd::vector<usize> buffers {};
+		IrqSpinlock<void> lock {};
+	};
+
+	explicit VirtioNic(pci::Device& device) : device {device} {
+		for (u32 i = 0;; ++i) {
+			auto cap_offset = device.get_cap_offset(pci::Cap::Vendor, i);
+			if (!cap_offset) {
+				break;
+			}
+
+			u8 type = device.read8(cap_offset + offsetof(virtio::PciCap, cfg_type));
+			u8 bar = device.read8(cap_offset + offsetof(virtio::PciCap, bar));
+			u32 bar_offset = device.read32(cap_offset + offsetof(virtio::PciCap, offset));
+			if (bar >= 6 || device.is_io_space(bar)) {
+				continue;
+			}
+
+			// only the first capability of each type is used
+			if (type == virtio::TYPE_COMMON_CFG && !common.mapping()) {
+				common = IoSpace {offset(get_bar(bar), void*, bar_offset)};
+			}
+			else if (type == virtio::TYPE_NOTIFY_CFG && !notify_base) {
+				notify_base = offset(get_bar(bar), u8*, bar_offset);
+				notify_off_multiplier = device.read32(cap_offset + offsetof(virtio::NotifyCap, notify_off_multiplier));
+			}
+			else if (type == virtio::TYPE_ISR_CFG && !isr.mapping()) {
+				isr = IoSpace {offset(get_bar(bar), void*, bar_offset)};
+			}
+			else if (type == virtio::TYPE_DEVICE_CFG && !device_cfg.mapping()) {
+				device_cfg = IoSpace {offset(get_bar(bar), void*, bar_offset)};
+			}
+		}
+
+		device.enable_mem_space(true);
+		device.enable_bus_master(true);
+	}
+
+	void* get_bar(u8 bar) {
+		if (!bars[bar]) {
+			bars[bar] = device.map_bar(bar);
+		}
+		return bars[bar];
+	}
+
+	void set_status(u8 bits) {
+		common.store(virtio::common_cfg::DEVICE_STATUS, common.load(virtio::common_cfg::DEVICE_STATUS) | bits);
+	}
+
+	bool negotiate_features() {
+		u64 device_features = 0;
+		for (u32 i = 0; i < 2; ++i) {
+			common.store(virtio::common_cfg::DEVICE_FEATURE_SELECT, i);
+			device_features |= u64 {common.load(virtio::common_cfg::DEVICE_FEATURE)} << (i * 32);
+		}
+
+		if (!(device_features & virtio::features::VERSION_1)) {
+			println("[kernel][nic]: virtio device doesn't support version 1");
+			return false;
+		}
+
+		using namespace virtio_net::features;
+
+		u64 wanted = virtio::features::VERSION_1 | virtio::features::RING_EVENT_IDX |
+			CSUM | GUEST_CSUM | MTU | MAC | HOST_TSO4 | MRG_RXBUF | STATUS | CTRL_VQ | MQ | NOTF_COAL;
+		features = device_features & wanted;
+
+		if (!(features & CSUM)) {
+			features &= ~HOST_TSO4;
+		}
+		if (!(features & CTRL_VQ)) {
+			features &= ~(MQ | NOTF_COAL);
+		}
+		// large received segments are only accepted when they can be spread over several page sized buffers
+		if ((device_features & GUEST_TSO4) && (features & GUEST_CSUM) && (features & MRG_RXBUF)) {
+			features |= GUEST_TSO4;
+		}
+
+		for (u32 i = 0; i < 2; ++i) {
+			common.store(virtio::common_cfg::DRIVER_FEATURE_SELECT, i);
+			common.store(virtio::common_cfg::DRIVER_FEATURE, static_cast<u32>(features >> (i * 32)));
+		}
+
+		set_status(virtio::status::FEATURES_OK);
+		return common.load(virtio::common_cfg::DEVICE_STATUS) & virtio::status::FEATURES_OK;
+	}
+
+	void read_config() {
+		u8 generation;
+		do {
+			generation = common.load(virtio::common_cfg::CONFIG_GENERATION);
+
+			if (features & virtio_net::features::MAC) {
+				for (usize i = 0; i < 6; ++i) {
+					mac.data[i] = device_cfg.load<u8>(virtio_net::cfg::MAC + i);
+				}
+			}
+			max_pairs = 1;
+			if (features & virtio_net::features::MQ) {
+				max_pairs = kstd::max(device_cfg.load(virtio_net::cfg::MAX_VIRTQUEUE_PAIRS), u16 {1});
+			}
+			if (features & virtio_net::features::MTU) {
+				mtu = device_cfg.load(virtio_net::cfg::MTU);
+			}
+		} while (generation != common.load(virtio::common_cfg::CONFIG_GENERATION));
+	}
+
+	bool init_queue(virtio::Virtqueue& vq, u16 index, u16 vector, bool polled) {
+		if (!vq.init(common, index, vector, features & virtio::features::RING_EVENT_IDX)) {
+			return false;
+		}
+		if (polled) {
+			vq.disable_notifications();
+		}
+		vq.notify_ptr = offset(notify_base, volatile u16*, vq.notify_off * notify_off_multiplier);
+		common.store(virtio::common_cfg::QUEUE_ENABLE, 1);
+		return true;
+	}
+
+	bool init() {
+		if (!common.mapping() || !notify_base || !isr.mapping() || !device_cfg.mapping()) {
+			println("[kernel][nic]: virtio nic is missing required capabilities");
+			return false;
+		}
+
+		common.store(virtio::common_cfg::DEVICE_STATUS, 0);
+		while (common.load(virtio::common_cfg::DEVICE_STATUS));
+
+		set_status(virtio::status::ACKNOWLEDGE);
+		set_status(virtio::status::DRIVER);
+
+		if (!negotiate_features()) {
+			set_status(virtio::status::FAILED);
+			return false;
+		}
+
+		read_config();
+
+		tx_csum_offload = features & virtio_net::features::CSUM;
+		tso = features & virtio_net::features::HOST_TSO4;
+
+		u16 pairs = kstd::min(max_pairs, static_cast<u16>(arch_get_cpu_count()));
+
+		// vector 0 is for config changes and every rx queue gets its own vector, tx completions
+		// are reaped while sending so tx queues don't interrupt at all
+		use_msix = false;
+		if (auto count = device.alloc_irqs(2, pairs + 1, pci::IrqFlags::Msix)) {
+			use_msix = true;
+			pairs = kstd::min(pairs, static_cast<u16>(count - 1));
+		}
+		else {
+			assert(device.alloc_irqs(1, 1, pci::IrqFlags::All));
+			pairs = 1;
+		}
+
+		if (use_msix) {
+			common.store(virtio::common_cfg::CONFIG_MSIX_VECTOR, 0);
+		}
+
+		rx_queues.resize(pairs);
+		tx_queues.resize(pairs);
+		for (u16 i = 0; i < pairs; ++i) {
+			rx_queues[i] = kstd::make_unique<RxQueue>();
+			tx_queues[i] = kstd::make_unique<TxQueue>();
+
+			auto& rx = *rx_queues[i];
+			auto& tx = *tx_queues[i];
+			rx.owner = this;
+
+			u16 rx_vector = use_msix ? static_cast<u16>(1 + i) : virtio::NO_VECTOR;
+			if (!init_queue(rx.vq, 2 * i, rx_vector, false) ||
+				!init_queue(tx.vq, 2 * i + 1, virtio::NO_VECTOR, true)) {
+				println("[kernel][nic]: virtio failed to init queue pair ", i);
+				set_status(virtio::status::FAILED);
+				return false;
+			}
+
+			rx.buffers.resize(rx.vq.size);
+			for (auto& buffer : rx.buffers) {
+				buffer = pmalloc(1);
+				assert(buffer);
+			}
+			if (features & virtio_net::features::MRG_RXBUF) {
+				rx.scratch.resize(virtio_net::MAX_FRAME_SIZE);
+			}
+
+			tx.buffers.resize(tx.vq.size);
+			for (auto& buffer : tx.buffers) {
+				buffer = pmalloc(1);
+				assert(buffer);
+			}
+		}
+
+		if (features & virtio_net::features::CTRL_VQ) {
+			if (!init_queue(ctrl_vq, 2 * max_pairs, virtio::NO_VECTOR, true)) {
+				println("[kernel][nic]: virtio failed to init control queue");
+				set_status(virtio::status::FAILED);
+				return false;
+			}
+			ctrl_buffer = pmalloc(1);
+			assert(ctrl_buffer);
+		}
+
+		if (use_msix) {
+			register_irq_handler(device.get_irq(0), &config_irq_handler);
+			usize cpu_count = arch_get_cpu_count();
+			for (u16 i = 0; i < pairs; ++i) {
+				auto* cpu = arch_get_cpu(i % cpu_count);
+				register_irq_handler(device.get_irq(1 + i), &rx_queues[i]->irq_handler);
+				device.set_irq_affinity(1 + i, cpu);
+				rx_queues[i]->poller.start("virtio rx poll", cpu);
+			}
+		}
+		else {
+			register_irq_handler(device.get_irq(0), &shared_irq_handler);
+			rx_queues[0]->poller.start("virtio rx poll", get_current_thread()->cpu);
+		}
+
+		for (auto& rx : rx_queues) {
+			refill_rx(*rx);
+		}
+
+		set_status(virtio::status::DRIVER_OK);
+
+		// the device steers each flow to the rx queue paired with the tx queue it was last sent
+		// from, so replies arrive on the cpu that sent the request
+		active_pairs = 1;
+		if (pairs > 1) {
+			u16 value = pairs;
+			if (ctrl_command(virtio_net::CTRL_MQ, virtio_net::CTRL_MQ_VQ_PAIRS_SET, &value, sizeof(value))) {
+				active_pairs = pairs;
+			}
+			else {
+				println("[kernel][nic]: virtio failed to enable multiqueue");
+			}
+		}
+
+		device.enable_irqs(true);
+
+		println("[kernel][nic]: virtio mac is ", zero_pad(2), Fmt::Hex,
+				mac.data[0], ":",
+				mac.data[1], ":",
+				mac.data[2], ":",
+				mac.data[3], ":",
+				mac.data[4], ":",
+				mac.data[5],
+				Fmt::Reset, Pad {},
+				", ", active_pairs, " queue pairs",
+				tx_csum_offload ? ", csum offload" : "",
+				tso ? ", tso" : "");
+		return true;
+	}
+
+	bool ctrl_command(u8 cls, u8 cmd, const void* data, u16 size) {
+		assert(size + 2u < PAGE_SIZE / 2);
+
+		auto guard = ctrl_lock.lock();
+
+		u16 id;
+		u32 len;
+
+		// a command that timed out still owns the buffer and its descriptors until the device returns it
+		if (ctrl_pending != CTRL_NONE) {
+			if (!ctrl_vq.pop_used(id, len)) {
+				return false;
+			}
+			assert(id == ctrl_pending);
+			ctrl_vq.free_chain(id);
+			ctrl_pending = CTRL_NONE;
+		}
+
+		auto* buf = to_virt<u8>(ctrl_buffer);
+		buf[0] = cls;
+		buf[1] = cmd;
+		memcpy(buf + 2, data, size);
+		auto* ack = buf + PAGE_SIZE / 2;
+		*ack = 0xFF;
+
+		u16 head = ctrl_vq.alloc_desc();
+		u16 data_id = ctrl_vq.alloc_desc();
+		u16 ack_id = ctrl_vq.alloc_desc();
+		ctrl_vq.desc[head] = {.addr = ctrl_buffer, .len = 2, .flags = virtio::DESC_F_NEXT, .next = data_id};
+		ctrl_vq.desc[data_id] = {.addr = ctrl_buffer + 2, .len = size, .flags = virtio::DESC_F_NEXT, .next = ack_id};
+		ctrl_vq.desc[ack_id] = {.addr = ctrl_buffer + PAGE_SIZE / 2, .len = 1, .flags = virtio::DESC_F_WRITE, .next = 0};
+		ctrl_vq.submit(head);
+		ctrl_vq.publish();
+		ctrl_vq.notify();
+
+		// the control queue has no interrupt, sleep between polls instead of spinning with the lock held
+		bool done = false;
+		for (usize i = 0; i < CTRL_TIMEOUT_MS; ++i) {
+			if (ctrl_vq.pop_used(id, len)) {
+				done = true;
+				break;
+			}
+			get_current_thread()->sleep_for(NS_IN_MS);
+		}
+
+		if (!done) {
+			println("[kernel][nic]: virtio control command timed out");
+			ctrl_pending = head;
+			return false;
+		}
+
+		assert(id == head);
+		ctrl_vq.free_chain(id);
+		return __atomic_load_n(ack, __ATOMIC_ACQUIRE) == virtio_net::CTRL_OK;
+	}
+
+	bool set_irq_coalescing(u32 max_frames, u32 max_usecs) override {
+		if (!(features & virtio_net::features::NOTF_COAL)) {
+			return false;
+		}
+
+		virtio_net::CtrlCoalRx coal {
+			.rx_max_packets = max_frames,
+			.rx_usecs = max_usecs
+		};
+		return ctrl_command(virtio_net::CTRL_NOTF_COAL, virtio_net::CTRL_NOTF_COAL_RX_SET, &coal, sizeof(coal));
+	}
+
+	void get_rx_stats(NicRxStats& stats) const override {
+		for (auto& rx : rx_queues) {
+			rx->poller.stats.add_to(stats);
+		}
+	}
+
+	void refill_rx(RxQueue& queue) {
+		auto& vq = queue.vq;
+		while (vq.num_free) {
+			u16 id = vq.alloc_desc();
+			vq.desc[id] = {
+				.addr = queue.buffers[id],
+				.len = PAGE_SIZE,
+				.flags = virtio::DESC_F_WRITE,
+				.next = 0
+			};
+			vq.submit(id);
+		}
+
+		// the whole batch is announced with a single notification
+		if (vq.publish()) {
+			vq.notify();
+		}
+	}
+
+	/// Completes the partial checksum of a frame received with NEEDS_CSUM, the device
+	/// only filled in the pseudo header sum. DATA_VALID frames need nothing as the stack
+	/// doesn't verify received checksums.
+	static bool complete_rx_csum(const virtio_net::Header& hdr, void* data, usize size) {
+		if (!(hdr.flags & virtio_net::HDR_F_NEEDS_CSUM)) {
+			return true;
+		}
+		if (hdr.csum_start + hdr.csum_offset + 2u > size) {
+			return false;
+		}
+
+		Checksum sum;
+		sum.add(offset(data, void*, hdr.csum_start), size - hdr.csum_start);
+		u16 value = sum.get();
+		memcpy(offset(data, void*, hdr.csum_start + hdr.csum_offset), &value, 2);
+		return true;
+	}
+
+	void receive(RxQueue& queue, u16 id, u32 len) {
+		auto& vq = queue.vq;
+		auto hdr = *to_virt<virtio_net::Header>(queue.buffers[id]);
+		u16 num_buffers = (features & virtio_net::features::MRG_RXBUF) ? hdr.num_buffers : 1;
+
+		if (len < sizeof(virtio_net::Header)) {
+			vq.free_chain(id);
+			return;
+		}
+
+		usize size = len - sizeof(virtio_net::Header);
+		void* frame = to_virt<virtio_net::Header>(queue.buffers[id]) + 1;
+		if (num_buffers <= 1) {
+			if (complete_rx_csum(hdr, frame, size)) {
+				ethernet_process_packet(*this, frame, size);
+			}
+			vq.free_chain(id);
+			return;
+		}
+
+		// the frame was spread over several buffers, they are all used before the index is updated
+		memcpy(queue.scratch.data(), frame, size);
+		vq.free_chain(id);
+
+		for (u16 i = 1; i < num_buffers; ++i) {
+			if (!vq.pop_used(id, len)) {
+				println("[kernel][nic]: virtio merged rx buffer is missing parts");
+				return;
+			}
+
+			if (size + len <= queue.scratch.size()) {
+				memcpy(queue.scratch.data() + size, to_virt<void>(queue.buffers[id]), len);
+			}
+			size += len;
+			vq.free_chain(id);
+		}
+
+		if (size > queue.scratch.size()) {
+			println("[kernel][nic]: virtio dropping oversized frame");
+			return;
+		}
+
+		if (complete_rx_csum(hdr, queue.scratch.data(), size)) {
+			ethernet_process_packet(*this, queue.scratch.data(), size);
+		}
+	}
+
+	u32 poll_rx(RxQueue& queue, u32 budget) {
+		u32 done = 0;
+		u16 id;
+		u32 len;
+		while (done < budget && queue.vq.pop_used(id, len)) {
+			receive(queue, id, len);
+			++done;
+		}
+
+		refill_rx(queue);
+		return done;
+	}
+
+	bool on_rx_irq(RxQueue& queue) {
+		queue.vq.disable_notifications();
+		queue.poller.schedule();
+		return true;
+	}
+
+	bool on_config_irq() {
+		if (!(features & virtio_net::features::STATUS)) {
+			return true;
+		}
+
+		auto status = device_cfg.load(virtio_net::cfg::STATUS);
+		if (status & virtio_net::STATUS_LINK_UP) {
+			if (!ip) {
+				println("[kernel][nic]: virtio link up");
+				dhcp_discover(this);
+			}
+		}
+		else {
+			println("[kernel][nic]: virtio link down");
+			ip = 0;
+			ip_available_event.reset();
+		}
+
+		return true;
+	}
+
+	bool on_shared_irq() {
+		// reading the isr status also acknowledges the interrupt
+		auto status = isr.load<u8>(0);
+		if (status & virtio::ISR_QUEUE) {
+			for (auto& rx : rx_queues) {
+				on_rx_irq(*rx);
+			}
+		}
+		if (status & virtio::ISR_CONFIG) {
+			on_config_irq();
+		}
+		return true;
+	}
+
+	void reclaim_tx(TxQueue& queue) {
+		u16 id;
+		u32 len;
+		while (queue.vq.pop_used(id, len)) {
+			queue.vq.free_chain(id);
+		}
+	}
+
+	void transmit(const void* data, u32 size, const TxOffload* offload) {
+		virtio_net::Header hdr {
+			.flags = 0,
+			.gso_type = virtio_net::GSO_NONE,
+			.hdr_len = 0,
+			.gso_size = 0,
+			.csum_start = 0,
+			.csum_offset = 0,
+			.num_buffers = 0
+		};
+
+		if (offload && offload->csum_start) {
+			hdr.flags = virtio_net::HDR_F_NEEDS_CSUM;
+			hdr.csum_start = offload->csum_start;
+			hdr.csum_offset = offload->csum_offset;
+		}
+		if (offload && offload->tcp_mss) {
+			assert(tso);
+			u8 tcp_data_offset = static_cast<const u8*>(data)[offload->csum_start + 12] >> 4;
+			hdr.gso_type = virtio_net::GSO_TCPV4;
+			hdr.gso_size = offload->tcp_mss;
+			hdr.hdr_len = offload->csum_start + tcp_data_offset * 4;
+		}
+
+		usize total = sizeof(hdr) + size;
+		u16 count = (total + PAGE_SIZE - 1) / PAGE_SIZE;
+
+		// queue pairs are per cpu so senders on different cpus don't contend
+		auto& queue = *tx_queues[get_current_thread()->cpu->number % active_pairs];
+		auto guard = queue.lock.lock();
+
+		auto& vq = queue.vq;
+		reclaim_tx(queue);
+		if (vq.num_free < count) {
+			println("[kernel][nic]: virtio send buffer overflow");
+			return;
+		}
+
+		u16 head = 0;
+		u16 prev = 0;
+		usize copied = 0;
+		for (u16 i = 0; i < count; ++i) {
+			u16 id = vq.alloc_desc();
+			if (i == 0) {
+				head = id;
+			}
+			else {
+				vq.desc[prev].flags = virtio::DESC_F_NEXT;
+				vq.desc[prev].next = id;
+			}
+
+			auto* buf = to_virt<u8>(queue.buffers[id]);
+			usize chunk = kstd::min(total - i * PAGE_SIZE, usize {PAGE_SIZE});
+			usize data_chunk = chunk;
+			if (i == 0) {
+				memcpy(buf, &hdr, sizeof(hdr));
+				buf += sizeof(hdr);
+				data_chunk -= sizeof(hdr);
+			}
+			memcpy(buf, static_cast<const u8*>(data) + copied, data_chunk);
+			copied += data_chunk;
+
+			vq.desc[id] = {
+				.addr = queue.buffers[id],
+				.len = static_cast<u32>(chunk),
+				.flags = 0,
+				.next = 0
+			};
+			prev = id;
+		}
+
+		vq.submit(head);
+		// with event index the device only asks for a kick when it has caught up with the ring
+		if (vq.publish()) {
+			vq.notify();
+		}
+	}
+
+	void send(const void* data, u32 size) override {
+		transmit(data, size, nullptr);
+	}
+
+	void send_offload(void* data, u32 size, const TxOffload& offload) override {
+		if (offload.csum_start && !tx_csum_offload) {
+			Nic::send_offload(data, size, offload);
+			return;
+		}
+		transmit(data, size, &offload);
+	}
+
+	pci::Device& device;
+	void* bars[6] {};
+	IoSpace common {};
+	IoSpace isr {};
+	IoSpace device_cfg {};
+	u8* notify_base {};
+	u32 notify_off_multiplier {};
+	u64 features {};
+	u16 max_pairs {1};
+	u16 active_pairs {1};
+	bool use_msix {};
+	kstd::vector<kstd::unique_ptr<RxQueue>> rx_queues;
+	kstd::vector<kstd::unique_ptr<TxQueue>> tx_queues;
+	virtio::Virtqueue ctrl_vq {};
+	Mutex<void> ctrl_lock {};
+	usize ctrl_buffer {};
+	static constexpr u16 CTRL_NONE = 0xFFFF;
+	static constexpr usize CTRL_TIMEOUT_MS = 1000;
+	u16 ctrl_pending {CTRL_NONE};
+	IrqHandler config_irq_handler {
+		.fn = [this](IrqFrame*) {
+			return on_config_irq();
+		},
+		.can_be_shared = false
+	};
+	IrqHandler shared_irq_handler {
+		.fn = [this](IrqFrame*) {
+			return on_shared_irq();
+		},
+		.can_be_shared = false
+	};
+};
+
 static InitStatus virtio_nic_init(pci::Device& device) {
 	println("[kernel][nic]: virtio nic init");
 
+	auto nic = kstd::make_shared<VirtioNic>(device);
+	if (!nic->init()) {
+		return InitStatus::Error;
+	}
+
+	{
+		IrqGuard irq_guard {};
+		auto guard = NICS->lock();
+		guard->push(nic);
+	}
+
+	dhcp_discover(nic.data());
+
 	return InitStatus::Success;
 }
 
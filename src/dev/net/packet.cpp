@@ -3,6 +3,11 @@
 #include "assert.hpp"
 #include "new.hpp"
 #include "cstring.hpp"
+#include "atomic.hpp"
+
+namespace {
+	kstd::atomic<u16> NEXT_IDENT {};
+}
 
 Packet::Packet(u32 size) : size {size} {
 	data = ALLOCATOR.alloc(size);
@@ -18,13 +23,14 @@ void Packet::add_ethernet(const Mac& src, const Mac& dest, EtherType ether_type)
 	ethernet->serialize();
 }
 
-void Packet::add_ipv4(IpProtocol protocol, u16 payload_size, u32 src_addr, u32 dest_addr) {
+void Packet::add_ipv4(IpProtocol protocol, u16 payload_size, u32 src_addr, u32 dest_addr, bool dont_fragment) {
 	Ipv4Header hdr {
 		.ihl_version = 5 | 4 << 4,
 		.ecn_dscp = 0,
 		.total_len = static_cast<u16>(20 + payload_size),
-		.ident = 0,
-		.frag_flags = 0,
+		// only has to be unique among the datagrams in flight that can be fragmented, but a counter is cheap
+		.ident = NEXT_IDENT.fetch_add(1, kstd::memory_order::relaxed),
+		.frag_flags = dont_fragment ? ipv4_flags::DONT_FRAGMENT : u16 {0},
 		.ttl = 64,
 		.protocol = protocol,
 		.hdr_checksum = 0,
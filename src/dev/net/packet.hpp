@@ -10,7 +10,8 @@ struct Packet {
 	void* add_header(u32 hdr_size);
 
 	void add_ethernet(const Mac& src, const Mac& dest, EtherType ether_type);
-	void add_ipv4(IpProtocol protocol, u16 payload_size, u32 src_addr, u32 dest_addr);
+	/// Adds an ipv4 header with a fresh identification, `dont_fragment` is set for traffic doing path mtu discovery.
+	void add_ipv4(IpProtocol protocol, u16 payload_size, u32 src_addr, u32 dest_addr, bool dont_fragment);
 	void add_udp(u16 src_port, u16 dest_port, u16 length);
 
 	union {
@@ -41,4 +42,6 @@ struct ReceivedPacket {
 		UdpHeader udp;
 	} layer2;
 	u16 layer2_len;
+	/// Bytes received from the start of layer1 to the end of the frame, including any link padding.
+	u32 layer1_len;
 };
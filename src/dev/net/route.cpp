@@ -0,0 +1,306 @@
+#include "route.hpp"
+#include "bit.hpp"
+#include "dev/clock.hpp"
+#include "manually_destroy.hpp"
+#include "nic/nic.hpp"
+#include "unique_ptr.hpp"
+#include "utils/irq_guard.hpp"
+#include "utils/spinlock.hpp"
+#include "vector.hpp"
+
+namespace {
+	struct RouteGroup {
+		/// Host order with the bits past the prefix cleared.
+		u32 dest;
+		u8 prefix_len;
+		kstd::vector<Route> routes;
+		/// Longest shorter prefix covering this one, searched when a bound lookup
+		/// has no route through its nic in this group.
+		RouteGroup* parent;
+	};
+
+	/// Multibit trie with 8 bit strides, prefixes that don't end on a stride are expanded
+	/// into every slot they cover so a lookup visits at most four nodes.
+	struct TrieNode {
+		struct Slot {
+			RouteGroup* group;
+			TrieNode* child;
+		};
+
+		Slot slots[256] {};
+	};
+
+	struct PathMtu {
+		/// Network order, zero if the slot is unused.
+		u32 dest;
+		u32 mtu;
+		u64 expires;
+	};
+
+	struct RoutingTable {
+		void rebuild();
+		void insert(RouteGroup* group);
+		[[nodiscard]] RouteGroup* lookup(u32 dest) const;
+
+		kstd::vector<kstd::unique_ptr<RouteGroup>> groups {};
+		kstd::vector<kstd::unique_ptr<TrieNode>> nodes {};
+		TrieNode* root {};
+		/// Path mtus learned from icmp, direct mapped by destination.
+		PathMtu pmtu[64] {};
+	};
+
+	ManuallyDestroy<Spinlock<RoutingTable>> ROUTES;
+}
+
+/// RFC 1191 recommends forgetting a learned mtu after 10 minutes so increases are noticed.
+static constexpr u64 PMTU_TIMEOUT = 10ULL * 60 * NS_IN_S;
+/// Same floor as other stacks, a forged icmp message could otherwise make every segment tiny.
+static constexpr u32 MIN_PATH_MTU = 552;
+
+static constexpr usize pmtu_hash(u32 dest) {
+	return (dest * u32 {0x9E3779B1}) >> 26;
+}
+
+static constexpr u32 prefix_mask(u8 prefix_len) {
+	return prefix_len ? ~u32 {0} << (32 - prefix_len) : 0;
+}
+
+void RoutingTable::rebuild() {
+	nodes.clear();
+	nodes.push(kstd::make_unique<TrieNode>());
+	root = nodes[0].data();
+
+	// shorter prefixes first so longer ones overwrite the slots they share
+	for (u8 len = 0; len <= 32; ++len) {
+		for (auto& group : groups) {
+			if (group->prefix_len == len) {
+				group->parent = lookup(group->dest);
+				insert(group.data());
+			}
+		}
+	}
+}
+
+void RoutingTable::insert(RouteGroup* group) {
+	auto* node = root;
+	u8 len = group->prefix_len;
+	for (u32 shift = 24;; shift -= 8) {
+		u8 index = group->dest >> shift;
+		if (len > 8) {
+			auto& slot = node->slots[index];
+			if (!slot.child) {
+				nodes.push(kstd::make_unique<TrieNode>());
+				slot.child = nodes[nodes.size() - 1].data();
+			}
+			node = slot.child;
+			len -= 8;
+			continue;
+		}
+
+		u32 span = 1U << (8 - len);
+		u32 start = index & ~(span - 1);
+		for (u32 i = start; i < start + span; ++i) {
+			node->slots[i].group = group;
+		}
+		break;
+	}
+}
+
+RouteGroup* RoutingTable::lookup(u32 dest) const {
+	RouteGroup* best = nullptr;
+	auto* node = root;
+	for (u32 shift = 24; node; shift -= 8) {
+		auto& slot = node->slots[(dest >> shift) & 0xFF];
+		if (slot.group) {
+			best = slot.group;
+		}
+		node = slot.child;
+	}
+	return best;
+}
+
+void route_add(Route route) {
+	u32 dest = kstd::to_ne_from_be(route.dest) & prefix_mask(route.prefix_len);
+
+	IrqGuard irq_guard {};
+	auto guard = ROUTES->lock();
+
+	RouteGroup* group = nullptr;
+	for (auto& existing : guard->groups) {
+		if (existing->dest == dest && existing->prefix_len == route.prefix_len) {
+			group = existing.data();
+			break;
+		}
+	}
+
+	if (!group) {
+		guard->groups.push(kstd::unique_ptr<RouteGroup> {new RouteGroup {
+			.dest = dest,
+			.prefix_len = route.prefix_len,
+			.routes {},
+			.parent = nullptr
+		}});
+		group = guard->groups[guard->groups.size() - 1].data();
+	}
+
+	for (auto& existing : group->routes) {
+		if (existing.nic.data() == route.nic.data() && existing.gateway == route.gateway) {
+			existing.src = route.src;
+			return;
+		}
+	}
+	group->routes.push(std::move(route));
+
+	guard->rebuild();
+}
+
+void route_remove_nic(Nic* nic) {
+	IrqGuard irq_guard {};
+	auto guard = ROUTES->lock();
+
+	for (usize i = 0; i < guard->groups.size();) {
+		auto& routes = guard->groups[i]->routes;
+		for (usize j = 0; j < routes.size();) {
+			if (routes[j].nic.data() == nic) {
+				routes.remove(j);
+			}
+			else {
+				++j;
+			}
+		}
+
+		if (routes.is_empty()) {
+			guard->groups.remove(i);
+		}
+		else {
+			++i;
+		}
+	}
+
+	guard->rebuild();
+}
+
+void route_configure_nic(Nic& nic) {
+	kstd::shared_ptr<Nic> ptr;
+	u32 ip;
+	u32 subnet_mask;
+	u32 gateway_ip;
+
+	{
+		IrqGuard irq_guard {};
+		auto guard = NICS->lock();
+		for (auto& other : *guard) {
+			if (other.data() == &nic) {
+				ptr = other;
+				break;
+			}
+		}
+	}
+
+	if (!ptr) {
+		return;
+	}
+
+	{
+		IrqGuard irq_guard {};
+		auto guard = nic.lock.lock();
+		ip = nic.ip;
+		subnet_mask = nic.subnet_mask;
+		gateway_ip = nic.gateway_ip;
+	}
+
+	route_remove_nic(&nic);
+
+	route_add({
+		.dest = ip & subnet_mask,
+		.prefix_len = static_cast<u8>(kstd::popcount(subnet_mask)),
+		.gateway = 0,
+		.src = ip,
+		.nic = ptr
+	});
+
+	if (gateway_ip) {
+		route_add({
+			.dest = 0,
+			.prefix_len = 0,
+			.gateway = gateway_ip,
+			.src = ip,
+			.nic = ptr
+		});
+	}
+}
+
+u32 route_update_pmtu(u32 dest, u32 mtu) {
+	// tcp always sets don't fragment, so a smaller mtu can't be honoured and is most likely forged
+	if (mtu < MIN_PATH_MTU) {
+		return 0;
+	}
+	auto now = get_current_ns();
+
+	IrqGuard irq_guard {};
+	auto guard = ROUTES->lock();
+	auto& cached = guard->pmtu[pmtu_hash(dest)];
+	if (cached.dest == dest && now < cached.expires && cached.mtu <= mtu) {
+		return cached.mtu;
+	}
+	cached = {
+		.dest = dest,
+		.mtu = mtu,
+		.expires = now + PMTU_TIMEOUT
+	};
+	return mtu;
+}
+
+bool route_lookup(u32 dest, u32 flow_hash, Nic* bound, RouteResult& result) {
+	IrqGuard irq_guard {};
+	auto guard = ROUTES->lock();
+	if (!guard->root) {
+		return false;
+	}
+
+	const Route* route = nullptr;
+	for (auto* group = guard->lookup(kstd::to_ne_from_be(dest)); group; group = group->parent) {
+		if (!bound) {
+			route = &group->routes[flow_hash % group->routes.size()];
+			break;
+		}
+
+		usize count = 0;
+		for (auto& candidate : group->routes) {
+			count += candidate.nic.data() == bound;
+		}
+		if (!count) {
+			continue;
+		}
+
+		usize index = flow_hash % count;
+		for (auto& candidate : group->routes) {
+			if (candidate.nic.data() == bound && !index--) {
+				route = &candidate;
+				break;
+			}
+		}
+		break;
+	}
+
+	if (!route) {
+		return false;
+	}
+
+	result.nic = route->nic;
+	result.src = route->src ? route->src : route->nic->ip;
+	// limited broadcast stays on the link of whichever route was picked
+	if (dest == 0xFFFFFFFF || !route->gateway) {
+		result.next_hop = dest;
+	}
+	else {
+		result.next_hop = route->gateway;
+	}
+
+	result.mtu = route->nic->mtu;
+	auto& cached = guard->pmtu[pmtu_hash(dest)];
+	if (cached.dest == dest && get_current_ns() < cached.expires) {
+		result.mtu = kstd::min(result.mtu, cached.mtu);
+	}
+	return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "shared_ptr.hpp"
+#include "types.hpp"
+
+struct Nic;
+
+/// Addresses are in network order like everywhere else in the stack.
+struct Route {
+	/// Network address, the bits past `prefix_len` are ignored.
+	u32 dest;
+	u8 prefix_len;
+	/// Router to send through, zero if the destinations are on link.
+	u32 gateway;
+	/// Source address of traffic using the route, zero to use the nic's address.
+	u32 src;
+	kstd::shared_ptr<Nic> nic;
+};
+
+struct RouteResult {
+	kstd::shared_ptr<Nic> nic;
+	u32 src;
+	u32 next_hop;
+	/// Largest datagram that can be sent, the nic's mtu unless a smaller path mtu was learned.
+	u32 mtu;
+};
+
+/// Adds a route, routes with the same prefix share the traffic to it by flow.
+void route_add(Route route);
+/// Removes every route through `nic`.
+void route_remove_nic(Nic* nic);
+/// Replaces the routes of `nic` with its on link and default routes, called once it has an address.
+void route_configure_nic(Nic& nic);
+
+/// Records a path mtu reported by an icmp fragmentation needed message for `dest`, a known mtu is only
+/// ever lowered until it expires. Returns the path mtu now in effect, which may be larger than `mtu`,
+/// or zero if `mtu` is below the minimum and was ignored.
+u32 route_update_pmtu(u32 dest, u32 mtu);
+
+/// Finds the longest prefix route to `dest`, the lookup cost doesn't depend on the number of routes.
+/// `flow_hash` picks between routes with the same prefix so a flow always uses the same one.
+/// If `bound` isn't null only routes through that nic are considered.
+bool route_lookup(u32 dest, u32 flow_hash, Nic* bound, RouteResult& result);
@@ -0,0 +1,68 @@
+#pragma once
+#include "double_list.hpp"
+#include "types.hpp"
+#include "utils/irq_guard.hpp"
+#include "utils/spinlock.hpp"
+
+/// Fixed size hash table of sockets with a lock per bucket, lookups from the rx path only
+/// contend with sockets being added or removed in the same bucket.
+template<typename T, DoubleListHook (T::*Hook), usize BUCKETS>
+struct SocketTable {
+	static_assert((BUCKETS & (BUCKETS - 1)) == 0, "bucket count must be a power of two");
+
+	void insert(u32 hash, T* socket) {
+		IrqGuard irq_guard {};
+		get_bucket(hash).lock()->push(socket);
+	}
+
+	/// Inserts `socket` unless a socket for which `pred` returns true is already in its bucket.
+	template<typename Pred>
+	bool insert_unique(u32 hash, T* socket, Pred pred) {
+		IrqGuard irq_guard {};
+		auto guard = get_bucket(hash).lock();
+		for (auto& other : *guard) {
+			if (pred(other)) {
+				return false;
+			}
+		}
+		guard->push(socket);
+		return true;
+	}
+
+	void remove(u32 hash, T* socket) {
+		IrqGuard irq_guard {};
+		get_bucket(hash).lock()->remove(socket);
+	}
+
+	/// Calls `fn` with the first socket in the bucket for which `pred` returns true,
+	/// the bucket stays locked during the call so the socket can't be removed from under it.
+	template<typename Pred, typename F>
+	bool find(u32 hash, Pred pred, F fn) {
+		IrqGuard irq_guard {};
+		auto guard = get_bucket(hash).lock();
+		for (auto& socket : *guard) {
+			if (pred(socket)) {
+				fn(socket);
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	Spinlock<DoubleList<T, Hook>>& get_bucket(u32 hash) {
+		return buckets[hash & (BUCKETS - 1)];
+	}
+
+	Spinlock<DoubleList<T, Hook>> buckets[BUCKETS] {};
+};
+
+constexpr u32 socket_port_hash(u16 port) {
+	return (port * u32 {0x9E3779B1}) >> 16;
+}
+
+constexpr u32 socket_hash(u32 local_ip, u16 local_port, u32 remote_ip, u16 remote_port) {
+	u64 hash = (u64 {local_ip} << 32 | remote_ip) * u64 {0x9E3779B97F4A7C15};
+	hash ^= (u64 {local_port} << 16 | remote_port) * u64 {0xC2B2AE3D27D4EB4F};
+	return hash >> 32;
+}
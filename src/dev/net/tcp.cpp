@@ -1,17 +1,22 @@
 #include "tcp.hpp"
 #include "arch/cpu.hpp"
-#include "arp.hpp"
 #include "checksum.hpp"
+#include "dev/clock.hpp"
 #include "dev/net/nic/nic.hpp"
 #include "dev/random.hpp"
 #include "manually_destroy.hpp"
 #include "mem/register.hpp"
+#include "neighbour.hpp"
+#include "net_worker.hpp"
 #include "packet.hpp"
-#include "ring_buffer.hpp"
+#include "route.hpp"
 #include "sched/process.hpp"
 #include "sched/sched.hpp"
+#include "socket_table.hpp"
 #include "sys/socket.hpp"
+#include "tcp_connection.hpp"
 #include "unique_ptr.hpp"
+#include "utils/trace.hpp"
 
 namespace flags {
 	static constexpr BitField<u16, bool> FIN {0, 1};
@@ -63,9 +68,26 @@ struct TcpHeader {
 		urgent_ptr = kstd::to_ne_from_be(urgent_ptr);
 	}
 
-	void calculate_checksum(u32 src_ip, u32 dest_ip, u16 header_size, const void* data, u16 data_size) {
-		checksum = 0;
+	/// Starts the checksum of a segment with the pseudo header, the header and its options,
+	/// the payload has to be added last.
+	[[nodiscard]] Checksum start_checksum(u32 src_ip, u32 dest_ip, const void* options, u16 options_size, u16 data_size) const {
+		PseudoHeader pseudo {
+			.src_ip = src_ip,
+			.dest_ip = dest_ip,
+			.zero = 0,
+			.protocol = IpProtocol::Tcp,
+			.header_payload_size = kstd::to_be(static_cast<u16>(sizeof(TcpHeader) + options_size + data_size))
+		};
+
+		Checksum sum;
+		sum.add(&pseudo, sizeof(PseudoHeader));
+		sum.add(this, sizeof(TcpHeader));
+		sum.add(options, options_size);
+		return sum;
+	}
 
+	/// Stores the folded pseudo header sum for a nic that completes the checksum.
+	void calculate_pseudo_checksum(u32 src_ip, u32 dest_ip, u16 header_size, u16 data_size) {
 		PseudoHeader pseudo {
 			.src_ip = src_ip,
 			.dest_ip = dest_ip,
@@ -75,35 +97,54 @@ struct TcpHeader {
 		};
 
 		Checksum sum;
-		sum.add(this, header_size);
-		sum.add(data, data_size);
 		sum.add(&pseudo, sizeof(PseudoHeader));
-		auto res = sum.get();
-
-		checksum = res;
+		checksum = ~sum.get();
 	}
 };
 
+static constexpr u32 SEND_BUFFER_SIZE = 1024 * 256;
+static constexpr u32 RECEIVE_BUFFER_SIZE = 1024 * 256;
+
+static u64 tcp_now() {
+	return get_current_ns() / NS_IN_US;
+}
+
 struct Tcp4Socket;
 
+static void insert_socket(Tcp4Socket* socket, bool listening);
 static void remove_socket(Tcp4Socket* socket);
 
 struct Tcp4Socket : public Socket {
 	explicit Tcp4Socket(int flags) : Socket {flags} {
-		current_segment.resize(1024 * 64);
-		IrqGuard irq_guard {};
-		handler_thread->cpu->scheduler.queue(handler_thread);
+		timer.fn = [this]() {
+			on_timer();
+		};
 	}
 
 	int disconnect_helper() {
-		if (state != State::Connected) {
-			return 0;
+		{
+			IrqGuard irq_guard {};
+			auto guard = lock.lock();
+			if (!conn || conn->get_state() == TcpConnection::State::Closed) {
+				return 0;
+			}
+			conn->close();
+			flush(tcp_now());
 		}
 
-		do_disconnect = true;
-		send_event.signal_one();
-		while (state != State::None) {
-			state_change_event.wait();
+		// wait for the fin to be acked, the connection gives up on its own if the peer stops responding
+		while (true) {
+			{
+				IrqGuard irq_guard {};
+				auto guard = lock.lock();
+				auto state = conn->get_state();
+				if (state == TcpConnection::State::Closed ||
+					state == TcpConnection::State::FinWait2 ||
+					state == TcpConnection::State::TimeWait) {
+					break;
+				}
+			}
+			send_event.wait();
 		}
 
 		return 0;
@@ -112,92 +153,48 @@ struct Tcp4Socket : public Socket {
 	~Tcp4Socket() override {
 		disconnect_helper();
 		remove_socket(this);
-		while (!send_event.is_being_waited()) {
-			get_current_thread()->yield();
-		}
 
-		state = State::Destroyed;
-		state_change_event.reset();
-		send_event.signal_one();
-		state_change_event.wait();
+		{
+			IrqGuard irq_guard {};
+			auto guard = lock.lock();
+			destroyed = true;
+		}
+		worker->disarm_sync(&timer);
 	}
 
 	int connect(const AnySocketAddress& address) override {
 		if (address.generic.type != SOCKET_ADDRESS_TYPE_IPV4) {
 			return ERR_UNSUPPORTED;
 		}
-		u32 addr = address.ipv4.ipv4;
-		u16 port = address.ipv4.port;
-
-		{
-			IrqGuard irq_guard {};
-			auto guard = NICS->lock();
-			if (guard->is_empty()) {
-				return ERR_NO_ROUTE_TO_HOST;
-			}
-		}
 
 		u16 src_port = 0;
 		random_generate(&src_port, 2);
+		u32 iss = 0;
+		random_generate(&iss, 4);
 
-		u32 new_sequence = 0;
-		random_generate(&new_sequence, 4);
-		sequence = new_sequence + 1;
-
-		auto mac = arp_get_mac(addr);
-		if (!mac) {
-			println("[kernel][tcp]: no ip->mac mapping for target");
+		RouteResult route;
+		u32 flow_hash = socket_hash(0, src_port, address.ipv4.ipv4, address.ipv4.port);
+		if (!route_lookup(address.ipv4.ipv4, flow_hash, bound_nic.data(), route)) {
 			return ERR_NO_ROUTE_TO_HOST;
 		}
+		nic = std::move(route.nic);
+		own_ip = route.src;
+		next_hop = route.next_hop;
+
+		own_port = src_port;
+		target = address.ipv4;
+		create_connection(route.mtu);
+		insert_socket(this, false);
 
 		{
 			IrqGuard irq_guard {};
-			// todo support choosing the nic
-			auto nic_guard = NICS->lock();
-
-			own_ip = (*nic_guard->front())->ip;
-			own_port = src_port;
-
-			target = address.ipv4;
-
-			Packet packet {sizeof(EthernetHeader) + sizeof(Ipv4Header) + sizeof(TcpHeader)};
-
-			packet.add_ethernet((*(*nic_guard).front())->mac, mac.value(), EtherType::Ipv4);
-			packet.add_ipv4(IpProtocol::Tcp, sizeof(TcpHeader), own_ip, addr);
-
-			auto* hdr_ptr = packet.add_header(sizeof(TcpHeader));
-			TcpHeader hdr {
-				.src_port = src_port,
-				.dest_port = port,
-				.sequence = new_sequence,
-				.ack_number = 0,
-				.flags {flags::SYN(true) | flags::DATA_OFFSET(5)},
-				.window_size = static_cast<u16>(1024 * 64 - 1),
-				.checksum = 0,
-				.urgent_ptr = 0
-			};
-			hdr.serialize();
-			hdr.calculate_checksum(own_ip, addr, sizeof(TcpHeader), nullptr, 0);
-			memcpy(hdr_ptr, &hdr, sizeof(hdr));
-
-			(*nic_guard->front())->send(packet.data, packet.size);
-
-			state = State::SentSyn;
+			auto guard = lock.lock();
+			auto now = tcp_now();
+			conn->connect(iss, now);
+			flush(now);
 		}
 
-		while (true) {
-			if (state == State::None) {
-				return ERR_TRY_AGAIN;
-			}
-			else if (state == State::Connected) {
-				break;
-			}
-			else {
-				state_change_event.wait();
-			}
-		}
-
-		return 0;
+		return wait_for_handshake();
 	}
 
 	int disconnect() override {
@@ -207,9 +204,11 @@ struct Tcp4Socket : public Socket {
 	int listen(uint32_t port) override {
 		listen_event.reset();
 		own_port = port;
-		state = State::Listening;
+		listening = true;
+		insert_socket(this, true);
 		listen_event.wait();
-		state = State::None;
+		remove_socket(this);
+		listening = false;
 		return 0;
 	}
 
@@ -217,67 +216,125 @@ struct Tcp4Socket : public Socket {
 		if (!pending_connection_valid) {
 			return ERR_TRY_AGAIN;
 		}
+		auto pending = pending_connection;
+		pending_connection_valid = false;
 
 		kstd::shared_ptr<Tcp4Socket> new_socket {tcp_socket_create(connection_flags)};
-		new_socket->state = State::SynAck;
-		new_socket->own_port = pending_connection.own_port;
-		new_socket->own_ip = pending_connection.own_ip;
-		new_socket->target.ipv4 = pending_connection.target_ip;
-		new_socket->target.port = pending_connection.target_port;
-		new_socket->received_sequence = pending_connection.sequence;
+		new_socket->own_port = pending.own_port;
+		new_socket->own_ip = pending.own_ip;
+		new_socket->target.ipv4 = pending.target_ip;
+		new_socket->target.port = pending.target_port;
+		new_socket->bound_nic = bound_nic;
+
+		// replies leave through the nic the syn came in on
+		RouteResult route;
+		u32 flow_hash = socket_hash(pending.own_ip, pending.own_port, pending.target_ip, pending.target_port);
+		if (!route_lookup(pending.target_ip, flow_hash, pending.nic, route)) {
+			return ERR_NO_ROUTE_TO_HOST;
+		}
+		new_socket->nic = std::move(route.nic);
+		new_socket->next_hop = route.next_hop;
 
-		pending_connection_valid = false;
+		u32 iss = 0;
+		random_generate(&iss, 4);
+
+		new_socket->create_connection(route.mtu);
+		insert_socket(new_socket.data(), false);
 
-		new_socket->send_event.signal_one();
-		while (new_socket->state != State::Connected && new_socket->state != State::None) {
-			new_socket->state_change_event.wait();
+		{
+			IrqGuard irq_guard {};
+			auto guard = new_socket->lock.lock();
+			auto now = tcp_now();
+			new_socket->conn->accept(pending.syn, iss, now);
+			new_socket->flush(now);
 		}
 
-		if (new_socket->state == State::None) {
-			return ERR_TRY_AGAIN;
+		if (auto status = new_socket->wait_for_handshake()) {
+			return status;
 		}
 
 		connection = std::move(new_socket);
-
 		return 0;
 	}
 
 	int send(const void* data, usize& size) override {
-		if (state != State::Connected) {
-			return ERR_CONNECTION_CLOSED;
-		}
+		usize written = 0;
 
-		if (flags & SOCK_NONBLOCK) {
-			size = send_buffer.write(data, size);
-		}
-		else {
-			send_buffer.write_block(data, size);
+		while (true) {
+			{
+				IrqGuard irq_guard {};
+				auto guard = lock.lock();
+				if (!conn || (conn->get_state() != TcpConnection::State::Established &&
+					conn->get_state() != TcpConnection::State::CloseWait)) {
+					if (!written) {
+						return ERR_CONNECTION_CLOSED;
+					}
+					break;
+				}
+
+				written += conn->write(offset(data, const u8*, written), size - written);
+				// transmit straight away if the window allows instead of waiting for an ack
+				flush(tcp_now());
+				if (written == size || (flags & SOCK_NONBLOCK)) {
+					break;
+				}
+			}
+
+			send_event.wait();
 		}
 
-		send_event.signal_one();
+		size = written;
 		return 0;
 	}
 
 	int receive(void* data, usize& size) override {
-		if (flags & OPEN_NONBLOCK) {
-			size = receive_buffer.read(data, size);
-			if (!size && state == State::Connected) {
-				return ERR_TRY_AGAIN;
+		while (true) {
+			{
+				IrqGuard irq_guard {};
+				auto guard = lock.lock();
+				if (!conn) {
+					size = 0;
+					return ERR_CONNECTION_CLOSED;
+				}
+
+				if (auto count = conn->read(data, size)) {
+					// the read may have opened the window enough to warrant an update
+					flush(tcp_now());
+					size = count;
+					return 0;
+				}
+				else if (conn->receive_closed()) {
+					size = 0;
+					return ERR_CONNECTION_CLOSED;
+				}
+				else if (flags & SOCK_NONBLOCK) {
+					size = 0;
+					return ERR_TRY_AGAIN;
+				}
 			}
+
+			receive_event.wait();
 		}
-		else {
-			bool interrupted = false;
-			size = receive_buffer.read_some(data, 1, size, state_change_event, interrupted);
+	}
+
+	int bind_interface(u32 index) override {
+		if (index == UINT32_MAX) {
+			bound_nic = nullptr;
+			return 0;
 		}
 
-		if (!size && state != State::Connected) {
-			return ERR_CONNECTION_CLOSED;
+		auto new_nic = nics_get(index);
+		if (!new_nic) {
+			return ERR_INVALID_ARGUMENT;
 		}
+		bound_nic = std::move(new_nic);
 		return 0;
 	}
 
 	int get_peer_name(AnySocketAddress& address) override {
-		if (state != State::Connected) {
+		IrqGuard irq_guard {};
+		auto guard = lock.lock();
+		if (!conn || !conn->is_synchronized() || conn->get_state() == TcpConnection::State::Closed) {
 			return ERR_CONNECTION_CLOSED;
 		}
 		address.ipv4 = target;
@@ -285,43 +342,15 @@ struct Tcp4Socket : public Socket {
 		return 0;
 	}
 
-	void process_packet(ReceivedPacket& packet, const TcpHeader& hdr) {
-		if (hdr.flags & flags::RST) {
-			println("[kernel][tcp]: received a rst");
-			state = State::None;
-			state_change_event.signal_one();
-			return;
-		}
-
-		if (expect_fin_ack) {
-			if (!(hdr.flags & flags::ACK)) {
-				println("[kernel][tcp]: expected an ack in reply to fin");
-				return;
-			}
-			if (hdr.sequence != received_sequence + 1) {
-				println("[kernel][tcp]: invalid sequence in fin reply ack");
-				return;
-			}
-			if (hdr.ack_number != sequence) {
-				println("[kernel][tcp]: invalid ack number in fin reply ack");
-				return;
-			}
-
-			expect_fin_ack = false;
-			fin_sent = true;
-			return;
-		}
-
-		if (state == State::Listening) {
-			if (hdr.flags & flags::SYN) {
-				if (pending_connection_valid) {
-					return;
-				}
-
-				println("[kernel][tcp]: new connection to port ", hdr.dest_port);
+	/// Called from the rx path with irqs disabled.
+	void process_packet(Nic& rx_nic, ReceivedPacket& packet, const TcpHeader& hdr, const TcpSegment& segment, const void* payload) {
+		if (listening) {
+			if ((segment.flags & tcp_flags::SYN) && !(segment.flags & tcp_flags::ACK) && !pending_connection_valid) {
+				debugln("[kernel][tcp]: new connection to port ", hdr.dest_port);
 
 				pending_connection = {
-					.sequence = hdr.sequence,
+					.syn = segment,
+					.nic = &rx_nic,
 					.target_ip = packet.layer1.ipv4.src_addr,
 					.own_ip = packet.layer1.ipv4.dest_addr,
 					.target_port = hdr.src_port,
@@ -330,455 +359,307 @@ struct Tcp4Socket : public Socket {
 				pending_connection_valid = true;
 				listen_event.signal_one();
 			}
+			return;
 		}
-		else if (state == State::SynAck) {
-			if (!(hdr.flags & flags::ACK)) {
-				println("[kernel][tcp]: expected an ack in reply to syn-ack");
-				return;
-			}
-			if (hdr.sequence != received_sequence + 1) {
-				println("[kernel][tcp]: invalid sequence in syn-ack reply ack");
-				return;
-			}
-			if (hdr.ack_number != sequence) {
-				println("[kernel][tcp]: invalid ack number in syn-ack reply ack");
-				return;
-			}
-			println("[kernel][tcp]: state -> Connected");
-			state = State::Connected;
-			state_change_event.signal_all();
-		}
-		else if (state == State::SentSyn) {
-			if (!(hdr.flags & flags::SYN) || !(hdr.flags & flags::ACK)) {
-				println("[kernel][tcp]: expected syn-ack");
-				return;
-			}
-			if (hdr.ack_number != sequence) {
-				println("[kernel][tcp]: invalid ack number in syn-ack");
-				return;
-			}
-
-			received_sequence = hdr.sequence;
 
-			state = State::ReceivedSynAck;
-			send_event.signal_one();
+		auto guard = lock.lock();
+		if (!conn) {
+			return;
 		}
-		else if (state == State::Connected) {
-			if (!(hdr.flags & flags::ACK)) {
-				println("[kernel][tcp]: expected ack to be set in a data packet");
-				return;
-			}
-			if (hdr.sequence != received_sequence + 1) {
-				println("[kernel][tcp]: invalid sequence in a data packet");
-				return;
-			}
-
-			if (hdr.ack_number != sequence) {
-				println("[kernel][tcp]: invalid ack number in a data packet");
-				return;
-			}
-
-			u16 hdr_len = (hdr.flags & flags::DATA_OFFSET) * 4;
-			u16 data_len = packet.layer2_len - hdr_len;
-
-			if (hdr.flags & flags::FIN) {
-				state = State::ReceivedFin;
-				send_event.signal_one();
-				++received_sequence;
-			}
-
-			received_sequence += data_len;
 
-			auto* data = offset(packet.layer2.raw, const char*, hdr_len);
+		auto now = tcp_now();
+		conn->on_segment(segment, payload, now);
+		flush(now);
+	}
 
-			if (receive_buffer.size() + data_len > 1024 * 64) {
-				println("[kernel][tcp]: discarding packet because receive buffer is full");
-				return;
-			}
-			receive_buffer.write_block(data, data_len);
-			send_event.signal_one();
+	/// Called from the rx path with irqs disabled.
+	void process_path_mtu(u32 seq, u32 mtu) {
+		auto guard = lock.lock();
+		if (!conn) {
+			return;
 		}
-		else if (state == State::SentFin) {
-			if (!(hdr.flags & flags::ACK)) {
-				println("[kernel][tcp]: expected an ack in reply to fin");
-				return;
-			}
-			if (hdr.sequence != received_sequence + 1) {
-				println("[kernel][tcp]: invalid sequence in fin reply ack");
-				return;
-			}
-			if (hdr.ack_number != sequence) {
-				println("[kernel][tcp]: invalid ack number in fin reply ack");
-				return;
-			}
 
-			state = State::None;
-			state_change_event.signal_one();
-			println("[kernel][tcp]: socket disconnected");
-		}
-		else {
-			println("[kernel][tcp]: unhandled receive state");
+		auto now = tcp_now();
+		if (conn->on_path_mss(seq, mtu - sizeof(Ipv4Header) - sizeof(TcpHeader), now)) {
+			flush(now);
 		}
 	}
 
-	[[noreturn]] static void handler_fn(void* ptr) {
-		auto* self = static_cast<Tcp4Socket*>(ptr);
-		auto* thread = get_current_thread();
-
-		while (true) {
-			self->send_event.wait();
-			if (self->state == State::SynAck) {
-				Packet packet {sizeof(EthernetHeader) + sizeof(Ipv4Header) + sizeof(TcpHeader)};
-
-				auto mac = arp_get_mac(self->target.ipv4);
-				if (!mac) {
-					println("[kernel][tcp]: no ip->mac mapping for target");
-				}
-
-				IrqGuard irq_guard {};
-				// todo support choosing the nic
-				auto nic_guard = NICS->lock();
-
-				packet.add_ethernet((*(*nic_guard).front())->mac, mac.value(), EtherType::Ipv4);
-				packet.add_ipv4(IpProtocol::Tcp, sizeof(TcpHeader), self->own_ip, self->target.ipv4);
-
-				u32 new_sequence = 0;
-				random_generate(&new_sequence, 4);
-
-				self->sequence = new_sequence + 1;
-
-				auto* hdr_ptr = packet.add_header(sizeof(TcpHeader));
-				TcpHeader hdr {
-					.src_port = self->own_port,
-					.dest_port = self->target.port,
-					.sequence = new_sequence,
-					.ack_number = self->received_sequence + 1,
-					.flags {flags::SYN(true) | flags::ACK(true) | flags::DATA_OFFSET(5)},
-					.window_size = static_cast<u16>(1024 * 64 - 1),
-					.checksum = 0,
-					.urgent_ptr = 0
-				};
-				hdr.serialize();
-				hdr.calculate_checksum(self->own_ip, self->target.ipv4, sizeof(TcpHeader), nullptr, 0);
-				memcpy(hdr_ptr, &hdr, sizeof(hdr));
-
-				(*nic_guard->front())->send(packet.data, packet.size);
-
-				println("[kernel][tcp]: sending syn-ack");
-			}
-			else if (self->state == State::Connected) {
-				if (auto size = self->send_buffer.size()) {
-					u32 to_send = kstd::min(size, usize {1024 * 64 - sizeof(Ipv4Header) - sizeof(TcpHeader)});
-
-					kstd::vector<u8> buffer;
-					buffer.resize(to_send);
-					self->send_buffer.read_block(buffer.data(), to_send);
-
-					auto mac = arp_get_mac(self->target.ipv4);
-					if (!mac) {
-						println("[kernel][tcp]: no ip->mac mapping for target");
-					}
-
-					IrqGuard irq_guard {};
-					// todo support choosing the nic
-					auto nic_guard = NICS->lock();
-
-					u32 packet_size = sizeof(EthernetHeader) + sizeof(Ipv4Header) + sizeof(TcpHeader) + to_send;
-					Packet packet {packet_size};
-					packet.add_ethernet((*(*nic_guard).front())->mac, mac.value(), EtherType::Ipv4);
-					packet.add_ipv4(IpProtocol::Tcp, sizeof(TcpHeader) + to_send, self->own_ip, self->target.ipv4);
-
-					auto* hdr_ptr = packet.add_header(sizeof(TcpHeader));
-					TcpHeader hdr {
-						.src_port = self->own_port,
-						.dest_port = self->target.port,
-						.sequence = self->sequence,
-						.ack_number = self->received_sequence + 1,
-						.flags {flags::ACK(true) | flags::DATA_OFFSET(5)},
-						.window_size = static_cast<u16>(1024 * 64 - 1),
-						.checksum = 0,
-						.urgent_ptr = 0
-					};
-
-					self->sequence += to_send;
-
-					auto* data_ptr = packet.add_header(to_send);
-					memcpy(data_ptr, buffer.data(), to_send);
-
-					hdr.serialize();
-					hdr.calculate_checksum(self->own_ip, self->target.ipv4, sizeof(TcpHeader), data_ptr, to_send);
-					memcpy(hdr_ptr, &hdr, sizeof(hdr));
-
-					(*nic_guard->front())->send(packet.data, packet.size);
-				}
-				else if (self->do_disconnect) {
-					auto mac = arp_get_mac(self->target.ipv4);
-					if (!mac) {
-						println("[kernel][tcp]: no ip->mac mapping for target");
-					}
+	/// Called on the worker when the connection's timer expires.
+	void on_timer() {
+		IrqGuard irq_guard {};
+		auto guard = lock.lock();
+		timer_deadline = UINT64_MAX;
+		if (destroyed || !conn) {
+			return;
+		}
 
-					IrqGuard irq_guard {};
-					// todo support choosing the nic
-					auto nic_guard = NICS->lock();
-
-					Packet fin_packet {sizeof(EthernetHeader) + sizeof(Ipv4Header) + sizeof(TcpHeader)};
-					fin_packet.add_ethernet((*(*nic_guard).front())->mac, mac.value(), EtherType::Ipv4);
-					fin_packet.add_ipv4(IpProtocol::Tcp, sizeof(TcpHeader), self->own_ip, self->target.ipv4);
-
-					auto* hdr_ptr2 = fin_packet.add_header(sizeof(TcpHeader));
-					TcpHeader hdr2 {
-						.src_port = self->own_port,
-						.dest_port = self->target.port,
-						.sequence = self->sequence,
-						.ack_number = self->received_sequence + 1,
-						.flags {flags::ACK(true) | flags::FIN(true) | flags::DATA_OFFSET(5)},
-						.window_size = static_cast<u16>(1024 * 64 - 1),
-						.checksum = 0,
-						.urgent_ptr = 0
-					};
-					hdr2.serialize();
-					hdr2.calculate_checksum(self->own_ip, self->target.ipv4, sizeof(TcpHeader), nullptr, 0);
-					memcpy(hdr_ptr2, &hdr2, sizeof(hdr2));
-
-					++self->sequence;
-
-					(*nic_guard->front())->send(fin_packet.data, fin_packet.size);
-
-					println("[kernel][tcp]: sending fin");
-
-					self->do_disconnect = false;
-					self->expect_fin_ack = true;
-				}
-				else {
-					auto mac = arp_get_mac(self->target.ipv4);
-					if (!mac) {
-						println("[kernel][tcp]: no ip->mac mapping for target");
-					}
+		auto now = tcp_now();
+		conn->on_timer(now);
+		flush(now);
+	}
 
-					IrqGuard irq_guard {};
-					// todo support choosing the nic
-					auto nic_guard = NICS->lock();
-
-					u32 packet_size = sizeof(EthernetHeader) + sizeof(Ipv4Header) + sizeof(TcpHeader);
-					Packet packet {packet_size};
-					packet.add_ethernet((*(*nic_guard).front())->mac, mac.value(), EtherType::Ipv4);
-					packet.add_ipv4(IpProtocol::Tcp, sizeof(TcpHeader), self->own_ip, self->target.ipv4);
-
-					auto* hdr_ptr = packet.add_header(sizeof(TcpHeader));
-					TcpHeader hdr {
-						.src_port = self->own_port,
-						.dest_port = self->target.port,
-						.sequence = self->sequence,
-						.ack_number = self->received_sequence + 1,
-						.flags {flags::ACK(true) | flags::DATA_OFFSET(5)},
-						.window_size = static_cast<u16>(1024 * 64 - 1),
-						.checksum = 0,
-						.urgent_ptr = 0
-					};
-
-					hdr.serialize();
-					hdr.calculate_checksum(self->own_ip, self->target.ipv4, sizeof(TcpHeader), nullptr, 0);
-					memcpy(hdr_ptr, &hdr, sizeof(hdr));
-
-					(*nic_guard->front())->send(packet.data, packet.size);
-				}
-			}
-			else if (self->state == State::ReceivedFin) {
-				Packet packet {sizeof(EthernetHeader) + sizeof(Ipv4Header) + sizeof(TcpHeader)};
+	void create_connection(u32 path_mtu) {
+		// the advertised mss is what the local link can receive, segments sent are limited by the path
+		u16 mss = nic->mtu - sizeof(Ipv4Header) - sizeof(TcpHeader);
+		TcpConfig config {
+			.send_buffer_size = SEND_BUFFER_SIZE,
+			.receive_buffer_size = RECEIVE_BUFFER_SIZE,
+			.mss = mss,
+			.path_mss = static_cast<u16>(kstd::min(path_mtu, nic->mtu) - sizeof(Ipv4Header) - sizeof(TcpHeader)),
+			.max_burst = nic->tso ?
+				u32 {0xFFFF - sizeof(Ipv4Header) - sizeof(TcpHeader) - TcpOptions::MAX_SIZE} :
+				mss,
+			.congestion = CongestionAlgorithm::Cubic
+		};
 
-				auto mac = arp_get_mac(self->target.ipv4);
-				if (!mac) {
-					println("[kernel][tcp]: no ip->mac mapping for target");
-				}
+		auto new_conn = kstd::make_unique<TcpConnection>(config);
+		IrqGuard irq_guard {};
+		auto guard = lock.lock();
+		conn = std::move(new_conn);
+	}
 
+	int wait_for_handshake() {
+		while (true) {
+			{
 				IrqGuard irq_guard {};
-				// todo support choosing the nic
-				auto nic_guard = NICS->lock();
-
-				packet.add_ethernet((*(*nic_guard).front())->mac, mac.value(), EtherType::Ipv4);
-				packet.add_ipv4(IpProtocol::Tcp, sizeof(TcpHeader), self->own_ip, self->target.ipv4);
-
-				BitValue<u16> flags {flags::ACK(true) | flags::DATA_OFFSET(5)};
-				if (!self->fin_sent) {
-					flags |= flags::FIN(true);
-				}
-
-				auto* hdr_ptr = packet.add_header(sizeof(TcpHeader));
-				TcpHeader hdr {
-					.src_port = self->own_port,
-					.dest_port = self->target.port,
-					.sequence = self->sequence,
-					.ack_number = self->received_sequence + 1,
-					.flags {flags},
-					.window_size = static_cast<u16>(1024 * 64 - 1),
-					.checksum = 0,
-					.urgent_ptr = 0
-				};
-				hdr.serialize();
-				hdr.calculate_checksum(self->own_ip, self->target.ipv4, sizeof(TcpHeader), nullptr, 0);
-				memcpy(hdr_ptr, &hdr, sizeof(hdr));
-
-				++self->sequence;
-
-				(*nic_guard->front())->send(packet.data, packet.size);
-
-				if (!self->fin_sent) {
-					println("[kernel][tcp]: sending fin-ack");
-					self->state = State::SentFin;
-				}
-				else {
-					println("[kernel][tcp]: sending ack");
-					self->state = State::None;
-					self->state_change_event.signal_one();
+				auto guard = lock.lock();
+				auto state = conn->get_state();
+				if (state != TcpConnection::State::SynSent && state != TcpConnection::State::SynReceived) {
+					return state == TcpConnection::State::Closed ? ERR_TRY_AGAIN : 0;
 				}
 			}
-			else if (self->state == State::ReceivedSynAck) {
-				Packet packet {sizeof(EthernetHeader) + sizeof(Ipv4Header) + sizeof(TcpHeader)};
+			send_event.wait();
+		}
+	}
 
-				auto mac = arp_get_mac(self->target.ipv4);
-				if (!mac) {
-					println("[kernel][tcp]: no ip->mac mapping for target");
-				}
+	/// Transmits everything the connection has ready and wakes up whoever is waiting on it,
+	/// called with the lock held and irqs disabled.
+	void flush(u64 now) {
+		TcpSegment segment {};
+		while (conn->next_segment(segment, now)) {
+			send_segment(segment);
+		}
 
-				IrqGuard irq_guard {};
-				// todo support choosing the nic
-				auto nic_guard = NICS->lock();
-
-				packet.add_ethernet((*(*nic_guard).front())->mac, mac.value(), EtherType::Ipv4);
-				packet.add_ipv4(IpProtocol::Tcp, sizeof(TcpHeader), self->own_ip, self->target.ipv4);
-
-				auto* hdr_ptr = packet.add_header(sizeof(TcpHeader));
-				TcpHeader hdr {
-					.src_port = self->own_port,
-					.dest_port = self->target.port,
-					.sequence = self->sequence,
-					.ack_number = self->received_sequence + 1,
-					.flags {flags::ACK(true) | flags::DATA_OFFSET(5)},
-					.window_size = static_cast<u16>(1024 * 64 - 1),
-					.checksum = 0,
-					.urgent_ptr = 0
-				};
-				hdr.serialize();
-				hdr.calculate_checksum(self->own_ip, self->target.ipv4, sizeof(TcpHeader), nullptr, 0);
-				memcpy(hdr_ptr, &hdr, sizeof(hdr));
+		if (conn->readable() || conn->receive_closed()) {
+			receive_event.signal_one_if_not_pending();
+		}
+		if (conn->writable() || conn->get_state() != TcpConnection::State::Established) {
+			send_event.signal_one_if_not_pending();
+		}
 
-				(*nic_guard->front())->send(packet.data, packet.size);
+		auto deadline = conn->next_deadline();
+		if (deadline != timer_deadline && !destroyed) {
+			timer_deadline = deadline;
+			if (deadline == UINT64_MAX) {
+				worker->disarm(&timer);
+			}
+			else {
+				worker->arm(&timer, deadline);
+			}
+		}
+	}
 
-				println("[kernel][tcp]: sending ack");
+	void send_segment(const TcpSegment& segment) {
+		trace(TRACE_EVENT_TCP_TX, u32 {own_port} << 16 | target.port, segment.len);
+
+		u8 options[TcpOptions::MAX_SIZE];
+		u32 options_size = tcp_write_options(options, segment.options);
+		u32 hdr_size = sizeof(TcpHeader) + options_size;
+
+		Packet packet {static_cast<u32>(sizeof(EthernetHeader) + sizeof(Ipv4Header) + hdr_size + segment.len)};
+		// the destination mac is filled in by the neighbour table
+		packet.add_ethernet(nic->mac, {}, EtherType::Ipv4);
+		packet.add_ipv4(IpProtocol::Tcp, hdr_size + segment.len, own_ip, target.ipv4, true);
+
+		auto* hdr_ptr = packet.add_header(hdr_size);
+		auto* data_ptr = packet.add_header(segment.len);
+
+		TcpHeader hdr {
+			.src_port = own_port,
+			.dest_port = target.port,
+			.sequence = segment.seq,
+			.ack_number = segment.ack,
+			.flags {static_cast<u16>(segment.flags | flags::DATA_OFFSET(hdr_size / 4))},
+			.window_size = segment.window,
+			.checksum = 0,
+			.urgent_ptr = 0
+		};
+		hdr.serialize();
 
-				self->state = State::Connected;
-				self->state_change_event.signal_one();
+		if (nic->tx_csum_offload) {
+			if (segment.len) {
+				conn->copy_payload(segment.seq, data_ptr, segment.len);
 			}
-			else if (self->state == State::Destroyed) {
-				IrqGuard irq_guard {};
-				self->state_change_event.signal_one();
-				thread->cpu->scheduler.exit_thread(0);
+			hdr.calculate_pseudo_checksum(own_ip, target.ipv4, hdr_size, segment.len);
+			memcpy(hdr_ptr, &hdr, sizeof(hdr));
+			memcpy(offset(hdr_ptr, void*, sizeof(hdr)), options, options_size);
+
+			u32 mss = conn->get_mss();
+			TxOffload offload {
+				.csum_start = sizeof(EthernetHeader) + sizeof(Ipv4Header),
+				.csum_offset = offsetof(TcpHeader, checksum),
+				.tcp_mss = static_cast<u16>(segment.len > mss ? mss : 0)
+			};
+			neighbour_output(*nic, next_hop, packet, offload);
+		}
+		else {
+			// the payload is checksummed while it's copied out of the send buffer
+			auto sum = hdr.start_checksum(own_ip, target.ipv4, options, options_size, segment.len);
+			if (segment.len) {
+				conn->copy_payload(segment.seq, data_ptr, segment.len, sum);
 			}
+			hdr.checksum = sum.get();
+			memcpy(hdr_ptr, &hdr, sizeof(hdr));
+			memcpy(offset(hdr_ptr, void*, sizeof(hdr)), options, options_size);
+			neighbour_output(*nic, next_hop, packet);
 		}
 	}
 
 	struct Connection {
-		u32 sequence;
+		TcpSegment syn;
+		Nic* nic;
 		u32 target_ip;
 		u32 own_ip;
 		u16 target_port;
 		u16 own_port;
 	};
 	Connection pending_connection {};
+	DoubleListHook table_hook {};
+	u32 table_hash {};
+	enum class Table {
+		None,
+		Established,
+		Listening
+	} table {};
 	bool pending_connection_valid {};
-	bool do_disconnect {};
-	bool expect_fin_ack {};
-	bool fin_sent {};
-
-	Thread* create_handler_thread() {
-		IrqGuard irq_guard {};
-		auto* thread = new Thread {"tcp handler", get_current_thread()->cpu, &*KERNEL_PROCESS, handler_fn, this};
-		return thread;
-	}
-
-	RingBuffer<u8> send_buffer {1024 * 64};
-	RingBuffer<u8> receive_buffer {1024 * 64};
-	kstd::vector<u8> current_segment {};
+	bool listening {};
+	bool destroyed {};
+
+	Spinlock<void> lock {};
+	kstd::unique_ptr<TcpConnection> conn {};
+	kstd::shared_ptr<Nic> nic {};
+	kstd::shared_ptr<Nic> bound_nic {};
+	u32 next_hop {};
 	Ipv4SocketAddress target {};
 	Event listen_event {};
 	Event send_event {};
-	Event state_change_event {};
-	Thread* handler_thread {create_handler_thread()};
+	Event receive_event {};
+	/// Timers of every connection created on a cpu are driven by that cpu's worker.
+	NetWorker* worker {net_worker_get(get_current_thread()->cpu)};
+	NetTimer timer {};
+	u64 timer_deadline {UINT64_MAX};
 	u32 own_ip {};
 	u16 own_port {};
-	u32 sequence {};
-	u32 received_sequence {};
-	u32 acked_sequence {};
-
-	enum class State {
-		None,
-		SynAck,
-		ReceivedFin,
-		ReceivedSynAck,
-		SentFin,
-		SentSyn,
-		Connected,
-		Listening,
-		Destroyed
-	} state {};
 };
 
 namespace {
-	ManuallyDestroy<Spinlock<kstd::vector<Tcp4Socket*>>> SOCKETS;
+	/// Connected sockets and sockets connecting or being accepted, keyed by the 4-tuple.
+	ManuallyDestroy<SocketTable<Tcp4Socket, &Tcp4Socket::table_hook, 1024>> ESTABLISHED;
+	/// Listening sockets keyed by the local port.
+	ManuallyDestroy<SocketTable<Tcp4Socket, &Tcp4Socket::table_hook, 64>> LISTENERS;
 }
 
-static void remove_socket(Tcp4Socket* socket) {
-	IrqGuard irq_guard {};
-	auto guard = SOCKETS->lock();
+static void insert_socket(Tcp4Socket* socket, bool listening) {
+	remove_socket(socket);
 
-	for (usize i = 0; i < guard->size(); ++i) {
-		if ((*guard)[i] == socket) {
-			guard->remove(i);
-			break;
-		}
+	if (listening) {
+		socket->table_hash = socket_port_hash(socket->own_port);
+		socket->table = Tcp4Socket::Table::Listening;
+		LISTENERS->insert(socket->table_hash, socket);
+	}
+	else {
+		socket->table_hash = socket_hash(socket->own_ip, socket->own_port, socket->target.ipv4, socket->target.port);
+		socket->table = Tcp4Socket::Table::Established;
+		ESTABLISHED->insert(socket->table_hash, socket);
 	}
 }
 
+static void remove_socket(Tcp4Socket* socket) {
+	if (socket->table == Tcp4Socket::Table::Listening) {
+		LISTENERS->remove(socket->table_hash, socket);
+	}
+	else if (socket->table == Tcp4Socket::Table::Established) {
+		ESTABLISHED->remove(socket->table_hash, socket);
+	}
+	socket->table = Tcp4Socket::Table::None;
+}
+
 kstd::shared_ptr<Socket> tcp_socket_create(int flags) {
-	auto socket = kstd::make_shared<Tcp4Socket>(flags);
-	IrqGuard irq_guard {};
-	auto guard = SOCKETS->lock();
-	guard->push(socket.data());
-	return socket;
+	return kstd::make_shared<Tcp4Socket>(flags);
 }
 
 void tcp_process_packet(Nic& nic, ReceivedPacket& packet) {
+	if (packet.layer2_len < sizeof(TcpHeader)) {
+		return;
+	}
+
 	TcpHeader hdr {};
 	memcpy(&hdr, packet.layer2.raw, sizeof(TcpHeader));
 	hdr.deserialize();
 
-	bool processed = false;
-
-	IrqGuard irq_guard {};
-	auto guard = SOCKETS->lock();
+	u16 hdr_len = (hdr.flags & flags::DATA_OFFSET) * 4;
+	if (hdr_len < sizeof(TcpHeader) || hdr_len > packet.layer2_len) {
+		return;
+	}
 
-	for (auto& socket : *guard) {
-		if (socket->state == Tcp4Socket::State::Listening) {
-			continue;
-		}
+	TcpSegment segment {
+		.seq = hdr.sequence,
+		.ack = hdr.ack_number,
+		.flags = static_cast<u8>(hdr.flags.value),
+		.window = hdr.window_size,
+		.len = static_cast<u32>(packet.layer2_len - hdr_len),
+		.options {}
+	};
+	trace(TRACE_EVENT_TCP_RX, u32 {hdr.dest_port} << 16 | hdr.src_port, segment.len);
 
-		if (socket->own_ip == packet.layer1.ipv4.dest_addr &&
-			socket->own_port == hdr.dest_port &&
-			socket->target.ipv4 == packet.layer1.ipv4.src_addr &&
-			socket->target.port == hdr.src_port) {
-			socket->process_packet(packet, hdr);
-			processed = true;
-			break;
-		}
+	auto* options = offset(packet.layer2.raw, const u8*, sizeof(TcpHeader));
+	if (!tcp_parse_options(options, hdr_len - sizeof(TcpHeader), segment.options)) {
+		return;
 	}
+	auto* payload = offset(packet.layer2.raw, const void*, hdr_len);
+
+	u32 own_ip = packet.layer1.ipv4.dest_addr;
+	u32 target_ip = packet.layer1.ipv4.src_addr;
+
+	auto process = [&](Tcp4Socket& socket) {
+		socket.process_packet(nic, packet, hdr, segment, payload);
+	};
+
+	bool processed = ESTABLISHED->find(
+		socket_hash(own_ip, hdr.dest_port, target_ip, hdr.src_port),
+		[&](Tcp4Socket& socket) {
+			return !socket.listening &&
+				socket.own_ip == own_ip &&
+				socket.own_port == hdr.dest_port &&
+				socket.target.ipv4 == target_ip &&
+				socket.target.port == hdr.src_port;
+		},
+		process);
 
 	if (!processed) {
-		for (auto& socket : *guard) {
-			if (socket->state == Tcp4Socket::State::Listening &&
-				socket->own_port == hdr.dest_port) {
-				socket->process_packet(packet, hdr);
-				break;
-			}
-		}
+		LISTENERS->find(
+			socket_port_hash(hdr.dest_port),
+			[&](Tcp4Socket& socket) {
+				return socket.listening &&
+					socket.own_port == hdr.dest_port &&
+					(!socket.bound_nic || socket.bound_nic.data() == &nic);
+			},
+			process);
 	}
 }
+
+void tcp_process_path_mtu(u32 own_ip, u16 own_port, u32 target_ip, u16 target_port, u32 seq, u32 mtu) {
+	ESTABLISHED->find(
+		socket_hash(own_ip, own_port, target_ip, target_port),
+		[&](Tcp4Socket& socket) {
+			return !socket.listening &&
+				socket.own_ip == own_ip &&
+				socket.own_port == own_port &&
+				socket.target.ipv4 == target_ip &&
+				socket.target.port == target_port;
+		},
+		[&](Tcp4Socket& socket) {
+			socket.process_path_mtu(seq, mtu);
+		});
+}
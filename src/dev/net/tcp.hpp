@@ -6,4 +6,7 @@ struct Nic;
 struct ReceivedPacket;
 
 void tcp_process_packet(Nic& nic, ReceivedPacket& packet);
+/// Lowers the segment size of the connection a segment starting at `seq` that was too large for the path
+/// belongs to, called for icmp fragmentation needed messages. Addresses are in network order, ports in host order.
+void tcp_process_path_mtu(u32 own_ip, u16 own_port, u32 target_ip, u16 target_port, u32 seq, u32 mtu);
 kstd::shared_ptr<Socket> tcp_socket_create(int flags);
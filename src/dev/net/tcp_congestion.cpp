@@ -0,0 +1,148 @@
+#include "tcp_congestion.hpp"
+#include "algorithm.hpp"
+
+static constexpr u32 MAX_CWND = 1U << 30;
+
+CongestionControl::CongestionControl(u32 mss) : mss {mss}, cwnd {} {
+	set_mss(mss);
+}
+
+void CongestionControl::set_mss(u32 new_mss) {
+	// RFC 6928 initial window
+	mss = new_mss;
+	cwnd = kstd::min(10 * mss, kstd::max(2 * mss, u32 {14600}));
+}
+
+void CongestionControl::on_timeout(u32 in_flight, u64) {
+	ssthresh = kstd::max(in_flight / 2, 2 * mss);
+	cwnd = mss;
+}
+
+void CongestionControl::on_recovery_end() {
+	cwnd = ssthresh;
+}
+
+u32 CongestionControl::slow_start(u32 acked) {
+	// RFC 3465 byte counting with L = 2 so delayed acks don't halve the growth
+	cwnd += kstd::min(acked, 2 * mss);
+	if (cwnd > ssthresh) {
+		u32 left = cwnd - ssthresh;
+		cwnd = ssthresh;
+		return left;
+	}
+	return 0;
+}
+
+void NewRenoCongestion::on_ack(u32 acked, u64, u64) {
+	if (cwnd < ssthresh) {
+		acked = slow_start(acked);
+		if (!acked) {
+			return;
+		}
+	}
+
+	bytes_acked += acked;
+	if (bytes_acked >= cwnd) {
+		bytes_acked -= cwnd;
+		cwnd = kstd::min(cwnd + mss, MAX_CWND);
+	}
+}
+
+void NewRenoCongestion::on_loss(u32 in_flight, u64) {
+	ssthresh = kstd::max(in_flight / 2, 2 * mss);
+	cwnd = ssthresh;
+	bytes_acked = 0;
+}
+
+static u64 cube_root(u64 value) {
+	u64 res = 0;
+	for (int bit = 20; bit >= 0; --bit) {
+		u64 next = res | u64 {1} << bit;
+		if (next * next * next <= value) {
+			res = next;
+		}
+	}
+	return res;
+}
+
+void CubicCongestion::start_epoch(u64 now) {
+	epoch_start = now;
+	in_epoch = true;
+	w_est = cwnd;
+	est_credit = 0;
+
+	if (cwnd < w_max) {
+		// K = cbrt((W_max - cwnd) / C) seconds with the window in segments, computed in milliseconds
+		k_ms = cube_root(u64 {w_max - cwnd} * 2500000000 / mss);
+		origin = w_max;
+	}
+	else {
+		k_ms = 0;
+		origin = cwnd;
+	}
+}
+
+void CubicCongestion::on_ack(u32 acked, u64 now, u64 srtt) {
+	if (cwnd < ssthresh) {
+		acked = slow_start(acked);
+		if (!acked) {
+			return;
+		}
+	}
+
+	if (!in_epoch) {
+		start_epoch(now);
+	}
+
+	// W_cubic(t + rtt) = C * (t + rtt - K)^3 + W_max, C * d^3 in thousandths of a segment is 2 * d^3 / 5e6
+	i64 d = static_cast<i64>((now - epoch_start + srtt) / 1000) - static_cast<i64>(k_ms);
+	d = kstd::min(kstd::max(d, i64 {-1000000}), i64 {1000000});
+	i64 delta = 2 * d * d * d / 5000000 * mss / 1000;
+	i64 target = kstd::max(static_cast<i64>(origin) + delta, i64 {0});
+	target = kstd::min(target, static_cast<i64>(cwnd) + cwnd / 2);
+
+	// reno friendly estimate, grows by 3(1 - β)/(1 + β) segments per window until it reaches W_max
+	u64 alpha = w_est < w_max ? 9 : 17;
+	est_credit += u64 {acked} * mss * alpha;
+	u64 per_segment = u64 {cwnd} * 17;
+	w_est += est_credit / per_segment;
+	est_credit %= per_segment;
+
+	if (static_cast<i64>(w_est) > target) {
+		cwnd = kstd::max(cwnd, w_est);
+	}
+	else if (target > cwnd) {
+		cwnd += (static_cast<u64>(target) - cwnd) * acked / cwnd;
+	}
+	cwnd = kstd::min(cwnd, MAX_CWND);
+}
+
+void CubicCongestion::on_loss(u32, u64) {
+	in_epoch = false;
+	// fast convergence, release bandwidth to new flows when the window didn't recover to the last maximum
+	if (cwnd < w_max) {
+		w_max = static_cast<u32>(u64 {cwnd} * 17 / 20);
+	}
+	else {
+		w_max = cwnd;
+	}
+	ssthresh = kstd::max(static_cast<u32>(u64 {cwnd} * 7 / 10), 2 * mss);
+	cwnd = ssthresh;
+}
+
+void CubicCongestion::on_timeout(u32, u64) {
+	in_epoch = false;
+	w_max = cwnd;
+	ssthresh = kstd::max(static_cast<u32>(u64 {cwnd} * 7 / 10), 2 * mss);
+	cwnd = mss;
+}
+
+kstd::unique_ptr<CongestionControl> congestion_control_create(CongestionAlgorithm algorithm, u32 mss) {
+	switch (algorithm) {
+		case CongestionAlgorithm::NewReno:
+			return kstd::unique_ptr<CongestionControl> {new NewRenoCongestion {mss}};
+		case CongestionAlgorithm::Cubic:
+			return kstd::unique_ptr<CongestionControl> {new CubicCongestion {mss}};
+	}
+	return nullptr;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "types.hpp"
+#include "unique_ptr.hpp"
+
+enum class CongestionAlgorithm {
+	NewReno,
+	Cubic
+};
+
+/// Congestion window policy of a tcp connection, sizes are in bytes and times in microseconds.
+struct CongestionControl {
+	explicit CongestionControl(u32 mss);
+	virtual ~CongestionControl() = default;
+
+	/// Called for every ack that advances the unacknowledged sequence outside of loss recovery.
+	virtual void on_ack(u32 acked, u64 now, u64 srtt) = 0;
+	/// Called once per window of data when a loss is detected through duplicate acks or sack.
+	virtual void on_loss(u32 in_flight, u64 now) = 0;
+	/// Called when the retransmission timer expires.
+	virtual void on_timeout(u32 in_flight, u64 now);
+	/// Called when every segment outstanding at the start of loss recovery has been acked.
+	virtual void on_recovery_end();
+
+	/// Updates the segment size after the handshake, resetting the initial window.
+	void set_mss(u32 new_mss);
+
+	u32 mss;
+	u32 cwnd;
+	u32 ssthresh {UINT32_MAX};
+
+protected:
+	/// Slow start increase, returns the part of `acked` left over for congestion avoidance.
+	u32 slow_start(u32 acked);
+};
+
+/// RFC 5681 / RFC 6582 additive increase, multiplicative decrease.
+struct NewRenoCongestion : CongestionControl {
+	using CongestionControl::CongestionControl;
+
+	void on_ack(u32 acked, u64 now, u64 srtt) override;
+	void on_loss(u32 in_flight, u64 now) override;
+
+private:
+	u32 bytes_acked {};
+};
+
+/// RFC 9438 cubic window growth in integer arithmetic (β = 0.7, C = 0.4).
+struct CubicCongestion : CongestionControl {
+	using CongestionControl::CongestionControl;
+
+	void on_ack(u32 acked, u64 now, u64 srtt) override;
+	void on_loss(u32 in_flight, u64 now) override;
+	void on_timeout(u32 in_flight, u64 now) override;
+
+private:
+	void start_epoch(u64 now);
+
+	u64 epoch_start {};
+	u64 k_ms {};
+	u64 est_credit {};
+	u32 w_max {};
+	u32 origin {};
+	u32 w_est {};
+	bool in_epoch {};
+};
+
+kstd::unique_ptr<CongestionControl> congestion_control_create(CongestionAlgorithm algorithm, u32 mss);
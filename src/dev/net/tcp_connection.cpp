@@ -0,0 +1,1123 @@
+#include "tcp_connection.hpp"
+#include "algorithm.hpp"
+
+#ifdef TESTING
+#include <cstring>
+#else
+#include "cstring.hpp"
+#endif
+
+static constexpr u64 MIN_RTO = 200 * 1000;
+static constexpr u64 MAX_RTO = 60 * 1000 * 1000;
+static constexpr u64 CLOCK_GRANULARITY = 1000;
+static constexpr u64 DELAYED_ACK = 40 * 1000;
+static constexpr u64 TIME_WAIT = 2 * 1000 * 1000;
+static constexpr u32 MAX_RETRIES = 12;
+static constexpr u32 DUP_THRESHOLD = 3;
+static constexpr u32 TIMESTAMP_SIZE = 12;
+
+namespace option {
+	static constexpr u8 END = 0;
+	static constexpr u8 NOP = 1;
+	static constexpr u8 MSS = 2;
+	static constexpr u8 WINDOW_SCALE = 3;
+	static constexpr u8 SACK_PERMITTED = 4;
+	static constexpr u8 SACK = 5;
+	static constexpr u8 TIMESTAMP = 8;
+}
+
+static void write_be16(u8* ptr, u16 value) {
+	ptr[0] = value >> 8;
+	ptr[1] = value;
+}
+
+static void write_be32(u8* ptr, u32 value) {
+	ptr[0] = value >> 24;
+	ptr[1] = value >> 16;
+	ptr[2] = value >> 8;
+	ptr[3] = value;
+}
+
+static u16 read_be16(const u8* ptr) {
+	return ptr[0] << 8 | ptr[1];
+}
+
+static u32 read_be32(const u8* ptr) {
+	return u32 {ptr[0]} << 24 | u32 {ptr[1]} << 16 | u32 {ptr[2]} << 8 | ptr[3];
+}
+
+usize tcp_write_options(u8* ptr, const TcpOptions& options) {
+	usize size = 0;
+
+	if (options.mss) {
+		ptr[size++] = option::MSS;
+		ptr[size++] = 4;
+		write_be16(ptr + size, options.mss);
+		size += 2;
+	}
+
+	// laid out the same way as most stacks so every option stays naturally aligned
+	if (options.sack_permitted && options.has_timestamp) {
+		ptr[size++] = option::SACK_PERMITTED;
+		ptr[size++] = 2;
+	}
+	else if (options.sack_permitted) {
+		ptr[size++] = option::NOP;
+		ptr[size++] = option::NOP;
+		ptr[size++] = option::SACK_PERMITTED;
+		ptr[size++] = 2;
+	}
+	else if (options.has_timestamp) {
+		ptr[size++] = option::NOP;
+		ptr[size++] = option::NOP;
+	}
+
+	if (options.has_timestamp) {
+		ptr[size++] = option::TIMESTAMP;
+		ptr[size++] = 10;
+		write_be32(ptr + size, options.ts_val);
+		write_be32(ptr + size + 4, options.ts_ecr);
+		size += 8;
+	}
+
+	if (options.has_window_scale) {
+		ptr[size++] = option::NOP;
+		ptr[size++] = option::WINDOW_SCALE;
+		ptr[size++] = 3;
+		ptr[size++] = options.window_scale;
+	}
+
+	if (options.sack_count) {
+		ptr[size++] = option::NOP;
+		ptr[size++] = option::NOP;
+		ptr[size++] = option::SACK;
+		ptr[size++] = 2 + options.sack_count * 8;
+		for (u8 i = 0; i < options.sack_count; ++i) {
+			write_be32(ptr + size, options.sack[i].start);
+			write_be32(ptr + size + 4, options.sack[i].end);
+			size += 8;
+		}
+	}
+
+	return size;
+}
+
+bool tcp_parse_options(const u8* ptr, usize size, TcpOptions& options) {
+	options = {};
+
+	usize i = 0;
+	while (i < size) {
+		u8 kind = ptr[i];
+		if (kind == option::END) {
+			break;
+		}
+		else if (kind == option::NOP) {
+			++i;
+			continue;
+		}
+
+		if (i + 1 >= size) {
+			return false;
+		}
+		u8 len = ptr[i + 1];
+		if (len < 2 || i + len > size) {
+			return false;
+		}
+		auto* data = ptr + i + 2;
+
+		switch (kind) {
+			case option::MSS:
+				if (len == 4) {
+					options.mss = read_be16(data);
+				}
+				break;
+			case option::WINDOW_SCALE:
+				if (len == 3) {
+					options.has_window_scale = true;
+					options.window_scale = kstd::min(data[0], u8 {14});
+				}
+				break;
+			case option::SACK_PERMITTED:
+				options.sack_permitted = len == 2;
+				break;
+			case option::SACK:
+				for (usize j = 0; j + 8 <= len - 2u && options.sack_count < TcpOptions::MAX_SACK_BLOCKS; j += 8) {
+					options.sack[options.sack_count++] = {
+						.start = read_be32(data + j),
+						.end = read_be32(data + j + 4)
+					};
+				}
+				break;
+			case option::TIMESTAMP:
+				if (len == 10) {
+					options.has_timestamp = true;
+					options.ts_val = read_be32(data);
+					options.ts_ecr = read_be32(data + 4);
+				}
+				break;
+			default:
+				break;
+		}
+
+		i += len;
+	}
+
+	return true;
+}
+
+void SeqRanges::add(u32 start, u32 end) {
+	if (!seq_lt(start, end)) {
+		return;
+	}
+
+	ranges.push({start, end});
+	for (usize i = ranges.size() - 1; i > 0 && seq_lt(ranges[i].start, ranges[i - 1].start); --i) {
+		auto tmp = ranges[i];
+		ranges[i] = ranges[i - 1];
+		ranges[i - 1] = tmp;
+	}
+
+	usize out = 0;
+	for (usize i = 1; i < ranges.size(); ++i) {
+		auto& last = ranges[out];
+		if (seq_le(ranges[i].start, last.end)) {
+			if (seq_gt(ranges[i].end, last.end)) {
+				last.end = ranges[i].end;
+			}
+		}
+		else {
+			ranges[++out] = ranges[i];
+		}
+	}
+	ranges.resize(out + 1);
+}
+
+void SeqRanges::remove_below(u32 seq) {
+	usize out = 0;
+	for (usize i = 0; i < ranges.size(); ++i) {
+		auto range = ranges[i];
+		if (seq_le(range.end, seq)) {
+			continue;
+		}
+		if (seq_lt(range.start, seq)) {
+			range.start = seq;
+		}
+		ranges[out++] = range;
+	}
+	ranges.resize(out);
+}
+
+bool SeqRanges::contains(u32 seq) const {
+	for (auto& range : ranges) {
+		if (seq_le(range.start, seq) && seq_lt(seq, range.end)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+u32 SeqRanges::skip(u32 seq) const {
+	for (auto& range : ranges) {
+		if (seq_le(range.start, seq) && seq_lt(seq, range.end)) {
+			return range.end;
+		}
+	}
+	return seq;
+}
+
+u32 SeqRanges::covered(u32 start, u32 end) const {
+	u32 total = 0;
+	for (auto& range : ranges) {
+		u32 range_start = seq_gt(range.start, start) ? range.start : start;
+		u32 range_end = seq_lt(range.end, end) ? range.end : end;
+		if (seq_lt(range_start, range_end)) {
+			total += range_end - range_start;
+		}
+	}
+	return total;
+}
+
+TcpConnection::TcpConnection(const TcpConfig& config)
+	: config {config}, cc {congestion_control_create(config.congestion, config.path_mss)} {
+	send_buf.resize(config.send_buffer_size);
+	recv_buf.resize(config.receive_buffer_size);
+	while ((config.receive_buffer_size >> rcv_wscale) > 0xFFFF && rcv_wscale < 14) {
+		++rcv_wscale;
+	}
+}
+
+void TcpConnection::connect(u32 new_iss, u64) {
+	iss = new_iss;
+	snd_una = iss;
+	snd_nxt = iss;
+	snd_max = iss;
+	send_seq = iss + 1;
+	recover = iss;
+	state = State::SynSent;
+	syn_needed = true;
+}
+
+void TcpConnection::accept(const TcpSegment& syn, u32 new_iss, u64 now) {
+	connect(new_iss, now);
+	irs = syn.seq;
+	rcv_nxt = syn.seq + 1;
+	negotiate(syn.options);
+	// the window in a syn is never scaled
+	snd_wnd = syn.window;
+	snd_wl1 = syn.seq;
+	snd_wl2 = iss;
+	state = State::SynReceived;
+}
+
+void TcpConnection::negotiate(const TcpOptions& options) {
+	sack_ok = options.sack_permitted;
+	ts_ok = options.has_timestamp;
+	if (ts_ok) {
+		ts_recent = options.ts_val;
+	}
+
+	wscale_ok = options.has_window_scale;
+	if (wscale_ok) {
+		snd_wscale = options.window_scale;
+	}
+	else {
+		snd_wscale = 0;
+		rcv_wscale = 0;
+	}
+
+	// RFC 6691, the mss doesn't account for options so the timestamps take space from the payload
+	u32 peer_mss = options.mss ? options.mss : 536;
+	snd_mss = kstd::min(peer_mss, u32 {config.path_mss});
+	if (ts_ok) {
+		snd_mss -= TIMESTAMP_SIZE;
+	}
+	cc->set_mss(snd_mss);
+}
+
+void TcpConnection::close() {
+	switch (state) {
+		case State::Closed:
+		case State::SynSent:
+			set_closed();
+			break;
+		case State::SynReceived:
+		case State::Established:
+			fin_queued = true;
+			state = State::FinWait1;
+			break;
+		case State::CloseWait:
+			fin_queued = true;
+			state = State::LastAck;
+			break;
+		default:
+			break;
+	}
+}
+
+void TcpConnection::abort() {
+	if (state != State::Closed && state != State::SynSent) {
+		rst_needed = true;
+	}
+	set_closed();
+}
+
+void TcpConnection::set_closed() {
+	state = State::Closed;
+	rto_timer.cancel();
+	delack_timer.cancel();
+	persist_timer.cancel();
+	time_wait_timer.cancel();
+}
+
+usize TcpConnection::writable() const {
+	if (fin_queued || (state != State::Established && state != State::CloseWait &&
+		state != State::SynSent && state != State::SynReceived)) {
+		return 0;
+	}
+	return send_buf.size() - send_len;
+}
+
+bool TcpConnection::receive_closed() const {
+	return fin_received || state == State::Closed;
+}
+
+usize TcpConnection::write(const void* data, usize size) {
+	size = kstd::min(size, writable());
+
+	usize cap = send_buf.size();
+	usize pos = (send_start + send_len) % cap;
+	usize first = kstd::min(size, cap - pos);
+	memcpy(send_buf.data() + pos, data, first);
+	memcpy(send_buf.data(), static_cast<const u8*>(data) + first, size - first);
+	send_len += size;
+	return size;
+}
+
+usize TcpConnection::read(void* data, usize size) {
+	size = kstd::min(size, recv_len);
+
+	usize cap = recv_buf.size();
+	usize first = kstd::min(size, cap - recv_start);
+	memcpy(data, recv_buf.data() + recv_start, first);
+	memcpy(static_cast<u8*>(data) + first, recv_buf.data(), size - first);
+	recv_start = (recv_start + size) % cap;
+	recv_len -= size;
+
+	// reopen a window that was mostly closed without waiting for the next data segment
+	if (size && is_synchronized() && !fin_received &&
+		last_adv_wnd < cap / 2 && receive_window() >= cap / 2) {
+		ack_needed = true;
+	}
+	return size;
+}
+
+void TcpConnection::copy_payload(u32 seq, void* dest, u32 len) const {
+	usize cap = send_buf.size();
+	usize pos = (send_start + (seq - send_seq)) % cap;
+	usize first = kstd::min(usize {len}, cap - pos);
+	memcpy(dest, send_buf.data() + pos, first);
+	memcpy(static_cast<u8*>(dest) + first, send_buf.data(), len - first);
+}
+
+void TcpConnection::copy_payload(u32 seq, void* dest, u32 len, Checksum& sum) const {
+	usize cap = send_buf.size();
+	usize pos = (send_start + (seq - send_seq)) % cap;
+	usize first = kstd::min(usize {len}, cap - pos);
+	sum.add_copy(dest, send_buf.data() + pos, first);
+	sum.add_copy(static_cast<u8*>(dest) + first, send_buf.data(), len - first);
+}
+
+u32 TcpConnection::send_end() const {
+	return send_seq + send_len;
+}
+
+u32 TcpConnection::receive_window() const {
+	return recv_buf.size() - recv_len;
+}
+
+bool TcpConnection::fin_acked() const {
+	return fin_queued && seq_gt(snd_una, send_end());
+}
+
+u32 TcpConnection::in_flight() const {
+	// RFC 6675 pipe, sacked bytes and holes known to be lost but not yet retransmitted have left the network
+	u32 out = snd_nxt - snd_una;
+	if (sack_ok) {
+		out -= sacked.covered(snd_una, snd_nxt);
+		if (recovery && !sacked.ranges.is_empty()) {
+			u32 high = sacked.ranges[sacked.ranges.size() - 1].end;
+			if (seq_lt(rexmit_next, high)) {
+				out -= (high - rexmit_next) - sacked.covered(rexmit_next, high);
+			}
+		}
+	}
+	else {
+		// every duplicate ack is a segment that left the network
+		out -= kstd::min(dupacks * snd_mss, out);
+	}
+	return out;
+}
+
+void TcpConnection::update_rtt(u64 rtt) {
+	// RFC 6298
+	if (!has_rtt) {
+		srtt = rtt;
+		rttvar = rtt / 2;
+		has_rtt = true;
+	}
+	else {
+		u64 diff = srtt > rtt ? srtt - rtt : rtt - srtt;
+		rttvar = (3 * rttvar + diff) / 4;
+		srtt = (7 * srtt + rtt) / 8;
+	}
+	rto = kstd::min(kstd::max(srtt + kstd::max(CLOCK_GRANULARITY, 4 * rttvar), MIN_RTO), MAX_RTO);
+}
+
+void TcpConnection::arm_rto(u64 now) {
+	u64 timeout = rto << kstd::min(backoff, u32 {16});
+	rto_timer.arm(now + kstd::min(timeout, MAX_RTO));
+}
+
+void TcpConnection::enter_recovery(u64 now) {
+	cc->on_loss(in_flight(), now);
+	recovery = true;
+	recover = snd_max;
+	rexmit_next = snd_una;
+	rexmit_forced = true;
+	++stats.fast_retransmits;
+}
+
+void TcpConnection::on_segment(const TcpSegment& segment, const void* payload, u64 now) {
+	++stats.segments_received;
+
+	if (state == State::Closed) {
+		return;
+	}
+	else if (state == State::SynSent) {
+		bool has_ack = segment.flags & tcp_flags::ACK;
+		if (has_ack && (seq_le(segment.ack, iss) || seq_gt(segment.ack, snd_max))) {
+			return;
+		}
+		if (segment.flags & tcp_flags::RST) {
+			if (has_ack) {
+				reset = true;
+				set_closed();
+			}
+			return;
+		}
+		if (!(segment.flags & tcp_flags::SYN)) {
+			return;
+		}
+
+		irs = segment.seq;
+		rcv_nxt = segment.seq + 1;
+		last_ack_sent = rcv_nxt;
+		negotiate(segment.options);
+
+		if (has_ack) {
+			if (ts_ok && segment.options.ts_ecr) {
+				update_rtt((u32(now / 1000) - segment.options.ts_ecr) * u64 {1000});
+			}
+			else if (!backoff) {
+				update_rtt(now - rtt_start);
+			}
+			snd_una = segment.ack;
+			snd_wnd = segment.window;
+			snd_wl1 = segment.seq;
+			snd_wl2 = segment.ack;
+			backoff = 0;
+			retries = 0;
+			rto_timer.cancel();
+			state = State::Established;
+			ack_needed = true;
+		}
+		else {
+			// simultaneous open
+			state = State::SynReceived;
+			syn_needed = true;
+		}
+		return;
+	}
+
+	u32 seg_len = segment.len;
+	if (segment.flags & tcp_flags::SYN) {
+		++seg_len;
+	}
+	if (segment.flags & tcp_flags::FIN) {
+		++seg_len;
+	}
+
+	u32 wnd = receive_window();
+	bool acceptable;
+	if (!seg_len) {
+		acceptable = wnd ?
+			(seq_ge(segment.seq, rcv_nxt) && seq_lt(segment.seq, rcv_nxt + wnd)) :
+			segment.seq == rcv_nxt;
+	}
+	else {
+		u32 last = segment.seq + seg_len - 1;
+		acceptable = wnd && (
+			(seq_ge(segment.seq, rcv_nxt) && seq_lt(segment.seq, rcv_nxt + wnd)) ||
+			(seq_ge(last, rcv_nxt) && seq_lt(last, rcv_nxt + wnd)));
+	}
+
+	// PAWS, drop old duplicates from a previous wrap of the sequence space
+	if (ts_ok && segment.options.has_timestamp && seq_lt(segment.options.ts_val, ts_recent) &&
+		!(segment.flags & tcp_flags::RST)) {
+		acceptable = false;
+	}
+
+	if (!acceptable) {
+		if (!(segment.flags & tcp_flags::RST)) {
+			ack_needed = true;
+		}
+		return;
+	}
+
+	if (segment.flags & tcp_flags::RST) {
+		reset = true;
+		set_closed();
+		return;
+	}
+
+	if (segment.flags & tcp_flags::SYN) {
+		if (state == State::SynReceived && segment.seq == irs) {
+			syn_needed = true;
+		}
+		else {
+			ack_needed = true;
+		}
+		return;
+	}
+
+	if (!(segment.flags & tcp_flags::ACK)) {
+		return;
+	}
+
+	if (ts_ok && segment.options.has_timestamp && seq_le(segment.seq, last_ack_sent)) {
+		ts_recent = segment.options.ts_val;
+	}
+
+	if (state == State::SynReceived) {
+		if (!seq_gt(segment.ack, snd_una) || seq_gt(segment.ack, snd_max)) {
+			return;
+		}
+		state = fin_queued ? State::FinWait1 : State::Established;
+		snd_wl1 = segment.seq - 1;
+	}
+
+	if (!process_ack(segment, now) || state == State::Closed) {
+		return;
+	}
+
+	if (segment.len && (state == State::Established || state == State::FinWait1 || state == State::FinWait2)) {
+		process_data(segment, payload, now);
+	}
+
+	if ((segment.flags & tcp_flags::FIN) && !fin_received) {
+		rcv_fin_seq = segment.seq + segment.len;
+		rcv_fin_pending = true;
+	}
+	if (rcv_fin_pending && !fin_received && rcv_fin_seq == rcv_nxt) {
+		process_fin(now);
+	}
+}
+
+bool TcpConnection::process_ack(const TcpSegment& segment, u64 now) {
+	if (seq_gt(segment.ack, snd_max)) {
+		ack_needed = true;
+		return false;
+	}
+
+	if (sack_ok) {
+		for (u8 i = 0; i < segment.options.sack_count; ++i) {
+			auto block = segment.options.sack[i];
+			if (seq_gt(block.end, snd_una) && seq_le(block.end, snd_max)) {
+				sacked.add(seq_gt(block.start, snd_una) ? block.start : snd_una, block.end);
+			}
+		}
+	}
+
+	u32 old_wnd = snd_wnd;
+	if (seq_lt(snd_wl1, segment.seq) || (snd_wl1 == segment.seq && seq_le(snd_wl2, segment.ack))) {
+		snd_wnd = u32 {segment.window} << snd_wscale;
+		snd_wl1 = segment.seq;
+		snd_wl2 = segment.ack;
+		if (snd_wnd) {
+			persist_timer.cancel();
+			probe_needed = false;
+		}
+	}
+
+	if (!seq_gt(segment.ack, snd_una)) {
+		bool duplicate = segment.ack == snd_una && !segment.len &&
+			!(segment.flags & (tcp_flags::SYN | tcp_flags::FIN)) &&
+			snd_wnd == old_wnd && seq_lt(snd_una, snd_max);
+		if (!duplicate) {
+			return true;
+		}
+
+		++dupacks;
+		if (!recovery && seq_ge(snd_una, recover) &&
+			(dupacks >= DUP_THRESHOLD ||
+			(sack_ok && sacked.covered(snd_una, snd_max) > (DUP_THRESHOLD - 1) * snd_mss))) {
+			enter_recovery(now);
+		}
+		return true;
+	}
+
+	u32 acked = segment.ack - snd_una;
+
+	if (ts_ok && segment.options.has_timestamp && segment.options.ts_ecr) {
+		update_rtt((u32(now / 1000) - segment.options.ts_ecr) * u64 {1000});
+	}
+	else if (rtt_timing && seq_ge(segment.ack, rtt_seq)) {
+		update_rtt(now - rtt_start);
+		rtt_timing = false;
+	}
+	backoff = 0;
+	retries = 0;
+
+	if (seq_gt(segment.ack, send_seq)) {
+		u32 data_acked = kstd::min(segment.ack - send_seq, static_cast<u32>(send_len));
+		send_start = (send_start + data_acked) % send_buf.size();
+		send_len -= data_acked;
+		send_seq += data_acked;
+	}
+
+	snd_una = segment.ack;
+	if (seq_lt(snd_nxt, snd_una)) {
+		snd_nxt = snd_una;
+	}
+	sacked.remove_below(snd_una);
+
+	if (recovery) {
+		if (seq_ge(snd_una, recover)) {
+			recovery = false;
+			dupacks = 0;
+			cc->on_recovery_end();
+		}
+		else if (!sack_ok) {
+			// RFC 6582 partial ack, the next hole starts at the new snd_una
+			rexmit_forced = true;
+			dupacks = 0;
+		}
+	}
+	else {
+		dupacks = 0;
+		cc->on_ack(acked, now, srtt);
+	}
+
+	if (snd_una == snd_max) {
+		rto_timer.cancel();
+	}
+	else {
+		arm_rto(now);
+	}
+
+	if (fin_acked()) {
+		if (state == State::FinWait1) {
+			state = State::FinWait2;
+		}
+		else if (state == State::Closing) {
+			state = State::TimeWait;
+			time_wait_timer.arm(now + TIME_WAIT);
+		}
+		else if (state == State::LastAck) {
+			set_closed();
+		}
+	}
+	return true;
+}
+
+void TcpConnection::process_data(const TcpSegment& segment, const void* payload, u64 now) {
+	u32 seq = segment.seq;
+	u32 len = segment.len;
+	auto* data = static_cast<const u8*>(payload);
+
+	if (seq_lt(seq, rcv_nxt)) {
+		u32 skip = rcv_nxt - seq;
+		if (skip >= len) {
+			ack_needed = true;
+			return;
+		}
+		data += skip;
+		len -= skip;
+		seq = rcv_nxt;
+	}
+
+	u32 off = seq - rcv_nxt;
+	u32 wnd = receive_window();
+	if (off >= wnd) {
+		ack_needed = true;
+		return;
+	}
+	len = kstd::min(len, wnd - off);
+
+	usize cap = recv_buf.size();
+	usize pos = (recv_start + recv_len + off) % cap;
+	usize first = kstd::min(usize {len}, cap - pos);
+	memcpy(recv_buf.data() + pos, data, first);
+	memcpy(recv_buf.data(), data + first, len - first);
+
+	if (off) {
+		ooo.add(seq, seq + len);
+		last_ooo_seq = seq;
+		++stats.out_of_order;
+		// duplicate acks carrying sack blocks drive the sender's loss detection
+		ack_needed = true;
+		return;
+	}
+
+	bool filled_hole = !ooo.ranges.is_empty();
+	u32 end = seq + len;
+	for (u32 next = ooo.skip(end); next != end; next = ooo.skip(end)) {
+		end = next;
+	}
+	recv_len += end - rcv_nxt;
+	rcv_nxt = end;
+	ooo.remove_below(rcv_nxt);
+
+	// RFC 5681 ack every second full segment, immediately when a hole was filled
+	if (filled_hole || ++unacked_segments >= 2) {
+		ack_needed = true;
+	}
+	else if (!delack_timer.armed()) {
+		delack_timer.arm(now + DELAYED_ACK);
+	}
+}
+
+void TcpConnection::process_fin(u64 now) {
+	fin_received = true;
+	rcv_fin_pending = false;
+	++rcv_nxt;
+	ack_needed = true;
+
+	switch (state) {
+		case State::Established:
+			state = State::CloseWait;
+			break;
+		case State::FinWait1:
+			if (!fin_acked()) {
+				state = State::Closing;
+				break;
+			}
+			[[fallthrough]];
+		case State::FinWait2:
+			state = State::TimeWait;
+			time_wait_timer.arm(now + TIME_WAIT);
+			break;
+		default:
+			break;
+	}
+}
+
+void TcpConnection::on_timer(u64 now) {
+	if (delack_timer.expired(now)) {
+		delack_timer.cancel();
+		ack_needed = true;
+	}
+
+	if (persist_timer.expired(now)) {
+		persist_timer.cancel();
+		probe_needed = true;
+	}
+
+	if (time_wait_timer.expired(now)) {
+		set_closed();
+		return;
+	}
+
+	if (!rto_timer.expired(now)) {
+		return;
+	}
+	rto_timer.cancel();
+	++backoff;
+	++stats.timeouts;
+
+	// an unanswered window probe isn't a sign of congestion
+	bool probing = !snd_wnd && is_synchronized();
+	if (!probing && ++retries > MAX_RETRIES) {
+		reset = true;
+		set_closed();
+		return;
+	}
+
+	if (state == State::SynSent || state == State::SynReceived) {
+		syn_needed = true;
+		return;
+	}
+
+	if (!probing) {
+		cc->on_timeout(in_flight(), now);
+	}
+
+	// RFC 2018 the receiver may have discarded sacked data, so go back to snd_una and resend everything
+	recovery = false;
+	rexmit_forced = false;
+	recover = snd_max;
+	dupacks = 0;
+	sacked.ranges.clear();
+	snd_nxt = snd_una;
+	rtt_timing = false;
+}
+
+bool TcpConnection::on_path_mss(u32 seq, u32 mss, u64) {
+	// RFC 5927 only messages quoting data that is in flight are believed
+	if (seq_lt(seq, snd_una) || !seq_lt(seq, snd_max) || mss >= config.path_mss) {
+		return false;
+	}
+	config.path_mss = mss;
+
+	// before the handshake completes the new size is picked up by the negotiation
+	if (!is_synchronized()) {
+		return true;
+	}
+
+	u32 new_mss = ts_ok ? mss - TIMESTAMP_SIZE : mss;
+	if (new_mss >= snd_mss) {
+		return false;
+	}
+	snd_mss = new_mss;
+	cc->mss = new_mss;
+
+	// RFC 1191 every segment sent with the old size was dropped on the way, they are sent again
+	// straight away and the loss isn't treated as a sign of congestion
+	recovery = false;
+	rexmit_forced = false;
+	recover = snd_max;
+	dupacks = 0;
+	snd_nxt = snd_una;
+	rtt_timing = false;
+	return true;
+}
+
+u64 TcpConnection::next_deadline() const {
+	return kstd::min({
+		rto_timer.deadline,
+		delack_timer.deadline,
+		persist_timer.deadline,
+		time_wait_timer.deadline
+	});
+}
+
+void TcpConnection::fill_header(TcpSegment& segment, u8 flags, u64 now) {
+	segment.flags = flags;
+	segment.ack = flags & tcp_flags::ACK ? rcv_nxt : 0;
+	segment.options = {};
+
+	u32 wnd = receive_window();
+	if (flags & tcp_flags::SYN) {
+		segment.window = kstd::min(wnd, u32 {0xFFFF});
+		last_adv_wnd = segment.window;
+	}
+	else {
+		wnd = kstd::min(wnd, u32 {0xFFFF} << rcv_wscale);
+		segment.window = wnd >> rcv_wscale;
+		last_adv_wnd = u32 {segment.window} << rcv_wscale;
+	}
+
+	if (ts_ok || (flags & tcp_flags::SYN && state == State::SynSent)) {
+		segment.options.has_timestamp = true;
+		segment.options.ts_val = now / 1000;
+		segment.options.ts_ecr = ts_ok ? ts_recent : 0;
+	}
+
+	if (sack_ok && !ooo.ranges.is_empty()) {
+		// the block holding the most recently received segment goes first
+		usize max_blocks = ts_ok ? 3 : 4;
+		for (auto& range : ooo.ranges) {
+			if (seq_le(range.start, last_ooo_seq) && seq_lt(last_ooo_seq, range.end)) {
+				segment.options.sack[segment.options.sack_count++] = range;
+			}
+		}
+		for (usize i = ooo.ranges.size(); i > 0 && segment.options.sack_count < max_blocks; --i) {
+			auto& range = ooo.ranges[i - 1];
+			if (!(seq_le(range.start, last_ooo_seq) && seq_lt(last_ooo_seq, range.end))) {
+				segment.options.sack[segment.options.sack_count++] = range;
+			}
+		}
+	}
+
+	if (flags & tcp_flags::ACK) {
+		last_ack_sent = rcv_nxt;
+		ack_needed = false;
+		unacked_segments = 0;
+		delack_timer.cancel();
+	}
+	++stats.segments_sent;
+}
+
+bool TcpConnection::next_retransmit(TcpSegment& segment, u64 now) {
+	if (!rexmit_forced && !(recovery && sack_ok)) {
+		return false;
+	}
+
+	u32 start;
+	u32 end;
+	if (sack_ok) {
+		if (seq_lt(rexmit_next, snd_una)) {
+			rexmit_next = snd_una;
+		}
+		start = sacked.skip(rexmit_next);
+		if (sacked.ranges.is_empty()) {
+			end = rexmit_forced ? start + snd_mss : start;
+		}
+		else {
+			end = sacked.ranges.back()->end;
+			for (auto& range : sacked.ranges) {
+				if (seq_gt(range.start, start)) {
+					end = range.start;
+					break;
+				}
+			}
+		}
+	}
+	else {
+		start = snd_una;
+		end = snd_una + snd_mss;
+	}
+
+	if (seq_gt(end, snd_max)) {
+		end = snd_max;
+	}
+	if (!seq_lt(start, end)) {
+		rexmit_forced = false;
+		return false;
+	}
+
+	u32 len = kstd::min(end - start, snd_mss);
+	if (!rexmit_forced && in_flight() + len > cc->cwnd) {
+		return false;
+	}
+
+	u32 data_end = send_end();
+	u32 data_len = seq_lt(start, data_end) ? kstd::min(len, data_end - start) : 0;
+	u8 flags = tcp_flags::ACK;
+	if (fin_queued && start + data_len == data_end && seq_gt(end, data_end)) {
+		flags |= tcp_flags::FIN;
+	}
+	if (!data_len && !(flags & tcp_flags::FIN)) {
+		rexmit_forced = false;
+		return false;
+	}
+
+	segment.seq = start;
+	segment.len = data_len;
+	fill_header(segment, flags, now);
+
+	rexmit_next = start + data_len + (flags & tcp_flags::FIN ? 1 : 0);
+	rexmit_forced = false;
+	rtt_timing = false;
+	++stats.retransmits;
+	if (!rto_timer.armed()) {
+		arm_rto(now);
+	}
+	return true;
+}
+
+bool TcpConnection::next_segment(TcpSegment& segment, u64 now) {
+	segment = {};
+
+	if (rst_needed) {
+		rst_needed = false;
+		segment.seq = snd_nxt;
+		segment.ack = rcv_nxt;
+		segment.flags = tcp_flags::RST | tcp_flags::ACK;
+		++stats.segments_sent;
+		return true;
+	}
+
+	if (state == State::Closed) {
+		return false;
+	}
+
+	if (syn_needed) {
+		syn_needed = false;
+		segment.seq = iss;
+
+		u8 flags = tcp_flags::SYN;
+		if (state == State::SynReceived) {
+			flags |= tcp_flags::ACK;
+		}
+		fill_header(segment, flags, now);
+
+		// a syn-ack only carries the options the peer offered
+		bool active = state == State::SynSent;
+		segment.options.mss = config.mss;
+		segment.options.sack_permitted = active || sack_ok;
+		if (active || wscale_ok) {
+			segment.options.has_window_scale = true;
+			segment.options.window_scale = rcv_wscale;
+		}
+
+		snd_nxt = iss + 1;
+		if (seq_lt(snd_max, snd_nxt)) {
+			snd_max = snd_nxt;
+		}
+		if (!backoff) {
+			rtt_start = now;
+		}
+		else {
+			++stats.retransmits;
+		}
+		arm_rto(now);
+		return true;
+	}
+
+	if (state == State::SynSent || state == State::SynReceived) {
+		return false;
+	}
+
+	if (next_retransmit(segment, now)) {
+		return true;
+	}
+
+	u32 data_end = send_end();
+	u32 pipe = in_flight();
+	u32 cwnd_room = cc->cwnd > pipe ? cc->cwnd - pipe : 0;
+	u32 wnd_end = snd_una + snd_wnd;
+	u32 wnd_room = seq_gt(wnd_end, snd_nxt) ? wnd_end - snd_nxt : 0;
+
+	if (seq_lt(snd_nxt, data_end)) {
+		u32 avail = data_end - snd_nxt;
+		u32 len = kstd::min({avail, wnd_room, cwnd_room, config.max_burst});
+
+		// sender side silly window avoidance and Nagle, a short segment is only sent when it
+		// drains the buffer and nothing else is in flight
+		if (len < snd_mss && !(len == avail && (snd_una == snd_nxt || fin_queued))) {
+			len = 0;
+		}
+
+		bool probe = false;
+		if (!len && probe_needed && snd_una == snd_nxt) {
+			len = kstd::max(kstd::min({avail, wnd_room, snd_mss}), u32 {1});
+			probe = true;
+		}
+		probe_needed = false;
+
+		if (len > snd_mss) {
+			len -= len % snd_mss;
+		}
+
+		if (len) {
+			u8 flags = tcp_flags::ACK;
+			if (len == avail) {
+				flags |= tcp_flags::PSH;
+				if (fin_queued) {
+					flags |= tcp_flags::FIN;
+				}
+			}
+
+			segment.seq = snd_nxt;
+			segment.len = len;
+			fill_header(segment, flags, now);
+
+			if (seq_lt(snd_nxt, snd_max)) {
+				++stats.retransmits;
+			}
+			else if (!rtt_timing && !ts_ok) {
+				rtt_timing = true;
+				rtt_seq = snd_nxt + len;
+				rtt_start = now;
+			}
+
+			snd_nxt += len + (flags & tcp_flags::FIN ? 1 : 0);
+			if (seq_gt(snd_nxt, snd_max)) {
+				snd_max = snd_nxt;
+			}
+			if (!rto_timer.armed()) {
+				arm_rto(now);
+			}
+			persist_timer.cancel();
+			return true;
+		}
+
+		if (!probe && snd_una == snd_nxt && !persist_timer.armed()) {
+			persist_timer.arm(now + kstd::min(rto << kstd::min(backoff, u32 {16}), MAX_RTO));
+		}
+	}
+	else if (fin_queued && snd_nxt == data_end) {
+		segment.seq = snd_nxt;
+		fill_header(segment, tcp_flags::FIN | tcp_flags::ACK, now);
+		if (seq_lt(snd_nxt, snd_max)) {
+			++stats.retransmits;
+		}
+		++snd_nxt;
+		if (seq_gt(snd_nxt, snd_max)) {
+			snd_max = snd_nxt;
+		}
+		if (!rto_timer.armed()) {
+			arm_rto(now);
+		}
+		return true;
+	}
+
+	if (ack_needed) {
+		segment.seq = snd_nxt;
+		fill_header(segment, tcp_flags::ACK, now);
+		return true;
+	}
+
+	return false;
+}
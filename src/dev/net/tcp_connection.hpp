@@ -0,0 +1,296 @@
+#pragma once
+#include "checksum.hpp"
+#include "tcp_congestion.hpp"
+#include "types.hpp"
+#include "unique_ptr.hpp"
+#include "vector.hpp"
+
+constexpr bool seq_lt(u32 a, u32 b) {
+	return static_cast<i32>(a - b) < 0;
+}
+
+constexpr bool seq_le(u32 a, u32 b) {
+	return static_cast<i32>(a - b) <= 0;
+}
+
+constexpr bool seq_gt(u32 a, u32 b) {
+	return static_cast<i32>(a - b) > 0;
+}
+
+constexpr bool seq_ge(u32 a, u32 b) {
+	return static_cast<i32>(a - b) >= 0;
+}
+
+namespace tcp_flags {
+	static constexpr u8 FIN = 1 << 0;
+	static constexpr u8 SYN = 1 << 1;
+	static constexpr u8 RST = 1 << 2;
+	static constexpr u8 PSH = 1 << 3;
+	static constexpr u8 ACK = 1 << 4;
+}
+
+struct TcpSackBlock {
+	u32 start;
+	u32 end;
+};
+
+/// Options carried in a segment, the timestamp and sack options are only valid if their flags are set.
+struct TcpOptions {
+	static constexpr usize MAX_SIZE = 40;
+	static constexpr usize MAX_SACK_BLOCKS = 4;
+
+	u16 mss;
+	u8 window_scale;
+	bool has_window_scale;
+	bool sack_permitted;
+	bool has_timestamp;
+	u32 ts_val;
+	u32 ts_ecr;
+	u8 sack_count;
+	TcpSackBlock sack[MAX_SACK_BLOCKS];
+};
+
+/// Encodes the options padded to a multiple of four, returns the size written.
+usize tcp_write_options(u8* ptr, const TcpOptions& options);
+/// Returns false if the option list is malformed.
+bool tcp_parse_options(const u8* ptr, usize size, TcpOptions& options);
+
+/// Header fields of a segment in host order, `window` is the raw unscaled header value.
+struct TcpSegment {
+	u32 seq;
+	u32 ack;
+	u8 flags;
+	u16 window;
+	u32 len;
+	TcpOptions options;
+};
+
+/// Sorted, disjoint sequence ranges used for the sack scoreboard and the out of order queue.
+struct SeqRanges {
+	void add(u32 start, u32 end);
+	void remove_below(u32 seq);
+	[[nodiscard]] bool contains(u32 seq) const;
+	/// Returns the end of the range containing `seq` or `seq` if it isn't covered.
+	[[nodiscard]] u32 skip(u32 seq) const;
+	/// Number of covered bytes in [start, end).
+	[[nodiscard]] u32 covered(u32 start, u32 end) const;
+
+	kstd::vector<TcpSackBlock> ranges;
+};
+
+struct TcpConfig {
+	u32 send_buffer_size;
+	u32 receive_buffer_size;
+	/// Largest segment the local link can carry, advertised in the mss option.
+	u16 mss;
+	/// Largest segment the path to the peer is known to carry, at most `mss`.
+	u16 path_mss;
+	/// Largest payload handed to the nic at once, larger than mss if it can segment on its own.
+	u32 max_burst;
+	CongestionAlgorithm congestion;
+};
+
+struct TcpStats {
+	u64 segments_sent;
+	u64 segments_received;
+	u64 retransmits;
+	u64 fast_retransmits;
+	u64 timeouts;
+	u64 out_of_order;
+};
+
+/// Protocol state of a single tcp connection, independent of how segments reach the wire.
+/// The owner feeds received segments and timer expiries in and pulls segments to transmit
+/// with `next_segment`, all times are in microseconds.
+class TcpConnection {
+public:
+	enum class State {
+		Closed,
+		SynSent,
+		SynReceived,
+		Established,
+		FinWait1,
+		FinWait2,
+		CloseWait,
+		Closing,
+		LastAck,
+		TimeWait
+	};
+
+	explicit TcpConnection(const TcpConfig& config);
+
+	/// Starts an active open, the syn is returned by the next `next_segment` call.
+	void connect(u32 iss, u64 now);
+	/// Starts a passive open from a received syn.
+	void accept(const TcpSegment& syn, u32 iss, u64 now);
+	/// Sends a fin once all queued data has been sent.
+	void close();
+	/// Resets the connection.
+	void abort();
+
+	/// Queues data for sending, returns the amount that fit into the send buffer.
+	usize write(const void* data, usize size);
+	/// Reads in order received data, returns the amount read.
+	usize read(void* data, usize size);
+
+	void on_segment(const TcpSegment& segment, const void* payload, u64 now);
+	void on_timer(u64 now);
+	/// Lowers the segment size to `mss` after a segment starting at `seq` was too large for the path.
+	/// Returns false if `seq` isn't in flight or the size wasn't lowered.
+	bool on_path_mss(u32 seq, u32 mss, u64 now);
+
+	/// Fills `segment` with the next segment to transmit, returns false if there is nothing to send.
+	bool next_segment(TcpSegment& segment, u64 now);
+	/// Copies the payload of a segment returned by `next_segment`.
+	void copy_payload(u32 seq, void* dest, u32 len) const;
+	/// Copies the payload while adding it to `sum`.
+	void copy_payload(u32 seq, void* dest, u32 len, Checksum& sum) const;
+
+	/// Earliest time `on_timer` needs to be called or UINT64_MAX.
+	[[nodiscard]] u64 next_deadline() const;
+
+	[[nodiscard]] State get_state() const {
+		return state;
+	}
+
+	[[nodiscard]] bool was_reset() const {
+		return reset;
+	}
+
+	[[nodiscard]] bool is_synchronized() const {
+		return state != State::Closed && state != State::SynSent && state != State::SynReceived;
+	}
+
+	/// True if no more data can arrive, either a fin was received or the connection is gone.
+	[[nodiscard]] bool receive_closed() const;
+
+	[[nodiscard]] usize readable() const {
+		return recv_len;
+	}
+
+	[[nodiscard]] usize writable() const;
+
+	[[nodiscard]] u32 get_cwnd() const {
+		return cc->cwnd;
+	}
+
+	[[nodiscard]] u32 get_mss() const {
+		return snd_mss;
+	}
+
+	[[nodiscard]] u64 get_srtt() const {
+		return srtt;
+	}
+
+	TcpStats stats {};
+
+private:
+	struct Timer {
+		u64 deadline {UINT64_MAX};
+
+		[[nodiscard]] bool armed() const {
+			return deadline != UINT64_MAX;
+		}
+
+		void arm(u64 at) {
+			deadline = at;
+		}
+
+		void cancel() {
+			deadline = UINT64_MAX;
+		}
+
+		[[nodiscard]] bool expired(u64 now) const {
+			return now >= deadline;
+		}
+	};
+
+	void negotiate(const TcpOptions& options);
+	/// Returns false if the segment acked data that was never sent and has to be dropped.
+	bool process_ack(const TcpSegment& segment, u64 now);
+	void process_data(const TcpSegment& segment, const void* payload, u64 now);
+	void process_fin(u64 now);
+	void enter_recovery(u64 now);
+	void update_rtt(u64 rtt);
+	void arm_rto(u64 now);
+	void set_closed();
+
+	[[nodiscard]] u32 in_flight() const;
+	[[nodiscard]] u32 send_end() const;
+	[[nodiscard]] u32 receive_window() const;
+	[[nodiscard]] bool fin_acked() const;
+	void fill_header(TcpSegment& segment, u8 flags, u64 now);
+	bool next_retransmit(TcpSegment& segment, u64 now);
+
+	TcpConfig config;
+	kstd::unique_ptr<CongestionControl> cc;
+	State state {State::Closed};
+
+	// send side, the buffer holds every byte from snd_una (or the byte after the syn) onwards
+	kstd::vector<u8> send_buf;
+	usize send_start {};
+	usize send_len {};
+	u32 send_seq {};
+	u32 iss {};
+	u32 snd_una {};
+	u32 snd_nxt {};
+	u32 snd_max {};
+	u32 snd_wnd {};
+	u32 snd_wl1 {};
+	u32 snd_wl2 {};
+	u32 snd_mss {536};
+	u8 snd_wscale {};
+	bool fin_queued {};
+	bool syn_needed {};
+	bool rst_needed {};
+	bool probe_needed {};
+
+	// loss recovery
+	SeqRanges sacked;
+	u32 recover {};
+	u32 rexmit_next {};
+	u32 dupacks {};
+	bool recovery {};
+	bool rexmit_forced {};
+
+	// rtt estimation, Karn's algorithm is used when timestamps aren't available
+	u64 srtt {};
+	u64 rttvar {};
+	u64 rto {1000 * 1000};
+	u32 backoff {};
+	u32 retries {};
+	u32 rtt_seq {};
+	u64 rtt_start {};
+	bool rtt_timing {};
+	bool has_rtt {};
+
+	// receive side, out of order data is stored in place after the in order bytes
+	kstd::vector<u8> recv_buf;
+	usize recv_start {};
+	usize recv_len {};
+	SeqRanges ooo;
+	u32 last_ooo_seq {};
+	u32 irs {};
+	u32 rcv_nxt {};
+	u32 rcv_fin_seq {};
+	u32 last_adv_wnd {};
+	u8 rcv_wscale {};
+	bool fin_received {};
+	bool rcv_fin_pending {};
+	u32 unacked_segments {};
+	bool ack_needed {};
+
+	// negotiated options
+	bool sack_ok {};
+	bool ts_ok {};
+	bool wscale_ok {};
+	u32 ts_recent {};
+	u32 last_ack_sent {};
+
+	bool reset {};
+
+	Timer rto_timer;
+	Timer delack_timer;
+	Timer persist_timer;
+	Timer time_wait_timer;
+};
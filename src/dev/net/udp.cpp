@@ -1,11 +1,14 @@
 #include "udp.hpp"
-#include "arp.hpp"
 #include "cstring.hpp"
 #include "dev/event.hpp"
+#include "ipv4.hpp"
 #include "nic/nic.hpp"
 #include "packet.hpp"
+#include "route.hpp"
+#include "socket_table.hpp"
 #include "stdio.hpp"
 #include "sys/socket.hpp"
+#include "utils/trace.hpp"
 
 struct Udp4BufferPacket {
 	DoubleListHook hook {};
@@ -51,32 +54,33 @@ struct Udp4Socket : public Socket {
 	}
 
 	int send_to(const void* data, usize& size, const AnySocketAddress& dest) override {
-		if (dest.generic.type != SOCKET_ADDRESS_TYPE_IPV4) {
+		if (dest.generic.type != SOCKET_ADDRESS_TYPE_IPV4 ||
+			size > 0xFFFF - sizeof(Ipv4Header) - sizeof(UdpHeader)) {
 			return ERR_INVALID_ARGUMENT;
 		}
 
-		auto mac = arp_get_mac(dest.ipv4.ipv4);
-		if (!mac) {
+		RouteResult route;
+		u32 flow_hash = socket_hash(0, own_port, dest.ipv4.ipv4, dest.ipv4.port);
+		if (!route_lookup(dest.ipv4.ipv4, flow_hash, bound_nic.data(), route)) {
 			return ERR_NO_ROUTE_TO_HOST;
 		}
-
-		kstd::shared_ptr<Nic> nic;
-
-		{
-			// todo allow other nics
-			IrqGuard irq_guard {};
-			nic = *NICS->lock()->front();
-		}
+		auto& nic = route.nic;
 
 		Packet packet {static_cast<u32>(sizeof(EthernetHeader) + sizeof(Ipv4Header) + sizeof(UdpHeader) + size)};
 
-		packet.add_ethernet(nic->mac, mac.value(), EtherType::Ipv4);
-		packet.add_ipv4(IpProtocol::Udp, sizeof(UdpHeader) + size, nic->ip, dest.ipv4.ipv4);
+		packet.add_ethernet(nic->mac, {}, EtherType::Ipv4);
+		packet.add_ipv4(IpProtocol::Udp, sizeof(UdpHeader) + size, route.src, dest.ipv4.ipv4, false);
 		packet.add_udp(own_port, dest.ipv4.port, size);
 		auto* ptr = packet.add_header(size);
 		memcpy(ptr, data, size);
 
-		nic->send(packet.data, packet.size);
+		trace(TRACE_EVENT_UDP_TX, u32 {own_port} << 16 | dest.ipv4.port, size);
+
+		// fragmented if it doesn't fit the path, queued until the destination is resolved
+		// and dropped if that already failed
+		if (!ipv4_output(*nic, route.next_hop, route.mtu, packet)) {
+			return ERR_NO_ROUTE_TO_HOST;
+		}
 
 		return 0;
 	}
@@ -128,69 +132,77 @@ struct Udp4Socket : public Socket {
 		return ERR_UNSUPPORTED;
 	}
 
+	int bind_interface(u32 index) override {
+		if (index == UINT32_MAX) {
+			bound_nic = nullptr;
+			return 0;
+		}
+
+		auto new_nic = nics_get(index);
+		if (!new_nic) {
+			return ERR_INVALID_ARGUMENT;
+		}
+		bound_nic = std::move(new_nic);
+		return 0;
+	}
+
 	u16 own_port {};
+	kstd::shared_ptr<Nic> bound_nic {};
+	DoubleListHook table_hook {};
+	bool in_table {};
 	Spinlock<DoubleList<Udp4BufferPacket, &Udp4BufferPacket::hook>> packet_list;
 	Spinlock<usize> packet_count;
 	Event event {};
 };
 
 namespace {
-	ManuallyDestroy<Spinlock<kstd::vector<Udp4Socket*>>> SOCKETS;
+	/// Bound sockets keyed by the local port.
+	ManuallyDestroy<SocketTable<Udp4Socket, &Udp4Socket::table_hook, 256>> SOCKETS;
 }
 
 static void remove_socket(Udp4Socket* socket) {
-	IrqGuard irq_guard {};
-	auto guard = SOCKETS->lock();
-
-	for (usize i = 0; i < guard->size(); ++i) {
-		if ((*guard)[i] == socket) {
-			guard->remove(i);
-			break;
-		}
+	if (socket->in_table) {
+		SOCKETS->remove(socket_port_hash(socket->own_port), socket);
 	}
 }
 
 kstd::shared_ptr<Socket> udp_socket_create(int flags) {
-	IrqGuard irq_guard {};
-	auto guard = SOCKETS->lock();
-	u16 port = UINT16_MAX;
-	while (true) {
-		bool found = true;
-		for (auto sock : *guard) {
-			if (sock->own_port == port) {
-				found = false;
-				break;
-			}
-		}
-
-		if (found) {
-			break;
-		}
-
-		if (!port) {
-			return nullptr;
+	auto socket = kstd::make_shared<Udp4Socket>(flags, u16 {0});
+
+	// ports are handed out downwards starting from the highest one
+	for (u32 port = UINT16_MAX; port > 0; --port) {
+		socket->own_port = port;
+		bool inserted = SOCKETS->insert_unique(socket_port_hash(port), socket.data(), [&](Udp4Socket& other) {
+			return other.own_port == port;
+		});
+		if (inserted) {
+			socket->in_table = true;
+			return socket;
 		}
-		--port;
 	}
 
-	auto socket = kstd::make_shared<Udp4Socket>(flags, port);
-
-	guard->push(socket.data());
-	return socket;
+	return nullptr;
 }
 
 void udp_process_packet(Nic& nic, ReceivedPacket& packet) {
 	UdpHeader hdr {};
 	memcpy(&hdr, packet.layer2.raw, sizeof(UdpHeader));
 	hdr.deserialize();
-
-	IrqGuard irq_guard {};
-	auto guard = SOCKETS->lock();
-	for (auto& socket : *guard) {
-		if (socket->own_port == hdr.dest_port) {
-			auto packet_list_guard = socket->packet_list.lock();
-
-			auto packet_count_guard = socket->packet_count.lock();
+	if (hdr.length < sizeof(UdpHeader) || hdr.length > packet.layer2_len) {
+		return;
+	}
+	trace(TRACE_EVENT_UDP_RX, u32 {hdr.dest_port} << 16 | hdr.src_port, hdr.length - sizeof(UdpHeader));
+
+	SOCKETS->find(
+		socket_port_hash(hdr.dest_port),
+		[&](Udp4Socket& socket) {
+			return socket.own_port == hdr.dest_port &&
+				(!socket.bound_nic || socket.bound_nic.data() == &nic);
+		},
+		[&](Udp4Socket& socket) {
+			auto packet_list_guard = socket.packet_list.lock();
+
+			auto packet_count_guard = socket.packet_count.lock();
 			if (packet_count_guard >= 64) {
 				return;
 			}
@@ -207,8 +219,6 @@ void udp_process_packet(Nic& nic, ReceivedPacket& packet) {
 				hdr.length - sizeof(UdpHeader));
 
 			packet_list_guard->push(udp_buffer_packet);
-			socket->event.signal_one();
-			break;
-		}
-	}
+			socket.event.signal_one();
+		});
 }
@@ -312,6 +312,7 @@ namespace pci {
 			auto mapping = map_bar(bar);
 			assert(mapping);
 			auto* entries = offset(mapping, MsiXEntry*, table_off_bir & ~0b111);
+			msix_table = entries;
 
 			u16 msg_control = read16(msix_cap_offset + 2);
 			// enable
@@ -415,6 +416,7 @@ namespace pci {
 
 		irqs.clear();
 		irqs.shrink_to_fit();
+		msix_table = nullptr;
 	}
 
 	u32 Device::get_irq(u32 index) const {
@@ -426,6 +428,22 @@ namespace pci {
 		}
 	}
 
+	bool Device::set_irq_affinity(u32 index, const Cpu* cpu) {
+		if (!msix_table || index >= irqs.size()) {
+			return false;
+		}
+
+		auto& entry = static_cast<volatile MsiXEntry*>(msix_table)[index];
+		usize msg_addr = 0xFEE00000 | cpu->lapic_id << 12;
+
+		// the entry has to be masked while its address is being changed
+		entry.vector_ctrl |= 1;
+		entry.msg_addr_low = msg_addr;
+		entry.msg_addr_high = msg_addr >> 32;
+		entry.vector_ctrl &= ~1;
+		return true;
+	}
+
 	void Device::enable_irqs(bool enable) {
 		if (msix_cap_offset && _flags & IrqFlags::Msix) {
 			u16 msg_control = read16(msix_cap_offset + 2);
@@ -3,6 +3,8 @@
 #include "types.hpp"
 #include "vector.hpp"
 
+struct Cpu;
+
 namespace pci {
 	void acpi_init();
 	void acpi_enumerate();
@@ -258,6 +260,9 @@ namespace pci {
 		void free_irqs();
 		[[nodiscard]] u32 get_irq(u32 index) const;
 
+		/// Routes msi-x vector `index` to `cpu`, returns false if the device doesn't use msi-x.
+		bool set_irq_affinity(u32 index, const Cpu* cpu);
+
 		void enable_irqs(bool enable);
 
 		inline void enable_legacy_irq(bool enable) {
@@ -319,6 +324,7 @@ namespace pci {
 		u32 msix_cap_offset;
 		u32 power_cap_offset;
 		kstd::vector<u32> irqs;
+		void* msix_table {};
 		IrqFlags _flags {};
 		bool legacy_no_free {};
 	};
@@ -5,6 +5,8 @@
 #include "mem/vspace.hpp"
 #include "sched/process.hpp"
 #include "utils/driver.hpp"
+#include "utils/irq_guard.hpp"
+#include "utils/spinlock.hpp"
 #include "dev/sound/sound_dev.hpp"
 
 namespace regs {
@@ -596,44 +598,83 @@ namespace widget_type {
 	};
 }
 
-static constexpr usize CHUNK_SIZE = 0x1000;
 static constexpr usize MAX_DESCRIPTORS = PAGE_SIZE / sizeof(BufferDescriptor);
+/// Every descriptor covers at most a page, so this is also the largest ring.
+static constexpr usize MAX_RING_SIZE = MAX_DESCRIPTORS * PAGE_SIZE;
+/// Buffers have to be 128 byte aligned.
+static constexpr usize MIN_PERIOD_SIZE = 128;
+static constexpr usize DEFAULT_PERIOD_SIZE = PAGE_SIZE;
 
 struct HdaStream {
 	IoSpace space;
-	kstd::atomic<usize> remaining_data;
-	usize write_ptr {};
 	Event event {};
 	BufferDescriptor* bdl;
+	/// Pages of the largest possible ring in order, a smaller ring uses the first ones.
+	usize pages[MAX_DESCRIPTORS] {};
+	/// Shared with clients that mapped the ring, only `write_pos` is written by them.
+	SoundRingPosition* position {};
+	/// Private copies of the layout in `position`, which clients could overwrite.
+	usize ring_bytes {};
+	usize period_bytes {};
+	usize position_phys {};
+	/// Protects the read position, which is advanced both from the irq and from position queries.
+	Spinlock<void> position_lock {};
+	u32 last_lpib {};
 
 	void initialize_output() {
 		auto bdl_phys = pmalloc(1);
 		assert(bdl_phys);
 		bdl = to_virt<BufferDescriptor>(bdl_phys);
 
-		space.store(regs::stream::BDPL, bdl_phys);
-		space.store(regs::stream::BDPU, bdl_phys >> 32);
-
-		for (usize i = 0; i < MAX_DESCRIPTORS; ++i) {
-			usize page = pmalloc(1);
+		for (auto& page : pages) {
+			page = pmalloc(1);
 			assert(page);
-			bdl[i].address = page;
-			bdl[i].length = PAGE_SIZE;
-			if (i && (i * PAGE_SIZE) % CHUNK_SIZE == 0) {
-				bdl[i].ioc = 1;
-			}
-			else {
-				bdl[i].ioc = 0;
-			}
+			memset(to_virt<void>(page), 0, PAGE_SIZE);
 		}
 
-		space.store(regs::stream::CBL, MAX_DESCRIPTORS * PAGE_SIZE);
+		position_phys = pmalloc(1);
+		assert(position_phys);
+		position = to_virt<SoundRingPosition>(position_phys);
+		memset(position, 0, PAGE_SIZE);
+
+		configure(DEFAULT_PERIOD_SIZE);
+	}
+
+	/// Resets the stream and lays the ring out for `period_size`, which has to be a power of two
+	/// of at least `MIN_PERIOD_SIZE`. The stream must not be running.
+	void configure(usize period_size) {
+		// the format survives the reset, everything else is programmed again
+		auto fmt = space.load(regs::stream::FMT);
+
+		space.store(regs::stream::CTL0, space.load(regs::stream::CTL0) | sdctl0::RST(true));
+		while (!(space.load(regs::stream::CTL0) & sdctl0::RST));
+		space.store(regs::stream::CTL0, space.load(regs::stream::CTL0) & ~sdctl0::RST);
+		while (space.load(regs::stream::CTL0) & sdctl0::RST);
+
+		// periods smaller than a page need several descriptors per page, which limits the ring size
+		usize ring_size = kstd::min(MAX_RING_SIZE, MAX_DESCRIPTORS * period_size);
+		usize descriptor_size = kstd::min(period_size, PAGE_SIZE);
+		usize descriptor_count = ring_size / descriptor_size;
+		for (usize i = 0; i < descriptor_count; ++i) {
+			usize offset = i * descriptor_size;
+			bdl[i].address = pages[offset / PAGE_SIZE] + offset % PAGE_SIZE;
+			bdl[i].length = descriptor_size;
+			// completion is signaled at the end of every period
+			bdl[i].ioc = (offset + descriptor_size) % period_size == 0;
+		}
+
+		auto bdl_phys = to_phys(bdl);
+		space.store(regs::stream::BDPL, bdl_phys);
+		space.store(regs::stream::BDPU, bdl_phys >> 32);
+		space.store(regs::stream::CBL, ring_size);
 
 		auto lvi = space.load(regs::stream::LVI);
 		lvi &= ~sdlvi::LVI;
-		lvi |= sdlvi::LVI(MAX_DESCRIPTORS - 1);
+		lvi |= sdlvi::LVI(descriptor_count - 1);
 		space.store(regs::stream::LVI, lvi);
 
+		space.store(regs::stream::FMT, fmt);
+
 		auto ctl2 = space.load(regs::stream::CTL2);
 		ctl2 &= ~sdctl2::STRM;
 		ctl2 |= sdctl2::STRM(1);
@@ -642,27 +683,70 @@ struct HdaStream {
 		auto ctl0 = space.load(regs::stream::CTL0);
 		ctl0 |= sdctl0::IOCE(true);
 		space.store(regs::stream::CTL0, ctl0);
+
+		IrqGuard irq_guard {};
+		auto guard = position_lock.lock();
+		last_lpib = 0;
+		ring_bytes = ring_size;
+		period_bytes = period_size;
+		__atomic_store_n(&position->read_pos, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&position->write_pos, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&position->underruns, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&position->period_size, period_size, __ATOMIC_RELAXED);
+		__atomic_store_n(&position->ring_size, ring_size, __ATOMIC_RELEASE);
 	}
 
-	void handle_output_irq() {
-		usize old = remaining_data.load(kstd::memory_order::relaxed);;
-		while (true) {
-			u32 value;
-			if (old < CHUNK_SIZE) {
-				value = 0;
-			}
-			else {
-				value = old - CHUNK_SIZE;
-			}
-			if (remaining_data.compare_exchange_weak(
-					old,
-					value,
-					kstd::memory_order::relaxed,
-					kstd::memory_order::relaxed)) {
-				break;
-			}
+	[[nodiscard]] usize ring_size() const {
+		return ring_bytes;
+	}
+
+	[[nodiscard]] usize period_size() const {
+		return period_bytes;
+	}
+
+	/// Returns the write position clamped to at most a ring ahead of `read`,
+	/// it's the only field of `position` taken from a client.
+	[[nodiscard]] u64 write_pos(u64 read) const {
+		auto write = __atomic_load_n(&position->write_pos, __ATOMIC_ACQUIRE);
+		if (write < read) {
+			return read;
+		}
+		return read + kstd::min(write - read, u64 {ring_bytes});
+	}
+
+	/// Returns the amount of queued data that hasn't been consumed yet.
+	[[nodiscard]] usize remaining() const {
+		auto read = __atomic_load_n(&position->read_pos, __ATOMIC_ACQUIRE);
+		return write_pos(read) - read;
+	}
+
+	/// Advances the read position to where the dma engine currently is, called with irqs disabled.
+	u64 update_read_pos() {
+		auto guard = position_lock.lock();
+		u32 size = ring_size();
+		u32 lpib = space.load(regs::stream::LPIB);
+		if (lpib >= size) {
+			return __atomic_load_n(&position->read_pos, __ATOMIC_RELAXED);
+		}
+
+		u32 delta = lpib >= last_lpib ? lpib - last_lpib : size - last_lpib + lpib;
+		last_lpib = lpib;
+
+		auto old_read = __atomic_load_n(&position->read_pos, __ATOMIC_RELAXED);
+		auto read = old_read + delta;
+		auto write = __atomic_load_n(&position->write_pos, __ATOMIC_ACQUIRE);
+		// the device passed the end of the queued data and kept going through stale data
+		if (write >= old_read && write < read) {
+			__atomic_store_n(&position->underruns, position->underruns + 1, __ATOMIC_RELAXED);
 		}
+		__atomic_store_n(&position->read_pos, read, __ATOMIC_RELEASE);
+		return read;
+	}
 
+	void handle_output_irq() {
+		// the status bits are cleared by writing ones
+		space.store(regs::stream::STS, sdsts::BCIS(true));
+		update_read_pos();
 		event.signal_one_if_not_pending();
 	}
 };
@@ -1152,8 +1236,6 @@ struct HdaCodec {
 	u8 cid;
 };
 
-static constexpr usize BUFFER_SIZE = CHUNK_SIZE * MAX_DESCRIPTORS;
-
 struct HdaCodecDev : public SoundDevice {
 	explicit HdaCodecDev(HdaCodec* codec) : codec {codec} {}
 
@@ -1169,7 +1251,7 @@ struct HdaCodecDev : public SoundDevice {
 
 		auto& path = codec->output_paths[index];
 		res.id = &path;
-		res.buffer_size = BUFFER_SIZE;
+		res.buffer_size = codec->controller->out_streams[0].ring_size();
 
 		auto pin = path.nodes[0];
 
@@ -1318,49 +1400,40 @@ struct HdaCodecDev : public SoundDevice {
 		return 0;
 	}
 
-	int queue_output(const void* buffer, usize& size) override {
+	int queue_output(UserSpan buffer, usize& size) override {
 		auto& stream = codec->controller->out_streams[0];
-		for (usize i = 0; i < size;) {
-			auto stream_remaining = stream.remaining_data.load(kstd::memory_order::relaxed);
+		auto ring_size = stream.ring_size();
 
-			usize to_copy;
-			if (i + (BUFFER_SIZE - stream_remaining) > size) {
-				to_copy = size - i;
-			}
-			else {
-				to_copy = BUFFER_SIZE - stream_remaining;
+		for (usize i = 0; i < size;) {
+			u64 read_pos;
+			{
+				IrqGuard irq_guard {};
+				read_pos = stream.update_read_pos();
+			}
+			// starts again right after the device's position if it ran out of data
+			auto write_pos = stream.write_pos(read_pos);
+			auto space = ring_size - (write_pos - read_pos);
+			if (!space) {
+				stream.event.wait();
+				continue;
 			}
 
+			usize to_copy = kstd::min(size - i, space);
 			for (usize copy_progress = 0; copy_progress < to_copy;) {
-				auto desc_index = stream.write_ptr / PAGE_SIZE;
-				auto desc_offset = stream.write_ptr % PAGE_SIZE;
-
-				auto remaining = to_copy - copy_progress;
-				usize to_copy_desc = kstd::min(remaining, PAGE_SIZE - desc_offset);
-
-				auto& desc = stream.bdl[desc_index];
-				auto* ptr = to_virt<void>(desc.address + desc_offset);
-				memcpy(ptr, offset(buffer, void*, i + copy_progress), to_copy_desc);
-
-				stream.write_ptr += to_copy_desc;
-				if (stream.write_ptr == BUFFER_SIZE) {
-					stream.write_ptr = 0;
-				}
-
-				copy_progress += to_copy_desc;
-			}
-
-			auto old = stream.remaining_data.load(kstd::memory_order::relaxed);
-			while (true) {
-				if (stream.remaining_data.compare_exchange_weak(
-						old,
-						old + to_copy,
-						kstd::memory_order::relaxed,
-						kstd::memory_order::relaxed)) {
-					break;
+				usize ring_offset = (write_pos + copy_progress) % ring_size;
+				usize page_offset = ring_offset % PAGE_SIZE;
+				usize to_copy_page = kstd::min(to_copy - copy_progress, PAGE_SIZE - page_offset);
+
+				auto* ptr = to_virt<void>(stream.pages[ring_offset / PAGE_SIZE] + page_offset);
+				if (!buffer.load(i + copy_progress, ptr, to_copy_page)) {
+					// whatever was copied before the fault is still queued
+					size = i;
+					return ERR_FAULT;
 				}
+				copy_progress += to_copy_page;
 			}
 
+			__atomic_store_n(&stream.position->write_pos, write_pos + to_copy, __ATOMIC_RELEASE);
 			i += to_copy;
 		}
 
@@ -1390,7 +1463,7 @@ struct HdaCodecDev : public SoundDevice {
 		auto& stream = codec->controller->out_streams[0];
 
 		while (true) {
-			auto data_remaining = stream.remaining_data.load(kstd::memory_order::relaxed);
+			auto data_remaining = stream.remaining();
 			if (data_remaining <= trip_size) {
 				remaining = data_remaining;
 				break;
@@ -1402,6 +1475,36 @@ struct HdaCodecDev : public SoundDevice {
 		return 0;
 	}
 
+	int set_period_size(usize& period_size, usize& ring_size) override {
+		auto& stream = codec->controller->out_streams[0];
+		if (stream.space.load(regs::stream::CTL0) & sdctl0::RUN) {
+			return ERR_INVALID_ARGUMENT;
+		}
+
+		// rounded down to a power of two so periods never straddle a page
+		period_size = kstd::max(kstd::min(period_size, MAX_RING_SIZE / 2), MIN_PERIOD_SIZE);
+		period_size = usize {1} << (63 - __builtin_clzll(period_size));
+
+		stream.configure(period_size);
+		period_size = stream.period_size();
+		ring_size = stream.ring_size();
+		return 0;
+	}
+
+	int get_ring(const usize*& pages, usize& page_count, usize& position_page) override {
+		auto& stream = codec->controller->out_streams[0];
+		pages = stream.pages;
+		page_count = MAX_DESCRIPTORS;
+		position_page = stream.position_phys;
+		return 0;
+	}
+
+	int get_position(u64& read_pos) override {
+		IrqGuard irq_guard {};
+		read_pos = codec->controller->out_streams[0].update_read_pos();
+		return 0;
+	}
+
 	HdaCodec* codec {};
 	HdaPath* active_output_path {};
 };
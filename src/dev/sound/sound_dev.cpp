@@ -1,13 +1,51 @@
 #include "sound_dev.hpp"
-#include "sys/user_access.hpp"
+#include "cstring.hpp"
+#include "mem/mem.hpp"
+#include "sched/process.hpp"
+#include "sched/sched.hpp"
 
-int SoundDevice::handle_request(const kstd::vector<u8>& data, kstd::vector<u8>& res, usize max_size) {
-	if (data.size() < sizeof(SoundLink) || max_size < sizeof(SoundLinkResponse)) {
+/// Maps the position page followed by the ring into the current process.
+static int map_ring(SoundDevice& device, SoundLinkResponse& resp) {
+	const usize* pages;
+	usize page_count;
+	usize position_page;
+	if (auto err = device.get_ring(pages, page_count, position_page)) {
+		return err;
+	}
+
+	auto process = get_current_thread()->process;
+	usize size = (page_count + 1) * PAGE_SIZE;
+	auto mem = process->allocate(nullptr, size, PageFlags::Read | PageFlags::Write, MemoryAllocFlags::None, nullptr);
+	if (!mem) {
+		return ERR_NO_MEM;
+	}
+
+	for (usize i = 0; i <= page_count; ++i) {
+		if (!process->page_map.map(
+				mem + i * PAGE_SIZE,
+				i ? pages[i - 1] : position_page,
+				PageFlags::Read | PageFlags::Write | PageFlags::User,
+				CacheMode::WriteBack)) {
+			process->free(mem, size);
+			return ERR_NO_MEM;
+		}
+	}
+
+	auto* position = reinterpret_cast<SoundRingPosition*>(mem);
+	resp.map_ring.position = position;
+	resp.map_ring.ring = reinterpret_cast<void*>(mem + PAGE_SIZE);
+	resp.map_ring.ring_size = __atomic_load_n(&to_virt<SoundRingPosition>(position_page)->ring_size, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int SoundDevice::handle_request(kstd::span<u8> data, void* res, usize& res_size) {
+	if (data.size() < sizeof(SoundLink) || res_size < sizeof(SoundLinkResponse)) {
 		return ERR_INVALID_ARGUMENT;
 	}
 	auto* link = reinterpret_cast<const SoundLink*>(data.data());
-	res.resize(sizeof(SoundLinkResponse));
-	auto* resp = reinterpret_cast<SoundLinkResponse*>(res.data());
+	res_size = sizeof(SoundLinkResponse);
+	auto* resp = static_cast<SoundLinkResponse*>(res);
+	memset(resp, 0, sizeof(SoundLinkResponse));
 
 	switch (link->op) {
 		case SoundLinkOpGetInfo:
@@ -43,14 +81,12 @@ int SoundDevice::handle_request(const kstd::vector<u8>& data, kstd::vector<u8>&
 		case SoundLinkOpQueueOutput:
 		{
 			auto size = link->queue_output.len;
-
-			kstd::vector<u8> buffer;
-			buffer.resize(size);
-			if (!UserAccessor(link->queue_output.buffer).load(buffer.data(), size)) {
+			UserSpan buffer {link->queue_output.buffer, size};
+			if (!buffer.is_valid()) {
 				return ERR_FAULT;
 			}
 
-			if (auto err = queue_output(buffer.data(), size)) {
+			if (auto err = queue_output(buffer, size)) {
 				return err;
 			}
 			break;
@@ -65,6 +101,27 @@ int SoundDevice::handle_request(const kstd::vector<u8>& data, kstd::vector<u8>&
 				return err;
 			}
 			break;
+		case SoundLinkOpSetPeriodSize:
+		{
+			usize period_size = link->set_period_size.period_size;
+			usize ring_size;
+			if (auto err = set_period_size(period_size, ring_size)) {
+				return err;
+			}
+			resp->set_period_size.period_size = period_size;
+			resp->set_period_size.ring_size = ring_size;
+			break;
+		}
+		case SoundLinkOpMapRing:
+			if (auto err = map_ring(*this, *resp)) {
+				return err;
+			}
+			break;
+		case SoundLinkOpGetPosition:
+			if (auto err = get_position(resp->get_position.read_pos)) {
+				return err;
+			}
+			break;
 	}
 
 	return 0;
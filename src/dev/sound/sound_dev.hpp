@@ -1,6 +1,7 @@
 #pragma once
 #include "crescent/devlink.h"
 #include "dev/user_dev.hpp"
+#include "sys/user_access.hpp"
 #include "types.hpp"
 
 struct SoundDeviceInfo {
@@ -12,7 +13,7 @@ struct SoundDevice : public UserDevice {
 		name = "sound";
 	}
 
-	int handle_request(const kstd::vector<u8>& data, kstd::vector<u8>& res, usize max_size) final;
+	int handle_request(kstd::span<u8> data, void* res, usize& res_size) final;
 
 	virtual int get_info(SoundDeviceInfo& res) = 0;
 	virtual int get_output_info(usize index, SoundOutputInfo& res) = 0;
@@ -20,7 +21,15 @@ struct SoundDevice : public UserDevice {
 	virtual int set_active_output(void* id) = 0;
 	virtual int set_output_params(SoundOutputParams& params) = 0;
 	virtual int set_volume(u8 percentage) = 0;
-	virtual int queue_output(const void* buffer, usize& size) = 0;
+	/// Copies `buffer` from the client straight into the output ring.
+	virtual int queue_output(UserSpan buffer, usize& size) = 0;
 	virtual int play(bool play) = 0;
 	virtual int wait_until_consumed(usize trip_size, usize& remaining) = 0;
+	/// Lays the ring out in periods of `period_size` bytes, rounded to what the device supports.
+	/// The output has to be stopped, positions start over from zero.
+	virtual int set_period_size(usize& period_size, usize& ring_size) = 0;
+	/// Returns the physical pages of the largest possible ring and of the shared position page.
+	virtual int get_ring(const usize*& pages, usize& page_count, usize& position_page) = 0;
+	/// Updates the read position from the device right away instead of waiting for the next period.
+	virtual int get_position(u64& read_pos) = 0;
 };
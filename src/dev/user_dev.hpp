@@ -2,6 +2,7 @@
 #include "vector.hpp"
 #include "manually_destroy.hpp"
 #include "shared_ptr.hpp"
+#include "span.hpp"
 #include "utils/spinlock.hpp"
 #include "string.hpp"
 #include "crescent/devlink.h"
@@ -13,7 +14,9 @@ struct UserDevice {
 	kstd::atomic<usize> open_count {};
 	bool exclusive {};
 
-	virtual int handle_request(const kstd::vector<u8>& data, kstd::vector<u8>& res, usize max_size) = 0;
+	/// Handles a device specific request that was copied into the kernel. The response is written to `res`,
+	/// which has room for `res_size` bytes, and `res_size` is set to the amount written.
+	virtual int handle_request(kstd::span<u8> data, void* res, usize& res_size) = 0;
 };
 
 struct DeviceHandle {
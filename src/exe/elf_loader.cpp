@@ -94,9 +94,7 @@ kstd::expected<LoadedElf, ElfLoadError> elf_load(Process* process, VNode* file)
 			return ElfLoadError::Invalid;
 		}
 
-		if (phdr.p_memsz > phdr.p_filesz) {
-			memset(offset(ptr, void*, phdr.p_filesz), 0, phdr.p_memsz - phdr.p_filesz);
-		}
+		// the bss needs no clearing, the backed memory from `allocate` is already zeroed
 
 		PageFlags flags = PageFlags::User;
 		if (phdr.p_flags & PF_R) {
@@ -86,6 +86,19 @@ struct TarFileNode : public VNode {
 		return FsStatus::Success;
 	}
 
+	FsStatus get_phys(usize& phys, usize offset) override {
+		if (hdr->type_flag != '0') {
+			return FsStatus::Unsupported;
+		}
+
+		if (offset > parse_oct(hdr->size)) {
+			return FsStatus::OutOfBounds;
+		}
+
+		phys = to_phys(offset(hdr, const void*, 512 + offset));
+		return FsStatus::Success;
+	}
+
 	FsStatus stat(FsStat& data) override {
 		if (hdr->type_flag != '0') {
 			return FsStatus::Unsupported;
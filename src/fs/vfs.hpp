@@ -73,6 +73,12 @@ struct VNode {
 		return FsStatus::Unsupported;
 	}
 
+	/// Gets the physical address of the data at `offset` for files that are resident in memory,
+	/// the data must be physically contiguous from there until the end of the file.
+	virtual FsStatus get_phys(usize& phys, usize offset) {
+		return FsStatus::Unsupported;
+	}
+
 	Event poll_event {};
 	bool seekable {};
 
@@ -1,6 +1,7 @@
 #include "acpi/pci.hpp"
 #include "arch/cpu.hpp"
 #include "dev/fb/fb_dev.hpp"
+#include "dev/net/nic/loopback.hpp"
 #include "dev/net/nic/nic.hpp"
 #include "dev/net/tcp.hpp"
 #include "exe/elf_loader.hpp"
@@ -72,12 +73,18 @@ struct NetworkLogSink : LogSink {
 void print_mem() {
 	println("[kernel]: total memory: ", pmalloc_get_total_mem() / 1024 / 1024, "MB, reserved: ", pmalloc_get_reserved_mem() / 1024 / 1024, "MB");
 	println("[kernel]: used memory: ", pmalloc_get_used_mem() / 1024 / 1024, "MB (", pmalloc_get_used_mem() / 1024, "KB)");
+	auto zero_pool = pmalloc_get_zero_pool_stats();
+	println("[kernel]: zero pool: ", zero_pool.pages, " pages, ", zero_pool.hits, " hits, ", zero_pool.misses, " misses");
 }
 
 [[noreturn, gnu::used]] void kmain(const void* initrd, usize initrd_size) {
     println("[kernel]: entered kmain");
+	log_drain_init();
+	pmalloc_zero_worker_init();
 	print_mem();
 
+	loopback_init();
+
 #if ARCH_X86_64
 	println("[kernel]: acpi init...");
 	pci::acpi_init();
@@ -15,3 +15,8 @@ inline usize to_phys(T* ptr) {
 
 #define ALIGNUP(value, align) (((value) + ((align) - 1)) & ~((align) - 1))
 #define ALIGNDOWN(value, align) ((value) & ~((align) - 1))
+
+/// Copies one page, both pointers must be page aligned.
+void page_copy(void* dest, const void* src);
+/// Zeroes one page, `dest` must be page aligned.
+void page_zero(void* dest);
@@ -5,6 +5,8 @@
 #include "mem.hpp"
 #include "new.hpp"
 #include "atomic.hpp"
+#include "arch/cpu.hpp"
+#include "dev/event.hpp"
 #ifdef ARCH_USER
 #include <assert.h>
 #endif
@@ -19,6 +21,23 @@ namespace {
 	usize TOTAL_MEMORY = 0;
 	usize RESERVED_MEMORY = 0;
 	kstd::atomic<usize> USED_MEMORY {0};
+
+	/// Free pages that were already zeroed, they are taken out of the freelists
+	/// but not counted as used.
+	struct ZeroPool {
+		DoubleList<Page, &Page::hook> pages {};
+		usize count {};
+	};
+
+	IrqSpinlock<ZeroPool> ZERO_POOL {};
+	/// The pool never holds more than this or an eighth of the free memory, whichever is less.
+	constexpr usize ZERO_POOL_MAX = 1024;
+	/// Below this the worker is woken up, idle cpus keep the pool topped up until then.
+	constexpr usize ZERO_POOL_LOW = ZERO_POOL_MAX / 4;
+	kstd::atomic<usize> ZERO_POOL_HITS {};
+	kstd::atomic<usize> ZERO_POOL_MISSES {};
+	kstd::atomic<bool> ZERO_WORKER_RUNNING {};
+	Event ZERO_WORKER_EVENT {};
 }
 
 static constexpr usize index_to_size(usize index) {
@@ -205,6 +224,26 @@ void pmalloc_add_mem(usize phys, usize size) {
 
 static IrqSpinlock<void> GIANT_LOCK {};
 
+/// Gives the zeroed pages back to the freelists so they can merge, returns whether there were any.
+static bool zero_pool_drain() {
+	bool drained = false;
+	while (true) {
+		Page* page;
+		{
+			auto guard = ZERO_POOL.lock();
+			page = guard->pages.pop();
+			if (!page) {
+				break;
+			}
+			--guard->count;
+		}
+
+		freelist_insert(0, page);
+		drained = true;
+	}
+	return drained;
+}
+
 usize pmalloc(usize count) {
 	if (!count) {
 		return 0;
@@ -213,6 +252,10 @@ usize pmalloc(usize count) {
 	auto guard = GIANT_LOCK.lock();
 
 	auto page = freelist_get(size_to_index(count));
+	if (!page && zero_pool_drain()) {
+		page = freelist_get(size_to_index(count));
+	}
+
 	if (page) {
 		memset(to_virt<void>(page->phys()), 0xCB, count * PAGE_SIZE);
 
@@ -224,6 +267,87 @@ usize pmalloc(usize count) {
 	}
 }
 
+usize pmalloc_zeroed(usize count) {
+	if (count == 1) {
+		Page* page;
+		usize left;
+		{
+			auto guard = ZERO_POOL.lock();
+			page = guard->pages.pop();
+			if (page) {
+				--guard->count;
+			}
+			left = guard->count;
+		}
+
+		if (left < ZERO_POOL_LOW && ZERO_WORKER_RUNNING.load(kstd::memory_order::acquire)) {
+			ZERO_WORKER_EVENT.signal_one_if_not_pending();
+		}
+
+		if (page) {
+			ZERO_POOL_HITS.fetch_add(1, kstd::memory_order::relaxed);
+			USED_MEMORY.fetch_add(PAGE_SIZE, kstd::memory_order::relaxed);
+			return page->phys();
+		}
+	}
+
+	ZERO_POOL_MISSES.fetch_add(1, kstd::memory_order::relaxed);
+	auto phys = pmalloc(count);
+	if (!phys) {
+		return 0;
+	}
+	for (usize i = 0; i < count; ++i) {
+		page_zero(to_virt<void>(phys + i * PAGE_SIZE));
+	}
+	return phys;
+}
+
+bool pmalloc_refill_zeroed() {
+	{
+		auto guard = ZERO_POOL.lock();
+		usize free_pages = (TOTAL_MEMORY - RESERVED_MEMORY - USED_MEMORY.load(kstd::memory_order::relaxed)) / PAGE_SIZE;
+		if (guard->count >= kstd::min(ZERO_POOL_MAX, (free_pages - guard->count) / 8)) {
+			return false;
+		}
+	}
+
+	Page* page;
+	{
+		auto guard = GIANT_LOCK.lock();
+		page = freelist_get(0);
+		if (!page) {
+			return false;
+		}
+	}
+
+	// the page is in neither the freelists nor the pool while it's zeroed, so no lock is needed
+	page_zero(to_virt<void>(page->phys()));
+
+	auto guard = ZERO_POOL.lock();
+	guard->pages.push(page);
+	++guard->count;
+	return true;
+}
+
+[[noreturn]] static void zero_worker_fn(void*) {
+	while (true) {
+		ZERO_WORKER_EVENT.wait();
+		while (pmalloc_refill_zeroed());
+	}
+}
+
+void pmalloc_zero_worker_init() {
+	IrqGuard irq_guard {};
+	auto* cpu = get_current_thread()->cpu;
+	auto* thread = new Thread {"zero pool worker", cpu, &*KERNEL_PROCESS, zero_worker_fn, nullptr};
+	// the lowest level, it only gets the cycles nothing else wants
+	thread->level_index = Scheduler::SCHED_LEVELS - 1;
+	thread->pin_level = true;
+	ZERO_WORKER_RUNNING.store(true, kstd::memory_order::release);
+	cpu->scheduler.queue(thread);
+	cpu->thread_count.fetch_add(1, kstd::memory_order::seq_cst);
+}
+
 void pfree(usize addr, usize count) {
 	auto guard = GIANT_LOCK.lock();
 
@@ -262,3 +386,11 @@ usize pmalloc_get_used_mem() {
 	IrqGuard irq_guard {};
 	return USED_MEMORY.load(kstd::memory_order::relaxed);
 }
+
+ZeroPoolStats pmalloc_get_zero_pool_stats() {
+	return {
+		.pages = ZERO_POOL.lock()->count,
+		.hits = ZERO_POOL_HITS.load(kstd::memory_order::relaxed),
+		.misses = ZERO_POOL_MISSES.load(kstd::memory_order::relaxed)
+	};
+}
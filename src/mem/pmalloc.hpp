@@ -37,3 +37,19 @@ void pfree(usize addr, usize count);
 usize pmalloc_get_total_mem();
 usize pmalloc_get_reserved_mem();
 usize pmalloc_get_used_mem();
+
+/// Like `pmalloc` but the pages are zeroed, single pages come from the pre-zeroed pool when it has any.
+usize pmalloc_zeroed(usize count);
+/// Zeroes one free page into the pool, returns false once the pool is full.
+/// Called by idle cpus between checks for runnable threads.
+bool pmalloc_refill_zeroed();
+/// Starts the low priority worker that refills the pool when it runs low.
+void pmalloc_zero_worker_init();
+
+struct ZeroPoolStats {
+	usize pages;
+	usize hits;
+	usize misses;
+};
+
+ZeroPoolStats pmalloc_get_zero_pool_stats();
@@ -6,6 +6,7 @@
 #include "arch/cpu.hpp"
 #include "ipc.hpp"
 #include "limits.hpp"
+#include "utils/trace.hpp"
 
 ManuallyDestroy<Mutex<kstd::unordered_map<int, Process*>>> PID_TO_PROC;
 static ManuallyDestroy<kstd::vector<int>> FREE_PIDS;
@@ -197,7 +198,7 @@ usize Process::allocate(
 		auto page_flags = PageFlags::User | prot;
 
 		for (usize i = 0; i < size; i += PAGE_SIZE) {
-			auto phys = pmalloc(1);
+			auto phys = pmalloc_zeroed(1);
 			if (!phys || !page_map.map(virt + i, phys, page_flags, cache_mode) ||
 				(kernel_mapping && !KERNEL_MAP.map(kernel_virt + i, phys, PageFlags::Read | PageFlags::Write, CacheMode::WriteBack))) {
 
@@ -239,6 +240,13 @@ bool Process::free(usize ptr, usize size) {
 	auto guard = mappings.lock();
 
 	auto mapping = guard->find<usize, &Mapping::base>(ptr);
+	// file mappings hand out pointers into the middle of their first page
+	if (!mapping && (ptr & (PAGE_SIZE - 1))) {
+		mapping = guard->find<usize, &Mapping::base>(ALIGNDOWN(ptr, PAGE_SIZE));
+		if (mapping && !(mapping->flags & MemoryAllocFlags::File)) {
+			mapping = nullptr;
+		}
+	}
 	if (!mapping) {
 		return false;
 	}
@@ -283,6 +291,16 @@ bool Process::protect(usize ptr, usize size, PageFlags prot) {
 
 	auto guard = mappings.lock();
 
+	// checked for the whole range first so a rejected call doesn't leave it half changed
+	if (prot & PageFlags::Write) {
+		for (auto* node = guard->get_first(); node; node = guard->get_successor(node)) {
+			if ((node->flags & MemoryAllocFlags::File) &&
+				node->base < ptr + size && ptr < node->base + node->size) {
+				return false;
+			}
+		}
+	}
+
 	usize i = 0;
 	while (i < size) {
 		auto node = guard->get_root();
@@ -380,7 +398,9 @@ void Process::add_thread(Thread* thread) {
 void Process::remove_thread(Thread* thread) {
 	{
 		IrqGuard irq_guard {};
-		threads.lock()->remove(thread);
+		auto guard = threads.lock();
+		guard->remove(thread);
+		exited_accounting.add(thread->accounting);
 	}
 
 	auto guard = tid_to_thread.lock();
@@ -418,6 +438,7 @@ void Process::exit(int status, ProcessDescriptor* skip_lock) {
 }
 
 bool Process::handle_pagefault(usize addr) {
+	TraceScope<TRACE_EVENT_PAGE_FAULT_ENTER, TRACE_EVENT_PAGE_FAULT_EXIT> trace_scope {addr};
 	auto guard = mappings.lock();
 
 	addr = ALIGNDOWN(addr, PAGE_SIZE);
@@ -441,7 +462,7 @@ bool Process::handle_pagefault(usize addr) {
 
 				assert(!phys);
 
-				auto page = pmalloc(1);
+				auto page = pmalloc_zeroed(1);
 				if (!page) {
 					println("[kernel][sched]: failed to allocate demand-allocated page");
 					return false;
@@ -453,6 +474,7 @@ bool Process::handle_pagefault(usize addr) {
 					return false;
 				}
 
+				trace_scope.result = true;
 				return true;
 			}
 
@@ -511,7 +533,7 @@ Process* Process::clone() {
 						return nullptr;
 					}
 
-					memcpy(to_virt<void>(new_page), to_virt<void>(page_phys), PAGE_SIZE);
+					page_copy(to_virt<void>(new_page), to_virt<void>(page_phys));
 
 					if (!new_process->page_map.map(node->base + i, new_page, node->prot, CacheMode::WriteBack)) {
 						new_process->vmem.xfree(new_addr, node->size);
@@ -535,7 +557,7 @@ Process* Process::clone() {
 						return nullptr;
 					}
 
-					memcpy(to_virt<void>(new_page), to_virt<void>(page_phys), PAGE_SIZE);
+					page_copy(to_virt<void>(new_page), to_virt<void>(page_phys));
 
 					if (!new_process->page_map.map(node->base + i, new_page, node->prot, CacheMode::WriteBack)) {
 						new_process->vmem.xfree(new_addr, node->size);
@@ -18,7 +18,9 @@ enum class MemoryAllocFlags {
 	None,
 	Backed = 1 << 3,
 	Demand = 1 << 4,
-	Fixed = 1 << 5
+	Fixed = 1 << 5,
+	/// Shared read-only pages of a resident file, never made writable.
+	File = 1 << 6
 };
 FLAGS_ENUM(MemoryAllocFlags);
 
@@ -110,6 +112,8 @@ struct Process {
 	bool killed {};
 	int pid {};
 	Spinlock<DoubleList<Thread, &Thread::process_hook>> threads {};
+	/// Accounting of the threads that already exited, protected by the `threads` lock.
+	SchedAccounting exited_accounting {};
 	Spinlock<CpuSet> cpu_set {};
 	Mutex<kstd::unordered_map<int, Thread*>> tid_to_thread {};
 
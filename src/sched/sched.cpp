@@ -2,6 +2,9 @@
 #include "stdio.hpp"
 #include "arch/cpu.hpp"
 #include "assert.hpp"
+#include "cstring.hpp"
+#include "utils/profiler.hpp"
+#include "utils/trace.hpp"
 
 [[noreturn]] void sched_load_balancer_fn(void*) {
 	auto& scheduler = get_current_thread()->cpu->scheduler;
@@ -40,12 +43,16 @@
 					auto thread_guard = thread.move_lock.lock();
 
 					if (!thread.pin_cpu && thread.status == Thread::Status::Waiting) {
-						println("[kernel][sched]: moving thread ", thread.name, " from cpu ", max_cpu_index, " to cpu ", min_cpu_index);
+						debugln("[kernel][sched]: moving thread ", thread.name, " from cpu ", max_cpu_index, " to cpu ", min_cpu_index);
 
 						guard->remove(&thread);
 
 						thread.cpu = min_cpu;
+						++thread.accounting.migrations;
+						// it has been waiting since it was first queued
+						auto ready_since = thread.ready_since;
 						min_cpu->scheduler.queue(&thread);
+						thread.ready_since = ready_since;
 
 						max_cpu->thread_count.fetch_sub(1, kstd::memory_order::seq_cst);
 						min_cpu->thread_count.fetch_add(1, kstd::memory_order::seq_cst);
@@ -66,7 +73,7 @@
 					}
 
 					if (!thread.pin_cpu) {
-						println(
+						debugln(
 							"[kernel][sched]: moving sleeping thread ",
 							thread.name,
 							" from cpu ",
@@ -76,6 +83,7 @@
 						guard->remove(&thread);
 
 						thread.cpu = min_cpu;
+						++thread.accounting.migrations;
 						auto min_guard = min_cpu->scheduler.sleeping_threads.lock();
 
 						Thread* next_sleeping = nullptr;
@@ -122,13 +130,13 @@
 			IrqGuard irq_guard {};
 			auto guard = list.lock();
 			for (auto& thread : *guard) {
-				println("[kernel][sched]: destroying exited thread ", thread.name);
+				debugln("[kernel][sched]: destroying exited thread ", thread.name);
 				guard->remove(&thread);
 				auto process = thread.process;
 				process->remove_thread(&thread);
 				delete &thread;
 				if (process->is_empty()) {
-					println("[kernel][sched]: destroying empty process ", process->name);
+					debugln("[kernel][sched]: destroying empty process ", process->name);
 					delete process;
 				}
 			}
@@ -176,6 +184,7 @@ Scheduler::Scheduler() {
 void Scheduler::queue(Thread* thread) {
 	auto& level = levels[thread->level_index];
 	IrqGuard irq_guard {};
+	thread->ready_since = arch_get_cycles();
 	level.list.lock()->push(thread);
 }
 
@@ -244,14 +253,33 @@ void Scheduler::update_schedule() {
 	us_to_next_schedule = levels[current->level_index].slice_us;
 }
 
+static void sched_record_wait(Thread* thread, u64 now) {
+	auto cycles_per_us = arch_get_cycle_frequency() / US_IN_S;
+	if (!thread->ready_since || now < thread->ready_since || !cycles_per_us) {
+		return;
+	}
+
+	u64 wait_us = (now - thread->ready_since) / cycles_per_us;
+	usize bucket = kstd::min(static_cast<usize>(kstd::bit_width(wait_us)), usize {SCHED_WAIT_BUCKETS - 1});
+	++thread->accounting.wait_histogram[bucket];
+}
+
 void Scheduler::do_schedule() const {
 	// do_schedule must always be called with interrupts disabled
 	assert(!arch_enable_irqs(false));
 
+	// also done when nothing else is runnable, so a thread that keeps the cpu is still accounted every tick
+	auto now = arch_get_cycles();
+	prev->account(now);
+
 	if (prev == current) {
 		return;
 	}
 
+	if (trace_enabled(TRACE_EVENT_SCHED_SWITCH)) [[unlikely]] {
+		trace_emit(TRACE_EVENT_SCHED_SWITCH, trace_thread_id(prev), trace_thread_id(current));
+	}
+
 	if (!prev->move_lock.is_locked()) {
 		prev->move_lock.manual_lock();
 	}
@@ -263,9 +291,18 @@ void Scheduler::do_schedule() const {
 	}
 	else if (prev != &prev->cpu->idle_thread && prev->status == Thread::Status::Running) {
 		assert(prev != current);
+		++prev->accounting.involuntary_switches;
 		prev->status = Thread::Status::Waiting;
 		prev->cpu->scheduler.queue(prev);
 	}
+	else if (prev != &prev->cpu->idle_thread) {
+		++prev->accounting.voluntary_switches;
+	}
+
+	current->account_start = now;
+	if (current != &current->cpu->idle_thread) {
+		sched_record_wait(current, now);
+	}
 
 	current->status = Thread::Status::Running;
 
@@ -375,6 +412,7 @@ void Scheduler::unblock(Thread* thread, bool remove_sleeping, bool assert_not_sl
 
 	assert(thread != thread->cpu->scheduler.current);
 	thread->status = Thread::Status::Waiting;
+	thread->ready_since = arch_get_cycles();
 	guard->push(thread);
 }
 
@@ -413,6 +451,10 @@ void Scheduler::enable_preemption(Cpu* cpu) {
 	auto time_before_sleep_end = first_sleep_end - now;
 	auto slice_us = levels[current->level_index].slice_us;
 	auto amount = kstd::min(time_before_sleep_end, slice_us);
+	// samples are taken from the tick irq, so it has to fire at least as often as the profiler wants
+	if (auto interval = PROFILE_INTERVAL_US.load(kstd::memory_order::relaxed)) {
+		amount = kstd::min(amount, interval);
+	}
 	current_irq_period = amount;
 	cpu->cpu_tick_source->oneshot(amount);
 }
@@ -476,3 +518,73 @@ void Scheduler::sleep(u64 ns) {
 	do_schedule();
 	arch_enable_irqs(state);
 }
+
+static void sched_copy_name(char (&dest)[32], kstd::string_view name) {
+	usize len = kstd::min(name.size(), sizeof(dest) - 1);
+	memcpy(dest, name.data(), len);
+	dest[len] = 0;
+}
+
+static SchedStats sched_stats_to_ns(const SchedAccounting& accounting, u64 freq) {
+	// split so the multiplication can't overflow
+	auto to_ns = [freq](u64 cycles) {
+		return cycles / freq * NS_IN_S + cycles % freq * NS_IN_S / freq;
+	};
+
+	SchedStats stats {
+		.user_ns = to_ns(accounting.user_cycles),
+		.kernel_ns = to_ns(accounting.kernel_cycles),
+		.voluntary_switches = accounting.voluntary_switches,
+		.involuntary_switches = accounting.involuntary_switches,
+		.migrations = accounting.migrations,
+		.wait_histogram {}
+	};
+	memcpy(stats.wait_histogram, accounting.wait_histogram, sizeof(stats.wait_histogram));
+	return stats;
+}
+
+static void sched_add_process_stats(kstd::vector<SchedStatsEntry>& entries, Process* process, u64 freq) {
+	IrqGuard irq_guard {};
+	auto guard = process->threads.lock();
+
+	usize process_index = entries.size();
+	entries.push({});
+
+	auto total = process->exited_accounting;
+	for (auto& thread : *guard) {
+		if (!thread.cpu || &thread != &thread.cpu->idle_thread) {
+			total.add(thread.accounting);
+		}
+
+		SchedStatsEntry entry {
+			.stats = sched_stats_to_ns(thread.accounting, freq),
+			.pid = process->pid,
+			.tid = thread.thread_id,
+			.level = static_cast<u32>(thread.level_index),
+			.cpu = thread.cpu ? thread.cpu->number : 0,
+			.name {}
+		};
+		sched_copy_name(entry.name, thread.name);
+		entries.push(entry);
+	}
+
+	auto& entry = entries[process_index];
+	entry.stats = sched_stats_to_ns(total, freq);
+	entry.pid = process->pid;
+	sched_copy_name(entry.name, process->name);
+}
+
+void sched_get_stats(kstd::vector<SchedStatsEntry>& entries) {
+	auto freq = arch_get_cycle_frequency();
+	if (!freq) {
+		return;
+	}
+
+	sched_add_process_stats(entries, &*KERNEL_PROCESS, freq);
+
+	// processes can't be destroyed while the lock is held
+	auto guard = PID_TO_PROC->lock();
+	guard->for_each([&](int, Process* process) {
+		sched_add_process_stats(entries, process, freq);
+	});
+}
@@ -5,6 +5,7 @@
 #include "sched/thread.hpp"
 #include "types.hpp"
 #include "utils/spinlock.hpp"
+#include "vector.hpp"
 
 struct Cpu;
 struct Process;
@@ -51,5 +52,7 @@ struct Scheduler {
 };
 
 void sched_init(bool bsp);
+/// Appends an entry for every process followed by entries for each of its threads.
+void sched_get_stats(kstd::vector<SchedStatsEntry>& entries);
 Thread* get_current_thread();
 void set_current_thread(Thread* thread);
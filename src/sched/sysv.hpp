@@ -1,6 +1,12 @@
 #pragma once
+#include "span.hpp"
+#include "string.hpp"
 #include "types.hpp"
 
+/// Limits of the arguments of a new process, they have to fit at the top of its initial stack.
+constexpr usize SYSV_MAX_ARGS = 256;
+constexpr usize SYSV_MAX_ARGS_SIZE = 64 * 1024;
+
 struct SysvInfo {
 	usize ld_entry;
 	usize exe_entry;
@@ -8,4 +14,15 @@ struct SysvInfo {
 	usize exe_phdrs_addr;
 	u16 exe_phdr_count;
 	u16 exe_phdr_size;
+	/// Passed to the process as argv.
+	kstd::span<kstd::string> args {};
 };
+
+/// Bytes the argument strings take at the top of the initial stack, padded to 16.
+inline usize sysv_strings_size(const SysvInfo& sysv) {
+	usize size = 0;
+	for (auto& arg : sysv.args) {
+		size += arg.size() + 1;
+	}
+	return (size + 15) & ~usize {15};
+}
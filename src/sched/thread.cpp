@@ -2,6 +2,17 @@
 #include "process.hpp"
 #include "arch/cpu.hpp"
 
+void SchedAccounting::add(const SchedAccounting& other) {
+	user_cycles += other.user_cycles;
+	kernel_cycles += other.kernel_cycles;
+	voluntary_switches += other.voluntary_switches;
+	involuntary_switches += other.involuntary_switches;
+	migrations += other.migrations;
+	for (usize i = 0; i < SCHED_WAIT_BUCKETS; ++i) {
+		wait_histogram[i] += other.wait_histogram[i];
+	}
+}
+
 Thread::Thread(kstd::string_view name, Cpu* cpu, Process* process, void (*fn)(void *), void *arg)
 	: ArchThread {fn, arg, process}, name {name}, cpu {cpu}, process {process} {
 	process->add_thread(this);
@@ -26,6 +37,26 @@ void Thread::yield() const {
 	cpu->scheduler.yield();
 }
 
+void Thread::account(u64 now) {
+	// threads that were never switched in (e.g. the one that booted the cpu) start counting now
+	if (account_start && now > account_start) {
+		auto elapsed = now - account_start;
+		if (process->user && !in_syscall) {
+			accounting.user_cycles += elapsed;
+		}
+		else {
+			accounting.kernel_cycles += elapsed;
+		}
+	}
+	account_start = now;
+}
+
+void Thread::set_in_syscall(bool value) {
+	IrqGuard irq_guard {};
+	account(arch_get_cycles());
+	in_syscall = value;
+}
+
 void Thread::add_descriptor(ThreadDescriptor* descriptor) {
 	IrqGuard irq_guard {};
 	descriptors.lock()->push(descriptor);
@@ -1,5 +1,6 @@
 #pragma once
 #include "arch/arch_thread.hpp"
+#include "crescent/sched.h"
 #include "double_list.hpp"
 #include "signal_ctx.hpp"
 #include "string.hpp"
@@ -21,6 +22,18 @@ struct ThreadDescriptor {
 	int exit_status {};
 };
 
+/// Cpu time and scheduling counters, times are in `arch_get_cycles` cycles.
+struct SchedAccounting {
+	void add(const SchedAccounting& other);
+
+	u64 user_cycles {};
+	u64 kernel_cycles {};
+	u64 voluntary_switches {};
+	u64 involuntary_switches {};
+	u64 migrations {};
+	u64 wait_histogram[SCHED_WAIT_BUCKETS] {};
+};
+
 struct Thread : public ArchThread {
 	Thread(kstd::string_view name, Cpu* cpu, Process* process, void (*fn)(void*), void* arg);
 	Thread(kstd::string_view name, Cpu* cpu, Process* process, const SysvInfo& sysv);
@@ -33,6 +46,11 @@ struct Thread : public ArchThread {
 	void remove_descriptor(ThreadDescriptor* descriptor);
 	void exit(int exit_status, ThreadDescriptor* skip_lock = nullptr);
 
+	/// Charges the time since the thread was switched in or last changed modes to the mode it's in.
+	void account(u64 now);
+	/// Called on syscall entry and exit so syscalls count as kernel time.
+	void set_in_syscall(bool value);
+
 	enum class Status {
 		Running,
 		Waiting,
@@ -61,6 +79,12 @@ struct Thread : public ArchThread {
 	bool in_futex_wait_list {};
 	uint32_t thread_id {};
 	ThreadSignalContext signal_ctx {};
+	SchedAccounting accounting {};
+	/// `arch_get_cycles` when the thread was switched in or last changed modes.
+	u64 account_start {};
+	/// `arch_get_cycles` when the thread was last queued.
+	u64 ready_since {};
+	bool in_syscall {};
 };
 
 #ifdef __x86_64__
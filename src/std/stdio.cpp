@@ -1,9 +1,58 @@
 #include "stdio.hpp"
+#include "arch/cpu.hpp"
 #include "cstring.hpp"
+#include "sched/process.hpp"
 
 constexpr const char CHARS[] = "0123456789ABCDEF";
 
-Log& Log::operator<<(usize value) {
+namespace {
+	struct LogRecord {
+		u64 seq;
+		u16 len;
+		/// Color to switch to before the text, `NO_COLOR` for none.
+		u8 color;
+	};
+
+	constexpr u8 NO_COLOR = 0xFF;
+
+	/// Only written by its own cpu with irqs disabled and only read by whoever holds `LOG`,
+	/// so producers never wait for each other or for the sinks.
+	struct LogRing {
+		static constexpr usize SIZE = 0x2000;
+
+		void copy_in(u64 pos, const void* src, usize len) {
+			usize off = pos % SIZE;
+			usize first = kstd::min(len, SIZE - off);
+			memcpy(data + off, src, first);
+			memcpy(data, offset(src, const void*, first), len - first);
+		}
+
+		void copy_out(u64 pos, void* dest, usize len) const {
+			usize off = pos % SIZE;
+			usize first = kstd::min(len, SIZE - off);
+			memcpy(dest, data + off, first);
+			memcpy(offset(dest, void*, first), data, len - first);
+		}
+
+		u64 head {};
+		u64 tail {};
+		kstd::atomic<usize> dropped {};
+		char data[SIZE] {};
+	};
+
+	LogRing RINGS[CONFIG_MAX_CPUS] {};
+	kstd::atomic<u64> NEXT_SEQ {};
+	kstd::atomic<bool> DRAIN_RUNNING {};
+
+	/// How long the drain thread sleeps when the rings are empty.
+	constexpr u64 DRAIN_INTERVAL = 10 * NS_IN_MS;
+	/// Records written per lock hold, so irqs aren't disabled for too long at a time.
+	constexpr usize DRAIN_BATCH = 32;
+}
+
+kstd::atomic<LogLevel> LOG_LEVEL {LogLevel::Info};
+
+LogLine& LogLine::operator<<(usize value) {
 	u8 base;
 	switch (fmt) {
 		case Fmt::Dec:
@@ -35,7 +84,7 @@ Log& Log::operator<<(usize value) {
 	return *this;
 }
 
-Log& Log::operator<<(isize value) {
+LogLine& LogLine::operator<<(isize value) {
 	if (value < 0) {
 		operator<<(kstd::string_view {"-", 1});
 		value *= -1;
@@ -43,29 +92,21 @@ Log& Log::operator<<(isize value) {
 	return operator<<(static_cast<usize>(value));
 }
 
-Log& Log::operator<<(kstd::string_view str) {
-	if (str.size() + 1 > LOG_SIZE) {
-		for (auto& sink : sinks) {
-			sink.write(str);
+LogLine& LogLine::operator<<(kstd::string_view str) {
+	while (!str.is_empty()) {
+		if (size == MAX_SIZE) {
+			flush();
 		}
-		return *this;
-	}
-
-	if (buf_ptr + str.size() + 1 > LOG_SIZE) {
-		buf_ptr = 0;
-	}
-
-	memcpy(buf + buf_ptr, str.data(), str.size());
-	buf[buf_ptr + str.size()] = 0;
-	buf_ptr += str.size() + 1;
 
-	for (auto& sink : sinks) {
-		sink.write(str);
+		usize amount = kstd::min(str.size(), MAX_SIZE - size);
+		memcpy(buf + size, str.data(), amount);
+		size += amount;
+		str = str.substr(amount);
 	}
 	return *this;
 }
 
-Log& Log::operator<<(Fmt new_fmt) {
+LogLine& LogLine::operator<<(Fmt new_fmt) {
 	if (new_fmt == Fmt::Reset) {
 		fmt = Fmt::Dec;
 		pad.amount = 0;
@@ -76,26 +117,187 @@ Log& Log::operator<<(Fmt new_fmt) {
 	return *this;
 }
 
-Log& Log::operator<<(Color new_color) {
-	for (auto& sink : sinks) {
-		sink.set_color(new_color);
+LogLine& LogLine::operator<<(Color new_color) {
+	// the color applies to whatever follows, so the text before it goes out first
+	if (size) {
+		flush();
 	}
+	color = new_color;
+	has_color = true;
 	return *this;
 }
 
-Log& Log::operator<<(Pad new_pad) {
+LogLine& LogLine::operator<<(Pad new_pad) {
 	pad = new_pad;
 	return *this;
 }
 
+void LogLine::flush() {
+	if (size || has_color) {
+		log_commit(kstd::string_view {buf, size}, has_color ? &color : nullptr);
+	}
+	size = 0;
+	has_color = false;
+}
+
+void log_commit(kstd::string_view text, const Color* color) {
+	IrqGuard irq_guard {};
+
+	if (!DRAIN_RUNNING.load(kstd::memory_order::acquire)) {
+		auto guard = LOG.lock();
+		if (color) {
+			guard->set_color(*color);
+		}
+		guard->write(text);
+		return;
+	}
+
+	auto& ring = RINGS[get_current_thread()->cpu->number];
+
+	LogRecord record {
+		.seq = NEXT_SEQ.fetch_add(1, kstd::memory_order::relaxed),
+		.len = static_cast<u16>(text.size()),
+		.color = color ? static_cast<u8>(*color) : NO_COLOR
+	};
+
+	auto head = ring.head;
+	auto tail = __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
+	if (LogRing::SIZE - (head - tail) < sizeof(LogRecord) + record.len) {
+		ring.dropped.fetch_add(1, kstd::memory_order::relaxed);
+		return;
+	}
+
+	ring.copy_in(head, &record, sizeof(LogRecord));
+	ring.copy_in(head + sizeof(LogRecord), text.data(), text.size());
+	__atomic_store_n(&ring.head, head + sizeof(LogRecord) + record.len, __ATOMIC_RELEASE);
+}
+
+/// Writes up to `DRAIN_BATCH` records to the sinks, oldest first across all cpus.
+/// Returns whether any records are left.
+static bool log_drain_batch(Log& log) {
+	usize cpu_count = kstd::min(arch_get_cpu_count(), usize {CONFIG_MAX_CPUS});
+
+	for (usize written = 0; written < DRAIN_BATCH; ++written) {
+		LogRing* oldest = nullptr;
+		LogRecord oldest_record {};
+
+		for (usize i = 0; i < cpu_count; ++i) {
+			auto& ring = RINGS[i];
+			if (__atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) == ring.tail) {
+				continue;
+			}
+
+			LogRecord record;
+			ring.copy_out(ring.tail, &record, sizeof(LogRecord));
+			if (!oldest || record.seq < oldest_record.seq) {
+				oldest = &ring;
+				oldest_record = record;
+			}
+		}
+
+		if (!oldest) {
+			return false;
+		}
+
+		char text[LogLine::MAX_SIZE];
+		oldest->copy_out(oldest->tail + sizeof(LogRecord), text, oldest_record.len);
+		__atomic_store_n(&oldest->tail, oldest->tail + sizeof(LogRecord) + oldest_record.len, __ATOMIC_RELEASE);
+
+		if (oldest_record.color != NO_COLOR) {
+			log.set_color(static_cast<Color>(oldest_record.color));
+		}
+		log.write(kstd::string_view {text, oldest_record.len});
+	}
+
+	return true;
+}
+
+void log_flush() {
+	// reported before taking the lock, the report itself goes through the rings
+	if (DRAIN_RUNNING.load(kstd::memory_order::acquire)) {
+		usize cpu_count = kstd::min(arch_get_cpu_count(), usize {CONFIG_MAX_CPUS});
+		for (usize i = 0; i < cpu_count; ++i) {
+			if (auto dropped = RINGS[i].dropped.exchange(0, kstd::memory_order::relaxed)) {
+				warnln("[kernel][log]: cpu ", i, " dropped ", dropped, " messages");
+			}
+		}
+	}
+
+	while (true) {
+		IrqGuard irq_guard {};
+		auto guard = LOG.lock();
+		if (!log_drain_batch(*guard)) {
+			break;
+		}
+	}
+}
+
+[[noreturn]] static void log_drain_fn(void*) {
+	while (true) {
+		log_flush();
+		get_current_thread()->sleep_for(DRAIN_INTERVAL);
+	}
+}
+
+void log_drain_init() {
+	auto* cpu = get_current_thread()->cpu;
+	auto* thread = new Thread {"log drain", cpu, &*KERNEL_PROCESS, log_drain_fn, nullptr};
+	DRAIN_RUNNING.store(true, kstd::memory_order::release);
+	cpu->scheduler.queue(thread);
+	cpu->thread_count.fetch_add(1, kstd::memory_order::seq_cst);
+}
+
+void Log::write(kstd::string_view str) {
+	for (auto& sink : sinks) {
+		sink.write(str);
+	}
+
+	// only the newest HISTORY_SIZE bytes are kept
+	if (str.size() > HISTORY_SIZE) {
+		history_end += str.size() - HISTORY_SIZE;
+		str = str.substr(str.size() - HISTORY_SIZE);
+	}
+
+	usize off = history_end % HISTORY_SIZE;
+	usize first = kstd::min(str.size(), HISTORY_SIZE - off);
+	memcpy(history + off, str.data(), first);
+	memcpy(history, str.data() + first, str.size() - first);
+	history_end += str.size();
+}
+
+void Log::set_color(Color color) {
+	for (auto& sink : sinks) {
+		sink.set_color(color);
+	}
+}
+
+usize Log::read_history(u64& pos, char* buffer, usize size) {
+	u64 start = history_end > HISTORY_SIZE ? history_end - HISTORY_SIZE : 0;
+	if (pos < start) {
+		pos = start;
+	}
+	if (pos >= history_end) {
+		pos = history_end;
+		return 0;
+	}
+
+	usize amount = kstd::min(size, static_cast<usize>(history_end - pos));
+	usize off = pos % HISTORY_SIZE;
+	usize first = kstd::min(amount, HISTORY_SIZE - off);
+	memcpy(buffer, history + off, first);
+	memcpy(buffer + first, history, amount - first);
+	pos += amount;
+	return amount;
+}
+
 void Log::register_sink(LogSink* sink) {
 	sink->registed = true;
 	sinks.push(sink);
 
-	for (usize i = 0; i < buf_ptr;) {
-		kstd::string_view str {buf + i};
-		sink->write(str);
-		i += str.size() + 1;
+	u64 pos = 0;
+	char buffer[256];
+	while (auto amount = read_history(pos, buffer, sizeof(buffer))) {
+		sink->write(kstd::string_view {buffer, amount});
 	}
 }
 
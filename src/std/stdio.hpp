@@ -1,4 +1,6 @@
 #pragma once
+#include "atomic.hpp"
+#include "config.hpp"
 #include "string_view.hpp"
 #include "types.hpp"
 #include "double_list.hpp"
@@ -40,68 +42,142 @@ constexpr Pad zero_pad(u32 amount) {
 	return Pad {'0', amount};
 }
 
+/// Importance of a message, lower is more important.
+enum class LogLevel : u8 {
+	Error,
+	Warn,
+	Info,
+	Debug
+};
+
+/// Messages less important than this are compiled out.
+inline constexpr LogLevel LOG_LEVEL_MAX = static_cast<LogLevel>(CONFIG_LOG_LEVEL);
+
+/// The registered sinks and a history of everything written to them, only touched by
+/// whoever drains the per-cpu log rings.
 class Log {
 public:
-	inline Log& operator<<(u8 value) {
+	void register_sink(LogSink* sink);
+	void unregister_sink(LogSink* sink);
+
+	void write(kstd::string_view str);
+	void set_color(Color color);
+
+	/// Copies history starting at byte `pos` of the log into `buffer` and advances `pos`,
+	/// a `pos` that was already overwritten skips to the oldest byte still kept.
+	usize read_history(u64& pos, char* buffer, usize size);
+
+private:
+	static constexpr usize HISTORY_SIZE = 0x10000;
+
+	DoubleList<LogSink, &LogSink::log_hook> sinks {};
+	char history[HISTORY_SIZE] {};
+	u64 history_end {};
+};
+
+extern Spinlock<Log> LOG;
+
+/// Formats a message on the stack, longer ones are committed in several pieces.
+class LogLine {
+public:
+	LogLine() = default;
+	~LogLine() {
+		flush();
+	}
+
+	LogLine(const LogLine&) = delete;
+	LogLine& operator=(const LogLine&) = delete;
+
+	inline LogLine& operator<<(u8 value) {
 		return operator<<(static_cast<usize>(value));
 	}
-	inline Log& operator<<(u16 value) {
+	inline LogLine& operator<<(u16 value) {
 		return operator<<(static_cast<usize>(value));
 	}
-	inline Log& operator<<(u32 value) {
+	inline LogLine& operator<<(u32 value) {
 		return operator<<(static_cast<usize>(value));
 	}
-	inline Log& operator<<(i8 value) {
+	inline LogLine& operator<<(i8 value) {
 		return operator<<(static_cast<isize>(value));
 	}
-	inline Log& operator<<(i16 value) {
+	inline LogLine& operator<<(i16 value) {
 		return operator<<(static_cast<isize>(value));
 	}
-	inline Log& operator<<(i32 value) {
+	inline LogLine& operator<<(i32 value) {
 		return operator<<(static_cast<isize>(value));
 	}
 
-	Log& operator<<(usize value);
-	Log& operator<<(isize value);
-	Log& operator<<(kstd::string_view str);
-	Log& operator<<(Fmt new_fmt);
-	Log& operator<<(Color new_color);
-	Log& operator<<(Pad new_pad);
+	LogLine& operator<<(usize value);
+	LogLine& operator<<(isize value);
+	LogLine& operator<<(kstd::string_view str);
+	LogLine& operator<<(Fmt new_fmt);
+	LogLine& operator<<(Color new_color);
+	LogLine& operator<<(Pad new_pad);
 
-	void register_sink(LogSink* sink);
-	void unregister_sink(LogSink* sink);
+	static constexpr usize MAX_SIZE = 192;
 
 private:
-	static constexpr usize LOG_SIZE = 0x2000;
+	void flush();
 
-	DoubleList<LogSink, &LogSink::log_hook> sinks {};
-	char buf[LOG_SIZE] {};
-	usize buf_ptr {};
+	char buf[MAX_SIZE];
+	usize size {};
+	/// Color to switch to before the buffered text if `has_color` is set.
+	Color color {};
+	bool has_color {};
 	Fmt fmt {};
 	Pad pad {};
 };
 
-extern Spinlock<Log> LOG;
+/// Queues `text` on the current cpu's log ring, or writes it straight to the sinks before
+/// the drain thread runs. The sinks switch to `color` first if it's given.
+void log_commit(kstd::string_view text, const Color* color = nullptr);
+/// Writes everything queued on any cpu to the sinks right away.
+void log_flush();
+/// Starts the thread that moves messages from the per-cpu rings to the sinks.
+void log_drain_init();
+
+extern kstd::atomic<LogLevel> LOG_LEVEL;
+
+template<LogLevel LEVEL, typename... Args>
+inline void log_print(Args... args) {
+	if constexpr (LEVEL <= LOG_LEVEL_MAX) {
+		if (LEVEL <= LOG_LEVEL.load(kstd::memory_order::relaxed)) {
+			LogLine line {};
+			((line << args), ...);
+		}
+	}
+}
 
 template<typename... Args>
 inline void print(Args... args) {
-	IrqGuard irq_guard {};
-	auto guard = LOG.lock();
-	((*guard << args), ...);
+	log_print<LogLevel::Info>(args...);
 }
 
 template<typename... Args>
 inline void println(Args... args) {
-	IrqGuard irq_guard {};
-	auto guard = LOG.lock();
-	((*guard << args), ...);
-	*guard << kstd::string_view {"\n"};
+	log_print<LogLevel::Info>(args..., kstd::string_view {"\n"});
+}
+
+template<typename... Args>
+inline void errorln(Args... args) {
+	log_print<LogLevel::Error>(args..., kstd::string_view {"\n"});
+}
+
+template<typename... Args>
+inline void warnln(Args... args) {
+	log_print<LogLevel::Warn>(args..., kstd::string_view {"\n"});
+}
+
+template<typename... Args>
+inline void debugln(Args... args) {
+	log_print<LogLevel::Debug>(args..., kstd::string_view {"\n"});
 }
 
 template<typename... Args>
 [[noreturn]] inline void panic(Args... args) {
 	IrqGuard irq_guard {};
-	println("KERNEL PANIC: ", args...);
+	errorln("KERNEL PANIC: ", args...);
+	log_flush();
 	while (true) {
 		arch_hlt();
 	}
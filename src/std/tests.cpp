@@ -1,6 +1,9 @@
 #include "vector.hpp"
 #include "vmem.hpp"
+#include "dev/net/checksum.hpp"
+#include "dev/net/tcp_connection.hpp"
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <utility>
 #include <vector>
 
@@ -58,3 +61,348 @@ TEST(memory, vector) {
 	other.push(10);
 	vec = other;
 }
+
+namespace {
+	/// Bottleneck link with a drop tail queue, random loss and jitter that reorders segments.
+	struct SimLink {
+		struct Packet {
+			u64 deliver_at;
+			TcpSegment segment;
+			std::vector<u8> payload;
+		};
+
+		u64 delay;
+		u64 jitter;
+		u32 loss_per_mille;
+		u64 ns_per_byte;
+		usize queue_limit;
+		u32 seed;
+		/// Segments with more payload are dropped and their sequence numbers recorded, like a router
+		/// sending fragmentation needed messages.
+		u32 max_len {UINT32_MAX};
+
+		std::vector<Packet> in_flight {};
+		std::vector<u32> too_big {};
+		u64 busy_until {};
+
+		u32 random() {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			return seed;
+		}
+
+		void send(const TcpSegment& segment, std::vector<u8> payload, u64 now) {
+			// round trip the options through the wire format
+			u8 options[TcpOptions::MAX_SIZE] {};
+			usize options_size = tcp_write_options(options, segment.options);
+			EXPECT_LE(options_size, TcpOptions::MAX_SIZE);
+			EXPECT_EQ(options_size % 4, 0u);
+
+			TcpSegment wire = segment;
+			EXPECT_TRUE(tcp_parse_options(options, options_size, wire.options));
+
+			if (segment.len > max_len) {
+				too_big.push_back(segment.seq);
+				return;
+			}
+
+			u64 start = std::max(now, busy_until);
+			if ((start - now) / ns_per_byte / 1500 > queue_limit || random() % 1000 < loss_per_mille) {
+				return;
+			}
+			busy_until = start + (segment.len + 54) * ns_per_byte;
+			u64 deliver_at = busy_until / 1000 + delay + (jitter ? random() % jitter : 0);
+			in_flight.push_back({deliver_at, wire, std::move(payload)});
+		}
+
+		u64 next_delivery() const {
+			u64 next = UINT64_MAX;
+			for (auto& packet : in_flight) {
+				next = std::min(next, packet.deliver_at);
+			}
+			return next;
+		}
+	};
+
+	void pump(TcpConnection& conn, SimLink& link, u64 now) {
+		TcpSegment segment {};
+		while (conn.next_segment(segment, now)) {
+			std::vector<u8> payload(segment.len);
+			if (segment.len) {
+				conn.copy_payload(segment.seq, payload.data(), segment.len);
+			}
+			link.send(segment, std::move(payload), now * 1000);
+		}
+	}
+
+	void deliver(TcpConnection& conn, SimLink& link, u64 now, bool& accepted) {
+		for (usize i = 0; i < link.in_flight.size();) {
+			if (link.in_flight[i].deliver_at > now) {
+				++i;
+				continue;
+			}
+
+			auto packet = std::move(link.in_flight[i]);
+			link.in_flight.erase(link.in_flight.begin() + static_cast<isize>(i));
+
+			if (!accepted) {
+				if (packet.segment.flags == tcp_flags::SYN) {
+					conn.accept(packet.segment, 0xFFFF0000, now);
+					accepted = true;
+				}
+				continue;
+			}
+			conn.on_segment(packet.segment, packet.payload.data(), now);
+		}
+	}
+
+	/// Sends `size` bytes from a client to a server over a pair of simulated links and checks
+	/// that they arrive intact and both sides close, returns the client for inspecting its stats.
+	TcpStats transfer(
+		CongestionAlgorithm algorithm,
+		u32 loss_per_mille,
+		u64 delay,
+		u64 jitter,
+		usize size,
+		u32 path_mss = 1460) {
+		TcpConfig config {
+			.send_buffer_size = 1024 * 128,
+			.receive_buffer_size = 1024 * 256,
+			.mss = 1460,
+			.path_mss = 1460,
+			.max_burst = 1460,
+			.congestion = algorithm
+		};
+		TcpConnection client {config};
+		TcpConnection server {config};
+
+		SimLink uplink {delay, jitter, loss_per_mille, 80, 64, 0x12345678};
+		SimLink downlink {delay, jitter, loss_per_mille, 80, 64, 0x9ABCDEF0};
+		uplink.max_len = path_mss;
+
+		std::vector<u8> data(size);
+		for (usize i = 0; i < size; ++i) {
+			data[i] = static_cast<u8>(i * 7 + i / 251);
+		}
+		std::vector<u8> received;
+		received.reserve(size);
+
+		u64 now = 0;
+		client.connect(0xFFFFF000, now);
+
+		usize written = 0;
+		bool accepted = false;
+		bool server_closed = false;
+		while (now < 600ULL * 1000 * 1000) {
+			written += client.write(data.data() + written, size - written);
+			if (written == size) {
+				client.close();
+			}
+
+			u8 buffer[4096];
+			while (usize count = server.read(buffer, sizeof(buffer))) {
+				received.insert(received.end(), buffer, buffer + count);
+			}
+			if (accepted && server.receive_closed() && !server_closed) {
+				server.close();
+				server_closed = true;
+			}
+
+			pump(client, uplink, now);
+			pump(server, downlink, now);
+			if (!uplink.too_big.empty()) {
+				// only the first report for the window lowers the mss
+				bool lowered = false;
+				for (u32 seq : uplink.too_big) {
+					lowered |= client.on_path_mss(seq, path_mss, now);
+				}
+				uplink.too_big.clear();
+				EXPECT_TRUE(lowered);
+				pump(client, uplink, now);
+			}
+
+			auto client_state = client.get_state();
+			if ((client_state == TcpConnection::State::TimeWait || client_state == TcpConnection::State::Closed) &&
+				server.get_state() == TcpConnection::State::Closed) {
+				break;
+			}
+
+			u64 next = std::min({
+				uplink.next_delivery(),
+				downlink.next_delivery(),
+				client.next_deadline(),
+				server.next_deadline()
+			});
+			if (next == UINT64_MAX) {
+				break;
+			}
+			now = std::max(now, next);
+
+			deliver(server, uplink, now, accepted);
+			bool client_accepted = true;
+			deliver(client, downlink, now, client_accepted);
+			client.on_timer(now);
+			server.on_timer(now);
+		}
+
+		EXPECT_FALSE(client.was_reset());
+		EXPECT_FALSE(server.was_reset());
+		EXPECT_EQ(server.get_state(), TcpConnection::State::Closed);
+		EXPECT_EQ(received.size(), size);
+		EXPECT_TRUE(received == data);
+		return client.stats;
+	}
+}
+
+TEST(tcp, clean_link) {
+	auto stats = transfer(CongestionAlgorithm::NewReno, 0, 10 * 1000, 0, 1024 * 1024);
+	EXPECT_EQ(stats.timeouts, 0u);
+}
+
+TEST(tcp, lossy_link_new_reno) {
+	auto stats = transfer(CongestionAlgorithm::NewReno, 20, 20 * 1000, 0, 1024 * 1024);
+	EXPECT_GT(stats.fast_retransmits, 0u);
+}
+
+TEST(tcp, lossy_link_cubic) {
+	auto stats = transfer(CongestionAlgorithm::Cubic, 20, 20 * 1000, 0, 1024 * 1024);
+	EXPECT_GT(stats.fast_retransmits, 0u);
+}
+
+TEST(tcp, reordering_link) {
+	transfer(CongestionAlgorithm::Cubic, 5, 5 * 1000, 8 * 1000, 512 * 1024);
+}
+
+TEST(tcp, path_mtu_discovery) {
+	auto stats = transfer(CongestionAlgorithm::Cubic, 0, 10 * 1000, 0, 512 * 1024, 1200);
+	// the first window is sent again at the smaller size without waiting for a timeout
+	EXPECT_GT(stats.retransmits, 0u);
+	EXPECT_EQ(stats.timeouts, 0u);
+}
+
+TEST(tcp, options) {
+	TcpOptions options {
+		.mss = 1460,
+		.window_scale = 7,
+		.has_window_scale = true,
+		.sack_permitted = true,
+		.has_timestamp = true,
+		.ts_val = 0x12345678,
+		.ts_ecr = 0x9ABCDEF0,
+		.sack_count = 0,
+		.sack {}
+	};
+	u8 buffer[TcpOptions::MAX_SIZE];
+	auto size = tcp_write_options(buffer, options);
+	EXPECT_EQ(size, 20u);
+
+	TcpOptions parsed {};
+	EXPECT_TRUE(tcp_parse_options(buffer, size, parsed));
+	EXPECT_EQ(parsed.mss, 1460);
+	EXPECT_EQ(parsed.window_scale, 7);
+	EXPECT_TRUE(parsed.sack_permitted);
+	EXPECT_EQ(parsed.ts_ecr, 0x9ABCDEF0u);
+
+	u8 truncated[] {8, 10, 0, 0};
+	EXPECT_FALSE(tcp_parse_options(truncated, sizeof(truncated), parsed));
+}
+
+namespace {
+	u16 reference_checksum(const u8* data, usize size) {
+		u64 sum = 0;
+		for (usize i = 0; i + 1 < size; i += 2) {
+			sum += data[i] << 8 | data[i + 1];
+		}
+		if (size & 1) {
+			sum += data[size - 1] << 8;
+		}
+		while (sum >> 16) {
+			sum = (sum & 0xFFFF) + (sum >> 16);
+		}
+		return ~sum;
+	}
+
+	u16 stored_value(u16 checksum) {
+		u8 bytes[2];
+		memcpy(bytes, &checksum, 2);
+		return bytes[0] << 8 | bytes[1];
+	}
+}
+
+TEST(checksum, matches_reference) {
+	std::vector<u8> buffer(3 * 1024 * 1024);
+	for (auto& byte : buffer) {
+		byte = rand();
+	}
+
+	for (int i = 0; i < 2000; ++i) {
+		usize size = rand() % 4096;
+		usize start = rand() % 64;
+		auto* data = buffer.data() + start;
+
+		// split into blocks of arbitrary size, which may start in the middle of a word
+		usize first = size ? rand() % (size + 1) : 0;
+		usize second = rand() % (size - first + 1);
+		Checksum sum;
+		sum.add(data, first);
+		sum.add(data + first, second);
+		sum.add(data + first + second, size - first - second);
+		EXPECT_EQ(stored_value(sum.get()), reference_checksum(data, size));
+	}
+
+	// long enough to drain the vector accumulators several times
+	std::fill(buffer.begin(), buffer.end(), 0xFF);
+	buffer.back() = 0x12;
+	Checksum sum;
+	sum.add(buffer.data() + 1, buffer.size() - 1);
+	EXPECT_EQ(stored_value(sum.get()), reference_checksum(buffer.data() + 1, buffer.size() - 1));
+}
+
+TEST(checksum, copy) {
+	std::vector<u8> src(9000);
+	std::vector<u8> dest(src.size());
+	for (auto& byte : src) {
+		byte = rand();
+	}
+
+	for (usize size : {0, 1, 3, 63, 64, 65, 1461, 9000}) {
+		// the copied part starts at an odd offset
+		usize prefix = kstd::min(size, usize {5});
+		Checksum copied;
+		copied.add(src.data(), prefix);
+		copied.add_copy(dest.data(), src.data() + prefix, size - prefix);
+		Checksum plain;
+		plain.add(src.data(), size);
+		EXPECT_EQ(copied.get(), plain.get());
+		EXPECT_TRUE(std::equal(dest.begin(), dest.begin() + (size - prefix), src.begin() + prefix));
+	}
+}
+
+TEST(checksum, incremental_update) {
+	for (int i = 0; i < 1000; ++i) {
+		u16 header[10];
+		for (auto& word : header) {
+			word = rand();
+		}
+		header[5] = 0;
+		Checksum sum;
+		sum.add(header, sizeof(header));
+		header[5] = sum.get();
+
+		u16 old_word = header[1];
+		header[1] = rand();
+		header[5] = checksum_update(header[5], old_word, header[1]);
+
+		u32 old_addr;
+		memcpy(&old_addr, &header[6], 4);
+		u32 new_addr = rand();
+		memcpy(&header[6], &new_addr, 4);
+		header[5] = checksum_update32(header[5], old_addr, new_addr);
+
+		// a header with a correct checksum sums to zero
+		Checksum verify;
+		verify.add(header, sizeof(header));
+		EXPECT_EQ(verify.get(), 0);
+	}
+}
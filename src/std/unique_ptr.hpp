@@ -1,6 +1,11 @@
 #pragma once
 #include "utility.hpp"
+
+#ifdef TESTING
+#include <cassert>
+#else
 #include "assert.hpp"
+#endif
 
 namespace kstd {
 	template<typename T>
@@ -168,6 +168,16 @@ namespace kstd {
 			return nullptr;
 		}
 
+		/// Calls `fn(key, value)` for every element in no particular order.
+		template<typename F>
+		void for_each(F fn) {
+			for (auto& bucket : table) {
+				if (bucket) {
+					fn(bucket->key, bucket->value);
+				}
+			}
+		}
+
 	private:
 		static uint64_t fnv_hash(const void* data, size_t size) {
 			uint64_t hash = 0xCBF29CE484222000;
@@ -13,6 +13,9 @@ namespace kstd {
 	};
 }
 
+#ifdef TESTING
+#include <utility>
+#else
 namespace std {
 	template<typename T>
 	constexpr kstd::remove_reference_t<T>&& move(T&& value) {
@@ -29,3 +32,4 @@ namespace std {
 		return static_cast<T&&>(value);
 	}
 }
+#endif
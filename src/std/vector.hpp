@@ -8,6 +8,7 @@
 #include <cstdlib>
 #include <cassert>
 #include <cstring>
+#include <new>
 
 class Allocator {
 public:
@@ -29,7 +30,7 @@ public:
 		::free(ptr);
 	}
 };
-Allocator ALLOCATOR {};
+inline Allocator ALLOCATOR {};
 
 #else
 #include "mem/malloc.hpp"
@@ -40,6 +40,11 @@ struct Socket {
 
 	virtual int get_peer_name(AnySocketAddress& address) = 0;
 
+	/// Restricts the socket to the nic with the given index, `UINT32_MAX` removes the restriction.
+	virtual int bind_interface(u32 index) {
+		return ERR_UNSUPPORTED;
+	}
+
 protected:
 	int flags;
 };
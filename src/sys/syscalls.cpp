@@ -2,6 +2,7 @@
 #include "user_access.hpp"
 #include "arch/cpu.hpp"
 #include "crescent/devlink.h"
+#include "crescent/mem.h"
 #include "crescent/syscalls.h"
 #include "crescent/socket.h"
 #include "event_queue.hpp"
@@ -15,7 +16,11 @@
 #include "sched/ipc.hpp"
 #include "dev/net/tcp.hpp"
 #include "dev/net/udp.hpp"
+#include "dev/net/nic/nic.hpp"
 #include "dev/date_time_provider.hpp"
+#include "mem/mem.hpp"
+#include "utils/profiler.hpp"
+#include "utils/trace.hpp"
 
 #ifdef __x86_64__
 #include "acpi/sleep.hpp"
@@ -42,10 +47,72 @@ static usize socket_address_type_to_size(SocketAddressType type) {
 
 void handle_posix_syscall(usize num, SyscallFrame* frame);
 
+static int devlink_specific(Process& process, const DevLink& link, const DevLinkRequest& req) {
+	if (req.size > DEVLINK_BUFFER_SIZE) {
+		return ERR_INVALID_ARGUMENT;
+	}
+	if (link.response_buf_size < sizeof(DevLinkResponse)) {
+		return ERR_BUFFER_TOO_SMALL;
+	}
+
+	auto handle = process.handles.get(req.handle);
+	DeviceHandle* device;
+	if (!handle || !(device = handle->get<DeviceHandle>())) {
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	// both are bounded by DEVLINK_BUFFER_SIZE, so they live on the stack instead of being allocated
+	// for every request, payloads larger than that are accessed in user memory by the device
+	alignas(16) u8 req_data[DEVLINK_BUFFER_SIZE];
+	alignas(16) u8 res_data[DEVLINK_BUFFER_SIZE];
+
+	if (!UserAccessor(link.request).load(req_data, req.size)) {
+		return ERR_FAULT;
+	}
+
+	usize res_size = kstd::min(link.response_buf_size - sizeof(DevLinkResponse), usize {DEVLINK_BUFFER_SIZE});
+	auto status = device->device->handle_request({req_data, req.size}, res_data, res_size);
+	if (status != 0) {
+		return status;
+	}
+
+	DevLinkResponse resp {
+		.size = sizeof(DevLinkResponse) + res_size,
+		.specific = offset(link.response_buffer, void*, sizeof(DevLinkResponse))
+	};
+	if (!UserAccessor(link.response_buffer).store(resp) ||
+		!UserAccessor(link.response_buffer + sizeof(DevLinkResponse)).store(res_data, res_size)) {
+		return ERR_FAULT;
+	}
+
+	return 0;
+}
+
+namespace {
+	/// Makes the time spent in the syscall count as kernel time of the thread.
+	struct SyscallAccounting {
+		explicit SyscallAccounting(Thread* thread) : thread {thread} {
+			thread->set_in_syscall(true);
+		}
+
+		~SyscallAccounting() {
+			thread->set_in_syscall(false);
+		}
+
+		SyscallAccounting(const SyscallAccounting&) = delete;
+		SyscallAccounting& operator=(const SyscallAccounting&) = delete;
+
+		Thread* thread;
+	};
+}
+
 extern "C" void syscall_handler(SyscallFrame* frame) {
 	auto num = *frame->num();
+	SyscallAccounting accounting {get_current_thread()};
+	TraceScope<TRACE_EVENT_SYSCALL_ENTER, TRACE_EVENT_SYSCALL_EXIT> trace_scope {num};
 	if (num >= SYS_POSIX_START) {
 		handle_posix_syscall(num, frame);
+		trace_scope.result = *frame->ret();
 		return;
 	}
 
@@ -124,9 +191,15 @@ extern "C" void syscall_handler(SyscallFrame* frame) {
 				break;
 			}
 
+			if (process_info.arg_count > SYSV_MAX_ARGS) {
+				*frame->ret() = ERR_INVALID_ARGUMENT;
+				break;
+			}
+
 			kstd::vector<kstd::string> args;
 			args.resize(process_info.arg_count);
 			bool success = true;
+			usize args_size = 0;
 			for (usize i = 0; i < process_info.arg_count; ++i) {
 				CrescentStringView view;
 				if (!UserAccessor(offset(process_info.args, void*, i * sizeof(CrescentStringView))).load(view)) {
@@ -134,6 +207,12 @@ extern "C" void syscall_handler(SyscallFrame* frame) {
 					success = false;
 					break;
 				}
+				args_size += view.len + 1;
+				if (view.len >= SYSV_MAX_ARGS_SIZE || args_size > SYSV_MAX_ARGS_SIZE) {
+					*frame->ret() = ERR_INVALID_ARGUMENT;
+					success = false;
+					break;
+				}
 				args[i].resize_without_null(view.len);
 				if (!UserAccessor(view.str).load(args[i].data(), view.len)) {
 					*frame->ret() = ERR_FAULT;
@@ -215,7 +294,8 @@ extern "C" void syscall_handler(SyscallFrame* frame) {
 				.ld_base = ld_elf_result.value().base,
 				.exe_phdrs_addr = elf_result.value().phdrs_addr,
 				.exe_phdr_count = elf_result.value().phdr_count,
-				.exe_phdr_size = elf_result.value().phdr_size
+				.exe_phdr_size = elf_result.value().phdr_size,
+				.args {args.data(), args.size()}
 			};
 
 			auto descriptor = kstd::make_shared<ProcessDescriptor>(process, 0);
@@ -395,6 +475,179 @@ extern "C" void syscall_handler(SyscallFrame* frame) {
 			*frame->ret() = 0;
 			break;
 		}
+		case SYS_SYSLOG_READ:
+		{
+			u64 pos;
+			if (!UserAccessor(*frame->arg2()).load(pos)) {
+				*frame->ret() = ERR_FAULT;
+				break;
+			}
+
+			auto buffer = *frame->arg0();
+			usize size = *frame->arg1();
+
+			// copied through the stack so user memory is never touched with the log locked
+			char chunk[512];
+			usize total = 0;
+			int status = 0;
+			while (total < size) {
+				usize amount;
+				{
+					IrqGuard irq_guard {};
+					amount = LOG.lock()->read_history(pos, chunk, kstd::min(size - total, sizeof(chunk)));
+				}
+				if (!amount) {
+					break;
+				}
+
+				if (!UserAccessor(buffer + total).store(chunk, amount)) {
+					status = ERR_FAULT;
+					break;
+				}
+				total += amount;
+			}
+
+			if (!UserAccessor(*frame->arg2()).store(pos) ||
+				!UserAccessor(*frame->arg3()).store(total)) {
+				status = ERR_FAULT;
+			}
+
+			*frame->ret() = status;
+			break;
+		}
+		case SYS_SYSLOG_SET_LEVEL:
+		{
+			static_assert(static_cast<int>(LogLevel::Error) == LOG_LEVEL_ERROR);
+			static_assert(static_cast<int>(LogLevel::Debug) == LOG_LEVEL_DEBUG);
+
+			auto level = *frame->arg0();
+			if (level > static_cast<usize>(LOG_LEVEL_DEBUG)) {
+				*frame->ret() = ERR_INVALID_ARGUMENT;
+				break;
+			}
+			else if (static_cast<LogLevel>(level) > LOG_LEVEL_MAX) {
+				*frame->ret() = ERR_UNSUPPORTED;
+				break;
+			}
+
+			auto old = LOG_LEVEL.exchange(static_cast<LogLevel>(level), kstd::memory_order::relaxed);
+			if (auto old_addr = *frame->arg1()) {
+				if (!UserAccessor(old_addr).store(static_cast<CrescentLogLevel>(old))) {
+					*frame->ret() = ERR_FAULT;
+					break;
+				}
+			}
+
+			*frame->ret() = 0;
+			break;
+		}
+		case SYS_TRACE_CONTROL:
+			*frame->ret() = trace_set_mask(*frame->arg0());
+			break;
+		case SYS_TRACE_READ:
+		{
+			auto buffer = *frame->arg0();
+			usize count = *frame->arg1();
+
+			// moved through the stack so user memory is never touched with the buffers locked
+			TraceRecord chunk[32];
+			usize total = 0;
+			int status = 0;
+			while (total < count) {
+				auto amount = trace_read(chunk, kstd::min(count - total, sizeof(chunk) / sizeof(*chunk)));
+				if (!amount) {
+					break;
+				}
+
+				if (!UserAccessor(buffer + total * sizeof(TraceRecord)).store(chunk, amount * sizeof(TraceRecord))) {
+					status = ERR_FAULT;
+					break;
+				}
+				total += amount;
+			}
+
+			if (!UserAccessor(*frame->arg2()).store(total)) {
+				status = ERR_FAULT;
+			}
+
+			*frame->ret() = status;
+			break;
+		}
+		case SYS_PROFILE_CONTROL:
+			*frame->ret() = profile_set_interval(*frame->arg0());
+			break;
+		case SYS_PROFILE_READ:
+		{
+			auto buffer = *frame->arg0();
+			usize count = *frame->arg1();
+
+			// same as for trace records, samples are moved through the stack
+			ProfileSample chunk[4];
+			usize total = 0;
+			u64 lost = 0;
+			int status = 0;
+			while (total < count) {
+				auto amount = profile_read(chunk, kstd::min(count - total, sizeof(chunk) / sizeof(*chunk)), lost);
+				if (!amount) {
+					break;
+				}
+
+				if (!UserAccessor(buffer + total * sizeof(ProfileSample)).store(chunk, amount * sizeof(ProfileSample))) {
+					status = ERR_FAULT;
+					break;
+				}
+				total += amount;
+			}
+
+			if (!UserAccessor(*frame->arg2()).store(total) ||
+				!UserAccessor(*frame->arg3()).store(lost)) {
+				status = ERR_FAULT;
+			}
+
+			*frame->ret() = status;
+			break;
+		}
+		case SYS_GET_SCHED_STATS:
+		{
+			usize count = *frame->arg1();
+
+			kstd::vector<SchedStatsEntry> entries;
+			sched_get_stats(entries);
+
+			int status = 0;
+			if (entries.size() > count) {
+				status = ERR_BUFFER_TOO_SMALL;
+			}
+			else if (!UserAccessor(*frame->arg0()).store(entries.data(), entries.size() * sizeof(SchedStatsEntry))) {
+				status = ERR_FAULT;
+			}
+
+			// the needed count is reported even if the buffer was too small
+			if (!UserAccessor(*frame->arg2()).store(entries.size())) {
+				status = ERR_FAULT;
+			}
+
+			*frame->ret() = status;
+			break;
+		}
+		case SYS_GET_MEM_STATS:
+		{
+			auto zero_pool = pmalloc_get_zero_pool_stats();
+			MemStats stats {
+				.total = pmalloc_get_total_mem(),
+				.reserved = pmalloc_get_reserved_mem(),
+				.used = pmalloc_get_used_mem(),
+				.zero_pool_pages = zero_pool.pages,
+				.zero_pool_hits = zero_pool.hits,
+				.zero_pool_misses = zero_pool.misses
+			};
+			if (!UserAccessor(*frame->arg0()).store(stats)) {
+				*frame->ret() = ERR_FAULT;
+				break;
+			}
+			*frame->ret() = 0;
+			break;
+		}
 		case SYS_MAP:
 		{
 			void* ptr;
@@ -570,51 +823,53 @@ extern "C" void syscall_handler(SyscallFrame* frame) {
 					break;
 				}
 				case DevLinkRequestSpecific:
+					*frame->ret() = devlink_specific(*thread->process, link, req);
+					break;
+				case DevLinkRequestBatch:
 				{
-					if (req.size > DEVLINK_BUFFER_SIZE) {
-						*frame->ret() = ERR_INVALID_ARGUMENT;
-						break;
-					}
-
-					auto handle = thread->process->handles.get(req.handle);
-					DeviceHandle* device;
-					if (!handle || !(device = handle->get<DeviceHandle>())) {
+					auto count = req.data.batch.count;
+					if (count > DEVLINK_MAX_BATCH) {
 						*frame->ret() = ERR_INVALID_ARGUMENT;
 						break;
 					}
-
-					kstd::vector<u8> req_data;
-					req_data.resize(req.size);
-					if (!UserAccessor(link.request).load(req_data.data(), req_data.size())) {
-						*frame->ret() = ERR_FAULT;
-						break;
-					}
-
 					if (link.response_buf_size < sizeof(DevLinkResponse)) {
 						*frame->ret() = ERR_BUFFER_TOO_SMALL;
 						break;
 					}
 
-					kstd::vector<u8> resp_data;
-					auto status = (*device).device->handle_request(req_data, resp_data, link.response_buf_size - sizeof(DevLinkResponse));
-					*frame->ret() = status;
-
-					DevLinkResponse resp {
-						.size = sizeof(DevLinkResponse) + resp_data.size(),
-						.specific = offset(link.response_buffer, void*, sizeof(DevLinkResponse))
-					};
+					int status = 0;
+					usize completed = 0;
+					for (; completed < count; ++completed) {
+						DevLink entry_link {};
+						DevLinkRequest entry_req {};
+						if (!UserAccessor(req.data.batch.links + completed).load(entry_link) ||
+							!UserAccessor(entry_link.request).load(entry_req)) {
+							status = ERR_FAULT;
+							break;
+						}
 
-					if (status == 0) {
-						if (!UserAccessor(link.response_buffer).store(resp)) {
-							*frame->ret() = ERR_FAULT;
+						if (entry_req.type != DevLinkRequestSpecific) {
+							status = ERR_INVALID_ARGUMENT;
 							break;
 						}
-						if (!UserAccessor(link.response_buffer + sizeof(DevLinkResponse)).store(resp_data.data(), resp_data.size())) {
-							*frame->ret() = ERR_FAULT;
+
+						status = devlink_specific(*thread->process, entry_link, entry_req);
+						if (status != 0) {
 							break;
 						}
 					}
 
+					DevLinkResponse resp {
+						.size = sizeof(DevLinkResponse),
+						.batch {
+							.completed = completed
+						}
+					};
+					if (!UserAccessor(link.response).store(resp)) {
+						status = ERR_FAULT;
+					}
+
+					*frame->ret() = status;
 					break;
 				}
 			}
@@ -1222,6 +1477,46 @@ extern "C" void syscall_handler(SyscallFrame* frame) {
 
 			break;
 		}
+		case SYS_SOCKET_BIND_INTERFACE:
+		{
+			auto user_handle = static_cast<CrescentHandle>(*frame->arg0());
+			auto index = static_cast<u32>(*frame->arg1());
+			auto handle = thread->process->handles.get(user_handle);
+			kstd::shared_ptr<Socket>* socket_ptr;
+			if (!handle || !(socket_ptr = handle->get<kstd::shared_ptr<Socket>>())) {
+				*frame->ret() = ERR_INVALID_ARGUMENT;
+				break;
+			}
+
+			*frame->ret() = (*socket_ptr)->bind_interface(index);
+			break;
+		}
+		case SYS_NIC_SET_IRQ_COALESCING:
+		{
+			auto nic = nics_get(static_cast<u32>(*frame->arg0()));
+			if (!nic) {
+				*frame->ret() = ERR_INVALID_ARGUMENT;
+				break;
+			}
+
+			auto max_frames = static_cast<u32>(*frame->arg1());
+			auto max_usecs = static_cast<u32>(*frame->arg2());
+			*frame->ret() = nic->set_irq_coalescing(max_frames, max_usecs) ? 0 : ERR_UNSUPPORTED;
+			break;
+		}
+		case SYS_NIC_GET_RX_STATS:
+		{
+			auto nic = nics_get(static_cast<u32>(*frame->arg0()));
+			if (!nic) {
+				*frame->ret() = ERR_INVALID_ARGUMENT;
+				break;
+			}
+
+			NicRxStats stats {};
+			nic->get_rx_stats(stats);
+			*frame->ret() = UserAccessor(*frame->arg1()).store(stats) ? 0 : ERR_FAULT;
+			break;
+		}
 		case SYS_SHARED_MEM_ALLOC:
 		{
 			usize size = *frame->arg1();
@@ -1229,7 +1524,7 @@ extern "C" void syscall_handler(SyscallFrame* frame) {
 			bool success = true;
 
 			for (usize i = 0; i < size; i += PAGE_SIZE) {
-				auto page = pmalloc(1);
+				auto page = pmalloc_zeroed(1);
 				if (!page) {
 					success = false;
 					*frame->ret() = ERR_NO_MEM;
@@ -1685,6 +1980,86 @@ extern "C" void syscall_handler(SyscallFrame* frame) {
 
 			break;
 		}
+		case SYS_MAP_FILE:
+		{
+			auto user_handle = static_cast<CrescentHandle>(*frame->arg0());
+			usize offset = *frame->arg1();
+			usize size = *frame->arg2();
+
+			auto handle = thread->process->handles.get(user_handle);
+			kstd::shared_ptr<OpenFile>* file_ptr;
+			if (!handle || !(file_ptr = handle->get<kstd::shared_ptr<OpenFile>>())) {
+				*frame->ret() = ERR_INVALID_ARGUMENT;
+				break;
+			}
+			auto& file = *file_ptr;
+
+			FsStat stat {};
+			if (file->node->stat(stat) != FsStatus::Success) {
+				*frame->ret() = ERR_UNSUPPORTED;
+				break;
+			}
+
+			if (!size || offset > stat.size || size > stat.size - offset) {
+				*frame->ret() = ERR_INVALID_ARGUMENT;
+				break;
+			}
+
+			// only files that are already resident in memory can be mapped,
+			// their pages are shared read-only between every process that maps them
+			usize phys;
+			if (file->node->get_phys(phys, offset) != FsStatus::Success) {
+				*frame->ret() = ERR_UNSUPPORTED;
+				break;
+			}
+
+			auto page_offset = phys & (PAGE_SIZE - 1);
+			auto phys_base = phys - page_offset;
+			auto map_size = ALIGNUP(page_offset + size, PAGE_SIZE);
+
+			auto mem = thread->process->allocate(
+				nullptr,
+				map_size,
+				PageFlags::Read,
+				MemoryAllocFlags::File,
+				nullptr);
+			if (!mem) {
+				*frame->ret() = ERR_NO_MEM;
+				break;
+			}
+
+			bool success = true;
+			for (usize i = 0; i < map_size; i += PAGE_SIZE) {
+				if (!thread->process->page_map.map(
+					mem + i,
+					phys_base + i,
+					PageFlags::Read | PageFlags::User,
+					CacheMode::WriteBack)) {
+					success = false;
+					break;
+				}
+			}
+
+			if (!success) {
+				thread->process->free(mem, map_size);
+				*frame->ret() = ERR_NO_MEM;
+				break;
+			}
+
+			if (!UserAccessor(*frame->arg3()).store(reinterpret_cast<void*>(mem + page_offset))) {
+				thread->process->free(mem, map_size);
+				*frame->ret() = ERR_FAULT;
+				break;
+			}
+
+			*frame->ret() = 0;
+			break;
+		}
+		case SYS_GET_CPU_COUNT:
+		{
+			*frame->ret() = arch_get_cpu_count();
+			break;
+		}
 		case SYS_PIPE_CREATE:
 		{
 			auto max_size = static_cast<size_t>(*frame->arg2());
@@ -2188,4 +2563,6 @@ extern "C" void syscall_handler(SyscallFrame* frame) {
 			*frame->ret() = ERR_INVALID_ARGUMENT;
 			break;
 	}
+
+	trace_scope.result = *frame->ret();
 }
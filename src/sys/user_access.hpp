@@ -31,3 +31,34 @@ struct UserAccessor {
 private:
 	usize addr;
 };
+
+/// A range of user memory accessed in place, so large payloads don't have to be copied
+/// into a kernel buffer first. Accesses are relative to the start and checked against the size.
+struct UserSpan {
+	constexpr UserSpan() = default;
+	constexpr UserSpan(usize addr, usize size) : addr {addr}, size {size} {}
+	template<typename T>
+	inline UserSpan(T* ptr, usize size) : addr {reinterpret_cast<usize>(ptr)}, size {size} {}
+
+	/// Returns false if the range wraps around the address space.
+	[[nodiscard]] constexpr bool is_valid() const {
+		return addr + size >= addr;
+	}
+
+	inline bool load(usize offset, void* data, usize len) const {
+		if (offset > size || len > size - offset) {
+			return false;
+		}
+		return mem_copy_to_kernel(data, addr + offset, len);
+	}
+
+	inline bool store(usize offset, const void* data, usize len) const {
+		if (offset > size || len > size - offset) {
+			return false;
+		}
+		return mem_copy_to_user(addr + offset, data, len);
+	}
+
+	usize addr {};
+	usize size {};
+};
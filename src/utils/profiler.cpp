@@ -0,0 +1,189 @@
+#include "profiler.hpp"
+#include "arch/cpu.hpp"
+#include "arch/paging.hpp"
+#include "cstring.hpp"
+#include "mem/mem.hpp"
+#include "sched/process.hpp"
+#include "trace.hpp"
+#include "utils/irq_guard.hpp"
+#include "utils/spinlock.hpp"
+
+kstd::atomic<u64> PROFILE_INTERVAL_US {};
+
+namespace {
+	/// Only written by its own cpu from the tick irq and only read with `PROFILE_READ_LOCK` held.
+	struct ProfileRing {
+		static constexpr usize SIZE = 512;
+
+		ProfileSample* samples {};
+		u64 head {};
+		u64 tail {};
+		kstd::atomic<u64> lost {};
+	};
+
+	ProfileRing RINGS[CONFIG_MAX_CPUS] {};
+	Spinlock<void> PROFILE_READ_LOCK {};
+
+	/// Anything faster mostly measures the tick irq itself.
+	constexpr u64 MIN_INTERVAL_US = 100;
+}
+
+/// Follows the frame pointer chain on the thread's kernel stack, every frame has to be above
+/// the previous one so a corrupted chain can't send the walk anywhere else.
+static usize walk_kernel_stack(const Thread* thread, usize fp, u64* frames, usize max) {
+	if (!thread->kernel_stack_base) {
+		return 0;
+	}
+
+	// the lowest page is the guard page
+	auto stack_start = reinterpret_cast<usize>(thread->kernel_stack_base) + PAGE_SIZE;
+	auto stack_end = reinterpret_cast<usize>(thread->syscall_sp);
+
+	usize depth = 0;
+	while (depth < max && fp >= stack_start && fp + 16 <= stack_end && !(fp & 7)) {
+		auto* frame = reinterpret_cast<const usize*>(fp);
+		if (!frame[1]) {
+			break;
+		}
+		frames[depth++] = frame[1];
+		if (frame[0] <= fp) {
+			break;
+		}
+		fp = frame[0];
+	}
+	return depth;
+}
+
+#ifdef __x86_64__
+
+/// Reads user memory through the page tables, the irq can't take a page fault on it.
+static bool load_user_word(PageMap& map, usize addr, usize& value) {
+	// user addresses are in the lower half
+	if ((addr & 7) || (addr >> 47)) {
+		return false;
+	}
+	auto phys = map.get_phys(addr);
+	if (!(phys & ~(PAGE_SIZE - 1))) {
+		return false;
+	}
+	value = *to_virt<usize>(phys);
+	return true;
+}
+
+static usize walk_user_stack(Process* process, usize fp, u64* frames, usize max) {
+	usize depth = 0;
+	while (depth < max) {
+		usize next;
+		usize ret;
+		if (!load_user_word(process->page_map, fp, next) ||
+			!load_user_word(process->page_map, fp + 8, ret) ||
+			!ret) {
+			break;
+		}
+		frames[depth++] = ret;
+		if (next <= fp) {
+			break;
+		}
+		fp = next;
+	}
+	return depth;
+}
+
+#else
+
+// the page tables can't be walked without their lock here, so only the pc is recorded
+static usize walk_user_stack(Process*, usize, u64*, usize) {
+	return 0;
+}
+
+#endif
+
+void profile_sample(bool user, usize pc, usize fp) {
+	auto* thread = get_current_thread();
+	auto cpu = thread->cpu->number;
+	auto& ring = RINGS[cpu];
+	auto* samples = __atomic_load_n(&ring.samples, __ATOMIC_ACQUIRE);
+	if (!samples) {
+		return;
+	}
+
+	auto head = ring.head;
+	if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) == ProfileRing::SIZE) {
+		ring.lost.fetch_add(1, kstd::memory_order::relaxed);
+		return;
+	}
+
+	auto& sample = samples[head % ProfileRing::SIZE];
+	sample.timestamp = get_current_ns();
+	sample.thread = trace_thread_id(thread);
+
+	kstd::string_view name = thread->process->name;
+	usize name_len = kstd::min(name.size(), sizeof(sample.process_name) - 1);
+	memcpy(sample.process_name, name.data(), name_len);
+	sample.process_name[name_len] = 0;
+
+	sample.cpu = cpu;
+	sample.flags = user ? PROFILE_SAMPLE_USER : 0;
+	sample.frames[0] = pc;
+	usize depth = 1;
+	if (user) {
+		depth += walk_user_stack(thread->process, fp, sample.frames + 1, PROFILE_MAX_FRAMES - 1);
+	}
+	else {
+		depth += walk_kernel_stack(thread, fp, sample.frames + 1, PROFILE_MAX_FRAMES - 1);
+	}
+	sample.depth = depth;
+
+	__atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+}
+
+int profile_set_interval(u64 interval_us) {
+	if (interval_us && interval_us < MIN_INTERVAL_US) {
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	if (interval_us) {
+		// allocated on first use and kept afterwards, a cpu could still be writing to them
+		usize cpu_count = kstd::min(arch_get_cpu_count(), usize {CONFIG_MAX_CPUS});
+		for (usize i = 0; i < cpu_count; ++i) {
+			if (__atomic_load_n(&RINGS[i].samples, __ATOMIC_RELAXED)) {
+				continue;
+			}
+
+			auto* samples = new ProfileSample[ProfileRing::SIZE];
+			if (!samples) {
+				return ERR_NO_MEM;
+			}
+			__atomic_store_n(&RINGS[i].samples, samples, __ATOMIC_RELEASE);
+		}
+	}
+
+	// picked up by each cpu the next time it arms its tick
+	PROFILE_INTERVAL_US.store(interval_us, kstd::memory_order::relaxed);
+	return 0;
+}
+
+usize profile_read(ProfileSample* samples, usize count, u64& lost) {
+	IrqGuard irq_guard {};
+	auto guard = PROFILE_READ_LOCK.lock();
+
+	usize cpu_count = kstd::min(arch_get_cpu_count(), usize {CONFIG_MAX_CPUS});
+	usize amount = 0;
+	for (usize i = 0; i < cpu_count; ++i) {
+		auto& ring = RINGS[i];
+		if (!ring.samples) {
+			continue;
+		}
+
+		lost += ring.lost.exchange(0, kstd::memory_order::relaxed);
+
+		auto head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+		auto tail = ring.tail;
+		for (; tail != head && amount < count; ++tail) {
+			samples[amount++] = ring.samples[tail % ProfileRing::SIZE];
+		}
+		__atomic_store_n(&ring.tail, tail, __ATOMIC_RELEASE);
+	}
+
+	return amount;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "atomic.hpp"
+#include "crescent/profile.h"
+#include "types.hpp"
+
+/// Sampling interval in us, zero while the profiler is stopped.
+extern kstd::atomic<u64> PROFILE_INTERVAL_US;
+
+/// Records a sample of the current thread, called from the cpu's tick irq with the interrupted state.
+void profile_sample(bool user, usize pc, usize fp);
+
+/// Starts sampling every cpu every `interval_us`, zero stops sampling.
+int profile_set_interval(u64 interval_us);
+/// Moves up to `count` samples out of the per-cpu buffers, returns the amount moved.
+/// Samples dropped because a buffer was full are added to `lost`.
+usize profile_read(ProfileSample* samples, usize count, u64& lost);
+
+inline bool profile_enabled() {
+	return PROFILE_INTERVAL_US.load(kstd::memory_order::relaxed);
+}
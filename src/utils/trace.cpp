@@ -0,0 +1,112 @@
+#include "trace.hpp"
+#include "arch/cpu.hpp"
+#include "utils/irq_guard.hpp"
+#include "utils/spinlock.hpp"
+
+kstd::atomic<u64> TRACE_MASK {};
+
+namespace {
+	/// Only written by its own cpu with irqs disabled and only read with `TRACE_READ_LOCK` held.
+	struct TraceRing {
+		static constexpr usize SIZE = 0x2000;
+
+		TraceRecord* records {};
+		u64 head {};
+		u64 tail {};
+		kstd::atomic<u64> lost {};
+	};
+
+	TraceRing RINGS[CONFIG_MAX_CPUS] {};
+	Spinlock<void> TRACE_READ_LOCK {};
+}
+
+u64 trace_thread_id(const Thread* thread) {
+	return u64 {static_cast<u32>(thread->process->pid)} << 32 | thread->thread_id;
+}
+
+void trace_emit(TraceEvent event, u64 arg0, u64 arg1) {
+	IrqGuard irq_guard {};
+
+	auto* thread = get_current_thread();
+	auto cpu = thread->cpu->number;
+	auto& ring = RINGS[cpu];
+	auto* records = __atomic_load_n(&ring.records, __ATOMIC_ACQUIRE);
+	if (!records) {
+		return;
+	}
+
+	auto head = ring.head;
+	if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) == TraceRing::SIZE) {
+		ring.lost.fetch_add(1, kstd::memory_order::relaxed);
+		return;
+	}
+
+	records[head % TraceRing::SIZE] = {
+		.timestamp = get_current_ns(),
+		.thread = trace_thread_id(thread),
+		.arg0 = arg0,
+		.arg1 = arg1,
+		.event = event,
+		.cpu = cpu
+	};
+	__atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+}
+
+int trace_set_mask(u64 mask) {
+	if (mask & ~u64 {TRACE_EVENT_MASK_ALL}) {
+		return ERR_INVALID_ARGUMENT;
+	}
+
+	if (mask) {
+		// allocated on first use and kept afterwards, a cpu could still be writing to them
+		usize cpu_count = kstd::min(arch_get_cpu_count(), usize {CONFIG_MAX_CPUS});
+		for (usize i = 0; i < cpu_count; ++i) {
+			if (__atomic_load_n(&RINGS[i].records, __ATOMIC_RELAXED)) {
+				continue;
+			}
+
+			auto* records = new TraceRecord[TraceRing::SIZE];
+			if (!records) {
+				return ERR_NO_MEM;
+			}
+			__atomic_store_n(&RINGS[i].records, records, __ATOMIC_RELEASE);
+		}
+	}
+
+	TRACE_MASK.store(mask, kstd::memory_order::relaxed);
+	return 0;
+}
+
+usize trace_read(TraceRecord* records, usize count) {
+	IrqGuard irq_guard {};
+	auto guard = TRACE_READ_LOCK.lock();
+
+	usize cpu_count = kstd::min(arch_get_cpu_count(), usize {CONFIG_MAX_CPUS});
+	usize amount = 0;
+	for (usize i = 0; i < cpu_count && amount < count; ++i) {
+		auto& ring = RINGS[i];
+		if (!ring.records) {
+			continue;
+		}
+
+		if (auto lost = ring.lost.exchange(0, kstd::memory_order::relaxed)) {
+			records[amount++] = {
+				.timestamp = get_current_ns(),
+				.thread = 0,
+				.arg0 = lost,
+				.arg1 = 0,
+				.event = TRACE_EVENT_LOST,
+				.cpu = static_cast<u32>(i)
+			};
+		}
+
+		auto head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+		auto tail = ring.tail;
+		for (; tail != head && amount < count; ++tail) {
+			records[amount++] = ring.records[tail % TraceRing::SIZE];
+		}
+		__atomic_store_n(&ring.tail, tail, __ATOMIC_RELEASE);
+	}
+
+	return amount;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "atomic.hpp"
+#include "config.hpp"
+#include "crescent/trace.h"
+#include "types.hpp"
+
+/// Events currently being recorded, one bit per `TraceEvent`.
+extern kstd::atomic<u64> TRACE_MASK;
+
+struct Thread;
+
+void trace_emit(TraceEvent event, u64 arg0, u64 arg1);
+/// Identifies `thread` in trace records.
+u64 trace_thread_id(const Thread* thread);
+
+/// Costs a load and a branch, constant false without CONFIG_TRACEPOINTS.
+inline bool trace_enabled(TraceEvent event) {
+#if CONFIG_TRACEPOINTS
+	return TRACE_MASK.load(kstd::memory_order::relaxed) & TRACE_EVENT_MASK(event);
+#else
+	return false;
+#endif
+}
+
+/// Records `event` on the current cpu if it's enabled, use `trace_enabled` first
+/// if the arguments are expensive to compute.
+inline void trace(TraceEvent event, u64 arg0 = 0, u64 arg1 = 0) {
+	if (trace_enabled(event)) [[unlikely]] {
+		trace_emit(event, arg0, arg1);
+	}
+}
+
+/// Records `ENTER` when created and `EXIT` with the same argument when destroyed.
+template<TraceEvent ENTER, TraceEvent EXIT>
+struct TraceScope {
+	explicit TraceScope(u64 arg) : arg {arg} {
+		trace(ENTER, arg);
+	}
+
+	~TraceScope() {
+		trace(EXIT, arg, result);
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+	u64 arg;
+	/// Second argument of the exit record.
+	u64 result {};
+};
+
+/// Starts recording the events in `mask`, zero stops recording.
+int trace_set_mask(u64 mask);
+/// Moves up to `count` records out of the per-cpu buffers, returns the amount moved.
+usize trace_read(TraceRecord* records, usize count);